@@ -1,5 +1,22 @@
 QMAKE_CFLAGS += -std=c11
 
+# libimagequant parallelizes remapping and k-means iterations with OpenMP.
+# Build with CONFIG+=no_openmp to keep the quantizer single threaded.
+# SSP_OPENMP lets PngQuantOptimizer size the team of pages quantized at once,
+# only where OpenMP is on: Apple clang has no omp.h. The -fopenmp link flag
+# is repeated for the users of sspcore in sspcore.pri, keep the scopes alike.
+!no_openmp {
+    *-g++*|linux-clang* {
+        DEFINES += SSP_OPENMP
+        QMAKE_CFLAGS += -fopenmp
+        QMAKE_LFLAGS += -fopenmp
+    }
+    msvc {
+        DEFINES += SSP_OPENMP
+        QMAKE_CFLAGS += -openmp
+    }
+}
+
 INCLUDEPATH += $$PWD
 
 HEADERS += \
@@ -0,0 +1,155 @@
+#include "CczWriter.h"
+#include <QtEndian>
+#include "ParallelDeflate.h"
+
+namespace {
+
+// the encryption starts at the len field of the header
+const qint64 kEncryptionOffset = 12;
+const int kEncryptionKeyLength = 1024;
+// the first 512 words are encrypted completely, after that every 64th word
+const qint64 kSecureLength = 512;
+const qint64 kDistance = 64;
+// the header checksum covers the first 128 plain words
+const qint64 kChecksumLength = 128;
+
+void appendBigEndian(QByteArray& data, quint32 value) {
+    quint32 be = qToBigEndian<quint32>(value);
+    data.append(reinterpret_cast<const char*>(&be), sizeof(be));
+}
+
+}
+
+CczWriter::CczWriter(const QString& encryptionKey)
+    : _encrypted(!encryptionKey.isEmpty())
+    , _fileSize(0)
+    , _checksum(0)
+{
+    memset(_encryptionKey, 0, sizeof(_encryptionKey));
+    if (!_encrypted) {
+        return;
+    }
+
+    QString key = encryptionKey;
+    uint32_t keys[4];
+    keys[0] = key.left(8).toUInt(nullptr, 16); key.remove(0, 8);
+    keys[1] = key.left(8).toUInt(nullptr, 16); key.remove(0, 8);
+    keys[2] = key.left(8).toUInt(nullptr, 16); key.remove(0, 8);
+    keys[3] = key.left(8).toUInt(nullptr, 16); key.remove(0, 8);
+
+    // create long key
+    unsigned int y, p, e;
+    unsigned int rounds = 6;
+    unsigned int sum = 0;
+    unsigned int z = _encryptionKey[kEncryptionKeyLength - 1];
+
+    do {
+#define DELTA 0x9e3779b9
+#define MX (((z>>5^y<<2) + (y>>3^z<<4)) ^ ((sum^y) + (keys[(p&3)^e] ^ z)))
+
+        sum += DELTA;
+        e = (sum >> 2) & 3;
+
+        for (p = 0; p < kEncryptionKeyLength - 1; p++)
+        {
+            y = _encryptionKey[p + 1];
+            z = _encryptionKey[p] += MX;
+        }
+
+        y = _encryptionKey[0];
+        z = _encryptionKey[kEncryptionKeyLength - 1] += MX;
+
+    } while (--rounds);
+#undef MX
+#undef DELTA
+}
+
+bool CczWriter::write(const QString& fileName, const QList<QByteArray>& parts, QString* errorString) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        *errorString = QString("Can't write %1: %2").arg(fileName).arg(file.errorString());
+        return false;
+    }
+    _fileSize = 0;
+    _pending.clear();
+    _checksum = 0;
+
+    qint64 uncompressedLen = 0;
+    for (const QByteArray& part : parts) uncompressedLen += part.size();
+
+    // CCZ header, the reserved field gets the checksum of encrypted files in flush()
+    QByteArray header("CCZ");
+    header.append(_encrypted ? 'p' : '!');
+    header.append(QByteArray(4, '\0'));     // compression type 0 (zlib), version 0
+    appendBigEndian(header, 0);             // reserved
+    appendBigEndian(header, uncompressedLen);
+    bool success = append(file, header);
+
+    // the zlib stream of compress() with the default level, deflated block by block
+    ParallelDeflate deflater;
+    success = success && deflater.compress(parts, [&](const QByteArray& data) {
+        return append(file, data);
+    });
+    success = success && flush(file);
+
+    if (!success) {
+        *errorString = QString("Can't write %1: %2").arg(fileName).arg(file.errorString());
+    }
+    return success;
+}
+
+bool CczWriter::append(QFile& file, const QByteArray& data) {
+    if (!_encrypted) {
+        _fileSize += data.size();
+        return file.write(data) == data.size();
+    }
+
+    QByteArray buffer = _pending;
+    buffer.append(data);
+
+    // whole words from the encryption offset on, the rest waits for the next call
+    const int start = (int)qBound<qint64>(0, kEncryptionOffset - _fileSize, buffer.size());
+    const qint64 words = (buffer.size() - start) / 4;
+    const qint64 firstWord = (_fileSize + start - kEncryptionOffset) / 4;
+    char* wordData = buffer.data() + start;
+
+    for (qint64 i = 0; i < words; ) {
+        const qint64 index = firstWord + i;
+        qint64 keyIndex;
+        if (index < kSecureLength) {
+            keyIndex = index;
+        } else if ((index - kSecureLength) % kDistance == 0) {
+            keyIndex = kSecureLength + (index - kSecureLength) / kDistance;
+        } else {
+            i += kDistance - (index - kSecureLength) % kDistance;
+            continue;
+        }
+
+        quint32 word;
+        memcpy(&word, wordData + i * 4, 4);
+        if (index < kChecksumLength) {
+            _checksum ^= word;
+        }
+        word ^= _encryptionKey[keyIndex % kEncryptionKeyLength];
+        memcpy(wordData + i * 4, &word, 4);
+        i += (index < kSecureLength) ? 1 : kDistance;
+    }
+
+    const int end = start + (int)words * 4;
+    _pending = buffer.mid(end);
+    _fileSize += end;
+    return file.write(buffer.constData(), end) == end;
+}
+
+bool CczWriter::flush(QFile& file) {
+    // an incomplete last word stays plain
+    _fileSize += _pending.size();
+    bool success = file.write(_pending) == _pending.size();
+    _pending.clear();
+
+    if (success && _encrypted) {
+        quint32 checksum = qToBigEndian<quint32>(_checksum);
+        success = file.seek(8) && (file.write(reinterpret_cast<const char*>(&checksum), sizeof(checksum)) == sizeof(checksum));
+    }
+    return success;
+}
@@ -0,0 +1,37 @@
+#ifndef CCZWRITER_H
+#define CCZWRITER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+
+// Writes cocos2d CCZ files: a 16 byte header followed by one zlib stream
+// of the concatenated parts, optionally encrypted the way ZipUtils expects
+// it ('CCZp'). The parts are deflated with ParallelDeflate straight to the
+// file, so large inputs are compressed on the global thread pool.
+class CczWriter
+{
+public:
+    // encryptionKey is the 128 bit content protection key as 32 hex digits,
+    // empty for plain 'CCZ!' files
+    explicit CczWriter(const QString& encryptionKey = QString());
+
+    bool write(const QString& fileName, const QList<QByteArray>& parts, QString* errorString);
+
+protected:
+    // writes data at the end of the file, encrypting the words of the
+    // protected region; an incomplete last word is held back until flush()
+    bool append(QFile& file, const QByteArray& data);
+    bool flush(QFile& file);
+
+private:
+    bool     _encrypted;
+    quint32  _encryptionKey[1024];
+
+    // state of the file being written
+    qint64     _fileSize;
+    QByteArray _pending;
+    quint32    _checksum;
+};
+
+#endif // CCZWRITER_H
@@ -0,0 +1,547 @@
+#include "DataFileExporter.h"
+#include <algorithm>
+#include "JsonWriter.h"
+#include "PListWriter.h"
+#include "SpriteSheetBinary.h"
+
+namespace {
+
+bool isLineTerminator(QChar c) {
+    return (c == '\n') || (c == '\r') || (c.unicode() == 0x2028) || (c.unicode() == 0x2029);
+}
+
+// array index property names: canonical numbers below 2^32 - 1
+bool isArrayIndex(const QString& name, quint32* index) {
+    if (name.isEmpty() || (name.size() > 10) || ((name.size() > 1) && (name[0] == '0'))) return false;
+    quint64 value = 0;
+    for (QChar c: name) {
+        if ((c < '0') || (c > '9')) return false;
+        value = value * 10 + (c.unicode() - '0');
+    }
+    if (value >= 0xffffffffULL) return false;
+    *index = (quint32)value;
+    return true;
+}
+
+// for..in order of property names
+bool scriptKeyLess(const QString& a, const QString& b) {
+    quint32 indexA, indexB;
+    bool arrayIndexA = isArrayIndex(a, &indexA);
+    bool arrayIndexB = isArrayIndex(b, &indexB);
+    if (arrayIndexA && arrayIndexB) return indexA < indexB;
+    return arrayIndexA && !arrayIndexB;
+}
+
+// path.replace(/^.*[\\\/]/, ''), '.' does not match line terminators
+QString stripDirectory(const QString& path) {
+    int end = 0;
+    while ((end < path.size()) && !isLineTerminator(path[end])) ++end;
+    for (int i = end - 1; i >= 0; --i) {
+        if ((path[i] == '/') || (path[i] == '\\')) return path.mid(i + 1);
+    }
+    return path;
+}
+
+// str.split('\\').pop().split('/').pop()
+QString getFileName(const QString& path) {
+    return path.mid(qMax(path.lastIndexOf('/'), path.lastIndexOf('\\')) + 1);
+}
+
+// getFileName(str).split('.').shift()
+QString getFileNameWithoutExtension(const QString& path) {
+    return getFileName(path).section('.', 0, 0);
+}
+
+QString cocosSize(int width, int height) {
+    return QString("{%1,%2}").arg(width).arg(height);
+}
+
+QString cocosRect(const QRect& rect) {
+    return QString("{{%1,%2},{%3,%4}}").arg(rect.x()).arg(rect.y()).arg(rect.width()).arg(rect.height());
+}
+
+bool trimmed(const SpriteFrameInfo& info) {
+    return (info.sourceSize.width() != info.sourceColorRect.width()) || (info.sourceSize.height() != info.sourceColorRect.height());
+}
+
+// the frames as the keys of a QVariantMap, the order toPList() writes them in
+QVector<DataFileExporter::Frame> plistOrder(const QVector<DataFileExporter::Frame>& frames) {
+    QVector<DataFileExporter::Frame> result = frames;
+    std::sort(result.begin(), result.end(), [](const DataFileExporter::Frame& a, const DataFileExporter::Frame& b) {
+        return a.name < b.name;
+    });
+    return result;
+}
+
+void writeGodotSubResources(const DataFileExporter::Input& input, QTextStream& out) {
+    int loopCount = 0;
+    for (const DataFileExporter::Frame& frame: input.frames) {
+        const SpriteFrameInfo& info = *frame.info;
+        out << QString("[sub_resource type=\"AtlasTexture\" id=%1]\n").arg(loopCount + 1);
+        out << "atlas = ExtResource( 1 )\n";
+        out << QString("region = Rect2( %1, %2, %3, %4 )\n")
+               .arg(info.frame.x()).arg(info.frame.y()).arg(info.frame.width()).arg(info.frame.height());
+        out << QString("margin = Rect2( %1, %2, %3, %4 )\n")
+               .arg(info.sourceColorRect.x()).arg(info.sourceColorRect.y())
+               .arg(info.sourceSize.width() - info.frame.width()).arg(info.sourceSize.height() - info.frame.height());
+        out << "\n";
+        loopCount++;
+    }
+}
+
+}
+
+bool DataFileExporter::supports(const QString& format, bool maskImage) {
+    if ((format == "json") || (format == "phaser") || (format == "pixijs") || (format == "binary")) {
+        return true;
+    }
+    if ((format == "cocos2d") || (format == "cocos2d-old") || (format == "godot-anim") || (format == "godot-parts")) {
+        return !maskImage;
+    }
+    return false;
+}
+
+QString DataFileExporter::fileExtension(const QString& format) {
+    if ((format == "cocos2d") || (format == "cocos2d-old")) return "plist";
+    if ((format == "json") || (format == "phaser") || (format == "pixijs")) return "json";
+    if ((format == "godot-anim") || (format == "godot-parts")) return "tscn";
+    if (format == "binary") return "ssb";
+    return QString();
+}
+
+bool DataFileExporter::exportSpriteSheet(const QString& format, const Input& input, const QString& filePath, QString* errorString) {
+    const QString extension = fileExtension(format);
+    if (extension.isEmpty()) {
+        *errorString = QString("Not found exporter for [%1] format").arg(format);
+        qDebug() << *errorString;
+        return false;
+    }
+
+    const bool binaryFormat = (format == "binary");
+    QFile file(filePath + "." + extension);
+    if (!file.open(binaryFormat? QIODevice::WriteOnly : (QIODevice::WriteOnly | QIODevice::Text))) {
+        *errorString = QString("Can't write %1: %2").arg(file.fileName()).arg(file.errorString());
+        qDebug() << *errorString;
+        return false;
+    }
+
+    if (binaryFormat) {
+        binary(input, &file);
+    } else {
+        QTextStream out(&file);
+        if (format == "cocos2d") cocos2d(input, out);
+        else if (format == "cocos2d-old") cocos2dOld(input, out);
+        else if (format == "json") json(input, out);
+        else if (format == "phaser") phaser(input, out);
+        else if (format == "pixijs") pixijs(input, out);
+        else if (format == "godot-anim") godotAnim(input, out);
+        else if (format == "godot-parts") godotParts(input, out);
+        out.flush();
+    }
+    file.close();
+    if (file.error() != QFileDevice::NoError) {
+        *errorString = QString("Can't write %1: %2").arg(file.fileName()).arg(file.errorString());
+        qDebug() << *errorString;
+        return false;
+    }
+    return true;
+}
+
+QVector<DataFileExporter::Frame> DataFileExporter::scriptOrder(const QVector<Frame>& frames) {
+    QVector<Frame> result;
+    QHash<QString, int> positions;
+    for (const Frame& frame: frames) {
+        auto it = positions.find(frame.name);
+        if (it != positions.end()) {
+            result[it.value()].info = frame.info;
+        } else {
+            positions.insert(frame.name, result.size());
+            result.push_back(frame);
+        }
+    }
+    std::stable_sort(result.begin(), result.end(), [](const Frame& a, const Frame& b) {
+        return scriptKeyLess(a.name, b.name);
+    });
+    return result;
+}
+
+void DataFileExporter::cocos2d(const Input& input, QTextStream& out) {
+    // keys in QVariantMap order, like the plist of the script's returned object
+    PListWriter writer(out);
+    writer.beginDocument();
+    writer.beginDict();
+    writer.key("frames");
+    writer.beginDict();
+    for (const Frame& frame: plistOrder(input.frames)) {
+        const SpriteFrameInfo& info = *frame.info;
+
+        QString triangles;
+        QString vertices;
+        QString verticesUV;
+        for (const QPoint& vert: info.triangles.verts) {
+            vertices += QString::number(vert.x() + info.offset.x()) + " " + QString::number(vert.y() + info.offset.y()) + " ";
+            verticesUV += QString::number(info.frame.x() + vert.x()) + " " + QString::number(info.frame.y() + vert.y()) + " ";
+        }
+        for (unsigned short index: info.triangles.indices) {
+            triangles += QString::number(index) + " ";
+        }
+        triangles.chop(1);
+        vertices.chop(1);
+        verticesUV.chop(1);
+
+        writer.key(frame.name);
+        writer.beginDict();
+        writer.key("aliases");
+        writer.beginArray();
+        writer.end();
+        writer.key("spriteOffset");
+        writer.value(cocosSize(info.offset.x(), info.offset.y()));
+        writer.key("spriteSize");
+        writer.value(cocosSize(info.frame.width(), info.frame.height()));
+        writer.key("spriteSourceSize");
+        writer.value(cocosSize(info.sourceSize.width(), info.sourceSize.height()));
+        writer.key("textureRect");
+        writer.value(cocosRect(info.frame));
+        writer.key("textureRotated");
+        writer.value(info.rotated);
+        if (!triangles.isEmpty()) {
+            writer.key("triangles");
+            writer.value(triangles);
+        }
+        if (!vertices.isEmpty()) {
+            writer.key("vertices");
+            writer.value(vertices);
+        }
+        if (!verticesUV.isEmpty()) {
+            writer.key("verticesUV");
+            writer.value(verticesUV);
+        }
+        writer.end();
+    }
+    writer.end();
+    writer.key("metadata");
+    writer.beginDict();
+    writer.key("format");
+    writer.value(3);
+    writer.key("size");
+    writer.value(cocosSize(input.textureSize.width(), input.textureSize.height()));
+    writer.key("textureFileName");
+    writer.value(stripDirectory(input.imageFilePath));
+    writer.end();
+    writer.end();
+    writer.endDocument();
+}
+
+void DataFileExporter::cocos2dOld(const Input& input, QTextStream& out) {
+    PListWriter writer(out);
+    writer.beginDocument();
+    writer.beginDict();
+    writer.key("frames");
+    writer.beginDict();
+    for (const Frame& frame: plistOrder(input.frames)) {
+        const SpriteFrameInfo& info = *frame.info;
+        writer.key(frame.name);
+        writer.beginDict();
+        writer.key("frame");
+        writer.value(cocosRect(info.frame));
+        writer.key("offset");
+        writer.value(cocosSize(info.offset.x(), info.offset.y()));
+        writer.key("rotated");
+        writer.value(info.rotated);
+        writer.key("sourceSize");
+        writer.value(cocosSize(info.sourceSize.width(), info.sourceSize.height()));
+        writer.end();
+    }
+    writer.end();
+    writer.key("metadata");
+    writer.beginDict();
+    writer.key("format");
+    writer.value(2);
+    writer.key("textureFileName");
+    writer.value(stripDirectory(input.imageFilePath));
+    writer.end();
+    writer.end();
+    writer.endDocument();
+}
+
+void DataFileExporter::json(const Input& input, QTextStream& out) {
+    JsonWriter writer(out);
+    writer.beginObject();
+    for (const Frame& frame: input.frames) {
+        const SpriteFrameInfo& info = *frame.info;
+        writer.beginObject(frame.name);
+        writer.beginObject("frame");
+        writer.value("x", info.frame.x());
+        writer.value("y", info.frame.y());
+        writer.value("width", info.frame.width());
+        writer.value("height", info.frame.height());
+        writer.end();
+        writer.beginObject("sourceSize");
+        writer.value("width", info.sourceSize.width());
+        writer.value("height", info.sourceSize.height());
+        writer.end();
+        writer.value("rotated", info.rotated);
+        writer.end();
+    }
+    writer.end();
+}
+
+void DataFileExporter::phaser(const Input& input, QTextStream& out) {
+    JsonWriter writer(out);
+    writer.beginObject();
+    writer.beginArray("frames");
+    for (const Frame& frame: input.frames) {
+        const SpriteFrameInfo& info = *frame.info;
+        // key.replace(/^.\//, '')
+        bool dotSlash = (frame.name.size() >= 2) && !isLineTerminator(frame.name[0]) && (frame.name[1] == '/');
+
+        writer.beginObject();
+        writer.value("filename", dotSlash? frame.name.mid(2) : frame.name);
+        writer.beginObject("frame");
+        writer.value("x", info.frame.x());
+        writer.value("y", info.frame.y());
+        writer.value("w", info.frame.width());
+        writer.value("h", info.frame.height());
+        writer.end();
+        writer.beginObject("spriteSourceSize");
+        writer.value("x", info.sourceColorRect.x());
+        writer.value("y", info.sourceColorRect.y());
+        writer.value("w", info.sourceColorRect.width());
+        writer.value("h", info.sourceColorRect.height());
+        writer.end();
+        writer.beginObject("sourceSize");
+        writer.value("w", info.sourceSize.width());
+        writer.value("h", info.sourceSize.height());
+        writer.end();
+        writer.value("trimmed", trimmed(info));
+        writer.value("rotated", info.rotated);
+        writer.end();
+    }
+    writer.end();
+    writer.beginObject("meta");
+    writer.value("image", stripDirectory(input.imageFilePath));
+    if (!input.maskFilePath.isEmpty()) {
+        writer.value("mask", stripDirectory(input.maskFilePath));
+    }
+    writer.end();
+    writer.end();
+}
+
+void DataFileExporter::pixijs(const Input& input, QTextStream& out) {
+    JsonWriter writer(out);
+    writer.beginObject();
+    writer.beginObject("frames");
+    for (const Frame& frame: input.frames) {
+        const SpriteFrameInfo& info = *frame.info;
+        writer.beginObject(frame.name);
+        writer.beginObject("frame");
+        writer.value("x", info.frame.x());
+        writer.value("y", info.frame.y());
+        writer.value("w", info.frame.width());
+        writer.value("h", info.frame.height());
+        writer.end();
+        writer.value("rotated", info.rotated);
+        writer.beginObject("spriteSourceSize");
+        writer.value("x", info.sourceColorRect.x());
+        writer.value("y", info.sourceColorRect.y());
+        writer.value("w", info.sourceColorRect.width());
+        writer.value("h", info.sourceColorRect.height());
+        writer.end();
+        writer.beginObject("sourceSize");
+        writer.value("w", info.sourceSize.width());
+        writer.value("h", info.sourceSize.height());
+        writer.end();
+        writer.value("trimmed", trimmed(info));
+        writer.end();
+    }
+    writer.end();
+    writer.beginObject("meta");
+    writer.value("image", stripDirectory(input.imageFilePath));
+    if (!input.maskFilePath.isEmpty()) {
+        writer.value("mask", stripDirectory(input.maskFilePath));
+    }
+    writer.end();
+    writer.end();
+}
+
+void DataFileExporter::godotAnim(const Input& input, QTextStream& out) {
+    const int imageCount = input.frames.size();
+
+    // The script keeps the animation names as the one element arrays
+    // getParentFolderName() returns; only frames without a folder give an
+    // empty array, which has no length and names the animation "".
+    QStringList animationNames;
+    QHash<QString, QString> animationEntry;
+    QString previousAnimation;
+    bool previousEmpty = true;
+    int loopCount = 0;
+    for (const Frame& frame: input.frames) {
+        QStringList parts = frame.name.split('/');
+        bool emptyArray = parts.size() < 2;
+        QString currentAnimation = emptyArray? QString() : parts[parts.size() - 2];
+        if (currentAnimation == ".") {
+            currentAnimation = "default";
+        }
+
+        loopCount++;
+        QString frameList = QString("SubResource( %1 ), ").arg(loopCount);
+
+        if (previousEmpty) {
+            previousAnimation = currentAnimation;
+        }
+
+        if (!animationEntry.contains(currentAnimation)) {
+            animationNames.push_back(currentAnimation);
+            animationEntry[currentAnimation] = frameList;
+        } else {
+            animationEntry[currentAnimation] += frameList;
+        }
+
+        if (previousAnimation != currentAnimation) {
+            animationEntry[previousAnimation].chop(2);
+        }
+
+        if (loopCount == imageCount) {
+            animationEntry[currentAnimation].chop(2);
+        }
+
+        previousAnimation = currentAnimation;
+        previousEmpty = emptyArray;
+    }
+    std::stable_sort(animationNames.begin(), animationNames.end(), scriptKeyLess);
+
+    out << QString("[gd_scene load_steps=%1 format=2]\n").arg(imageCount + 3);
+    out << "\n";
+    out << QString("[ext_resource path=\"res://%1\" type=\"Texture\" id=1]\n").arg(getFileName(input.imageFilePath));
+    out << "\n";
+    writeGodotSubResources(input, out);
+    out << QString("[sub_resource type=\"SpriteFrames\" id=%1]\n").arg(imageCount + 1);
+    out << "animations = [ ";
+
+    for (int i = 0; i < animationNames.size(); ++i) {
+        out << "{\n";
+        out << "\"frames\": [ " << animationEntry[animationNames[i]] << " ],\n";
+        out << "\"loop\": true,\n";
+        out << "\"name\": \"" << animationNames[i] << "\",\n";
+        out << "\"speed\": 5.0\n";
+        out << "}";
+        if (i + 1 < animationNames.size()) {
+            out << ", ";
+        }
+    }
+
+    out << " ]\n";
+    out << "\n";
+    out << "[node name=\"AnimatedSprite\" type=\"AnimatedSprite\"]\n";
+    out << QString("frames = SubResource( %1 )\n").arg(imageCount + 1);
+    out << "frame = 0\n";
+    out << "\n";
+}
+
+void DataFileExporter::godotParts(const Input& input, QTextStream& out) {
+    const int imageCount = input.frames.size();
+
+    out << QString("[gd_scene load_steps=%1 format=2]\n").arg(imageCount + 2);
+    out << "\n";
+    out << QString("[ext_resource path=\"res://%1\" type=\"Texture\" id=1]\n").arg(getFileName(input.imageFilePath));
+    out << "\n";
+    writeGodotSubResources(input, out);
+    out << QString("[node name=\"%1\" type=\"Sprite\"]\n\n").arg(getFileNameWithoutExtension(input.imageFilePath));
+
+    int partNumber = 1;
+    for (const Frame& frame: input.frames) {
+        out << QString("[node name=\"%1\" type=\"Sprite\" parent=\".\"]\n").arg(getFileNameWithoutExtension(frame.name));
+        out << QString("texture = SubResource(%1)\n\n").arg(partNumber);
+        partNumber++;
+    }
+    out << "\n";
+}
+
+void DataFileExporter::binary(const Input& input, QIODevice* device) {
+    typedef SpriteSheetBinary SSB;
+    static_assert(sizeof(SSB::Header) == 64, "SpriteSheetBinary::Header layout");
+    static_assert(sizeof(SSB::Frame) == 76, "SpriteSheetBinary::Frame layout");
+    static_assert(sizeof(SSB::Vertex) == 8, "SpriteSheetBinary::Vertex layout");
+
+    // the reader looks frames up with a binary search over the UTF-8 names
+    QVector<QPair<QByteArray, const SpriteFrameInfo*>> frames;
+    for (const Frame& frame: input.frames) {
+        frames.push_back(qMakePair(frame.name.toUtf8(), frame.info));
+    }
+    std::sort(frames.begin(), frames.end(), [](const QPair<QByteArray, const SpriteFrameInfo*>& a, const QPair<QByteArray, const SpriteFrameInfo*>& b) {
+        return a.first < b.first;
+    });
+
+    // every table size is known before anything is written, so the file
+    // goes out in one pass per table: image names, then the frame names
+    const QByteArray imageName = stripDirectory(input.imageFilePath).toUtf8();
+    const QByteArray maskName = input.maskFilePath.isEmpty()? QByteArray() : stripDirectory(input.maskFilePath).toUtf8();
+    quint32 stringTableSize = imageName.size() + 1 + (input.maskFilePath.isEmpty()? 0 : maskName.size() + 1);
+    const quint32 firstName = stringTableSize;
+    quint32 vertexCount = 0;
+    quint32 indexCount = 0;
+    for (const auto& frame: frames) {
+        stringTableSize += frame.first.size() + 1;
+        vertexCount += frame.second->triangles.verts.size();
+        indexCount += frame.second->triangles.indices.size();
+    }
+
+    auto align4 = [](quint32 offset) { return (offset + 3) & ~3u; };
+    const quint32 frameOffset = sizeof(SSB::Header);
+    const quint32 vertexOffset = frameOffset + frames.size() * sizeof(SSB::Frame);
+    const quint32 indexOffset = vertexOffset + vertexCount * sizeof(SSB::Vertex);
+    const quint32 indexEnd = indexOffset + indexCount * sizeof(quint16);
+    const quint32 stringTableOffset = align4(indexEnd);
+
+    QDataStream stream(device);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << SSB::kMagic << SSB::kVersion << (quint16)sizeof(SSB::Header)
+           << (quint32)(stringTableOffset + stringTableSize) << (quint32)0
+           << (quint32)input.textureSize.width() << (quint32)input.textureSize.height()
+           << (quint32)0 << (input.maskFilePath.isEmpty()? (quint32)SSB::kNoString : (quint32)(imageName.size() + 1))
+           << (quint32)frames.size() << frameOffset
+           << vertexCount << vertexOffset
+           << indexCount << indexOffset
+           << stringTableSize << stringTableOffset;
+
+    quint32 name = firstName;
+    quint32 firstVertex = 0;
+    quint32 firstIndex = 0;
+    for (const auto& frame: frames) {
+        const SpriteFrameInfo& info = *frame.second;
+        quint32 flags = (info.rotated? SSB::kRotated : 0) | (trimmed(info)? SSB::kTrimmed : 0);
+        stream << name << (quint32)frame.first.size() << flags
+               << (qint32)info.frame.x() << (qint32)info.frame.y() << (qint32)info.frame.width() << (qint32)info.frame.height()
+               << (qint32)info.offset.x() << (qint32)info.offset.y()
+               << (qint32)info.sourceColorRect.x() << (qint32)info.sourceColorRect.y()
+               << (qint32)info.sourceColorRect.width() << (qint32)info.sourceColorRect.height()
+               << (qint32)info.sourceSize.width() << (qint32)info.sourceSize.height()
+               << firstVertex << (quint32)info.triangles.verts.size()
+               << firstIndex << (quint32)info.triangles.indices.size();
+        name += frame.first.size() + 1;
+        firstVertex += info.triangles.verts.size();
+        firstIndex += info.triangles.indices.size();
+    }
+
+    for (const auto& frame: frames) {
+        for (const QPoint& vert: frame.second->triangles.verts) {
+            stream << (qint32)vert.x() << (qint32)vert.y();
+        }
+    }
+    for (const auto& frame: frames) {
+        for (unsigned short index: frame.second->triangles.indices) {
+            stream << (quint16)index;
+        }
+    }
+    for (quint32 i = indexEnd; i < stringTableOffset; ++i) {
+        stream << (quint8)0;
+    }
+
+    stream.writeRawData(imageName.constData(), imageName.size() + 1);
+    if (!input.maskFilePath.isEmpty()) {
+        stream.writeRawData(maskName.constData(), maskName.size() + 1);
+    }
+    for (const auto& frame: frames) {
+        stream.writeRawData(frame.first.constData(), frame.first.size() + 1);
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef DATAFILEEXPORTER_H
+#define DATAFILEEXPORTER_H
+
+#include <QtCore>
+#include "SpriteAtlas.h"
+
+// Compiled versions of the export scripts in defaultFormats. Every exporter
+// writes exactly the file its script produces for the same arguments, so
+// the built-in formats are published without a script engine. Custom
+// formats still go through QJSEngine. "binary" has no script at all: it
+// writes the mmap-able layout that runtime/SpriteSheetBinary.h reads.
+// The files are streamed while the frames are visited, nothing of the
+// size of the output is built in memory.
+class DataFileExporter
+{
+public:
+    struct Frame {
+        QString                name;
+        const SpriteFrameInfo* info;
+    };
+
+    // the arguments of exportSpriteSheet()
+    struct Input {
+        QString        imageFilePath;
+        // the alpha mask of JPG+PNG atlases, imageFilePath is the JPG then
+        QString        maskFilePath;
+        QVector<Frame> frames;
+        QSize          textureSize;
+    };
+
+    // false for the formats whose script does not accept the {rgb, mask}
+    // image paths of JPG+PNG atlases, the script reports the error then
+    static bool supports(const QString& format, bool maskImage);
+    // formats that exist without a script in defaultFormats
+    static QStringList nativeFormats() { return QStringList() << "binary"; }
+    // "plist", "json", ... empty for formats without an exporter
+    static QString fileExtension(const QString& format);
+    // writes filePath + "." + the extension of the format
+    static bool exportSpriteSheet(const QString& format, const Input& input, const QString& filePath, QString* errorString);
+
+    // The frames as a script enumerates them with for..in: names added
+    // twice keep their first position and their last value, and names that
+    // are array indices come first in ascending order.
+    static QVector<Frame> scriptOrder(const QVector<Frame>& frames);
+
+protected:
+    static void cocos2d(const Input& input, QTextStream& out);
+    static void cocos2dOld(const Input& input, QTextStream& out);
+    static void json(const Input& input, QTextStream& out);
+    static void phaser(const Input& input, QTextStream& out);
+    static void pixijs(const Input& input, QTextStream& out);
+    static void godotAnim(const Input& input, QTextStream& out);
+    static void godotParts(const Input& input, QTextStream& out);
+    static void binary(const Input& input, QIODevice* device);
+};
+
+#endif // DATAFILEEXPORTER_H
@@ -0,0 +1,403 @@
+#include "ImageConverter.h"
+#include <QtConcurrent>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGECONVERTER_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define IMAGECONVERTER_AVX2
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Band height used when splitting an image between worker threads.
+const int kDefaultBandHeight = 64;
+// Images smaller than this are converted on the calling thread.
+const int kMinParallelPixels = 256 * 256;
+
+const int kBayer4x4[4][4] = {
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 }
+};
+
+inline int mul255(int a, int b) {
+    int t = a * b + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Row kernels. All of them work on RGBA8888 memory (R, G, B, A byte order).
+
+void premultiplyRow(uchar* dst, const uchar* src, int width) {
+    int x = 0;
+#if defined(IMAGECONVERTER_AVX2)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i alphaMask = _mm256_set1_epi32(0xff000000);
+        const __m256i round = _mm256_set1_epi16(128);
+        for (; x + 8 <= width; x += 8) {
+            __m256i p = _mm256_loadu_si256((const __m256i*)(src + x * 4));
+            __m256i lo = _mm256_unpacklo_epi8(p, zero);
+            __m256i hi = _mm256_unpackhi_epi8(p, zero);
+            __m256i alo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            __m256i ahi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            lo = _mm256_add_epi16(_mm256_mullo_epi16(lo, alo), round);
+            hi = _mm256_add_epi16(_mm256_mullo_epi16(hi, ahi), round);
+            lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+            hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+            __m256i result = _mm256_packus_epi16(lo, hi);
+            result = _mm256_or_si256(_mm256_andnot_si256(alphaMask, result), _mm256_and_si256(alphaMask, p));
+            _mm256_storeu_si256((__m256i*)(dst + x * 4), result);
+        }
+    }
+#endif
+#if defined(IMAGECONVERTER_SSE2)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i alphaMask = _mm_set1_epi32(0xff000000);
+        const __m128i round = _mm_set1_epi16(128);
+        for (; x + 4 <= width; x += 4) {
+            __m128i p = _mm_loadu_si128((const __m128i*)(src + x * 4));
+            __m128i lo = _mm_unpacklo_epi8(p, zero);
+            __m128i hi = _mm_unpackhi_epi8(p, zero);
+            __m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            __m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            lo = _mm_add_epi16(_mm_mullo_epi16(lo, alo), round);
+            hi = _mm_add_epi16(_mm_mullo_epi16(hi, ahi), round);
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+            __m128i result = _mm_packus_epi16(lo, hi);
+            result = _mm_or_si128(_mm_andnot_si128(alphaMask, result), _mm_and_si128(alphaMask, p));
+            _mm_storeu_si128((__m128i*)(dst + x * 4), result);
+        }
+    }
+#endif
+    for (; x < width; ++x) {
+        const uchar* s = src + x * 4;
+        uchar* d = dst + x * 4;
+        int a = s[3];
+        d[0] = mul255(s[0], a);
+        d[1] = mul255(s[1], a);
+        d[2] = mul255(s[2], a);
+        d[3] = a;
+    }
+}
+
+void unpremultiplyRow(uchar* dst, const uchar* src, int width) {
+    int x = 0;
+#if defined(IMAGECONVERTER_SSE2)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 full = _mm_set1_ps(255.f);
+        for (; x < width; ++x) {
+            const uchar* s = src + x * 4;
+            uchar* d = dst + x * 4;
+            int a = s[3];
+            if ((a == 0) || (a == 255)) {
+                d[0] = a ? s[0] : 0;
+                d[1] = a ? s[1] : 0;
+                d[2] = a ? s[2] : 0;
+                d[3] = a;
+                continue;
+            }
+            int packed;
+            memcpy(&packed, s, 4);
+            __m128i p = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+            __m128 v = _mm_cvtepi32_ps(p);
+            __m128 scale = _mm_div_ps(full, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)));
+            __m128i result = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
+            result = _mm_packus_epi16(_mm_packs_epi32(result, zero), zero);
+            packed = _mm_cvtsi128_si32(result);
+            memcpy(d, &packed, 4);
+            d[3] = a;
+        }
+    }
+#endif
+    for (; x < width; ++x) {
+        const uchar* s = src + x * 4;
+        uchar* d = dst + x * 4;
+        int a = s[3];
+        if (a == 0) {
+            d[0] = d[1] = d[2] = d[3] = 0;
+        } else {
+            d[0] = qMin(255, (s[0] * 255 + a / 2) / a);
+            d[1] = qMin(255, (s[1] * 255 + a / 2) / a);
+            d[2] = qMin(255, (s[2] * 255 + a / 2) / a);
+            d[3] = a;
+        }
+    }
+}
+
+// RGBA8888 bytes to QRgb (Format_ARGB32 / Format_ARGB32_Premultiplied)
+void swizzleRow(QRgb* dst, const uchar* src, int width) {
+    int x = 0;
+#if defined(IMAGECONVERTER_SSE2) && (Q_BYTE_ORDER == Q_LITTLE_ENDIAN)
+    {
+        const __m128i rbMask = _mm_set1_epi32(0x00ff00ff);
+        const __m128i gaMask = _mm_set1_epi32(0xff00ff00);
+        for (; x + 4 <= width; x += 4) {
+            __m128i p = _mm_loadu_si128((const __m128i*)(src + x * 4));
+            __m128i rb = _mm_and_si128(p, rbMask);
+            rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+            _mm_storeu_si128((__m128i*)(dst + x), _mm_or_si128(rb, _mm_and_si128(p, gaMask)));
+        }
+    }
+#endif
+    for (; x < width; ++x) {
+        const uchar* s = src + x * 4;
+        dst[x] = qRgba(s[0], s[1], s[2], s[3]);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Channel reduction with optional dithering.
+
+struct ChannelLayout {
+    int bits[4];        // r, g, b, a; 8 means the channel is stored as is
+    bool clampToAlpha;  // premultiplied output: color can not exceed alpha
+};
+
+inline int expand(int q, int levels) {
+    return (q * 255 + levels / 2) / levels;
+}
+
+class RowReducer {
+public:
+    RowReducer(const ChannelLayout& layout, DitherMode dithering, int width)
+        : _layout(layout)
+        , _dithering(dithering)
+        , _width(width)
+    {
+        if (_dithering == kDitherFloydSteinberg) {
+            _error[0].fill(0, (width + 2) * 4);
+            _error[1].fill(0, (width + 2) * 4);
+        }
+    }
+
+    // src is RGBA8888 (premultiplied when layout.clampToAlpha), out receives
+    // quantized channel values in the target bit depth.
+    void reduce(const uchar* src, int y, int* out) {
+        int* current = nullptr;
+        int* next = nullptr;
+        if (_dithering == kDitherFloydSteinberg) {
+            current = _error[y & 1].data();
+            next = _error[(y + 1) & 1].data();
+            memset(next, 0, _error[0].size() * sizeof(int));
+        }
+
+        for (int x = 0; x < _width; ++x) {
+            const uchar* s = src + x * 4;
+            int* q = out + x * 4;
+            for (int c = 0; c < 4; ++c) {
+                int bits = _layout.bits[c];
+                int v = s[c];
+                if (bits >= 8) {
+                    q[c] = v;
+                    continue;
+                }
+                int levels = (1 << bits) - 1;
+                switch (_dithering) {
+                    case kDitherOrdered: {
+                        int threshold = kBayer4x4[y & 3][x & 3];
+                        q[c] = qMin(levels, (v * levels * 32 + (2 * threshold + 1) * 255) / (255 * 32));
+                    } break;
+                    case kDitherFloydSteinberg: {
+                        int e = (x + 1) * 4 + c;
+                        int value = qBound(0, v + current[e] / 16, 255);
+                        q[c] = (value * levels + 127) / 255;
+                        int error = value - expand(q[c], levels);
+                        current[e + 4] += error * 7;
+                        next[e - 4] += error * 3;
+                        next[e] += error * 5;
+                        next[e + 4] += error;
+                    } break;
+                    default:
+                        q[c] = (v * levels + 127) / 255;
+                        break;
+                }
+            }
+
+            if (_layout.clampToAlpha) {
+                int alphaBits = _layout.bits[3];
+                for (int c = 0; c < 3; ++c) {
+                    int levels = (1 << _layout.bits[c]) - 1;
+                    int maxValue = (alphaBits == _layout.bits[c])? q[3] : (s[3] * levels) / 255;
+                    q[c] = qMin(q[c], maxValue);
+                }
+            }
+        }
+    }
+
+private:
+    ChannelLayout _layout;
+    DitherMode    _dithering;
+    int           _width;
+    QVector<int>  _error[2];
+};
+
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+ImageConverter::ImageConverter(PixelFormat pixelFormat, bool premultiplied, DitherMode dithering)
+    : _pixelFormat(pixelFormat)
+    , _premultiplied(premultiplied)
+    , _dithering(dithering)
+    , _bandHeight(kDefaultBandHeight)
+{
+
+}
+
+QImage ImageConverter::convert(const QImage& image) const {
+    QImage::Format format;
+    switch (_pixelFormat) {
+        case kARGB8888: format = _premultiplied? QImage::Format_ARGB32 : QImage::Format_ARGB32_Premultiplied; break;
+        case kARGB8565: format = QImage::Format_ARGB8565_Premultiplied; break;
+        case kARGB4444: format = QImage::Format_ARGB4444_Premultiplied; break;
+        case kRGB888: format = QImage::Format_RGB888; break;
+        case kRGB565: format = QImage::Format_RGB16; break;
+        case kALPHA: format = QImage::Format_Grayscale8; break;
+        default: return image;
+    }
+    if (image.isNull()) return image;
+
+    QImage source = toStraightRgba(image);
+    QImage destination(source.size(), format);
+    if (destination.isNull()) return destination;
+    destination.bits(); // detach before the bands are written from worker threads
+
+    int bandHeight = qMax(1, _bandHeight);
+    int bandCount = (source.height() + bandHeight - 1) / bandHeight;
+    if ((bandCount < 2) || (source.width() * source.height() < kMinParallelPixels)) {
+        convertBand(source, destination, 0, source.height());
+    } else {
+        QVector<int> bands(bandCount);
+        for (int i = 0; i < bandCount; ++i) bands[i] = i;
+        QtConcurrent::blockingMap(bands, [&](int& band) {
+            int top = band * bandHeight;
+            convertBand(source, destination, top, qMin(top + bandHeight, source.height()));
+        });
+    }
+    return destination;
+}
+
+void ImageConverter::convertBand(const QImage& source, QImage& destination, int top, int bottom) const {
+    const int width = source.width();
+    const uchar* srcBits = source.constBits();
+    const int srcStride = source.bytesPerLine();
+    uchar* dstBits = const_cast<uchar*>(destination.constBits());
+    const int dstStride = destination.bytesPerLine();
+
+    QVector<uchar> premultipliedRow(width * 4);
+    QVector<int> quantized(width * 4);
+
+    ChannelLayout layout = {{8, 8, 8, 8}, false};
+    if (_pixelFormat == kARGB4444) {
+        layout = {{4, 4, 4, 4}, true};
+    } else if (_pixelFormat == kARGB8565) {
+        layout = {{5, 6, 5, 8}, true};
+    } else if (_pixelFormat == kRGB565) {
+        layout = {{5, 6, 5, 8}, false};
+    }
+    RowReducer reducer(layout, _dithering, width);
+
+    for (int y = top; y < bottom; ++y) {
+        const uchar* src = srcBits + y * srcStride;
+        uchar* dst = dstBits + y * dstStride;
+
+        switch (_pixelFormat) {
+            case kARGB8888:
+                if (_premultiplied) {
+                    swizzleRow(reinterpret_cast<QRgb*>(dst), src, width);
+                } else {
+                    premultiplyRow(premultipliedRow.data(), src, width);
+                    swizzleRow(reinterpret_cast<QRgb*>(dst), premultipliedRow.data(), width);
+                }
+                break;
+            case kARGB8565: {
+                premultiplyRow(premultipliedRow.data(), src, width);
+                reducer.reduce(premultipliedRow.data(), y, quantized.data());
+                for (int x = 0; x < width; ++x) {
+                    const int* q = quantized.constData() + x * 4;
+                    quint16 rgb = (q[0] << 11) | (q[1] << 5) | q[2];
+                    dst[x * 3 + 0] = q[3];
+                    dst[x * 3 + 1] = rgb & 0xff;
+                    dst[x * 3 + 2] = rgb >> 8;
+                }
+            } break;
+            case kARGB4444: {
+                premultiplyRow(premultipliedRow.data(), src, width);
+                reducer.reduce(premultipliedRow.data(), y, quantized.data());
+                quint16* line = reinterpret_cast<quint16*>(dst);
+                for (int x = 0; x < width; ++x) {
+                    const int* q = quantized.constData() + x * 4;
+                    line[x] = (q[3] << 12) | (q[0] << 8) | (q[1] << 4) | q[2];
+                }
+            } break;
+            case kRGB888: {
+                // no alpha channel: composite over black
+                premultiplyRow(premultipliedRow.data(), src, width);
+                const uchar* p = premultipliedRow.constData();
+                for (int x = 0; x < width; ++x) {
+                    dst[x * 3 + 0] = p[x * 4 + 0];
+                    dst[x * 3 + 1] = p[x * 4 + 1];
+                    dst[x * 3 + 2] = p[x * 4 + 2];
+                }
+            } break;
+            case kRGB565: {
+                premultiplyRow(premultipliedRow.data(), src, width);
+                reducer.reduce(premultipliedRow.data(), y, quantized.data());
+                quint16* line = reinterpret_cast<quint16*>(dst);
+                for (int x = 0; x < width; ++x) {
+                    const int* q = quantized.constData() + x * 4;
+                    line[x] = (q[0] << 11) | (q[1] << 5) | q[2];
+                }
+            } break;
+            case kALPHA:
+                for (int x = 0; x < width; ++x) {
+                    dst[x] = src[x * 4 + 3];
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+QImage ImageConverter::toStraightRgba(const QImage& image) {
+    if (image.format() == QImage::Format_RGBA8888) {
+        return image;
+    }
+    if (image.hasAlphaChannel() && image.pixelFormat().premultiplied() == QPixelFormat::Premultiplied) {
+        return unpremultiplied(image);
+    }
+    return image.convertToFormat(QImage::Format_RGBA8888);
+}
+
+QImage ImageConverter::premultiplied(const QImage& image) {
+    QImage source = toStraightRgba(image);
+    QImage result(source.size(), QImage::Format_RGBA8888_Premultiplied);
+    for (int y = 0; y < source.height(); ++y) {
+        premultiplyRow(result.scanLine(y), source.constScanLine(y), source.width());
+    }
+    return result;
+}
+
+QImage ImageConverter::unpremultiplied(const QImage& image) {
+    QImage source = image.convertToFormat(QImage::Format_RGBA8888_Premultiplied);
+    QImage result(source.size(), QImage::Format_RGBA8888);
+    for (int y = 0; y < source.height(); ++y) {
+        unpremultiplyRow(result.scanLine(y), source.constScanLine(y), source.width());
+    }
+    return result;
+}
+
+QImage ImageConverter::alpha(const QImage& image) {
+    return ImageConverter(kALPHA, false).convert(image);
+}
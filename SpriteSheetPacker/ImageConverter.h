@@ -0,0 +1,40 @@
+#ifndef IMAGECONVERTER_H
+#define IMAGECONVERTER_H
+
+#include <QImage>
+#include "ImageFormat.h"
+
+// Pixel format conversion used by publishing and by the atlas preview.
+// Every conversion works on a straight (non premultiplied) RGBA8888 copy of
+// the source image and is split into row bands that are processed in
+// parallel. Premultiply, unpremultiply and channel swizzles have SSE2/AVX2
+// kernels when the compiler targets those instruction sets.
+class ImageConverter
+{
+public:
+    ImageConverter(PixelFormat pixelFormat, bool premultiplied, DitherMode dithering = kDitherNone);
+
+    void setBandHeight(int bandHeight) { _bandHeight = bandHeight; }
+
+    QImage convert(const QImage& image) const;
+
+    static QImage toStraightRgba(const QImage& image);
+    static QImage premultiplied(const QImage& image);
+    static QImage unpremultiplied(const QImage& image);
+    static QImage alpha(const QImage& image);
+
+protected:
+    void convertBand(const QImage& source, QImage& destination, int top, int bottom) const;
+
+private:
+    PixelFormat _pixelFormat;
+    bool        _premultiplied;
+    DitherMode  _dithering;
+    int         _bandHeight;
+};
+
+inline QImage convertImage(const QImage& image, PixelFormat pixelFormat, bool premultiplied, DitherMode dithering = kDitherNone) {
+    return ImageConverter(pixelFormat, premultiplied, dithering).convert(image);
+}
+
+#endif // IMAGECONVERTER_H
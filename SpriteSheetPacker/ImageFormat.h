@@ -1,8 +1,7 @@
 #ifndef IMAGEFORMAT_H
 #define IMAGEFORMAT_H
 
-#include <QImage>
-#include <QPainter>
+#include <QString>
 
 enum ImageFormat {
     kPNG = 0,
@@ -11,7 +10,10 @@ enum ImageFormat {
     kJPG_PNG,
     kPKM,
     kPVR,
-    kPVR_CCZ
+    kPVR_CCZ,
+    kASTC,
+    kKTX,
+    kKTX2
 };
 
 enum PixelFormat {
@@ -30,7 +32,29 @@ enum PixelFormat {
     kPVRTC4A,
     kDXT1,
     kDXT3,
-    kDXT5
+    kDXT5,
+    kASTC4x4,
+    kASTC6x6,
+    kASTC8x8
+};
+
+enum DitherMode {
+    kDitherNone = 0,
+    kDitherOrdered,
+    kDitherFloydSteinberg
+};
+
+// Search effort of the built-in block compressors (ETC, DXT, ASTC).
+enum TextureQuality {
+    kTextureFast = 0,
+    kTextureNormal,
+    kTextureHigh
+};
+
+// Supercompression of the KTX2 mip levels.
+enum Supercompression {
+    kSupercompressionNone = 0,
+    kSupercompressionZlib
 };
 
 inline QString imageFormatToString(ImageFormat imageFormat) {
@@ -42,6 +66,9 @@ inline QString imageFormatToString(ImageFormat imageFormat) {
         case kPKM: return "*.pkm";
         case kPVR: return "*.pvr";
         case kPVR_CCZ: return "*.pvr.ccz";
+        case kASTC: return "*.astc";
+        case kKTX: return "*.ktx";
+        case kKTX2: return "*.ktx2";
         default: return "*.png";
     }
 }
@@ -54,6 +81,9 @@ inline ImageFormat imageFormatFromString(const QString& imageFormat) {
     if (imageFormat == "*.pkm") return kPKM;
     if (imageFormat == "*.pvr") return kPVR;
     if (imageFormat == "*.pvr.ccz") return kPVR_CCZ;
+    if (imageFormat == "*.astc") return kASTC;
+    if (imageFormat == "*.ktx") return kKTX;
+    if (imageFormat == "*.ktx2") return kKTX2;
     return kPNG;
 }
 
@@ -75,6 +105,9 @@ inline QString pixelFormatToString(PixelFormat pixelFormat) {
         case kDXT1: return "DXT1";
         case kDXT3: return "DXT3";
         case kDXT5: return "DXT5";
+        case kASTC4x4: return "ASTC4x4";
+        case kASTC6x6: return "ASTC6x6";
+        case kASTC8x8: return "ASTC8x8";
         default: return "ARGB8888";
     }
 }
@@ -96,40 +129,56 @@ inline PixelFormat pixelFormatFromString(const QString& pixelFormat) {
     if (pixelFormat == "DXT1") return kDXT1;
     if (pixelFormat == "DXT3") return kDXT3;
     if (pixelFormat == "DXT5") return kDXT5;
+    if (pixelFormat == "ASTC4x4") return kASTC4x4;
+    if (pixelFormat == "ASTC6x6") return kASTC6x6;
+    if (pixelFormat == "ASTC8x8") return kASTC8x8;
     return kARGB8888;
 }
 
-inline QImage convertImage(const QImage& image, PixelFormat pixelFormat, bool premultiplied) {
-    switch (pixelFormat) {
-        case kRGB888: return image.convertToFormat(QImage::Format_RGB888);
-        case kRGB565: return image.convertToFormat(QImage::Format_RGB16);
-        case kALPHA: {
-            QImage alphaImage = image.convertToFormat(QImage::Format_Alpha8);
-            QImage mono = image;
-            mono.fill(QColor(Qt::white).rgb());
-            QPainter painter(&mono);
-            painter.drawImage(0, 0, alphaImage);
-            mono.invertPixels(QImage::InvertRgb);
-            return mono.convertToFormat(QImage::Format_Grayscale8);
-        }
-        default: break;
+inline QString ditherModeToString(DitherMode ditherMode) {
+    switch (ditherMode) {
+        case kDitherNone: return "None";
+        case kDitherOrdered: return "Ordered";
+        case kDitherFloydSteinberg: return "FloydSteinberg";
+        default: return "None";
+    }
+}
+
+inline DitherMode ditherModeFromString(const QString& ditherMode) {
+    if (ditherMode == "None") return kDitherNone;
+    if (ditherMode == "Ordered") return kDitherOrdered;
+    if (ditherMode == "FloydSteinberg") return kDitherFloydSteinberg;
+    return kDitherNone;
+}
+
+inline QString textureQualityToString(TextureQuality textureQuality) {
+    switch (textureQuality) {
+        case kTextureFast: return "Fast";
+        case kTextureNormal: return "Normal";
+        case kTextureHigh: return "High";
+        default: return "Normal";
     }
-    if (premultiplied) {
-        switch (pixelFormat) {
-            case kARGB8888: return image.convertToFormat(QImage::Format_ARGB32);
-            case kARGB8565: return image.convertToFormat(QImage::Format_ARGB8565_Premultiplied);
-            case kARGB4444: return image.convertToFormat(QImage::Format_ARGB4444_Premultiplied);
-            default: break;
-        }
-    } else {
-        switch (pixelFormat) {
-            case kARGB8888: return image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
-            case kARGB8565: return image.convertToFormat(QImage::Format_ARGB8565_Premultiplied);
-            case kARGB4444: return image.convertToFormat(QImage::Format_ARGB4444_Premultiplied);
-            default: break;
-        }
+}
+
+inline TextureQuality textureQualityFromString(const QString& textureQuality) {
+    if (textureQuality == "Fast") return kTextureFast;
+    if (textureQuality == "Normal") return kTextureNormal;
+    if (textureQuality == "High") return kTextureHigh;
+    return kTextureNormal;
+}
+
+inline QString supercompressionToString(Supercompression supercompression) {
+    switch (supercompression) {
+        case kSupercompressionNone: return "None";
+        case kSupercompressionZlib: return "Zlib";
+        default: return "Zlib";
     }
-    return image;
+}
+
+inline Supercompression supercompressionFromString(const QString& supercompression) {
+    if (supercompression == "None") return kSupercompressionNone;
+    if (supercompression == "Zlib") return kSupercompressionZlib;
+    return kSupercompressionZlib;
 }
 
 #endif // IMAGEFORMAT_H
@@ -0,0 +1,91 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <QString>
+#include <QTextStream>
+#include <QVector>
+
+// Writes JSON text to a stream with the members in the order they are
+// written, laid out like JSON.stringify(value, null, "\t") or, when not
+// indented, like JSON.stringify(value). QJsonObject sorts its keys, which
+// the exported formats and the export scripts must not see, and it would
+// keep the whole document in memory.
+class JsonWriter
+{
+public:
+    explicit JsonWriter(QTextStream& stream, bool indented = true) : _stream(stream), _indented(indented) { }
+
+    void beginObject(const QString& key = QString()) { member(key); _stream << '{'; _levels.push_back({false, 0}); }
+    void beginArray(const QString& key = QString()) { member(key); _stream << '['; _levels.push_back({true, 0}); }
+    void end() {
+        Level level = _levels.takeLast();
+        if (_indented && (level.count > 0)) {
+            _stream << '\n';
+            indent();
+        }
+        _stream << (level.array? ']' : '}');
+    }
+
+    void value(const QString& key, int value) { member(key); _stream << QString::number(value); }
+    void value(const QString& key, qint64 value) { member(key); _stream << QString::number(value); }
+    void value(const QString& key, double value) { member(key); _stream << QString::number(value, 'g', 12); }
+    void value(const QString& key, bool value) { member(key); _stream << (value? "true" : "false"); }
+    void value(const QString& key, const QString& value) { member(key); quote(value); }
+
+private:
+    struct Level {
+        bool array;
+        int  count;
+    };
+
+    void indent() { _stream << QString(_levels.size(), '\t'); }
+
+    // separator and key of the next member, elements of arrays have no key
+    void member(const QString& key) {
+        if (_levels.isEmpty()) return;
+        Level& level = _levels.last();
+        if (_indented) {
+            _stream << ((level.count > 0)? ",\n" : "\n");
+            indent();
+        } else if (level.count > 0) {
+            _stream << ',';
+        }
+        level.count++;
+        if (!level.array) {
+            quote(key);
+            _stream << (_indented? ": " : ":");
+        }
+    }
+
+    void quote(const QString& string) {
+        QString text;
+        text.reserve(string.size() + 2);
+        text += '"';
+        for (QChar c: string) {
+            switch (c.unicode()) {
+                case '"': text += "\\\""; break;
+                case '\\': text += "\\\\"; break;
+                case '\b': text += "\\b"; break;
+                case '\f': text += "\\f"; break;
+                case '\n': text += "\\n"; break;
+                case '\r': text += "\\r"; break;
+                case '\t': text += "\\t"; break;
+                default:
+                    if (c.unicode() < 0x20) {
+                        text += QString("\\u%1").arg(c.unicode(), 4, 16, QChar('0'));
+                    } else {
+                        text += c;
+                    }
+                    break;
+            }
+        }
+        text += '"';
+        _stream << text;
+    }
+
+    QTextStream&   _stream;
+    bool           _indented;
+    QVector<Level> _levels;
+};
+
+#endif // JSONWRITER_H
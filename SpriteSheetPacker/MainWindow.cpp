@@ -11,6 +11,7 @@
 #include "AnimationDialog.h"
 #include "ContentProtectionDialog.h"
 #include "UpdaterDialog.h"
+#include "TextureEncoder.h"
 #include "ui_MainWindow.h"
 
 #include "PListParser.h"
@@ -59,7 +60,22 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->pixelFormatComboBox->addItem(pixelFormatToString(kDXT1));
     ui->pixelFormatComboBox->addItem(pixelFormatToString(kDXT3));
     ui->pixelFormatComboBox->addItem(pixelFormatToString(kDXT5));
+    ui->pixelFormatComboBox->addItem(pixelFormatToString(kASTC4x4));
+    ui->pixelFormatComboBox->addItem(pixelFormatToString(kASTC6x6));
+    ui->pixelFormatComboBox->addItem(pixelFormatToString(kASTC8x8));
     ui->pixelFormatComboBox->setCurrentIndex(0);
+    ui->ditheringComboBox->addItem(ditherModeToString(kDitherNone));
+    ui->ditheringComboBox->addItem(ditherModeToString(kDitherOrdered));
+    ui->ditheringComboBox->addItem(ditherModeToString(kDitherFloydSteinberg));
+    ui->ditheringComboBox->setCurrentIndex(0);
+    ui->textureQualityComboBox->addItem(textureQualityToString(kTextureFast));
+    ui->textureQualityComboBox->addItem(textureQualityToString(kTextureNormal));
+    ui->textureQualityComboBox->addItem(textureQualityToString(kTextureHigh));
+    ui->textureQualityComboBox->setCurrentIndex(kTextureNormal);
+
+    ui->supercompressionComboBox->addItem(supercompressionToString(kSupercompressionNone));
+    ui->supercompressionComboBox->addItem(supercompressionToString(kSupercompressionZlib));
+    ui->supercompressionComboBox->setCurrentIndex(kSupercompressionZlib);
     ui->imageFormatComboBox->addItem(imageFormatToString(kPNG));
     ui->imageFormatComboBox->addItem(imageFormatToString(kWEBP));
     ui->imageFormatComboBox->addItem(imageFormatToString(kJPG));
@@ -67,6 +83,9 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->imageFormatComboBox->addItem(imageFormatToString(kPKM));
     ui->imageFormatComboBox->addItem(imageFormatToString(kPVR));
     ui->imageFormatComboBox->addItem(imageFormatToString(kPVR_CCZ));
+    ui->imageFormatComboBox->addItem(imageFormatToString(kASTC));
+    ui->imageFormatComboBox->addItem(imageFormatToString(kKTX));
+    ui->imageFormatComboBox->addItem(imageFormatToString(kKTX2));
     ui->imageFormatComboBox->setCurrentIndex(0);
 
     // configure default values
@@ -128,20 +147,11 @@ MainWindow::~MainWindow() {
 void MainWindow::refreshFormats() {
     QSettings settings;
     QStringList formatsFolder;
-    formatsFolder.push_back(QCoreApplication::applicationDirPath() + "/defaultFormats");
+    formatsFolder.push_back(PublishSpriteSheet::defaultFormatsFolder());
     formatsFolder.push_back(settings.value("Preferences/customFormatFolder").toString());
 
     // load formats
-    PublishSpriteSheet::formats().clear();
-    for (auto folder: formatsFolder) {
-        if (QDir(folder).exists()) {
-            QDirIterator fileNames(folder, QStringList() << "*.js", QDir::Files | QDir::NoSymLinks | QDir::NoDotAndDotDot);
-            while(fileNames.hasNext()) {
-                fileNames.next();
-                PublishSpriteSheet::addFormat(fileNames.fileInfo().baseName(), fileNames.filePath());
-            }
-        }
-    }
+    PublishSpriteSheet::loadFormats(formatsFolder);
 
     _blockUISignals = true;
     QString prevFormat = ui->dataFormatComboBox->currentText();
@@ -227,6 +237,8 @@ void MainWindow::refreshAtlas(bool generate) {
 
         _future = QtConcurrent::run([this]() {
             _mutex.lock();
+            // the last atlases are the starting point of incremental updates
+            QList<SpriteAtlas> previousAtlases = _spriteAtlas;
             _spriteAtlas.clear();
             for (int i=0; i<ui->scalingVariantsGroupBox->layout()->count(); ++i) {
                 ScalingVariantWidget* scalingVariantWidget = qobject_cast<ScalingVariantWidget*>(ui->scalingVariantsGroupBox->layout()->itemAt(i)->widget());
@@ -260,6 +272,10 @@ void MainWindow::refreshAtlas(bool generate) {
                         atlas.abortGeneration();
                     });
 
+                    if (_spriteAtlas.size() < previousAtlases.size()) {
+                        atlas.setPreviousGeneration(previousAtlases.at(_spriteAtlas.size()));
+                    }
+
                     if (!atlas.generate(progress)) {
                         disconnect(connection);
                         delete progress;
@@ -314,7 +330,8 @@ void MainWindow::refreshPreview() {
             ui->atlasPreviewTabWidget->setTabText(i, title);
             spriteAtlasPreview->setAtlas(atlas,
                                          pixelFormatFromString(ui->pixelFormatComboBox->currentText()),
-                                         ui->premultipliedCheckBox->isChecked());
+                                         ui->premultipliedCheckBox->isChecked(),
+                                         ditherModeFromString(ui->ditheringComboBox->currentText()));
         }
     }
 }
@@ -351,6 +368,10 @@ void MainWindow::openSpritePackerProject(const QString& fileName) {
     ui->imageFormatComboBox->setCurrentText(imageFormatToString(projectFile->imageFormat()));
     ui->pixelFormatComboBox->setCurrentText(pixelFormatToString(projectFile->pixelFormat()));
     ui->premultipliedCheckBox->setChecked(projectFile->premultiplied());
+    ui->ditheringComboBox->setCurrentText(ditherModeToString(projectFile->dithering()));
+    ui->textureQualityComboBox->setCurrentText(textureQualityToString(projectFile->textureQuality()));
+    ui->supercompressionComboBox->setCurrentText(supercompressionToString(projectFile->supercompression()));
+    ui->mipmapsCheckBox->setChecked(projectFile->mipmaps());
     ui->pngOptModeComboBox->setCurrentText(projectFile->pngOptMode());
     ui->pngOptLevelSlider->setValue(projectFile->pngOptLevel());
     ui->webpQualitySlider->setValue(projectFile->webpQuality());
@@ -427,6 +448,10 @@ void MainWindow::saveSpritePackerProject(const QString& fileName) {
     projectFile->setImageFormat(imageFormatFromString(ui->imageFormatComboBox->currentText()));
     projectFile->setPixelFormat(pixelFormatFromString(ui->pixelFormatComboBox->currentText()));
     projectFile->setPremultiplied(ui->premultipliedCheckBox->isChecked());
+    projectFile->setDithering(ditherModeFromString(ui->ditheringComboBox->currentText()));
+    projectFile->setTextureQuality(textureQualityFromString(ui->textureQualityComboBox->currentText()));
+    projectFile->setSupercompression(supercompressionFromString(ui->supercompressionComboBox->currentText()));
+    projectFile->setMipmaps(ui->mipmapsCheckBox->isChecked());
     projectFile->setPngOptMode(ui->pngOptModeComboBox->currentText());
     projectFile->setPngOptLevel(ui->pngOptLevelSlider->value());
     projectFile->setWebpQuality(ui->webpQualitySlider->value());
@@ -649,6 +674,10 @@ void MainWindow::on_actionPublish_triggered() {
     publisher->setImageFormat(imageFormatFromString(ui->imageFormatComboBox->currentText()));
     publisher->setPixelFormat(pixelFormatFromString(ui->pixelFormatComboBox->currentText()));
     publisher->setPremultiplied(ui->premultipliedCheckBox->isChecked());
+    publisher->setDithering(ditherModeFromString(ui->ditheringComboBox->currentText()));
+    publisher->setTextureQuality(textureQualityFromString(ui->textureQualityComboBox->currentText()));
+    publisher->setSupercompression(supercompressionFromString(ui->supercompressionComboBox->currentText()));
+    publisher->setMipmaps(ui->mipmapsCheckBox->isChecked());
     publisher->setPngQuality(ui->pngOptModeComboBox->currentText(), ui->pngOptLevelSlider->value());
     publisher->setWebpQuality(ui->webpQualitySlider->value());
     publisher->setJpgQuality(ui->jpgQualitySlider->value());
@@ -728,19 +757,39 @@ void MainWindow::on_actionPublish_triggered() {
     }
 
     publishStatusDialog.log("Publish data and images...", Qt::darkGreen);
-    publisher->publish(ui->dataFormatComboBox->currentText());
-
-    if (ui->pngOptModeComboBox->currentText() == "None") {
-        delete publisher;
-    } else {
-        publishStatusDialog.log("PNG Optimization: optimize if needed.");
-        // TODO: you need to wait previous image optimization if they are the same
-        QObject::connect(publisher, &PublishSpriteSheet::onCompletedOptimizePNG, [this, publisher] () {
-            // TODO: it would be good to show here for information about the optimization
-            QMessageBox::information(this, "PNG Optimization", "PNG Optimization: complete.");
-            delete publisher;
-        });
+    // PNG optimization can take seconds per page, the dialog keeps showing
+    // the log of the pages while they are published on the thread pool
+    const QString format = ui->dataFormatComboBox->currentText();
+    QFutureWatcher<bool> publishWatcher;
+    QEventLoop publishLoop;
+    connect(&publishWatcher, SIGNAL(finished()), &publishLoop, SLOT(quit()));
+    publishWatcher.setFuture(QtConcurrent::run([publisher, format]() {
+        return publisher->publish(format);
+    }));
+    publishLoop.exec();
+    if (!publishWatcher.result()) {
+        QStringList errors;
+        for (const PublishTaskResult& result: publisher->publishResults()) {
+            if (!result.success) errors.push_back(result.errorString);
+        }
+        QMessageBox::critical(this, "Publish error", errors.join("\n"));
     }
+    for (const PublishTaskResult& result: publisher->publishResults()) {
+        if (result.success && result.imageSkipped) {
+            publishStatusDialog.log(QString("Unchanged %1 (%2 KB).").arg(result.outputFilePath).arg(result.imageSize / 1024));
+        } else if (result.success) {
+            QString psnr = (result.psnr > 0)? QString(", PSNR %1 dB").arg(result.psnr, 0, 'f', 2) : QString();
+            publishStatusDialog.log(QString("Published %1 (%2 KB, %3 ms%4).").arg(result.outputFilePath).arg(result.imageSize / 1024).arg(result.totalTime).arg(psnr));
+            if (result.unoptimizedSize > 0) {
+                publishStatusDialog.log(QString("Optimized %1: %2 KB -> %3 KB (%4 ms).").arg(result.outputFilePath)
+                                        .arg(result.unoptimizedSize / 1024).arg(result.imageSize / 1024).arg(result.optimizeTime));
+            }
+        } else {
+            publishStatusDialog.log(QString("Publish error %1: %2").arg(result.outputFilePath).arg(result.errorString), Qt::red);
+        }
+    }
+
+    delete publisher;
 
     publishStatusDialog.log(QString("Publishing is finished."), Qt::blue);
     if (!publishStatusDialog.complete()) {
@@ -971,6 +1020,9 @@ void MainWindow::on_imageFormatComboBox_currentIndexChanged(int index) {
         setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT1, false);
         setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT3, false);
         setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT5, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC4x4, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC6x6, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC8x8, false);
         if (!isEnabledComboBoxItem(ui->pixelFormatComboBox, ui->pixelFormatComboBox->currentIndex())) {
             ui->pixelFormatComboBox->setCurrentIndex(kARGB8888);
         }
@@ -995,6 +1047,9 @@ void MainWindow::on_imageFormatComboBox_currentIndexChanged(int index) {
         setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT1, false);
         setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT3, false);
         setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT5, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC4x4, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC6x6, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC8x8, false);
         if (!isEnabledComboBoxItem(ui->pixelFormatComboBox, ui->pixelFormatComboBox->currentIndex())) {
             ui->pixelFormatComboBox->setCurrentIndex(kRGB888);
         }
@@ -1019,6 +1074,9 @@ void MainWindow::on_imageFormatComboBox_currentIndexChanged(int index) {
         setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT1, false);
         setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT3, false);
         setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT5, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC4x4, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC6x6, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC8x8, false);
         if (!isEnabledComboBoxItem(ui->pixelFormatComboBox, ui->pixelFormatComboBox->currentIndex())) {
             ui->pixelFormatComboBox->setCurrentIndex(kRGB888);
         }
@@ -1042,6 +1100,9 @@ void MainWindow::on_imageFormatComboBox_currentIndexChanged(int index) {
         setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT1, false);
         setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT3, false);
         setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT5, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC4x4, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC6x6, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC8x8, false);
         if (!isEnabledComboBoxItem(ui->pixelFormatComboBox, ui->pixelFormatComboBox->currentIndex())) {
             ui->pixelFormatComboBox->setCurrentIndex(kETC1);
         }
@@ -1065,11 +1126,70 @@ void MainWindow::on_imageFormatComboBox_currentIndexChanged(int index) {
         setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT1, true);
         setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT3, true);
         setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT5, true);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC4x4, true);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC6x6, true);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC8x8, true);
         if (!isEnabledComboBoxItem(ui->pixelFormatComboBox, ui->pixelFormatComboBox->currentIndex())) {
             ui->pixelFormatComboBox->setCurrentIndex(kPVRTC4A);
         }
+    } else if (imageFormat == kASTC) {
+        imageTabBar->setTabEnabled(0, false);
+        imageTabBar->setTabEnabled(1, false);
+        imageTabBar->setTabEnabled(2, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kARGB8888, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kARGB8565, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kARGB4444, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kRGB888, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kRGB565, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kALPHA, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kETC1, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kETC2, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kETC2A, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kPVRTC2, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kPVRTC2A, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kPVRTC4, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kPVRTC4A, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT1, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT3, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT5, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC4x4, true);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC6x6, true);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC8x8, true);
+        if (!isEnabledComboBoxItem(ui->pixelFormatComboBox, ui->pixelFormatComboBox->currentIndex())) {
+            ui->pixelFormatComboBox->setCurrentIndex(kASTC4x4);
+        }
+    } else if ((imageFormat == kKTX) || (imageFormat == kKTX2)) {
+        imageTabBar->setTabEnabled(0, false);
+        imageTabBar->setTabEnabled(1, false);
+        imageTabBar->setTabEnabled(2, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kARGB8888, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kARGB8565, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kARGB4444, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kRGB888, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kRGB565, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kALPHA, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kETC1, true);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kETC2, true);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kETC2A, true);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kPVRTC2, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kPVRTC2A, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kPVRTC4, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kPVRTC4A, false);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT1, true);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT3, true);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kDXT5, true);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC4x4, true);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC6x6, true);
+        setEnabledComboBoxItem(ui->pixelFormatComboBox, kASTC8x8, true);
+        if (!isEnabledComboBoxItem(ui->pixelFormatComboBox, ui->pixelFormatComboBox->currentIndex())) {
+            ui->pixelFormatComboBox->setCurrentIndex(kASTC4x4);
+        }
     }
 
+    ui->supercompressionLabel->setVisible(imageFormat == kKTX2);
+    ui->supercompressionComboBox->setVisible(imageFormat == kKTX2);
+    ui->mipmapsCheckBox->setVisible(imageFormat == kKTX2);
+
     // enable/disable tabs content
     bool anyEnabled = false;
     for (int tab=0; tab<ui->imageFormatSettingsTabWidget->count(); ++tab) {
@@ -1109,13 +1229,20 @@ void MainWindow::on_pixelFormatComboBox_currentIndexChanged(int index) {
         }
     }
 
-    QVector<PixelFormat> formatsWithAlpha = {kARGB8888, kARGB8565, kARGB4444, kETC2A, kPVRTC2A, kPVRTC4A, kDXT1, kDXT3, kDXT5};
+    QVector<PixelFormat> formatsWithAlpha = {kARGB8888, kARGB8565, kARGB4444, kETC2A, kPVRTC2A, kPVRTC4A, kDXT1, kDXT3, kDXT5, kASTC4x4, kASTC6x6, kASTC8x8};
     if (formatsWithAlpha.indexOf(pixelFormat) != -1) {
         ui->premultipliedCheckBox->show();
     } else {
         ui->premultipliedCheckBox->hide();
     }
 
+    QVector<PixelFormat> formatsWithDithering = {kARGB8565, kARGB4444, kRGB565};
+    ui->ditheringLabel->setVisible(formatsWithDithering.indexOf(pixelFormat) != -1);
+    ui->ditheringComboBox->setVisible(formatsWithDithering.indexOf(pixelFormat) != -1);
+
+    ui->textureQualityLabel->setVisible(TextureEncoder::supports(pixelFormat));
+    ui->textureQualityComboBox->setVisible(TextureEncoder::supports(pixelFormat));
+
     if (pixelFormat == kARGB8888) {
         ui->premultipliedCheckBox->setEnabled(true);
     } else {
@@ -1146,6 +1273,23 @@ void MainWindow::on_premultipliedCheckBox_toggled() {
     setProjectDirty();
 }
 
+void MainWindow::on_ditheringComboBox_currentIndexChanged(int) {
+    setProjectDirty();
+    refreshPreview();
+}
+
+void MainWindow::on_textureQualityComboBox_currentIndexChanged(int) {
+    setProjectDirty();
+}
+
+void MainWindow::on_supercompressionComboBox_currentIndexChanged(int) {
+    setProjectDirty();
+}
+
+void MainWindow::on_mipmapsCheckBox_toggled() {
+    setProjectDirty();
+}
+
 void MainWindow::onScalingVariantWidgetValueChanged(bool refresh) {
     if (refresh) {
         propertiesValueChanged();
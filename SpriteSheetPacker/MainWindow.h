@@ -80,6 +80,10 @@ private slots:
     void on_spriteSheetLineEdit_textChanged(const QString& text);
     void on_pngOptModeComboBox_currentTextChanged(const QString &text);
     void on_premultipliedCheckBox_toggled();
+    void on_ditheringComboBox_currentIndexChanged(int index);
+    void on_textureQualityComboBox_currentIndexChanged(int index);
+    void on_supercompressionComboBox_currentIndexChanged(int index);
+    void on_mipmapsCheckBox_toggled();
 
     void onScalingVariantWidgetValueChanged(bool);
 
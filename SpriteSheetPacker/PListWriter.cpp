@@ -0,0 +1,106 @@
+#include "PListWriter.h"
+#include <QDate>
+#include <QDateTime>
+
+namespace {
+
+// text node escaping of QDomDocument: quotes stay, '>' only ends "]]>"
+QString escapeText(const QString& text) {
+    QString result;
+    result.reserve(text.size());
+    for (int i = 0; i < text.size(); ++i) {
+        QChar c = text[i];
+        if (c == '<') {
+            result += "&lt;";
+        } else if (c == '&') {
+            result += "&amp;";
+        } else if ((c == '>') && (i >= 2) && (text[i - 1] == ']') && (text[i - 2] == ']')) {
+            result += "&gt;";
+        } else if (c == '\r') {
+            result += "&#xd;";
+        } else {
+            result += c;
+        }
+    }
+    return result;
+}
+
+}
+
+void PListWriter::beginDocument() {
+    _stream << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    _stream << "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n";
+    _stream << "<plist version=\"1.0\"";
+    _levels.push_back({"plist", false});
+}
+
+void PListWriter::end() {
+    Level level = _levels.takeLast();
+    if (level.hasChildren) {
+        indent();
+        _stream << "</" << level.tag << ">\n";
+    } else {
+        _stream << "/>\n";
+    }
+}
+
+void PListWriter::value(const QVariant& value) {
+    switch (value.type()) {
+        case QVariant::Map: {
+            const QVariantMap map = value.toMap();
+            beginDict();
+            for (auto it = map.cbegin(); it != map.cend(); ++it) {
+                key(it.key());
+                this->value(it.value());
+            }
+            end();
+            break;
+        }
+        case QVariant::List: {
+            const QVariantList list = value.toList();
+            beginArray();
+            for (const QVariant& item: list) {
+                this->value(item);
+            }
+            end();
+            break;
+        }
+        case QVariant::Bool: this->value(value.toBool()); break;
+        case QVariant::Date: textElement("date", value.toDate().toString(Qt::ISODate)); break;
+        case QVariant::DateTime: textElement("date", value.toDateTime().toString(Qt::ISODate)); break;
+        case QVariant::ByteArray: textElement("data", QString::fromLatin1(value.toByteArray().toBase64())); break;
+        case QVariant::String: this->value(value.toString()); break;
+        case QVariant::Int: this->value(value.toInt()); break;
+        default:
+            if (value.canConvert(QVariant::Double)) {
+                textElement("real", QString::number(value.toDouble()));
+            }
+            break;
+    }
+}
+
+void PListWriter::begin(const char* tag) {
+    child();
+    indent();
+    _stream << '<' << tag;
+    _levels.push_back({tag, false});
+}
+
+// closes the start tag of the parent before its first child
+void PListWriter::child() {
+    if (_levels.isEmpty() || _levels.last().hasChildren) return;
+    _stream << ">\n";
+    _levels.last().hasChildren = true;
+}
+
+void PListWriter::textElement(const char* tag, const QString& text) {
+    child();
+    indent();
+    _stream << '<' << tag << '>' << escapeText(text) << "</" << tag << ">\n";
+}
+
+void PListWriter::emptyElement(const char* tag) {
+    child();
+    indent();
+    _stream << '<' << tag << "/>\n";
+}
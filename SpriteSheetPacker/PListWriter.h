@@ -0,0 +1,49 @@
+#ifndef PLISTWRITER_H
+#define PLISTWRITER_H
+
+#include <QTextStream>
+#include <QVariant>
+#include <QVector>
+
+// Writes an XML property list to a text stream while it is produced, with
+// the same text QDomDocument::toString() gives for the document
+// PListSerializer::toPList() builds, but without keeping a DOM of the
+// whole file in memory. Dictionary keys are written in the order they come,
+// callers that want toPList() output write them sorted like QVariantMap.
+class PListWriter
+{
+public:
+    explicit PListWriter(QTextStream& stream) : _stream(stream) { }
+
+    // the XML declaration, the doctype and <plist version="1.0">
+    void beginDocument();
+    void endDocument() { end(); }
+
+    void beginDict() { begin("dict"); }
+    void beginArray() { begin("array"); }
+    void end();
+
+    void key(const QString& key) { textElement("key", key); }
+    void value(const QString& value) { textElement("string", value); }
+    void value(int value) { textElement("integer", QString::number(value)); }
+    void value(bool value) { emptyElement(value? "true" : "false"); }
+    // maps, lists and the primitives toPList() knows, nothing for other types
+    void value(const QVariant& value);
+
+private:
+    struct Level {
+        const char* tag;
+        bool        hasChildren;
+    };
+
+    void begin(const char* tag);
+    void child();
+    void indent() { _stream << QString(_levels.size(), ' '); }
+    void textElement(const char* tag, const QString& text);
+    void emptyElement(const char* tag);
+
+    QTextStream&   _stream;
+    QVector<Level> _levels;
+};
+
+#endif // PLISTWRITER_H
@@ -0,0 +1,152 @@
+#include "ParallelDeflate.h"
+#include <QtConcurrent>
+#include <QtEndian>
+
+namespace {
+
+struct CompressedSegment {
+    QByteArray data;
+    uLong      adler;
+    qint64     size;
+};
+
+CompressedSegment deflateSegment(const ParallelDeflate::Segment& segment, int level, int strategy, bool last) {
+    CompressedSegment result;
+    result.size = segment.data.size();
+    result.adler = adler32(adler32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(segment.data.constData()), segment.data.size());
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // raw deflate, the zlib wrapper is written once for all segments
+    deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, strategy);
+    if (!segment.dictionary.isEmpty()) {
+        deflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(segment.dictionary.constData()), segment.dictionary.size());
+    }
+
+    // every segment but the last ends on a byte boundary, so the segments can be concatenated
+    result.data.resize(deflateBound(&stream, segment.data.size()) + 16);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(segment.data.constData()));
+    stream.avail_in = segment.data.size();
+    stream.next_out = reinterpret_cast<Bytef*>(result.data.data());
+    stream.avail_out = result.data.size();
+    const int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+    do {
+        if (stream.avail_out == 0) {
+            int used = result.data.size();
+            result.data.resize(used * 2);
+            stream.next_out = reinterpret_cast<Bytef*>(result.data.data() + used);
+            stream.avail_out = result.data.size() - used;
+        }
+        deflate(&stream, flush);
+    } while ((stream.avail_in > 0) || (stream.avail_out == 0));
+
+    result.data.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result;
+}
+
+// Copies [offset, offset + size) of the concatenated parts, without a copy when it lies in one part.
+QByteArray span(const QList<QByteArray>& parts, qint64 offset, qint64 size) {
+    QByteArray result;
+    qint64 partOffset = 0;
+    for (const QByteArray& part : parts) {
+        qint64 begin = qMax(offset, partOffset);
+        qint64 end = qMin(offset + size, partOffset + part.size());
+        if (begin < end) {
+            if (result.isEmpty() && (end - begin == size)) {
+                return QByteArray::fromRawData(part.constData() + (begin - partOffset), size);
+            }
+            result.append(part.constData() + (begin - partOffset), end - begin);
+        }
+        partOffset += part.size();
+    }
+    return result;
+}
+
+}
+
+const qint64 ParallelDeflate::kDefaultBlockSize;
+const int ParallelDeflate::kDictionarySize;
+
+ParallelDeflate::ParallelDeflate(int level, int strategy)
+    : _level(level)
+    , _strategy(strategy)
+{
+
+}
+
+bool ParallelDeflate::compress(int segmentCount,
+                               const std::function<Segment(int)>& segment,
+                               const std::function<bool(const QByteArray&)>& output) const
+{
+    segmentCount = qMax(1, segmentCount);
+
+    uLong adler = adler32(0L, Z_NULL, 0);
+    const int window = qMax(1, QThread::idealThreadCount() * 2);
+    std::function<CompressedSegment(int)> compressTask = [&](int index) {
+        return deflateSegment(segment(index), _level, _strategy, index == segmentCount - 1);
+    };
+
+    // compress a window of segments on the thread pool, then hand them out in order
+    bool success = true;
+    for (int first = 0; success && (first < segmentCount); first += window) {
+        QVector<int> indexes;
+        for (int i = first; i < qMin(first + window, segmentCount); ++i) indexes.push_back(i);
+        QVector<CompressedSegment> compressed = QtConcurrent::blockingMapped<QVector<CompressedSegment>>(indexes, compressTask);
+        for (int i = 0; success && (i < compressed.size()); ++i) {
+            adler = adler32_combine(adler, compressed[i].adler, compressed[i].size);
+
+            QByteArray data = compressed[i].data;
+            if (indexes[i] == 0) {
+                data.prepend(zlibHeader());
+            }
+            if (indexes[i] == segmentCount - 1) {
+                quint32 be = qToBigEndian<quint32>(adler);
+                data.append(reinterpret_cast<const char*>(&be), sizeof(be));
+            }
+            success = output(data);
+        }
+    }
+    return success;
+}
+
+bool ParallelDeflate::compress(const QList<QByteArray>& parts,
+                               const std::function<bool(const QByteArray&)>& output,
+                               qint64 blockSize) const
+{
+    qint64 size = 0;
+    for (const QByteArray& part : parts) size += part.size();
+
+    const int blocks = (int)((size + blockSize - 1) / blockSize);
+    return compress(blocks, [&](int index) {
+        const qint64 offset = index * blockSize;
+        const qint64 dictionaryOffset = qMax<qint64>(0, offset - kDictionarySize);
+        Segment result;
+        result.dictionary = span(parts, dictionaryOffset, offset - dictionaryOffset);
+        result.data = span(parts, offset, qMin(blockSize, size - offset));
+        return result;
+    }, output);
+}
+
+QByteArray ParallelDeflate::zlibHeader() const {
+    // same as the header deflate() writes for a 32 KB window
+    const int level = (_level == Z_DEFAULT_COMPRESSION) ? 6 : _level;
+    int levelFlags;
+    if ((_strategy >= Z_HUFFMAN_ONLY) || (level < 2)) {
+        levelFlags = 0;
+    } else if (level < 6) {
+        levelFlags = 1;
+    } else if (level == 6) {
+        levelFlags = 2;
+    } else {
+        levelFlags = 3;
+    }
+
+    int header = ((Z_DEFLATED + ((MAX_WBITS - 8) << 4)) << 8) | (levelFlags << 6);
+    header += 31 - (header % 31);
+
+    QByteArray result;
+    result.append((char)(header >> 8));
+    result.append((char)(header & 0xff));
+    return result;
+}
@@ -0,0 +1,50 @@
+#ifndef PARALLELDEFLATE_H
+#define PARALLELDEFLATE_H
+
+#include <QByteArray>
+#include <QList>
+#include <functional>
+#include "zlib.h"
+
+// Produces one zlib stream from independently deflated segments, the way
+// pigz does. Every segment is raw deflate primed with a dictionary (the
+// up to 32 KB of uncompressed data in front of it) and ends with a sync
+// flush, so the segments are compressed on the global thread pool and
+// simply concatenated; their adler32 values are joined with
+// adler32_combine for the trailer.
+class ParallelDeflate
+{
+public:
+    struct Segment {
+        QByteArray dictionary;
+        QByteArray data;
+    };
+
+    // level and strategy are the deflateInit2() values
+    explicit ParallelDeflate(int level = Z_DEFAULT_COMPRESSION, int strategy = Z_DEFAULT_STRATEGY);
+
+    // segment(index) builds the input of one segment and is called on the
+    // thread pool, a window of segments at a time. output receives the
+    // compressed segments in order, the zlib header is part of the first
+    // one and the adler32 trailer part of the last one.
+    bool compress(int segmentCount,
+                  const std::function<Segment(int)>& segment,
+                  const std::function<bool(const QByteArray&)>& output) const;
+
+    // compresses the concatenated parts in blocks of blockSize bytes
+    bool compress(const QList<QByteArray>& parts,
+                  const std::function<bool(const QByteArray&)>& output,
+                  qint64 blockSize = kDefaultBlockSize) const;
+
+    // the two byte zlib header deflate() writes for these settings
+    QByteArray zlibHeader() const;
+
+    static const qint64 kDefaultBlockSize = 256 * 1024;
+    static const int kDictionarySize = 32 * 1024;
+
+private:
+    int _level;
+    int _strategy;
+};
+
+#endif // PARALLELDEFLATE_H
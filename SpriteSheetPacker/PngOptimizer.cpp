@@ -2,30 +2,151 @@
 #include <QtDebug>
 #include <QtCore>
 #include "lodepng.h"
+#include "zlib.h"
 #include <QImage>
+#ifdef SSP_OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+// quantizations running in the process
+QAtomicInt activeQuantizations(0);
+
+// libimagequant runs an OpenMP team of every core per image. Of pages
+// quantized at the same time only the first one gets the team, the others
+// run on their own thread, so the threads stay below cores + pages.
+class QuantizeThreads
+{
+public:
+    QuantizeThreads() {
+        bool alone = (activeQuantizations.fetchAndAddOrdered(1) == 0);
+#ifdef SSP_OPENMP
+        // per calling thread, pool threads are reused so it is always set
+        omp_set_num_threads(alone? QThread::idealThreadCount() : 1);
+#else
+        Q_UNUSED(alone);
+#endif
+    }
+    ~QuantizeThreads() { activeQuantizations.fetchAndAddOrdered(-1); }
+};
+
+struct ZlibTrial {
+    int level;
+    int memLevel;
+    int strategy;
+};
+
+// lodepng hook that deflates with the bundled zlib, which compresses
+// better and faster than the lodepng built in deflate
+unsigned zlibCompress(unsigned char** out, size_t* outsize, const unsigned char* in, size_t insize, const LodePNGCompressSettings* settings) {
+    const ZlibTrial* trial = static_cast<const ZlibTrial*>(settings->custom_context);
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, trial->level, Z_DEFLATED, 15, trial->memLevel, trial->strategy) != Z_OK) {
+        return 111;
+    }
 
-OptiPngOptimizer::OptiPngOptimizer(int optLevel) {
-    _optLevel = optLevel;
+    uLong bound = deflateBound(&stream, insize);
+    *out = (unsigned char*)malloc(bound);
+    if (!*out) {
+        deflateEnd(&stream);
+        return 83;
+    }
+
+    stream.next_in = const_cast<Bytef*>(in);
+    stream.avail_in = insize;
+    stream.next_out = *out;
+    stream.avail_out = bound;
+
+    int status = deflate(&stream, Z_FINISH);
+    *outsize = stream.total_out;
+    deflateEnd(&stream);
+
+    return (status == Z_STREAM_END)? 0 : 111;
+}
 
-    memset(&options, 0, sizeof(options));
+// the brute force filter deflates every row five times with the slow lodepng
+// deflate, above this many pixels it is left out
+const qint64 kBruteForcePixels = 1024 * 1024;
+
+// Encodes pixels described by state.info_raw, trying several filter and
+// deflate strategy combinations (more of them for higher optimization
+// levels) and keeps the smallest result.
+bool encodePng(const unsigned char* pixels, unsigned width, unsigned height, LodePNGState& state, int optLevel, QByteArray& pngData) {
+    QVector<LodePNGFilterStrategy> filters;
+    QVector<int> strategies;
+
+    filters << LFS_MINSUM;
+    strategies << Z_DEFAULT_STRATEGY;
+    if (optLevel >= 1) filters << LFS_ZERO;
+    if (optLevel >= 2) strategies << Z_FILTERED;
+    if (optLevel >= 3) filters << LFS_ENTROPY;
+    if (optLevel >= 4) strategies << Z_RLE;
+    if ((optLevel >= 5) && ((qint64)width * height <= kBruteForcePixels)) filters << LFS_BRUTE_FORCE;
 
-    options.optim_level = _optLevel;
-    options.interlace = -1;
+    state.encoder.add_id = false;
+    state.encoder.filter_palette_zero = 0;
+    state.encoder.zlibsettings.custom_zlib = zlibCompress;
+
+    pngData.clear();
+    for (LodePNGFilterStrategy filter: filters) {
+        for (int strategy: strategies) {
+            // the rows brute force picks hardly depend on the strategy, one trial is enough
+            if ((filter == LFS_BRUTE_FORCE) && (strategy != Z_DEFAULT_STRATEGY)) continue;
+
+            ZlibTrial trial = { Z_BEST_COMPRESSION, (optLevel >= 2)? 9 : 8, strategy };
+            state.encoder.filter_strategy = filter;
+            state.encoder.zlibsettings.custom_context = &trial;
+
+            unsigned char* compressed = NULL;
+            size_t compressedSize = 0;
+            unsigned error = lodepng_encode(&compressed, &compressedSize, pixels, width, height, &state);
+            if (!error && (pngData.isEmpty() || (int)compressedSize < pngData.size())) {
+                pngData = QByteArray((const char*)compressed, (int)compressedSize);
+            }
+            free(compressed);
+        }
+    }
 
-    optimizer = opng_create_optimizer();
-    transformer = opng_create_transformer();
+    return !pngData.isEmpty();
+}
 
-    opng_set_options(optimizer, &options);
+// libimagequant settings for each optimization level (0-6). Low levels
+// quantize fast and accept a lower quality, the highest level is the
+// slowest and keeps the best quality.
+struct QuantizeLevel {
+    int speed;
+    int minQuality;
+    int maxQuality;
+};
+
+const QuantizeLevel quantizeLevels[] = {
+    { 10, 0, 70 },
+    { 8, 0, 75 },
+    { 6, 0, 80 },
+    { 5, 0, 85 },
+    { 4, 0, 90 },
+    { 3, 0, 95 },
+    { 1, 0, 100 },
+};
+
+bool writePng(const QString& fileName, const QByteArray& pngData) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    return file.write(pngData) == pngData.size();
+}
 
-    opng_set_transformer(optimizer, transformer);
 }
 
-OptiPngOptimizer::~OptiPngOptimizer() {
-    opng_destroy_optimizer(optimizer);
-    opng_destroy_transformer(transformer);
+LosslessPngOptimizer::LosslessPngOptimizer(int optLevel) {
+    _optLevel = optLevel;
 }
 
-bool OptiPngOptimizer::optimizeFiles(const QStringList& fileNames) {
+bool LosslessPngOptimizer::optimizeFiles(const QStringList& fileNames) {
 
     for(const QString& fileName : fileNames) {
         if (!optimizeFile(fileName)) {
@@ -36,45 +157,62 @@ bool OptiPngOptimizer::optimizeFiles(const QStringList& fileNames) {
     return true;
 }
 
-bool OptiPngOptimizer::optimizeFile(const QString& fileName) {
+bool LosslessPngOptimizer::optimizeFile(const QString& fileName) {
+    QImage img(fileName);
+    if (img.isNull()) return false;
 
-    if (opng_optimize_file(optimizer,
-                           fileName.toStdString().c_str(),
-                           fileName.toStdString().c_str(),
-                           NULL) == -1) {
+    QByteArray pngData;
+    if (!optimizeImage(img, pngData)) {
         return false;
     }
 
-    return true;
+    return writePng(fileName, pngData);
 }
 
-bool OptiPngOptimizer::setOptions(int optLevel) {
-    _optLevel = optLevel;
+bool LosslessPngOptimizer::optimizeImage(const QImage& image, QByteArray& pngData) {
+    // the lossless reduction (color type, bit depth, palette) is done by lodepng auto_convert
+    QImage rgba = image.convertToFormat(QImage::Format_RGBA8888);
 
-    options.optim_level = _optLevel;
+    LodePNGState state;
+    lodepng_state_init(&state);
+    state.info_raw.colortype = LCT_RGBA;
+    state.info_raw.bitdepth = 8;
+    state.encoder.auto_convert = 1;
 
-    if (opng_set_options(optimizer, &options) < 0) {
-        return false;
-    }
+    bool result = encodePng(rgba.constBits(), rgba.width(), rgba.height(), state, _optLevel, pngData);
 
-    return true;
+    lodepng_state_cleanup(&state);
+
+    return result;
 }
 
-PngQuantOptimizer::PngQuantOptimizer(int optLevel) {
+bool LosslessPngOptimizer::setOptions(int optLevel) {
     _optLevel = optLevel;
+    return true;
+}
 
+PngQuantOptimizer::PngQuantOptimizer(int optLevel) {
     attr = liq_attr_create();
+    image = NULL;
+    res = NULL;
+
+    setOptions(optLevel);
 }
 
 PngQuantOptimizer::~PngQuantOptimizer() {
+    releaseImage();
     liq_attr_destroy(attr);
+}
 
-    if (image) {
-        liq_image_destroy(image);
-    }
-
+void PngQuantOptimizer::releaseImage() {
     if (res) {
         liq_result_destroy(res);
+        res = NULL;
+    }
+
+    if (image) {
+        liq_image_destroy(image);
+        image = NULL;
     }
 }
 
@@ -90,25 +228,34 @@ bool PngQuantOptimizer::optimizeFiles(const QStringList& fileNames) {
 }
 
 bool PngQuantOptimizer::optimizeFile(const QString& fileName) {
-    unsigned int width, height = 0;
-    unsigned char *compressed = NULL;
-    size_t compressed_size = 0;
-
     QImage img(fileName);
-    img = img.convertToFormat(QImage::Format_RGBA8888);
+    if (img.isNull()) return false;
+
+    QByteArray pngData;
+    if (!optimizeImage(img, pngData)) {
+        return false;
+    }
 
-    width = img.width();
-    height = img.height();
+    return writePng(fileName, pngData);
+}
 
-    LodePNGState state;
-    lodepng_state_init(&state);
+bool PngQuantOptimizer::optimizeImage(const QImage& img, QByteArray& pngData) {
+    QImage rgba = img.convertToFormat(QImage::Format_RGBA8888);
 
-    image = liq_image_create_rgba(attr, img.bits(), width, height, 0);
-    liq_set_speed(attr, 1);
+    unsigned int width = rgba.width();
+    unsigned int height = rgba.height();
+
+    // before the image is created, its buffers are sized for the team
+    QuantizeThreads threads;
+    releaseImage();
+    image = liq_image_create_rgba(attr, rgba.constBits(), width, height, 0);
 
     res = liq_quantize_image(attr, image);
 
-    if (!res) return false;
+    if (!res) {
+        releaseImage();
+        return false;
+    }
 
     liq_set_dithering_level(res, 1.0f);
 
@@ -117,41 +264,46 @@ bool PngQuantOptimizer::optimizeFile(const QString& fileName) {
 
     if (liq_write_remapped_image(res, image, buffer, buffer_size) != LIQ_OK) {
         free(buffer);
+        releaseImage();
 
         return false;
     }
 
     const liq_palette* pal = liq_get_palette(res);
 
+    LodePNGState state;
+    lodepng_state_init(&state);
+
     state.info_raw.colortype = LCT_PALETTE;
     state.info_raw.bitdepth = 8;
     state.info_png.color.colortype = LCT_PALETTE;
     state.info_png.color.bitdepth = pal->count <= 16 ? 4 : 8;
     state.encoder.auto_convert = 0;
 
-    // png compression
-    state.encoder.add_id = false;
-    state.encoder.zlibsettings.nicematch = 258;
-    state.encoder.zlibsettings.lazymatching = 1;
-    state.encoder.zlibsettings.windowsize = 32768;
-
     for(unsigned int i = 0; i < pal->count; i++) {
         lodepng_palette_add(&state.info_png.color, pal->entries[i].r, pal->entries[i].g, pal->entries[i].b, pal->entries[i].a);
         lodepng_palette_add(&state.info_raw, pal->entries[i].r, pal->entries[i].g, pal->entries[i].b, pal->entries[i].a);
     }
 
-    lodepng_encode(&compressed, &compressed_size, buffer, width, height, &state);
-    lodepng_save_file(compressed, compressed_size, fileName.toStdString().c_str());
+    bool result = encodePng(buffer, width, height, state, _optLevel, pngData);
 
     lodepng_state_cleanup(&state);
     free(buffer);
-    free(compressed);
+    releaseImage();
 
-    return true;
+    return result;
 }
 
 bool PngQuantOptimizer::setOptions(int optLevel) {
-    _optLevel = optLevel;
+    _optLevel = qBound(0, optLevel, 6);
+
+    const QuantizeLevel& level = quantizeLevels[_optLevel];
+    if (liq_set_speed(attr, level.speed) != LIQ_OK) {
+        return false;
+    }
+    if (liq_set_quality(attr, level.minQuality, level.maxQuality) != LIQ_OK) {
+        return false;
+    }
 
     return true;
 }
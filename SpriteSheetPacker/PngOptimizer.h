@@ -2,38 +2,39 @@
 #define PNGOPTIMIZER_H
 
 #include <QtCore>
-#include "opnglib.h"
+#include <QImage>
 #include "libimagequant.h"
 
 class PngOptimizer {
 public:
     PngOptimizer() {}
-    ~PngOptimizer() {}
+    virtual ~PngOptimizer() {}
 	
 public:
     virtual bool optimizeFiles(const QStringList&) { return true; }
     virtual bool optimizeFile(const QString&) { return true; }
+    // encodes the image straight to optimized PNG bytes, without touching the disk
+    virtual bool optimizeImage(const QImage&, QByteArray&) { return false; }
 
     virtual bool setOptions(int) { return true; }
 };
 
-class OptiPngOptimizer : public PngOptimizer {
+// Lossless re-encoding in memory: reduces the color type, bit depth and
+// palette where no pixel changes, then tries more filter and deflate
+// strategies for higher levels and keeps the smallest PNG.
+class LosslessPngOptimizer : public PngOptimizer {
 
 public:
-    OptiPngOptimizer(int optLevel = 0);
-    ~OptiPngOptimizer();
+    LosslessPngOptimizer(int optLevel = 0);
 
     bool optimizeFiles(const QStringList& fileNames) override;
     bool optimizeFile(const QString& fileName) override;
+    bool optimizeImage(const QImage& image, QByteArray& pngData) override;
 
     bool setOptions(int optLevel) override;
 
 private:
     int _optLevel;
-
-    opng_options options;
-    opng_optimizer_t* optimizer;
-    opng_transformer_t* transformer;
 };
 
 class PngQuantOptimizer : public PngOptimizer {
@@ -44,10 +45,13 @@ public:
 
     bool optimizeFiles(const QStringList& fileNames) override;
     bool optimizeFile(const QString& fileName) override;
+    bool optimizeImage(const QImage& image, QByteArray& pngData) override;
 
     bool setOptions(int optLevel) override;
 
 private:
+    void releaseImage();
+
     int _optLevel;
 
     liq_attr* attr;
@@ -0,0 +1,286 @@
+#include "PngWriter.h"
+#include <QFile>
+#include <QtEndian>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "ImageConverter.h"
+#include "ParallelDeflate.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PNGWRITER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// filtered bytes per IDAT segment, rounded down to whole rows
+const qint64 kSegmentSize = 256 * 1024;
+
+enum Filter {
+    kFilterNone = 0,
+    kFilterSub,
+    kFilterUp,
+    kFilterAverage,
+    kFilterPaeth,
+    kFilterCount
+};
+
+inline int paethPredictor(int a, int b, int c) {
+    int pa = qAbs(b - c);
+    int pb = qAbs(a - c);
+    int pc = qAbs(a + b - 2 * c);
+    if ((pa <= pb) && (pa <= pc)) return a;
+    return (pb <= pc)? b : c;
+}
+
+// Scalar filter for bytes [begin, end) of the row; a and c are zero for the first pixel.
+void filterBytes(int filter, const uint8_t* row, const uint8_t* prior, int begin, int end, int bpp, uint8_t* out) {
+    for (int i = begin; i < end; ++i) {
+        const int a = (i >= bpp)? row[i - bpp] : 0;
+        const int b = prior[i];
+        const int c = (i >= bpp)? prior[i - bpp] : 0;
+        int predictor = 0;
+        switch (filter) {
+            case kFilterSub: predictor = a; break;
+            case kFilterUp: predictor = b; break;
+            case kFilterAverage: predictor = (a + b) >> 1; break;
+            case kFilterPaeth: predictor = paethPredictor(a, b, c); break;
+            default: break;
+        }
+        out[i] = (uint8_t)(row[i] - predictor);
+    }
+}
+
+#ifdef PNGWRITER_SSE2
+inline __m128i select(__m128i mask, __m128i ifTrue, __m128i ifFalse) {
+    return _mm_or_si128(_mm_and_si128(mask, ifTrue), _mm_andnot_si128(mask, ifFalse));
+}
+
+inline __m128i abs16(__m128i value) {
+    return _mm_max_epi16(value, _mm_sub_epi16(_mm_setzero_si128(), value));
+}
+
+// Paeth predictor of 8 pixels bytes widened to 16 bit
+inline __m128i paeth16(__m128i a, __m128i b, __m128i c) {
+    __m128i pa = abs16(_mm_sub_epi16(b, c));
+    __m128i pb = abs16(_mm_sub_epi16(a, c));
+    __m128i pc = abs16(_mm_add_epi16(_mm_sub_epi16(a, c), _mm_sub_epi16(b, c)));
+    __m128i notA = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+    __m128i bOrC = select(_mm_cmpgt_epi16(pb, pc), c, b);
+    return select(notA, bOrC, a);
+}
+#endif
+
+void filterRow(int filter, const uint8_t* row, const uint8_t* prior, int bytes, int bpp, uint8_t* out) {
+    if (filter == kFilterNone) {
+        memcpy(out, row, bytes);
+        return;
+    }
+
+    // the first pixel has no left neighbour
+    const int first = qMin(bpp, bytes);
+    filterBytes(filter, row, prior, 0, first, bpp, out);
+    int i = first;
+
+#ifdef PNGWRITER_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i - bpp));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prior + i));
+        __m128i predictor;
+        switch (filter) {
+            case kFilterSub:
+                predictor = a;
+                break;
+            case kFilterUp:
+                predictor = b;
+                break;
+            case kFilterAverage:
+                // _mm_avg_epu8 rounds up, PNG rounds down
+                predictor = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+                break;
+            default: {
+                __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prior + i - bpp));
+                __m128i low = paeth16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+                __m128i high = paeth16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+                predictor = _mm_packus_epi16(low, high);
+                break;
+            }
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_sub_epi8(x, predictor));
+    }
+#endif
+
+    filterBytes(filter, row, prior, i, bytes, bpp, out);
+}
+
+// Sum of the filtered bytes taken as signed values, the libpng filter heuristic.
+quint64 sumOfAbsolutes(const uint8_t* data, int bytes) {
+    quint64 sum = 0;
+    int i = 0;
+#ifdef PNGWRITER_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128i total = zero;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        // |signed byte| is min(value, 256 - value) as unsigned bytes
+        __m128i magnitude = _mm_min_epu8(value, _mm_sub_epi8(zero, value));
+        total = _mm_add_epi64(total, _mm_sad_epu8(magnitude, zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), total);
+    sum = lanes[0] + lanes[1];
+#endif
+    for (; i < bytes; ++i) {
+        sum += (data[i] < 128)? data[i] : 256 - data[i];
+    }
+    return sum;
+}
+
+// Appends the filter type byte and the filtered bytes of rows [top, bottom).
+void appendFilteredRows(const QImage& image, int bpp, int top, int bottom, QByteArray& data) {
+    const int bytes = image.width() * bpp;
+    const std::vector<uint8_t> zeroRow(bytes, 0);
+    std::vector<uint8_t> candidates(bytes * kFilterCount);
+
+    int offset = data.size();
+    data.resize(offset + (bottom - top) * (bytes + 1));
+    for (int y = top; y < bottom; ++y) {
+        const uint8_t* row = image.constScanLine(y);
+        const uint8_t* prior = (y > 0)? image.constScanLine(y - 1) : zeroRow.data();
+
+        int best = kFilterNone;
+        quint64 bestSum = 0;
+        for (int filter = kFilterNone; filter < kFilterCount; ++filter) {
+            uint8_t* out = candidates.data() + filter * bytes;
+            filterRow(filter, row, prior, bytes, bpp, out);
+            quint64 sum = sumOfAbsolutes(out, bytes);
+            if ((filter == kFilterNone) || (sum < bestSum)) {
+                best = filter;
+                bestSum = sum;
+            }
+        }
+
+        data[offset] = (char)best;
+        memcpy(data.data() + offset + 1, candidates.data() + best * bytes, bytes);
+        offset += bytes + 1;
+    }
+}
+
+void appendBigEndian(QByteArray& data, quint32 value) {
+    quint32 be = qToBigEndian<quint32>(value);
+    data.append(reinterpret_cast<const char*>(&be), sizeof(be));
+}
+
+bool writeChunk(QIODevice* device, const char* type, const QByteArray& data) {
+    QByteArray chunk;
+    appendBigEndian(chunk, data.size());
+    chunk.append(type, 4);
+    chunk.append(data);
+    // the CRC covers the type and the data
+    appendBigEndian(chunk, crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(chunk.constData() + 4), chunk.size() - 4));
+    return device->write(chunk) == chunk.size();
+}
+
+}
+
+PngWriter::PngWriter(int compressionLevel)
+    : _compressionLevel(compressionLevel)
+{
+
+}
+
+bool PngWriter::write(const QString& fileName, const QImage& image, QString* errorString) {
+    if (image.isNull()) {
+        *errorString = QString("Can't write %1: empty image").arg(fileName);
+        return false;
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        *errorString = QString("Can't write %1: %2").arg(fileName).arg(file.errorString());
+        return false;
+    }
+    if (!write(&file, image, errorString)) {
+        *errorString = QString("Can't write %1: %2").arg(fileName).arg(*errorString);
+        return false;
+    }
+    return true;
+}
+
+bool PngWriter::write(QIODevice* device, const QImage& image, QString* errorString) {
+    if (image.isNull()) {
+        *errorString = "empty image";
+        return false;
+    }
+
+    // PNG color type and bytes per pixel of the rows as QImage stores them
+    QImage source;
+    int colorType;
+    int bpp;
+    if (image.format() == QImage::Format_Grayscale8) {
+        source = image;
+        colorType = 0;
+        bpp = 1;
+    } else if (image.hasAlphaChannel()) {
+        source = ImageConverter::toStraightRgba(image);
+        colorType = 6;
+        bpp = 4;
+    } else {
+        source = image.convertToFormat(QImage::Format_RGB888);
+        colorType = 2;
+        bpp = 3;
+    }
+
+    QByteArray ihdr;
+    appendBigEndian(ihdr, source.width());
+    appendBigEndian(ihdr, source.height());
+    ihdr.append((char)8);           // bit depth
+    ihdr.append((char)colorType);
+    ihdr.append(QByteArray(3, '\0'));   // deflate, adaptive filtering, no interlace
+
+    bool success = (device->write("\x89PNG\r\n\x1a\n", 8) == 8) && writeChunk(device, "IHDR", ihdr);
+
+    if (success && (source.dotsPerMeterX() > 0) && (source.dotsPerMeterY() > 0)) {
+        QByteArray phys;
+        appendBigEndian(phys, source.dotsPerMeterX());
+        appendBigEndian(phys, source.dotsPerMeterY());
+        phys.append((char)1);   // meters
+        success = writeChunk(device, "pHYs", phys);
+    }
+
+    // segments of whole rows; a segment refilters the rows in front of it that prime its dictionary
+    const int rowSize = source.width() * bpp + 1;
+    const int rowsPerSegment = qMax<int>(1, kSegmentSize / rowSize);
+    const int dictionaryRows = (ParallelDeflate::kDictionarySize + rowSize - 1) / rowSize;
+    const int segments = (source.height() + rowsPerSegment - 1) / rowsPerSegment;
+
+    // libpng compresses filtered rows with Z_FILTERED as well
+    ParallelDeflate deflater(_compressionLevel, Z_FILTERED);
+    success = success && deflater.compress(segments, [&](int index) {
+        const int top = index * rowsPerSegment;
+        const int bottom = qMin(top + rowsPerSegment, source.height());
+        const int dictionaryTop = qMax(0, top - dictionaryRows);
+
+        QByteArray rows;
+        appendFilteredRows(source, bpp, dictionaryTop, bottom, rows);
+        const int dictionaryBytes = (top - dictionaryTop) * rowSize;
+        const int dictionarySize = qMin(dictionaryBytes, ParallelDeflate::kDictionarySize);
+
+        ParallelDeflate::Segment segment;
+        segment.dictionary = rows.mid(dictionaryBytes - dictionarySize, dictionarySize);
+        segment.data = rows.mid(dictionaryBytes);
+        return segment;
+    }, [&](const QByteArray& data) {
+        return writeChunk(device, "IDAT", data);
+    });
+
+    success = success && writeChunk(device, "IEND", QByteArray());
+    if (!success) {
+        *errorString = device->errorString();
+    }
+    return success;
+}
@@ -2,6 +2,7 @@
 #include "PolygonImage.h"
 #include "clipper.hpp"
 #include "poly2tri.h"
+#include "Trace.h"
 
 const static float PRECISION = 10.f;
 
@@ -21,6 +22,8 @@ PolygonImage::PolygonImage(const QImage& image, const QRectF& rect, const float
     , _height(image.height())
     , _threshold(threshold)
 {
+    // triangulate is a nested event of the trace
+    TRACE_SCOPE("polygon trace");
     _image = image.convertToFormat(QImage::Format_RGBA8888);
 
     QRectF realRect = rect;
@@ -124,6 +127,7 @@ PolygonImage::PolygonImage(const QImage& image, const QRectF& rect, const float
     }
 
     // triangulate polygon(s)
+    TRACE_SCOPE_DETAIL("triangulate", QString("%1 polygons").arg(_polygons.size()));
     auto it_p1 = _polygons.begin();
     while (it_p1 != _polygons.end()) {
         auto tri = triangulate((*it_p1));
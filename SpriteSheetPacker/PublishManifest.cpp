@@ -0,0 +1,141 @@
+#include "PublishManifest.h"
+
+namespace {
+
+// bumped when the manifest layout changes, older manifests are ignored
+const int kManifestVersion = 1;
+
+// held while the manifest of a folder is read, merged and written
+QMutex& directoryMutex(const QString& directory) {
+    static QMutex mutex;
+    static QHash<QString, QSharedPointer<QMutex>> mutexes;
+    QMutexLocker locker(&mutex);
+    QSharedPointer<QMutex>& directoryMutex = mutexes[QDir(directory).absolutePath()];
+    if (!directoryMutex) {
+        directoryMutex.reset(new QMutex);
+    }
+    return *directoryMutex;
+}
+
+}
+
+PublishManifest::PublishManifest(const QString& directory)
+    : _directory(directory)
+{
+
+}
+
+QString PublishManifest::fileName(const QString& directory) {
+    return QDir(directory).filePath(".spritesheetpacker-manifest.json");
+}
+
+bool PublishManifest::load() {
+    _entries.clear();
+    _changed.clear();
+
+    QFile file(fileName(_directory));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QJsonObject json = QJsonDocument::fromJson(file.readAll()).object();
+    if (json["version"].toInt() != kManifestVersion) {
+        return false;
+    }
+
+    QJsonObject outputs = json["outputs"].toObject();
+    for (auto it = outputs.constBegin(); it != outputs.constEnd(); ++it) {
+        QJsonObject output = it.value().toObject();
+        Entry entry;
+        entry.hash = QByteArray::fromHex(output["hash"].toString().toLatin1());
+        QJsonObject files = output["files"].toObject();
+        for (auto it_file = files.constBegin(); it_file != files.constEnd(); ++it_file) {
+            entry.fileSizes[it_file.key()] = (qint64)it_file.value().toDouble();
+        }
+        _entries[it.key()] = entry;
+    }
+    return true;
+}
+
+bool PublishManifest::save(QString* errorString) const {
+    QJsonObject outputs;
+    for (auto it = _entries.cbegin(); it != _entries.cend(); ++it) {
+        QJsonObject files;
+        for (auto it_file = it.value().fileSizes.cbegin(); it_file != it.value().fileSizes.cend(); ++it_file) {
+            files[it_file.key()] = (double)it_file.value();
+        }
+        QJsonObject output;
+        output["hash"] = QString::fromLatin1(it.value().hash.toHex());
+        output["files"] = files;
+        outputs[it.key()] = output;
+    }
+
+    QJsonObject json;
+    json["version"] = kManifestVersion;
+    json["outputs"] = outputs;
+
+    QFile file(fileName(_directory));
+    QByteArray data = QJsonDocument(json).toJson();
+    // an unchanged publish leaves the manifest untouched too
+    if (file.open(QIODevice::ReadOnly) && (file.readAll() == data)) {
+        return true;
+    }
+    file.close();
+    // written next to it and renamed, readers never see half a manifest
+    QSaveFile saveFile(file.fileName());
+    if (!saveFile.open(QIODevice::WriteOnly) || (saveFile.write(data) != data.size()) || !saveFile.commit()) {
+        *errorString = QString("Can't write %1: %2").arg(saveFile.fileName()).arg(saveFile.errorString());
+        qDebug() << *errorString;
+        return false;
+    }
+    return true;
+}
+
+bool PublishManifest::saveChanges(QString* errorString) {
+    QMutexLocker locker(&directoryMutex(_directory));
+
+    PublishManifest current(_directory);
+    current.load();
+    for (const QString& key: _changed) {
+        auto it = _entries.find(key);
+        if (it != _entries.end()) {
+            current._entries[key] = it.value();
+        } else {
+            current._entries.remove(key);
+        }
+    }
+    if (!current.save(errorString)) {
+        return false;
+    }
+
+    _entries = current._entries;
+    _changed.clear();
+    return true;
+}
+
+bool PublishManifest::upToDate(const QString& key, const QByteArray& hash) const {
+    auto it = _entries.find(key);
+    if ((it == _entries.end()) || hash.isEmpty() || (it.value().hash != hash) || it.value().fileSizes.isEmpty()) {
+        return false;
+    }
+
+    QDir dir(_directory);
+    for (auto it_file = it.value().fileSizes.cbegin(); it_file != it.value().fileSizes.cend(); ++it_file) {
+        QFileInfo fileInfo(dir.filePath(it_file.key()));
+        if (!fileInfo.isFile() || (fileInfo.size() != it_file.value())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void PublishManifest::insert(const QString& key, const QByteArray& hash, const QStringList& filePaths) {
+    QDir dir(_directory);
+    Entry entry;
+    entry.hash = hash;
+    for (const QString& filePath: filePaths) {
+        entry.fileSizes[dir.relativeFilePath(filePath)] = QFileInfo(filePath).size();
+    }
+    _entries[key] = entry;
+    _changed.insert(key);
+}
@@ -0,0 +1,46 @@
+#ifndef PUBLISHMANIFEST_H
+#define PUBLISHMANIFEST_H
+
+#include <QtCore>
+
+// What earlier publishes wrote into one folder: for every output (the
+// image or the data file of a page) the hash of the pixels, frames and
+// settings it was made from, and the files it produced with their sizes.
+// An output whose hash matches and whose files are still there as they
+// were written is neither encoded nor written again, so its files keep
+// their modification times.
+class PublishManifest
+{
+public:
+    explicit PublishManifest(const QString& directory = QString());
+
+    // the manifest file in directory
+    static QString fileName(const QString& directory);
+
+    // false when there is no manifest yet or it is unreadable, it is empty then
+    bool load();
+    bool save(QString* errorString) const;
+    // Writes only the outputs inserted and removed since load() to the
+    // manifest as it is on disk now: it is reloaded, merged and saved under
+    // a lock of the folder, so publishers of one folder that run at the same
+    // time (the projects of a batch) keep each other's outputs.
+    bool saveChanges(QString* errorString);
+
+    bool upToDate(const QString& key, const QByteArray& hash) const;
+    void insert(const QString& key, const QByteArray& hash, const QStringList& filePaths);
+    void remove(const QString& key) { _entries.remove(key); _changed.insert(key); }
+
+private:
+    struct Entry {
+        QByteArray            hash;
+        // relative to the directory
+        QMap<QString, qint64> fileSizes;
+    };
+
+    QString              _directory;
+    QMap<QString, Entry> _entries;
+    // keys inserted or removed since load()
+    QSet<QString>        _changed;
+};
+
+#endif // PUBLISHMANIFEST_H
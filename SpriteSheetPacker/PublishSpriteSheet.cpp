@@ -1,149 +1,139 @@
 #include "PublishSpriteSheet.h"
 #include "SpritePackerProjectFile.h"
 #include "SpriteAtlas.h"
-#include "PListSerializer.h"
-#include <QMessageBox>
 #include "PngOptimizer.h"
+#include "TextureEncoder.h"
+#include "TextureContainer.h"
+#include "CczWriter.h"
+#include "PngWriter.h"
+#include "DataFileExporter.h"
+#include "JsonWriter.h"
+#include "PListWriter.h"
+#include "ScriptExporter.h"
+#include "Trace.h"
 #include "PVRTexture.h"
 #include "PVRTextureUtilities.h"
 
-/////////////////////////////////////////////////////////////////////////////////////////////
-unsigned int checksumPvr(const unsigned int *data, unsigned int len) {
-    unsigned int cs = 0;
-    const int cslen = 128;
-
-    len = (len < cslen) ? len : cslen;
-
-    for(unsigned int i = 0; i < len; i++) {
-        cs = cs ^ data[i];
-    }
-
-    return cs;
-}
-
-void encodePvr(unsigned int *data, unsigned int len, unsigned int keys[4]) {
-    unsigned int encryptionKey[1024];
-    memset(encryptionKey, 0, sizeof(encryptionKey));
-
-    bool s_bEncryptionKeyIsValid = false;
-
-    const int enclen = 1024;
-    const int securelen = 512;
-    const int distance = 64;
-
-    // create long key
-    if(!s_bEncryptionKeyIsValid) {
-        unsigned int y, p, e;
-        unsigned int rounds = 6;
-        unsigned int sum = 0;
-        unsigned int z = encryptionKey[enclen-1];
-
-        do {
-#define DELTA 0x9e3779b9
-#define MX (((z>>5^y<<2) + (y>>3^z<<4)) ^ ((sum^y) + (keys[(p&3)^e] ^ z)))
-
-            sum += DELTA;
-            e = (sum >> 2) & 3;
-
-            for (p = 0; p < enclen - 1; p++)
-            {
-                y = encryptionKey[p + 1];
-                z = encryptionKey[p] += MX;
-            }
-
-            y = encryptionKey[0];
-            z = encryptionKey[enclen - 1] += MX;
-
-        } while (--rounds);
-
-        s_bEncryptionKeyIsValid = true;
-    }
-
-    int b = 0;
-    unsigned int i = 0;
-
-    // encrypt first part completely
-    for(; i < len && i < securelen; i++) {
-        data[i] ^= encryptionKey[b++];
-
-        if(b >= enclen) {
-            b = 0;
-        }
-    }
+using namespace pvrtexture;
 
-    // encrypt second section partially
-    for(; i < len; i += distance) {
-        data[i] ^= encryptionKey[b++];
+QMap<QString, QString> PublishSpriteSheet::_formats;
 
-        if(b >= enclen) {
-            b = 0;
+// PVR v3 header and meta data of the texture, as CPVRTexture::saveFile writes them
+QByteArray pvrFileHeader(const CPVRTexture& texture) {
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    PVRTextureHeaderV3 header = texture.getFileHeader();
+    stream << header.u32Version << header.u32Flags << header.u64PixelFormat << header.u32ColourSpace << header.u32ChannelType
+           << header.u32Height << header.u32Width << header.u32Depth << header.u32NumSurfaces << header.u32NumFaces
+           << header.u32MIPMapCount << header.u32MetaDataSize;
+
+    const MetaDataMap* metaDataMap = texture.getMetaDataMap();
+    for (uint32 i = 0; i < metaDataMap->GetSize(); ++i) {
+        const CPVRTMap<uint32, MetaDataBlock>* blocks = metaDataMap->GetDataAtIndex(i);
+        for (uint32 j = 0; j < blocks->GetSize(); ++j) {
+            const MetaDataBlock* block = blocks->GetDataAtIndex(j);
+            stream << block->DevFOURCC << block->u32Key << block->u32DataSize;
+            stream.writeRawData(reinterpret_cast<const char*>(block->Data), block->u32DataSize);
         }
     }
+    return data;
 }
-/////////////////////////////////////////////////////////////////////////////////////////////
-
-using namespace pvrtexture;
-
-QMap<QString, QString> PublishSpriteSheet::_formats;
 
 QString imagePrefix(ImageFormat imageFormat) {
     switch (imageFormat) {
         case kPNG: return ".png";
         case kWEBP: return ".webp";
         case kJPG: return ".jpg";
-        case kPKM: return ".pvr";
+        case kPKM: return ".pkm";
         case kPVR: return ".pvr";
         case kPVR_CCZ: return ".pvr.ccz";
+        case kASTC: return ".astc";
+        case kKTX: return ".ktx";
+        case kKTX2: return ".ktx2";
         default: return ".png";
     }
 }
 
-QJSValue jsValue(QJSEngine& engine, const QRect& rect) {
-    QJSValue value = engine.newObject();
-    value.setProperty("x", rect.left());
-    value.setProperty("y", rect.top());
-    value.setProperty("width", rect.width());
-    value.setProperty("height", rect.height());
-    return value;
+// the pixel formats PVRTexLib writes to PVR files: PVRTC, and the
+// uncompressed ones as 8 bit RGBA; the others have a built-in encoder
+bool pvrTexLibWrites(PixelFormat pixelFormat) {
+    switch (pixelFormat) {
+        case kARGB8888:
+        case kARGB8565:
+        case kARGB4444:
+        case kRGB888:
+        case kRGB565:
+        case kALPHA:
+        case kPVRTC2:
+        case kPVRTC2A:
+        case kPVRTC4:
+        case kPVRTC4A:
+            return true;
+        default:
+            return false;
+    }
+}
+
+QString PublishSpriteSheet::defaultFormatsFolder() {
+    return QCoreApplication::applicationDirPath() + "/defaultFormats";
+}
+
+void PublishSpriteSheet::loadFormats(const QStringList& formatsFolders) {
+    _formats.clear();
+    // formats without a script, a script with the same name replaces them
+    for (const QString& format: DataFileExporter::nativeFormats()) {
+        _formats[format] = QString();
+    }
+
+    for (auto folder: formatsFolders) {
+        if (QDir(folder).exists()) {
+            QDirIterator fileNames(folder, QStringList() << "*.js", QDir::Files | QDir::NoSymLinks | QDir::NoDotAndDotDot);
+            while(fileNames.hasNext()) {
+                fileNames.next();
+                addFormat(fileNames.fileInfo().baseName(), fileNames.filePath());
+            }
+        }
+    }
 }
 
-QJSValue jsValue(QJSEngine& engine, const QSize& size) {
-    QJSValue value = engine.newObject();
-    value.setProperty("width", size.width());
-    value.setProperty("height", size.height());
-    return value;
+void writeJson(JsonWriter& writer, const QString& key, const QRect& rect) {
+    writer.beginObject(key);
+    writer.value("x", rect.left());
+    writer.value("y", rect.top());
+    writer.value("width", rect.width());
+    writer.value("height", rect.height());
+    writer.end();
 }
 
-QJSValue jsValue(QJSEngine& engine, const QPoint& point) {
-    QJSValue value = engine.newObject();
-    value.setProperty("x", point.x());
-    value.setProperty("y", point.y());
-    return value;
+void writeJson(JsonWriter& writer, const QString& key, const QSize& size) {
+    writer.beginObject(key);
+    writer.value("width", size.width());
+    writer.value("height", size.height());
+    writer.end();
 }
 
-QJSValue jsValue(QJSEngine& engine, const Triangles& triangles) {
-    QJSValue value = engine.newObject();
+void writeJson(JsonWriter& writer, const QString& key, const QPoint& point) {
+    writer.beginObject(key);
+    writer.value("x", point.x());
+    writer.value("y", point.y());
+    writer.end();
+}
 
-    int index = 0;
-    QJSValue verts = engine.newArray(triangles.verts.size());
+void writeJson(JsonWriter& writer, const QString& key, const Triangles& triangles) {
+    writer.beginObject(key);
+    writer.beginArray("verts");
     for (auto vert: triangles.verts) {
-        verts.setProperty(index, jsValue(engine, vert));
-        ++index;
+        writeJson(writer, QString(), vert);
     }
-    value.setProperty("verts", verts);
-
-    index = 0;
-    QJSValue indices = engine.newArray(triangles.indices.size());
+    writer.end();
+    writer.beginArray("indices");
     for (auto idx: triangles.indices) {
-        indices.setProperty(index, idx);
-        ++index;
+        writer.value(QString(), (int)idx);
     }
-    value.setProperty("indices", indices);
-    return value;
-}
-
-void JSConsole::log(QString msg) {
-    qDebug() << "js:"<< msg;
+    writer.end();
+    writer.end();
 }
 
 
@@ -151,6 +141,13 @@ PublishSpriteSheet::PublishSpriteSheet() {
     _imageFormat = kPNG;
     _pixelFormat = kARGB8888;
     _premultiplied = true;
+    _dithering = kDitherNone;
+    _textureQuality = kTextureNormal;
+    _supercompression = kSupercompressionZlib;
+    _mipmaps = false;
+    _maxConcurrentPages = QThread::idealThreadCount();
+    _pageSemaphore = nullptr;
+    _skipUnchanged = true;
     _webpQuality = 80;
     _jpgQuality = 80;
 
@@ -163,315 +160,558 @@ void PublishSpriteSheet::addSpriteSheet(const SpriteAtlas &atlas, const QString
     _fileNames.append(fileName);
 }
 
-bool PublishSpriteSheet::publish(const QString& format, bool errorMessage) {
+QString PublishSpriteSheet::pageFilePath(const QString& filePath, int page, int pages) {
+    QString outputFilePath = filePath;
+    if (outputFilePath.contains("{n}")) {
+        outputFilePath.replace("{n}", QString::number(page));
+    } else if (outputFilePath.contains("{n1}")) {
+        outputFilePath.replace("{n1}", QString::number(page + 1));
+    } else if (pages > 1) {
+        outputFilePath = outputFilePath + "_" + QString::number(page);
+    }
+    return outputFilePath;
+}
+
+QStringList PublishSpriteSheet::imageFiles() const {
+    QStringList files;
+    for (int i = 0; i < _spriteAtlases.size(); i++) {
+        const int pages = _spriteAtlases.at(i).outputData().size();
+        for (int n = 0; n < pages; ++n) {
+            files += imageFilePaths(pageFilePath(_fileNames.at(i), n, pages));
+        }
+    }
+    return files;
+}
+
+bool PublishSpriteSheet::publish(const QString& format) {
 
     if (_spriteAtlases.size() != _fileNames.size()) {
         return false;
     }
 
-    QStringList outputFilePaths;
+    QElapsedTimer publishTimer;
+    publishTimer.start();
+
+    // custom export scripts are evaluated again once per worker thread
+    ScriptExporter::reset();
+
+    QVector<PublishTask> tasks;
     for (int i = 0; i < _spriteAtlases.size(); i++) {
         const SpriteAtlas& atlas = _spriteAtlases.at(i);
         const QString& filePath = _fileNames.at(i);
 
         for (int n=0; n<atlas.outputData().size(); ++n) {
-            const auto& outputData = atlas.outputData().at(n);
-
-            QString outputFilePath = filePath;
-            if (outputFilePath.contains("{n}")) {
-                outputFilePath.replace("{n}", QString::number(n));
-            } else if (outputFilePath.contains("{n1}")) {
-                outputFilePath.replace("{n1}", QString::number(n + 1));
-            } else if (atlas.outputData().size() > 1) {
-                outputFilePath = outputFilePath + "_" + QString::number(n);
-            }
-
-            // save this name for optimize png
-            outputFilePaths.push_back(outputFilePath);
+            PublishTask task;
+            task.atlasIndex = i;
+            task.page = n;
+            task.outputFilePath = pageFilePath(filePath, n, atlas.outputData().size());
+            task.manifest = nullptr;
+            tasks.push_back(task);
+        }
+    }
 
-            // generate the data file and the image
-            if (!format.isEmpty() && !generateDataFile(outputFilePath, format, outputData._spriteFrames, outputData._atlasImage, errorMessage)) {
-                return false;
-            }
+    // one manifest per output folder, only read while the pages are published
+    QMap<QString, PublishManifest> manifests;
+    for (const PublishTask& task: tasks) {
+        QString directory = QFileInfo(task.outputFilePath).absolutePath();
+        if (!manifests.contains(directory)) {
+            PublishManifest manifest(directory);
+            manifest.load();
+            manifests.insert(directory, manifest);
+        }
+    }
+    if (_skipUnchanged) {
+        for (PublishTask& task: tasks) {
+            task.manifest = &manifests.find(QFileInfo(task.outputFilePath).absolutePath()).value();
+        }
+    }
 
-            // save image
-            QString fileName = outputFilePath + imagePrefix(_imageFormat);
-            qDebug() << "Save image:" << fileName;
-            if ((_imageFormat == kPNG) || (_imageFormat == kWEBP) || (_imageFormat == kJPG) || (_imageFormat == kJPG_PNG)) {
-                QImage image = convertImage(outputData._atlasImage, _pixelFormat, _premultiplied);
-                if (_imageFormat == kPNG) {
-                    QImageWriter writer(outputFilePath + imagePrefix(kPNG), "png");
-                    writer.setOptimizedWrite(true);
-                    writer.setCompression(100);
-                    writer.setQuality(0);
-                    writer.write(image);
-                } else if (_imageFormat == kWEBP) {
-                    QImageWriter writer(outputFilePath + imagePrefix(kWEBP), "webp");
-                    writer.setOptimizedWrite(true);
-                    writer.setCompression(100);
-                    writer.setQuality(_webpQuality);
-                    writer.write(image);
-                } else if ((_imageFormat == kJPG) || (_imageFormat == kJPG_PNG)) {
-                    QImageWriter writer(outputFilePath + imagePrefix(kJPG), "jpg");
-                    writer.setOptimizedWrite(true);
-                    writer.setCompression(100);
-                    writer.setQuality(_jpgQuality);
-                    writer.write(image);
-
-                    if (_imageFormat == kJPG_PNG) {
-                        QImage maskImage = convertImage(outputData._atlasImage, kALPHA, _premultiplied);
-                        QImageWriter writer(outputFilePath + imagePrefix(kPNG), "png");
-                        writer.setOptimizedWrite(true);
-                        writer.setCompression(100);
-                        writer.setQuality(0);
-                        writer.write(maskImage);
-                    }
-                }
-            } else if ((_imageFormat == kPKM) || (_imageFormat == kPVR) || (_imageFormat == kPVR_CCZ)) {
-                CPVRTextureHeader pvrHeader(PVRStandard8PixelType.PixelTypeID,
-                                            outputData._atlasImage.height(),
-                                            outputData._atlasImage.width());
-                // create the texture
-                CPVRTexture pvrTexture(pvrHeader, outputData._atlasImage.bits());
-                switch (_pixelFormat) {
-                    case kETC1: Transcode(pvrTexture, PixelType(ePVRTPF_ETC1), ePVRTVarTypeUnsignedByteNorm, ePVRTCSpacelRGB, eETCFast, true); break;
-                    case kETC2: Transcode(pvrTexture, PixelType(ePVRTPF_ETC2_RGB), ePVRTVarTypeUnsignedByteNorm, ePVRTCSpacelRGB, eETCFast, true); break;
-                    case kETC2A: Transcode(pvrTexture, PixelType(ePVRTPF_ETC2_RGBA), ePVRTVarTypeUnsignedByteNorm, ePVRTCSpacelRGB, eETCFast, true); break;
-                    case kPVRTC2: Transcode(pvrTexture, PixelType(ePVRTPF_PVRTCI_2bpp_RGB), ePVRTVarTypeUnsignedByteNorm, ePVRTCSpacelRGB, ePVRTCBest, true); break;
-                    case kPVRTC2A: Transcode(pvrTexture, PixelType(ePVRTPF_PVRTCI_2bpp_RGBA), ePVRTVarTypeUnsignedByteNorm, ePVRTCSpacelRGB, ePVRTCBest, true); break;
-                    case kPVRTC4: Transcode(pvrTexture, PixelType(ePVRTPF_PVRTCI_4bpp_RGB), ePVRTVarTypeUnsignedByteNorm, ePVRTCSpacelRGB, ePVRTCBest, true); break;
-                    case kPVRTC4A: Transcode(pvrTexture, PixelType(ePVRTPF_PVRTCI_4bpp_RGBA), ePVRTVarTypeUnsignedByteNorm, ePVRTCSpacelRGB, ePVRTCBest, true); break;
-                    case kDXT1: Transcode(pvrTexture, PixelType(ePVRTPF_DXT1), ePVRTVarTypeUnsignedByteNorm, ePVRTCSpacelRGB, ePVRTCBest, true); break;
-                    case kDXT3: Transcode(pvrTexture, PixelType(ePVRTPF_DXT3), ePVRTVarTypeUnsignedByteNorm, ePVRTCSpacelRGB, ePVRTCBest, true); break;
-                    case kDXT5: Transcode(pvrTexture, PixelType(ePVRTPF_DXT5), ePVRTVarTypeUnsignedByteNorm, ePVRTCSpacelRGB, ePVRTCBest, true); break;
-                    default: break;
-                }
-
-                qDebug() << "Transcode complete.";
-                // save the file
-                if (_imageFormat == kPVR_CCZ) {
-                    QString tempFileName = outputFilePath + "_temp.pvr";
-                    pvrTexture.saveFile(tempFileName.toStdString().c_str());
-
-                    // read and compress
-                    QFile file(tempFileName);
-                    file.open(QIODevice::ReadOnly);
-                    unsigned int uncompressedLen = file.size();
-                    QByteArray compressedData = qCompress(file.readAll());
-                    file.close();
-                    QFile::remove(tempFileName);
-
-                    //  Strip the first six bytes (a 4-byte length put on by qCompress)
-                    compressedData.remove(0, 4);
-
-                    struct CCZHeader {
-                        unsigned char   sig[4];             /** Signature. Should be 'CCZ!' 4 bytes. */
-                        unsigned short  compression_type;   /** Should be 0. */
-                        unsigned short  version;            /** Should be 2 (although version type==1 is also supported). */
-                        unsigned int    reserved;           /** Reserved for users. */
-                        unsigned int    len;                /** Size of the uncompressed file. */
-                    };
-
-                    CCZHeader cczHeader;
-                    cczHeader.sig[0] = 'C';
-                    cczHeader.sig[1] = 'C';
-                    cczHeader.sig[2] = 'Z';
-                    cczHeader.sig[3] = _encryptionKey.isEmpty()? '!':'p';
-                    cczHeader.compression_type = qToBigEndian<unsigned short>(0);
-                    cczHeader.version = qToBigEndian<unsigned short>(0);
-                    cczHeader.reserved = qToBigEndian<unsigned int>(0);
-                    cczHeader.len = qToBigEndian<unsigned int>(uncompressedLen);
-
-                    compressedData.insert(0, QByteArray((const char *)&cczHeader, sizeof(CCZHeader)));
-
-                    // encrypt
-                    if (!_encryptionKey.isEmpty()) {
-                        QString key = _encryptionKey;
-                        uint32_t keys[4];
-                        keys[0] = key.left(8).toUInt(nullptr, 16); key.remove(0, 8);
-                        keys[1] = key.left(8).toUInt(nullptr, 16); key.remove(0, 8);
-                        keys[2] = key.left(8).toUInt(nullptr, 16); key.remove(0, 8);
-                        keys[3] = key.left(8).toUInt(nullptr, 16); key.remove(0, 8);
-
-                        unsigned int* ints = (unsigned int*)(compressedData.data()+12);
-                        unsigned int enclen = (compressedData.length()-12)/4;
-
-                        CCZHeader* header = (CCZHeader*)compressedData.data();
-                        header->reserved = qToBigEndian<unsigned int>(checksumPvr(ints, enclen));
-
-                        encodePvr(ints, enclen, keys);
-                    }
-
-                    // write compressed data
-                    file.setFileName(fileName);
-                    file.open(QIODevice::WriteOnly);
-                    file.write(compressedData);
-                    file.close();
-                } else {
-                    pvrTexture.saveFile(fileName.toStdString().c_str());
-                }
-                qDebug() << "Write to file complete.";
+    // every page of every scaling variant is independent: run them on the shared pool
+    QSemaphore ownPageSemaphore(_maxConcurrentPages);
+    QSemaphore* pageSemaphore = _pageSemaphore? _pageSemaphore : &ownPageSemaphore;
+    std::function<PublishTaskResult(const PublishTask&)> publishTask = [this, &format, pageSemaphore](const PublishTask& task) {
+        return publishPage(task, format, pageSemaphore);
+    };
+    _publishResults = QtConcurrent::blockingMapped<QVector<PublishTaskResult>>(tasks, publishTask);
+
+    int writtenCount = 0;
+    int skippedCount = 0;
+    for (int i = 0; i < tasks.size(); ++i) {
+        const PublishTaskResult& result = _publishResults.at(i);
+        PublishManifest& manifest = manifests[QFileInfo(tasks.at(i).outputFilePath).absolutePath()];
+        const QString key = QFileInfo(tasks.at(i).outputFilePath).fileName();
+        if (!format.isEmpty()) {
+            if (result.dataSkipped) {
+                skippedCount++;
+            } else if (!result.dataFile.isEmpty()) {
+                manifest.insert(key + ":data", result.dataHash, QStringList() << result.dataFile);
+                writtenCount++;
+            } else {
+                manifest.remove(key + ":data");
             }
         }
+        if (result.imageSkipped) {
+            skippedCount++;
+        } else if (result.success) {
+            manifest.insert(key + ":image", result.imageHash, result.imageFiles);
+            writtenCount++;
+        } else {
+            manifest.remove(key + ":image");
+        }
+    }
+    // other publishers may have written to the same folders meanwhile
+    for (PublishManifest& manifest: manifests) {
+        QString errorString;
+        if (!manifest.saveChanges(&errorString)) {
+            qWarning() << errorString;
+        }
     }
 
-    if ((_imageFormat == kPNG) && (_pngQuality.optMode != "None")) {
-        qDebug() << "Begin optimize image...";
-        // we use values 1-7 so that it is more user friendly, because 0 also means optimization.
-        optimizePNGInThread(outputFilePaths, _pngQuality.optMode, _pngQuality.optLevel - 1);
+    QStringList errors;
+    for (const PublishTaskResult& result: _publishResults) {
+        if (result.success && result.imageSkipped) {
+            qDebug() << QString("Unchanged %1").arg(result.outputFilePath);
+        } else if (result.success) {
+            qDebug() << QString("Published %1 (%2 bytes) in %3 ms (data: %4 ms, convert: %5 ms, encode: %6 ms)")
+                        .arg(result.outputFilePath)
+                        .arg(result.imageSize)
+                        .arg(result.totalTime)
+                        .arg(result.dataTime)
+                        .arg(result.convertTime)
+                        .arg(result.encodeTime);
+            if (result.unoptimizedSize > 0) {
+                qDebug() << QString("Optimized %1: %2 -> %3 bytes (%4%) in %5 ms")
+                            .arg(result.outputFilePath)
+                            .arg(result.unoptimizedSize)
+                            .arg(result.imageSize)
+                            .arg(100 * (result.unoptimizedSize - result.imageSize) / result.unoptimizedSize)
+                            .arg(result.optimizeTime);
+            }
+        } else {
+            qWarning() << QString("Publish %1 failed: %2").arg(result.outputFilePath).arg(result.errorString);
+            errors.push_back(result.errorString);
+        }
     }
+    qDebug() << "Publish time:" << publishTimer.elapsed() << "ms," << tasks.size() << "pages,"
+             << writtenCount << "files written," << skippedCount << "unchanged";
 
     _spriteAtlases.clear();
     _fileNames.clear();
 
-    return true;
+    return errors.isEmpty();
+}
+
+PublishTaskResult PublishSpriteSheet::publishPage(const PublishTask& task, const QString& format, QSemaphore* pageSemaphore) {
+    TRACE_SCOPE_DETAIL("publish page", QFileInfo(task.outputFilePath).fileName());
+    const SpriteAtlas::OutputData& outputData = _spriteAtlases.at(task.atlasIndex).outputData().at(task.page);
+
+    PublishTaskResult result;
+    result.outputFilePath = task.outputFilePath;
+    result.success = true;
+    result.dataTime = 0;
+    result.convertTime = 0;
+    result.encodeTime = 0;
+    result.imageSize = 0;
+    result.optimizeTime = 0;
+    result.unoptimizedSize = 0;
+    result.psnr = 0.0;
+    result.imageSkipped = false;
+    result.dataSkipped = false;
+
+    QElapsedTimer taskTimer;
+    taskTimer.start();
+
+    // generate the data file and the image, unless the manifest has them as made from the same content
+    const QString key = QFileInfo(task.outputFilePath).fileName();
+    if (!format.isEmpty()) {
+        QElapsedTimer timer;
+        timer.start();
+        result.dataHash = dataHash(format, outputData, task.outputFilePath);
+        if (task.manifest && task.manifest->upToDate(key + ":data", result.dataHash)) {
+            result.dataSkipped = true;
+        } else if (!generateDataFile(task.outputFilePath, format, outputData._spriteFrames, outputData._atlasImage, &result.dataFile, &result.errorString)) {
+            result.success = false;
+        }
+        result.dataTime = timer.elapsed();
+    }
+
+    if (result.success) {
+        result.imageHash = imageHash(outputData._atlasImage);
+        result.imageFiles = imageFilePaths(task.outputFilePath);
+        if (task.manifest && task.manifest->upToDate(key + ":image", result.imageHash)) {
+            result.imageSkipped = true;
+            result.imageSize = QFileInfo(task.outputFilePath + imagePrefix(_imageFormat)).size();
+        } else {
+            pageSemaphore->acquire();
+            result.success = saveImage(task.outputFilePath, outputData._atlasImage, result);
+            pageSemaphore->release();
+        }
+    }
+
+    result.totalTime = taskTimer.elapsed();
+    return result;
 }
 
-bool PublishSpriteSheet::generateDataFile(const QString& filePath, const QString& format,  const QMap<QString, SpriteFrameInfo>& spriteFrames, const QImage& atlasImage, bool errorMessage) {
-    QJSEngine engine;
+bool PublishSpriteSheet::saveImage(const QString& outputFilePath, const QImage& atlasImage, PublishTaskResult& result) {
+    QElapsedTimer timer;
+    timer.start();
+
+    // save image
+    QString fileName = outputFilePath + imagePrefix(_imageFormat);
+    qDebug() << "Save image:" << fileName;
+    if ((_imageFormat == kPNG) || (_imageFormat == kWEBP) || (_imageFormat == kJPG) || (_imageFormat == kJPG_PNG)) {
+        QImage image;
+        {
+            TRACE_SCOPE("convert");
+            image = convertImage(atlasImage, _pixelFormat, _premultiplied, _dithering);
+        }
+        result.convertTime = timer.restart();
+
+        TRACE_SCOPE_DETAIL("encode", imageFormatToString(_imageFormat));
+        bool success = true;
+        if (_imageFormat == kPNG) {
+            success = writePNG(outputFilePath + imagePrefix(kPNG), image, true, result);
+        } else if (_imageFormat == kWEBP) {
+            QImageWriter writer(outputFilePath + imagePrefix(kWEBP), "webp");
+            writer.setOptimizedWrite(true);
+            writer.setCompression(100);
+            writer.setQuality(_webpQuality);
+            success = writer.write(image);
+            if (!success) result.errorString = writer.errorString();
+        } else if ((_imageFormat == kJPG) || (_imageFormat == kJPG_PNG)) {
+            QImageWriter writer(outputFilePath + imagePrefix(kJPG), "jpg");
+            writer.setOptimizedWrite(true);
+            writer.setCompression(100);
+            writer.setQuality(_jpgQuality);
+            success = writer.write(image);
+            if (!success) result.errorString = writer.errorString();
+
+            if (success && (_imageFormat == kJPG_PNG)) {
+                QImage maskImage = ImageConverter::alpha(atlasImage);
+                success = writePNG(outputFilePath + imagePrefix(kPNG), maskImage, false, result);
+            }
+        }
+        result.encodeTime = timer.elapsed();
+        result.imageSize = QFileInfo(fileName).size();
+        return success;
+    } else if (TextureContainer::supports(_imageFormat, _pixelFormat) && TextureEncoder::supports(_pixelFormat)) {
+        TRACE_SCOPE_DETAIL("encode", pixelFormatToString(_pixelFormat));
+        TextureEncoder encoder(_pixelFormat, _textureQuality);
+        QByteArray payload = encoder.encode(atlasImage);
+        QVector<QByteArray> levels;
+        levels << payload;
+        if ((_imageFormat == kKTX2) && _mipmaps) {
+            // halve the previous level down to 1x1, every level is encoded on the thread pool
+            QImage levelImage = atlasImage;
+            while ((levelImage.width() > 1) || (levelImage.height() > 1)) {
+                levelImage = levelImage.scaled(qMax(1, levelImage.width() / 2), qMax(1, levelImage.height() / 2),
+                                               Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+                levels << encoder.encode(levelImage);
+            }
+        }
+        result.encodeTime = timer.elapsed();
+        result.psnr = TextureEncoder::psnr(atlasImage, encoder.decode(payload, atlasImage.size()), encoder.hasAlpha());
+        qDebug() << "Encode complete, PSNR:" << result.psnr << "dB";
+
+        bool success = false;
+        if (_imageFormat == kPVR_CCZ) {
+            success = writeCCZ(fileName, QList<QByteArray>() << TextureContainer::pvrHeader(_pixelFormat, atlasImage.size()) << payload, &result.errorString);
+        } else {
+            QByteArray fileData = (_imageFormat == kKTX2)? TextureContainer::ktx2(_pixelFormat, atlasImage.size(), levels, _supercompression) :
+                                                           TextureContainer::serialize(_imageFormat, _pixelFormat, atlasImage.size(), payload);
+            QFile file(fileName);
+            success = file.open(QIODevice::WriteOnly) && (file.write(fileData) == fileData.size());
+            if (!success) result.errorString = QString("Can't write %1: %2").arg(fileName).arg(file.errorString());
+        }
+        result.imageSize = QFileInfo(fileName).size();
+        return success;
+    } else if (((_imageFormat != kPVR) && (_imageFormat != kPVR_CCZ)) || !pvrTexLibWrites(_pixelFormat)) {
+        result.errorString = QString("%1 can't hold %2 textures.").arg(imageFormatToString(_imageFormat)).arg(pixelFormatToString(_pixelFormat));
+        return false;
+    } else {
+        CPVRTextureHeader pvrHeader(PVRStandard8PixelType.PixelTypeID,
+                                    atlasImage.height(),
+                                    atlasImage.width());
+        // create the texture
+        CPVRTexture pvrTexture(pvrHeader, atlasImage.bits());
+        result.convertTime = timer.restart();
+
+        TRACE_SCOPE_DETAIL("encode", pixelFormatToString(_pixelFormat));
+        // PVRTexLib is not documented as reentrant, keep one transcode at a time
+        static QMutex transcodeMutex;
+        QMutexLocker transcodeLocker(&transcodeMutex);
+        switch (_pixelFormat) {
+            case kPVRTC2: Transcode(pvrTexture, PixelType(ePVRTPF_PVRTCI_2bpp_RGB), ePVRTVarTypeUnsignedByteNorm, ePVRTCSpacelRGB, ePVRTCBest, true); break;
+            case kPVRTC2A: Transcode(pvrTexture, PixelType(ePVRTPF_PVRTCI_2bpp_RGBA), ePVRTVarTypeUnsignedByteNorm, ePVRTCSpacelRGB, ePVRTCBest, true); break;
+            case kPVRTC4: Transcode(pvrTexture, PixelType(ePVRTPF_PVRTCI_4bpp_RGB), ePVRTVarTypeUnsignedByteNorm, ePVRTCSpacelRGB, ePVRTCBest, true); break;
+            case kPVRTC4A: Transcode(pvrTexture, PixelType(ePVRTPF_PVRTCI_4bpp_RGBA), ePVRTVarTypeUnsignedByteNorm, ePVRTCSpacelRGB, ePVRTCBest, true); break;
+            default: break;
+        }
 
+        transcodeLocker.unlock();
+        qDebug() << "Transcode complete.";
+        // save the file
+        if (_imageFormat == kPVR_CCZ) {
+            // the payload is compressed straight from the texture memory
+            QByteArray pvrData = QByteArray::fromRawData(static_cast<const char*>(pvrTexture.getDataPtr()), pvrTexture.getDataSize());
+            if (!writeCCZ(fileName, QList<QByteArray>() << pvrFileHeader(pvrTexture) << pvrData, &result.errorString)) {
+                return false;
+            }
+        } else if (!pvrTexture.saveFile(fileName.toStdString().c_str())) {
+            result.errorString = QString("Can't write %1").arg(fileName);
+            return false;
+        }
+        qDebug() << "Write to file complete.";
+        result.encodeTime = timer.elapsed();
+        result.imageSize = QFileInfo(fileName).size();
+    }
+
+    return true;
+}
+
+bool PublishSpriteSheet::generateDataFile(const QString& filePath, const QString& format,  const QMap<QString, SpriteFrameInfo>& spriteFrames, const QImage& atlasImage, QString* dataFilePath, QString* errorString) {
     auto it_format = _formats.find(format);
     if (it_format == _formats.end()) {
-        QString errorString = QString("Not found script file for [%1] format").arg(format);
-        qDebug() << errorString;
-        if (errorMessage) QMessageBox::critical(NULL, "Export script error", errorString);
+        *errorString = QString("Not found script file for [%1] format").arg(format);
+        qDebug() << *errorString;
         return false;
     }
 
     QString scriptFileName = it_format.value();
-    QFile scriptFile(scriptFileName);
-    if (!scriptFile.open(QIODevice::ReadOnly)) {
-        qDebug() << "File [" << scriptFileName << "] not found!";
+    QString imageFilePath = filePath + imagePrefix((_imageFormat == kJPG_PNG)? kJPG : _imageFormat);
+    QString maskFilePath = (_imageFormat == kJPG_PNG)? filePath + imagePrefix(kPNG) : QString();
+
+    // the scripts shipped in defaultFormats have compiled versions, a custom folder can still override them
+    bool builtIn = scriptFileName.isEmpty() || (QFileInfo(scriptFileName).absolutePath() == QDir(defaultFormatsFolder()).absolutePath());
+    if (builtIn && DataFileExporter::supports(format, _imageFormat == kJPG_PNG)) {
+        TRACE_SCOPE_DETAIL("data export", format);
+        DataFileExporter::Input input;
+        input.imageFilePath = imageFilePath;
+        input.maskFilePath = maskFilePath;
+        input.textureSize = atlasImage.size();
+        for (auto it_f = spriteFrames.cbegin(); it_f != spriteFrames.cend(); ++it_f) {
+            input.frames.push_back({exportedSpriteName(it_f.key()), &it_f.value()});
+        }
+        input.frames = DataFileExporter::scriptOrder(input.frames);
+
+        *dataFilePath = filePath + "." + DataFileExporter::fileExtension(format);
+        if (!DataFileExporter::exportSpriteSheet(format, input, filePath, errorString)) {
+            dataFilePath->clear();
+            return false;
+        }
+        return true;
+    }
+
+    TRACE_SCOPE_DETAIL("script export", format);
+    // evaluated once per thread and publish
+    ScriptExporter* exporter = ScriptExporter::threadExporter(scriptFileName, errorString);
+    if (!exporter) {
         return false;
     }
+    QJSEngine& engine = exporter->engine();
+
+    QJSValueList args;
+    args << QJSValue(filePath);
+    if (_imageFormat == kJPG_PNG) {
+        QJSValue imageFilePathsValue = engine.newObject();
+        imageFilePathsValue.setProperty("rgb", QJSValue(imageFilePath));
+        imageFilePathsValue.setProperty("mask", QJSValue(maskFilePath));
+        args << imageFilePathsValue;
+    } else {
+        args << QJSValue(imageFilePath);
+    }
 
-    QTextStream stream(&scriptFile);
-    QString contents = stream.readAll();
-    scriptFile.close();
+    // collect sprite frames, the script gets them with a single JSON.parse
+    QString framesJson;
+    QTextStream framesStream(&framesJson);
+    JsonWriter writer(framesStream, false);
+    writer.beginObject();
+    auto it_f = spriteFrames.cbegin();
+    for (; it_f != spriteFrames.cend(); ++it_f) {
+        writer.beginObject(exportedSpriteName(it_f.key()));
+        writeJson(writer, "frame", it_f.value().frame);
+        writeJson(writer, "offset", it_f.value().offset);
+        writer.value("rotated", it_f.value().rotated);
+        writeJson(writer, "sourceColorRect", it_f.value().sourceColorRect);
+        writeJson(writer, "sourceSize", it_f.value().sourceSize);
+        writeJson(writer, "triangles", it_f.value().triangles);
+        writer.end();
+    }
+    writer.end();
+    framesStream.flush();
+    args << exporter->parseJson(framesJson);
 
-    // add console object
-    JSConsole console;
-    QJSValue consoleObj = engine.newQObject(&console);
-    engine.globalObject().setProperty("console", consoleObj);
+    QJSValue textureSizeValue = engine.newObject();
+    textureSizeValue.setProperty("width", atlasImage.width());
+    textureSizeValue.setProperty("height", atlasImage.height());
+    args << textureSizeValue;
 
-    // evaluate export plugin script
-    qDebug() << "Run script...";
-    QJSValue result = engine.evaluate(contents);
+    // run export
+    QJSValue result = exporter->exportSpriteSheet(args);
     if (result.isError()) {
-        QString errorString = "Uncaught exception at line " + result.property("lineNumber").toString() + " : " + result.toString();
-        qDebug() << errorString;
-        if (errorMessage) QMessageBox::critical(NULL, "Export script error", errorString);
+        *errorString = "Uncaught exception at line " + result.property("lineNumber").toString() + " : " + result.toString();
+        qDebug() << *errorString;
         return false;
     }
 
-    if (engine.globalObject().hasOwnProperty("exportSpriteSheet")) {
-        QJSValueList args;
-        args << QJSValue(filePath);
-        if (_imageFormat == kJPG_PNG) {
-            QJSValue imageFilePathsValue = engine.newObject();
-            imageFilePathsValue.setProperty("rgb", QJSValue(filePath + imagePrefix(kJPG)));
-            imageFilePathsValue.setProperty("mask", QJSValue(filePath + imagePrefix(kPNG)));
-            args << imageFilePathsValue;
-        } else {
-            args << QJSValue(filePath + imagePrefix(_imageFormat));
-        }
+    // write data
+    if (!result.hasProperty("data") || !result.hasProperty("format")) {
+        *errorString = "Script function must be return object: {data:data, format:'plist|json|other'}";
+        qDebug() << *errorString;
+        return false;
+    }
+    QJSValue data = result.property("data");
+    QString dataFormat = result.property("format").toString();
+    if (!writeDataFile(filePath, dataFormat, (dataFormat == "plist")? data.toVariant() : QVariant(data.toString()), errorString)) {
+        return false;
+    }
+    *dataFilePath = filePath + "." + dataFormat;
+    return true;
+}
 
-        // collect sprite frames
-        QJSValue spriteFramesValue = engine.newObject();
-        auto it_f = spriteFrames.cbegin();
-        for (; it_f != spriteFrames.cend(); ++it_f) {
-            QJSValue spriteFrameValue = engine.newObject();
-            spriteFrameValue.setProperty("frame", jsValue(engine, it_f.value().frame));
-            spriteFrameValue.setProperty("offset", jsValue(engine, it_f.value().offset));
-            spriteFrameValue.setProperty("rotated", it_f.value().rotated);
-            spriteFrameValue.setProperty("sourceColorRect", jsValue(engine, it_f.value().sourceColorRect));
-            spriteFrameValue.setProperty("sourceSize", jsValue(engine, it_f.value().sourceSize));
-            spriteFrameValue.setProperty("triangles", jsValue(engine, it_f.value().triangles));
-
-            QString name = it_f.key();
-            // remove root folder if needed
-            if (!_prependSmartFolderName) {
-                auto idx = name.indexOf('/');
-                if (idx != -1) {
-                    name = name.right(name.length() - idx - 1);
-                }
-            }            
-            if (_trimSpriteNames) {
-                name = QDir::fromNativeSeparators(QFileInfo(name).path() + QDir::separator() + QFileInfo(name).baseName());
-            }
-            spriteFramesValue.setProperty(name, spriteFrameValue);
+QString PublishSpriteSheet::exportedSpriteName(const QString& spriteName) const {
+    QString name = spriteName;
+    // remove root folder if needed
+    if (!_prependSmartFolderName) {
+        auto idx = name.indexOf('/');
+        if (idx != -1) {
+            name = name.right(name.length() - idx - 1);
         }
-        args << QJSValue(spriteFramesValue);
+    }
+    if (_trimSpriteNames) {
+        name = QDir::fromNativeSeparators(QFileInfo(name).path() + QDir::separator() + QFileInfo(name).baseName());
+    }
+    return name;
+}
 
-        args << jsValue(engine, atlasImage.size());
+QByteArray PublishSpriteSheet::imageHash(const QImage& atlasImage) const {
+    QByteArray settings;
+    QDataStream stream(&settings, QIODevice::WriteOnly);
+    stream << QCoreApplication::applicationVersion()
+           << (int)_imageFormat << (int)_pixelFormat << _premultiplied << (int)_dithering
+           << (int)_textureQuality << (int)_supercompression << _mipmaps
+           << _pngQuality.optMode << _pngQuality.optLevel << _webpQuality << _jpgQuality << _encryptionKey
+           << atlasImage.width() << atlasImage.height() << (int)atlasImage.format();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(settings);
+    // the visible bytes of every row, not the padding at the end of it
+    const int rowSize = atlasImage.width() * atlasImage.depth() / 8;
+    for (int y = 0; y < atlasImage.height(); ++y) {
+        hash.addData(reinterpret_cast<const char*>(atlasImage.constScanLine(y)), rowSize);
+    }
+    return hash.result();
+}
 
-        // run export
-        QJSValue exportSpriteSheet = engine.globalObject().property("exportSpriteSheet");
-        result = exportSpriteSheet.call(args);
+QByteArray PublishSpriteSheet::dataHash(const QString& format, const SpriteAtlas::OutputData& outputData, const QString& outputFilePath) const {
+    QByteArray content;
+    QDataStream stream(&content, QIODevice::WriteOnly);
+    stream << QCoreApplication::applicationVersion()
+           << format << outputFilePath << (int)_imageFormat << _trimSpriteNames << _prependSmartFolderName
+           << outputData._atlasImage.size();
 
-        if (result.isError()) {
-            QString errorString = "Uncaught exception at line " + result.property("lineNumber").toString() + " : " + result.toString();
-            qDebug() << errorString;
-            if (errorMessage) QMessageBox::critical(NULL, "Export script error", errorString);
-            return false;
-        } else {
-            // write data
-            if (!result.hasProperty("data") || !result.hasProperty("format")) {
-                QString errorString = "Script function must be return object: {data:data, format:'plist|json|other'}";
-                qDebug() << errorString;
-                if (errorMessage) QMessageBox::critical(NULL, "Export script error", errorString);
-                return false;
-            } else {
-                QJSValue data = result.property("data");
-                QString format = result.property("format").toString();
-                QFile file(filePath + "." + format);
-                file.open(QIODevice::WriteOnly | QIODevice::Text);
-                QTextStream out(&file);
-                if (format == "plist") {
-                    out << PListSerializer::toPList(data.toVariant());
-                } else {
-                    out << data.toString();
-                }
-            }
+    // a changed export script changes the data file too
+    auto it_format = _formats.find(format);
+    if ((it_format != _formats.end()) && !it_format.value().isEmpty()) {
+        QFile scriptFile(it_format.value());
+        if (scriptFile.open(QIODevice::ReadOnly)) {
+            stream << scriptFile.readAll();
         }
+    }
 
+    for (auto it_f = outputData._spriteFrames.cbegin(); it_f != outputData._spriteFrames.cend(); ++it_f) {
+        const SpriteFrameInfo& info = it_f.value();
+        stream << it_f.key() << info.frame << info.offset << info.rotated << info.sourceColorRect << info.sourceSize
+               << info.triangles.verts << info.triangles.indices;
+    }
+    return QCryptographicHash::hash(content, QCryptographicHash::Sha1);
+}
+
+QStringList PublishSpriteSheet::imageFilePaths(const QString& outputFilePath) const {
+    if (_imageFormat == kJPG_PNG) {
+        return QStringList() << outputFilePath + imagePrefix(kJPG) << outputFilePath + imagePrefix(kPNG);
+    }
+    return QStringList() << outputFilePath + imagePrefix(_imageFormat);
+}
+
+bool PublishSpriteSheet::writeDataFile(const QString& filePath, const QString& format, const QVariant& data, QString* errorString) {
+    QFile file(filePath + "." + format);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        *errorString = QString("Can't write %1: %2").arg(file.fileName()).arg(file.errorString());
+        qDebug() << *errorString;
+        return false;
+    }
+    QTextStream out(&file);
+    if (format == "plist") {
+        PListWriter writer(out);
+        writer.beginDocument();
+        writer.value(data);
+        writer.endDocument();
     } else {
-        qDebug() << "Not found global exportSpriteSheet function!";
-        if (errorMessage) QMessageBox::critical(NULL, "Export script error", "Not found global exportSpriteSheet function!");
+        out << data.toString();
+    }
+    out.flush();
+    file.close();
+    if (file.error() != QFileDevice::NoError) {
+        *errorString = QString("Can't write %1: %2").arg(file.fileName()).arg(file.errorString());
+        qDebug() << *errorString;
         return false;
     }
-
     return true;
 }
 
-bool PublishSpriteSheet::optimizePNG(const QString& fileName, const QString& optMode, int optLevel) {
-    bool result = false;
+bool PublishSpriteSheet::writePNG(const QString& fileName, const QImage& image, bool optimize, PublishTaskResult& result) {
+    QString* errorString = &result.errorString;
+    QByteArray pngData;
+    if (optimize && (_pngQuality.optMode != "None")) {
+        // we use values 1-7 so that it is more user friendly, because 0 also means optimization.
+        int optLevel = _pngQuality.optLevel - 1;
+        TRACE_SCOPE_DETAIL("optimize", _pngQuality.optMode);
+
+        // the PNG that would be written without optimization, the savings are measured
+        // against it; PngWriter is quick next to the optimizer's search
+        QBuffer unoptimized;
+        unoptimized.open(QIODevice::WriteOnly);
+        PngWriter writer;
+        QString unoptimizedError;
+        const qint64 unoptimizedSize = writer.write(&unoptimized, image, &unoptimizedError)? unoptimized.size() : 0;
+
+        QElapsedTimer timer;
+        timer.start();
+
+        // quantize or reduce in memory, so the atlas is encoded and written only once
+        QScopedPointer<PngOptimizer> optimizer;
+        if (_pngQuality.optMode == "Lossless") {
+            optimizer.reset(new LosslessPngOptimizer(optLevel));
+        } else if (_pngQuality.optMode == "Lossy") {
+            optimizer.reset(new PngQuantOptimizer(optLevel));
+        }
 
-    if (optMode == "Lossless") {
-        OptiPngOptimizer optimizer(optLevel);
+        if (optimizer && optimizer->optimizeImage(image, pngData)) {
+            result.optimizeTime = timer.elapsed();
+            result.unoptimizedSize = unoptimizedSize;
+        } else {
+            qWarning() << "Optimize" << fileName << "failed, write it without optimization.";
+            pngData.clear();
+        }
+    }
 
-        _mutex.lock();
-        result = optimizer.optimizeFile(fileName + ".png");
-        _mutex.unlock();
-    } else if (optMode == "Lossy") {
-        PngQuantOptimizer optimizer(optLevel);
+    if (pngData.isEmpty()) {
+        // filtered and deflated on every core, straight to the file
+        PngWriter writer;
+        return writer.write(fileName, image, errorString);
+    }
 
-        _mutex.lock();
-        result = optimizer.optimizeFile(fileName + ".png");
-        _mutex.unlock();
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly) || (file.write(pngData) != pngData.size())) {
+        *errorString = QString("Can't write %1: %2").arg(fileName).arg(file.errorString());
+        return false;
     }
 
-    return result;
+    return true;
 }
 
-void PublishSpriteSheet::optimizePNGInThread(QStringList fileNames, const QString& optMode, int optLevel) {
-    QObject::connect(&_watcher, SIGNAL(finished()), this, SIGNAL(onCompletedOptimizePNG()));
-
-    QFuture<bool> resultFuture;
-
-    for (const QString& fileName : fileNames) {
-        resultFuture = QtConcurrent::run(this, &PublishSpriteSheet::optimizePNG, fileName, optMode, optLevel);
-    }
-
-    _watcher.setFuture(resultFuture);
+bool PublishSpriteSheet::writeCCZ(const QString& fileName, const QList<QByteArray>& parts, QString* errorString) {
+    CczWriter writer(_encryptionKey);
+    return writer.write(fileName, parts, errorString);
 }
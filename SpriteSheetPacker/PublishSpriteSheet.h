@@ -2,24 +2,42 @@
 #define PUBLISHSPRITESHEET_H
 
 #include <QtCore>
-#include <QJSEngine>
 #include <QtConcurrent>
 #include "ImageFormat.h"
+#include "ImageConverter.h"
 #include "PngOptimizer.h"
+#include "PublishManifest.h"
 #include "SpriteAtlas.h"
 
 struct ScalingVariant;
 
-class JSConsole : public QObject {
-    Q_OBJECT
-public:
-    explicit JSConsole() { }
-
-public slots:
-    void log(QString msg);
+struct PublishTaskResult {
+    QString outputFilePath;
+    bool    success;
+    QString errorString;
+    // timings in milliseconds
+    qint64  dataTime;
+    qint64  convertTime;
+    qint64  encodeTime;
+    qint64  totalTime;
+    // size of the written image file in bytes
+    qint64  imageSize;
+    // PNG optimization, 0 when the page was not optimized: the time of the
+    // search and the size of the PNG that would have been written without it
+    qint64  optimizeTime;
+    qint64  unoptimizedSize;
+    // quality of the built-in texture encoder output, 0 when not measured
+    double  psnr;
+    // outputs the publish manifest had as unchanged, their files were not touched
+    bool    imageSkipped;
+    bool    dataSkipped;
+    // what the manifest records for the page
+    QByteArray  imageHash;
+    QByteArray  dataHash;
+    QStringList imageFiles;
+    QString     dataFile;
 };
 
-
 class PublishSpriteSheet: public QObject {
     Q_OBJECT
 
@@ -30,29 +48,66 @@ public:
     void setImageFormat(ImageFormat imageFormat) { _imageFormat = imageFormat; }
     void setPixelFormat(PixelFormat pixelFormat) { _pixelFormat = pixelFormat; }
     void setPremultiplied(bool premultiplied) { _premultiplied = premultiplied; }
+    void setDithering(DitherMode dithering) { _dithering = dithering; }
+    void setTextureQuality(TextureQuality textureQuality) { _textureQuality = textureQuality; }
+    void setSupercompression(Supercompression supercompression) { _supercompression = supercompression; }
+    void setMipmaps(bool mipmaps) { _mipmaps = mipmaps; }
     void setPngQuality(const QString& optMode, int optLevel) { _pngQuality.optMode = optMode; _pngQuality.optLevel = optLevel; }
     void setWebpQuality(int quality) { _webpQuality = quality; }
     void setJpgQuality(int quality) { _jpgQuality = quality; }
     void setTrimSpriteNames(bool trimSpriteNames) { _trimSpriteNames = trimSpriteNames; }
     void setPrependSmartFolderName(bool prependSmartFolderName) { _prependSmartFolderName = prependSmartFolderName; }
     void setEncryptionKey(const QString& key) { _encryptionKey = key; }
-
-    bool publish(const QString& format, bool errorMessage = true);
+    void setMaxConcurrentPages(int maxConcurrentPages) { _maxConcurrentPages = qMax(1, maxConcurrentPages); }
+    // pages of several publishers running at once share pageSemaphore instead of
+    // a limit of their own, nullptr to go back to setMaxConcurrentPages()
+    void setPageSemaphore(QSemaphore* pageSemaphore) { _pageSemaphore = pageSemaphore; }
+    // when false every image and data file is written even if the manifest has it as unchanged
+    void setSkipUnchanged(bool skipUnchanged) { _skipUnchanged = skipUnchanged; }
+
+    // false when a page failed, publishResults() has the error of every page
+    bool publish(const QString& format);
+    const QVector<PublishTaskResult>& publishResults() const { return _publishResults; }
+    // the image files of every page of the sprite sheets, whether published yet or not
+    QStringList imageFiles() const;
 
     static void addFormat(const QString& format, const QString& scriptFileName) { _formats[format] = scriptFileName; }
     static QMap<QString, QString>& formats() { return _formats; }
-
-signals:
-    void onCompletedOptimizePNG();
+    // the export scripts installed with the application
+    static QString defaultFormatsFolder();
+    // the built-in formats plus the *.js scripts of the folders, later folders override earlier ones
+    static void loadFormats(const QStringList& formatsFolders);
 
 protected:
-    bool generateDataFile(const QString& filePath, const QString& format, const QMap<QString, SpriteFrameInfo>& spriteFrames, const QImage& atlasImage, bool errorMessage = true);
-    bool optimizePNG(const QString& fileName, const QString& optMode, int optLevel);
-    void optimizePNGInThread(QStringList fileNames, const QString& optMode, int optLevel);
+    struct PublishTask {
+        int     atlasIndex;
+        int     page;
+        QString outputFilePath;
+        // of the output folder, nullptr when unchanged outputs are written anyway
+        const PublishManifest* manifest;
+    };
+
+    // the output of page out of pages, filePath may have {n} or {n1} for the page number
+    static QString pageFilePath(const QString& filePath, int page, int pages);
+    PublishTaskResult publishPage(const PublishTask& task, const QString& format, QSemaphore* pageSemaphore);
+    bool saveImage(const QString& outputFilePath, const QImage& atlasImage, PublishTaskResult& result);
+    bool generateDataFile(const QString& filePath, const QString& format, const QMap<QString, SpriteFrameInfo>& spriteFrames, const QImage& atlasImage, QString* dataFilePath, QString* errorString);
+    bool writeDataFile(const QString& filePath, const QString& format, const QVariant& data, QString* errorString);
+    QString exportedSpriteName(const QString& spriteName) const;
+    // hashes of everything the image or the data file of a page is made from
+    QByteArray imageHash(const QImage& atlasImage) const;
+    QByteArray dataHash(const QString& format, const SpriteAtlas::OutputData& outputData, const QString& outputFilePath) const;
+    QStringList imageFilePaths(const QString& outputFilePath) const;
+    bool writeCCZ(const QString& fileName, const QList<QByteArray>& parts, QString* errorString);
+    // optimize with the PNG quality, the savings go into result
+    bool writePNG(const QString& fileName, const QImage& image, bool optimize, PublishTaskResult& result);
 
 protected:
-    QFutureWatcher<bool> _watcher;
-    QMutex _mutex;
+    // limits the number of pages converted and encoded at the same time
+    int _maxConcurrentPages;
+    QSemaphore* _pageSemaphore;
+    bool _skipUnchanged;
+    QVector<PublishTaskResult> _publishResults;
 
     QList<SpriteAtlas> _spriteAtlases;
     QStringList _fileNames;
@@ -60,6 +115,10 @@ protected:
     ImageFormat _imageFormat;
     PixelFormat _pixelFormat;
     bool        _premultiplied;
+    DitherMode  _dithering;
+    TextureQuality _textureQuality;
+    Supercompression _supercompression;
+    bool        _mipmaps;
 
     struct {
         QString optMode;
@@ -0,0 +1,69 @@
+#include "ScriptExporter.h"
+
+QAtomicInt ScriptExporter::_currentGeneration(0);
+
+void JSConsole::log(QString msg) {
+    qDebug() << "js:"<< msg;
+}
+
+ScriptExporter::ScriptExporter()
+    : _generation(-1)
+{
+    // add console object
+    _engine.globalObject().setProperty("console", _engine.newQObject(&_console));
+    _jsonParse = _engine.globalObject().property("JSON").property("parse");
+}
+
+ScriptExporter* ScriptExporter::threadExporter(const QString& scriptFileName, QString* errorString) {
+    // deleted with the thread, in the thread that owns the engines
+    static QThreadStorage<QHash<QString, QSharedPointer<ScriptExporter>>> exporters;
+
+    QSharedPointer<ScriptExporter>& exporter = exporters.localData()[scriptFileName];
+    const int generation = _currentGeneration.load();
+    if (exporter && (exporter->_generation == generation)) {
+        return exporter.data();
+    }
+
+    // a fresh engine, so nothing of an older version of the script survives
+    exporter.reset(new ScriptExporter());
+    if (!exporter->load(scriptFileName, errorString)) {
+        exporter.reset();
+        return nullptr;
+    }
+    exporter->_generation = generation;
+    return exporter.data();
+}
+
+void ScriptExporter::reset() {
+    _currentGeneration.fetchAndAddOrdered(1);
+}
+
+bool ScriptExporter::load(const QString& scriptFileName, QString* errorString) {
+    QFile scriptFile(scriptFileName);
+    if (!scriptFile.open(QIODevice::ReadOnly)) {
+        *errorString = QString("File [%1] not found!").arg(scriptFileName);
+        qDebug() << *errorString;
+        return false;
+    }
+
+    QTextStream stream(&scriptFile);
+    QString contents = stream.readAll();
+    scriptFile.close();
+
+    // evaluate export plugin script
+    qDebug() << "Run script...";
+    QJSValue result = _engine.evaluate(contents, scriptFileName);
+    if (result.isError()) {
+        *errorString = "Uncaught exception at line " + result.property("lineNumber").toString() + " : " + result.toString();
+        qDebug() << *errorString;
+        return false;
+    }
+
+    if (!_engine.globalObject().hasOwnProperty("exportSpriteSheet")) {
+        *errorString = "Not found global exportSpriteSheet function!";
+        qDebug() << *errorString;
+        return false;
+    }
+    _exportSpriteSheet = _engine.globalObject().property("exportSpriteSheet");
+    return true;
+}
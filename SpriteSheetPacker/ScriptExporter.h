@@ -0,0 +1,50 @@
+#ifndef SCRIPTEXPORTER_H
+#define SCRIPTEXPORTER_H
+
+#include <QtCore>
+#include <QJSEngine>
+
+class JSConsole : public QObject {
+    Q_OBJECT
+public:
+    explicit JSConsole() { }
+
+public slots:
+    void log(QString msg);
+};
+
+// An export script evaluated in its own QJSEngine. QJSEngine may only be
+// used by the thread that created it, so every publish worker thread keeps
+// one exporter per script: the script is read and evaluated on the first
+// page the thread publishes after reset(), later pages only call the
+// cached exportSpriteSheet function. Globals a script leaves behind are
+// therefore shared by the pages of one publish on the same thread.
+class ScriptExporter
+{
+public:
+    // the exporter of scriptFileName for the calling thread, nullptr with
+    // errorString set when the script can't be read or evaluated
+    static ScriptExporter* threadExporter(const QString& scriptFileName, QString* errorString);
+    // makes every thread evaluate its scripts again on next use
+    static void reset();
+
+    QJSEngine& engine() { return _engine; }
+    // turns JSON text into script values in one call instead of one bridge call per property
+    QJSValue parseJson(const QString& json) { return _jsonParse.call(QJSValueList() << json); }
+    QJSValue exportSpriteSheet(const QJSValueList& args) { return _exportSpriteSheet.call(args); }
+
+protected:
+    ScriptExporter();
+    bool load(const QString& scriptFileName, QString* errorString);
+
+private:
+    QJSEngine _engine;
+    JSConsole _console;
+    QJSValue  _jsonParse;
+    QJSValue  _exportSpriteSheet;
+    int       _generation;
+
+    static QAtomicInt _currentGeneration;
+};
+
+#endif // SCRIPTEXPORTER_H
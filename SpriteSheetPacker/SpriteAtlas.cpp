@@ -1,10 +1,85 @@
 #include "SpriteAtlas.h"
 
+#include <algorithm>
 #include <functional>
 #include "binpack2d.hpp"
 #include "polypack2d.h"
 #include "ImageRotate.h"
 #include "PolygonImage.h"
+#include "Trace.h"
+
+namespace {
+
+// incremental updates fall back to a full pack below this share of the last full pack's occupancy
+const float kIncrementalOccupancy = 0.85f;
+
+// the rects placed on a page, bucketed by a coarse grid for overlap tests
+class RectGrid
+{
+public:
+    explicit RectGrid(const QSize& size)
+        : _columns(qMax(1, (size.width() + kCellSize - 1) / kCellSize))
+        , _rows(qMax(1, (size.height() + kCellSize - 1) / kCellSize))
+        , _cells(_columns * _rows)
+    {
+
+    }
+
+    void insert(const QRect& rect) {
+        forEachCell(rect, [this, &rect](QVector<QRect>& cell) { cell.push_back(rect); return true; });
+    }
+
+    bool intersects(const QRect& rect) {
+        return !forEachCell(rect, [&rect](QVector<QRect>& cell) {
+            for (const QRect& other: cell) {
+                if (other.intersects(rect)) return false;
+            }
+            return true;
+        });
+    }
+
+private:
+    static const int kCellSize = 64;
+
+    // false as soon as function returns false
+    template<typename Function>
+    bool forEachCell(const QRect& rect, Function function) {
+        const int left = qBound(0, rect.left() / kCellSize, _columns - 1);
+        const int right = qBound(0, rect.right() / kCellSize, _columns - 1);
+        const int top = qBound(0, rect.top() / kCellSize, _rows - 1);
+        const int bottom = qBound(0, rect.bottom() / kCellSize, _rows - 1);
+        for (int y = top; y <= bottom; ++y) {
+            for (int x = left; x <= right; ++x) {
+                if (!function(_cells[y * _columns + x])) return false;
+            }
+        }
+        return true;
+    }
+
+    int _columns;
+    int _rows;
+    QVector<QVector<QRect>> _cells;
+};
+
+// What QPixmap::setMask(createHeuristicMask()) did, without a QPixmap: those
+// need a QGuiApplication and the GUI thread, sprites are loaded on workers.
+QImage applyHeuristicMask(const QImage& source) {
+    // cleared bits are the background color touching the edges
+    const QImage mask = source.createHeuristicMask();
+    QImage image = source.convertToFormat(QImage::Format_ARGB32);
+    for (int y = 0; y < image.height(); ++y) {
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+        const uchar* maskLine = mask.constScanLine(y);
+        for (int x = 0; x < image.width(); ++x) {
+            if (!(maskLine[x >> 3] & (1 << (x & 7)))) {
+                line[x] = qRgba(0, 0, 0, 0);
+            }
+        }
+    }
+    return image;
+}
+
+}
 
 int pow2(int len) {
     int order = 1;
@@ -23,10 +98,12 @@ PackContent::PackContent(const QString& name, const QImage& image) {
     _name = name;
     _image = image;
     _rect = QRect(0, 0, _image.width(), _image.height());
+    _hash = 0;
 }
 
 bool PackContent::isIdentical(const PackContent& other) {
     if (_rect != other._rect) return false;
+    if (_hash != other._hash) return false;
 
     for (int x = _rect.left(); x < _rect.right(); ++x) {
         for (int y = _rect.top(); y < _rect.bottom(); ++y) {
@@ -37,6 +114,33 @@ bool PackContent::isIdentical(const PackContent& other) {
     return true;
 }
 
+void PackContent::computeHash() {
+    // FNV-1a over the pixels isIdentical() compares
+    _hash = 14695981039346656037ULL;
+    for (int x = _rect.left(); x < _rect.right(); ++x) {
+        for (int y = _rect.top(); y < _rect.bottom(); ++y) {
+            _hash = (_hash ^ _image.pixel(x, y)) * 1099511628211ULL;
+        }
+    }
+}
+
+bool SpriteContentCache::find(const QString& key, const QFileInfo& fileInfo, PackContent* content) {
+    QMutexLocker locker(&_mutex);
+    Entry* entry = _cache.object(key);
+    if (!entry || (entry->lastModified != fileInfo.lastModified()) || (entry->fileSize != fileInfo.size())) {
+        return false;
+    }
+    *content = entry->content;
+    return true;
+}
+
+void SpriteContentCache::insert(const QString& key, const QFileInfo& fileInfo, const PackContent& content) {
+    // in KB, QCache costs are ints
+    const int cost = qMax(1, content.image().bytesPerLine() * content.image().height() / 1024);
+    QMutexLocker locker(&_mutex);
+    _cache.insert(key, new Entry{fileInfo.lastModified(), fileInfo.size(), content}, cost);
+}
+
 void PackContent::trim(int alpha) {
     int l = _image.width();
     int t = _image.height();
@@ -87,6 +191,8 @@ SpriteAtlas::SpriteAtlas(const QStringList& sourceList, int textureBorder, int s
     _algorithm = "Rect";
     _rotateSprites = false;
     _polygonMode.enable = false;
+    _packedOccupancy = 0;
+    _sharedContentCache = nullptr;
 
     _aborted = false;
 }
@@ -96,6 +202,36 @@ void SpriteAtlas::enablePolygonMode(bool enable, float epsilon) {
     _polygonMode.epsilon = epsilon;
 }
 
+void SpriteAtlas::setPreviousGeneration(const SpriteAtlas& previous) {
+    _previous.reset(new SpriteAtlas(previous));
+    // only one generation back
+    _previous->_previous.reset();
+}
+
+bool SpriteAtlas::sameContentSettings(const SpriteAtlas& other) const {
+    return (_trim == other._trim) &&
+           (_heuristicMask == other._heuristicMask) &&
+           (_scale == other._scale) &&
+           (_polygonMode.enable == other._polygonMode.enable) &&
+           (!_polygonMode.enable || (_polygonMode.epsilon == other._polygonMode.epsilon));
+}
+
+QString SpriteAtlas::sharedContentKey(const QString& filePath) const {
+    return QString("%1|%2|%3|%4|%5").arg(filePath).arg(_scale).arg(_trim).arg(_heuristicMask)
+                                    .arg(_polygonMode.enable? _polygonMode.epsilon : -1.f);
+}
+
+bool SpriteAtlas::samePackSettings(const SpriteAtlas& other) const {
+    return sameContentSettings(other) &&
+           (_algorithm == other._algorithm) &&
+           (_textureBorder == other._textureBorder) &&
+           (_spriteBorder == other._spriteBorder) &&
+           (_pow2 == other._pow2) &&
+           (_forceSquared == other._forceSquared) &&
+           (_maxTextureSize == other._maxTextureSize) &&
+           (_rotateSprites == other._rotateSprites);
+}
+
 bool SpriteAtlas::generate(SpriteAtlasGenerateProgress* progress) {
     _aborted = false;
 
@@ -109,13 +245,13 @@ bool SpriteAtlas::generate(SpriteAtlasGenerateProgress* progress) {
     if (_progress)
         _progress->setProgressText(QString("Optimizing sprites..."));
 
-    QStringList nameFilter;
-    nameFilter << "*.png" << "*.jpg" << "*.jpeg" << "*.gif" << "*.bmp";
+    QStringList nameFilter = imageNameFilters();
 
     QList< QPair<QString, QString> > fileList;
     for(auto pathName: _sourceList) {
         if (_aborted) return false;
 
+        TRACE_SCOPE_DETAIL("file scan", pathName);
         QFileInfo fi(pathName);
 
         if (fi.isDir()) {
@@ -137,42 +273,77 @@ bool SpriteAtlas::generate(SpriteAtlasGenerateProgress* progress) {
     // init images and rects
     _identicalFrames.clear();
 
+    // sprites of files that did not change since the previous generation are taken as they were prepared
+    const bool reuseContent = _previous && sameContentSettings(*_previous);
+    int reusedSprites = 0;
+    _contentCache.clear();
+
+    PackContent cachedContent(QString(), QImage());
     int progressIndex = 1;
     QVector<PackContent> inputContent;
     auto it_f = fileList.begin();
     for(; it_f != fileList.end(); ++it_f, ++progressIndex) {
         if (_aborted) return false;
 
-        QImage image((*it_f).first);
-        if (image.isNull()) continue;
-        if (_scale != 1) {
-            image = image.scaled(ceil(image.width() * _scale), ceil(image.height() * _scale), Qt::KeepAspectRatio, Qt::SmoothTransformation);
-        }
-        if (image.format() == QImage::Format_Indexed8) {
-            image = image.convertToFormat(QImage::Format_ARGB32);
-        }
+        QFileInfo fileInfo((*it_f).first);
+        auto it_cached = reuseContent? _previous->_contentCache.find((*it_f).first) : _contentCache.end();
+        if (reuseContent && (it_cached != _previous->_contentCache.end()) &&
+            (it_cached.value().lastModified == fileInfo.lastModified()) &&
+            (it_cached.value().fileSize == fileInfo.size()) &&
+            (it_cached.value().content.name() == (*it_f).second)) {
+            _contentCache.insert((*it_f).first, it_cached.value());
+            reusedSprites++;
+        } else if (_sharedContentCache && _sharedContentCache->find(sharedContentKey((*it_f).first), fileInfo, &cachedContent)) {
+            // other projects may name the same file differently
+            cachedContent.setName((*it_f).second);
+            _contentCache.insert((*it_f).first, CachedContent{fileInfo.lastModified(), fileInfo.size(), cachedContent});
+            reusedSprites++;
+        } else {
+            QImage image;
+            {
+                TRACE_SCOPE_DETAIL("decode", (*it_f).second);
+                image.load((*it_f).first);
+            }
+            if (image.isNull()) continue;
+            if (_scale != 1) {
+                TRACE_SCOPE_DETAIL("scale", (*it_f).second);
+                image = image.scaled(ceil(image.width() * _scale), ceil(image.height() * _scale), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            }
+            if (image.format() == QImage::Format_Indexed8) {
+                image = image.convertToFormat(QImage::Format_ARGB32);
+            }
 
-        // Apply Heuristic mask
-        if (_heuristicMask) {
-            QPixmap pix = QPixmap::fromImage(image);
-            pix.setMask(pix.createHeuristicMask());
-            image = pix.toImage();
-        }
+            // Apply Heuristic mask
+            if (_heuristicMask) {
+                image = applyHeuristicMask(image);
+            }
 
-        PackContent packContent((*it_f).second, image);
+            PackContent packContent((*it_f).second, image);
+
+            // Trim / Crop
+            if (_trim) {
+                {
+                    TRACE_SCOPE_DETAIL("trim", (*it_f).second);
+                    packContent.trim(_trim);
+                }
+                if (_polygonMode.enable) {
+                    //qDebug() << (*it_f).first;
+                    PolygonImage polygonImage(packContent.image(), packContent.rect(), _polygonMode.epsilon, _trim);
+                    packContent.setPolygons(polygonImage.polygons());
+                    packContent.setTriangles(polygonImage.triangles());
+                }
+            }
+            packContent.computeHash();
 
-        // Trim / Crop
-        if (_trim) {
-            packContent.trim(_trim);
-            if (_polygonMode.enable) {
-                //qDebug() << (*it_f).first;
-                PolygonImage polygonImage(packContent.image(), packContent.rect(), _polygonMode.epsilon, _trim);
-                packContent.setPolygons(polygonImage.polygons());
-                packContent.setTriangles(polygonImage.triangles());
+            _contentCache.insert((*it_f).first, CachedContent{fileInfo.lastModified(), fileInfo.size(), packContent});
+            if (_sharedContentCache) {
+                _sharedContentCache->insert(sharedContentKey((*it_f).first), fileInfo, packContent);
             }
         }
+        const PackContent& packContent = _contentCache.find((*it_f).first).value().content;
 
         // Find Identical
+        TRACE_SCOPE_DETAIL("dedup", packContent.name());
         bool findIdentical = false;
         for (auto& content: inputContent) {
             if (content.isIdentical(packContent)) {
@@ -191,13 +362,31 @@ bool SpriteAtlas::generate(SpriteAtlasGenerateProgress* progress) {
     }
     if (skipSprites)
         qDebug() << "Total skip sprites: " << skipSprites;
+    if (reusedSprites)
+        qDebug() << "Reused sprites:" << reusedSprites;
 
     bool result = false;
+    _placements.clear();
     if ((_algorithm == "Polygon") && (_polygonMode.enable)) {
         result = packWithPolygon(inputContent);
+    } else if (packIncremental(inputContent)) {
+        result = true;
     } else {
         result = packWithRect(inputContent);
+        if (result && (_outputData.size() == 1)) {
+            qint64 area = 0;
+            for (const RectPlacement& placement: _placements) {
+                area += (qint64)placement.rect.width() * placement.rect.height();
+            }
+            const QSize canvas = _pageSize - QSize(_textureBorder * 2, _textureBorder * 2);
+            _packedOccupancy = (float)area / qMax<qint64>(1, (qint64)canvas.width() * canvas.height());
+        }
+    }
+    // only single page layouts are updated incrementally
+    if (_outputData.size() != 1) {
+        _placements.clear();
     }
+    _previous.reset();
 
     int elapsed = timePerform.elapsed();
     qDebug() << "Generate time mc:" <<  elapsed/1000.f << "sec";
@@ -206,6 +395,7 @@ bool SpriteAtlas::generate(SpriteAtlasGenerateProgress* progress) {
 }
 
 bool SpriteAtlas::packWithRect(const QVector<PackContent>& content) {
+    TRACE_SCOPE_DETAIL("rect pack", QString("%1 sprites").arg(content.size()));
     if (_progress)
         _progress->setProgressText("Optimizing atlas...");
 
@@ -245,6 +435,7 @@ bool SpriteAtlas::packWithRect(const QVector<PackContent>& content) {
         while (1) {
             if (_aborted) return false;
 
+            TRACE_SCOPE_DETAIL("size search", QString("%1x%2").arg(w).arg(h));
             BinPack2D::CanvasArray<PackContent> canvasArray = BinPack2D::UniformCanvasArrayBuilder<PackContent>(w - _textureBorder*2, h - _textureBorder*2, 1).Build();
 
             bool success = canvasArray.Place(inputContent, remainder);
@@ -295,6 +486,7 @@ bool SpriteAtlas::packWithRect(const QVector<PackContent>& content) {
             if (_forceSquared) {
                 h = w;
             }
+            TRACE_SCOPE_DETAIL("size search", QString("%1x%2").arg(w).arg(h));
             BinPack2D::CanvasArray<PackContent> canvasArray = BinPack2D::UniformCanvasArrayBuilder<PackContent>(w - _textureBorder*2, h - _textureBorder*2, 1).Build();
 
             bool success = canvasArray.Place(inputContent, remainder);
@@ -315,6 +507,7 @@ bool SpriteAtlas::packWithRect(const QVector<PackContent>& content) {
                 if (_aborted) return false;
 
                 h = h/2;
+                TRACE_SCOPE_DETAIL("size search", QString("%1x%2").arg(w).arg(h));
                 BinPack2D::CanvasArray<PackContent> canvasArray = BinPack2D::UniformCanvasArrayBuilder<PackContent>(w - _textureBorder*2, h - _textureBorder*2, 1).Build();
 
                 bool success = canvasArray.Place(inputContent, remainder);
@@ -335,6 +528,7 @@ bool SpriteAtlas::packWithRect(const QVector<PackContent>& content) {
         while (1) {
             if (_aborted) return false;
 
+            TRACE_SCOPE_DETAIL("size search", QString("%1x%2").arg(w).arg(h));
             BinPack2D::CanvasArray<PackContent> canvasArray = BinPack2D::UniformCanvasArrayBuilder<PackContent>(w - _textureBorder*2, h - _textureBorder*2, 1).Build();
 
             bool success = canvasArray.Place(inputContent, remainder);
@@ -387,6 +581,7 @@ bool SpriteAtlas::packWithRect(const QVector<PackContent>& content) {
             if (_forceSquared) {
                 h = w;
             }
+            TRACE_SCOPE_DETAIL("size search", QString("%1x%2").arg(w).arg(h));
             BinPack2D::CanvasArray<PackContent> canvasArray = BinPack2D::UniformCanvasArrayBuilder<PackContent>(w - _textureBorder*2, h - _textureBorder*2, 1).Build();
 
             bool success = canvasArray.Place(inputContent, remainder);
@@ -408,6 +603,7 @@ bool SpriteAtlas::packWithRect(const QVector<PackContent>& content) {
                 if (_aborted) return false;
 
                 h -= step;
+                TRACE_SCOPE_DETAIL("size search", QString("%1x%2").arg(w).arg(h));
                 BinPack2D::CanvasArray<PackContent> canvasArray = BinPack2D::UniformCanvasArrayBuilder<PackContent>(w - _textureBorder*2, h - _textureBorder*2, 1).Build();
 
                 bool success = canvasArray.Place(inputContent, remainder);
@@ -427,31 +623,127 @@ bool SpriteAtlas::packWithRect(const QVector<PackContent>& content) {
     if (_progress)
         _progress->setProgressText(QString("Found optimize size: %1x%2").arg(w).arg(h));
 
+    QVector<PackContent> placedContent;
+    QVector<RectPlacement> placements;
+    for (auto itor = outputContent.Get().begin(); itor != outputContent.Get().end(); itor++) {
+        const BinPack2D::Content<PackContent> &content = *itor;
+        placedContent.push_back(content.content);
+        placements.push_back({QRect(content.coord.x, content.coord.y, content.size.w, content.size.h), content.rotated});
+    }
+    return renderRectPage(QSize(w, h), placedContent, placements);
+}
+
+bool SpriteAtlas::packIncremental(const QVector<PackContent>& content) {
+    if (!_previous || _previous->_placements.isEmpty() || !samePackSettings(*_previous)) {
+        return false;
+    }
+    TRACE_SCOPE_DETAIL("incremental pack", QString("%1 sprites").arg(content.size()));
+
+    const QSize pageSize = _previous->_pageSize;
+    const QRect canvas(0, 0, pageSize.width() - _textureBorder * 2, pageSize.height() - _textureBorder * 2);
+    RectGrid grid(canvas.size());
+
+    // sprites that kept their size keep their place
+    QVector<RectPlacement> placements(content.size());
+    QVector<int> pending;
+    QVector<QPoint> candidates;
+    candidates.push_back(QPoint(0, 0));
+    QSet<QString> kept;
+    for (int i = 0; i < content.size(); ++i) {
+        const QSize size(content[i].rect().width() + _spriteBorder, content[i].rect().height() + _spriteBorder);
+        auto it = _previous->_placements.find(content[i].name());
+        if ((it != _previous->_placements.end()) && ((it.value().rotated? it.value().rect.size().transposed() : it.value().rect.size()) == size)) {
+            placements[i] = it.value();
+            grid.insert(it.value().rect);
+            candidates.push_back(it.value().rect.topRight() + QPoint(1, 0));
+            candidates.push_back(it.value().rect.bottomLeft() + QPoint(0, 1));
+            kept.insert(content[i].name());
+        } else {
+            pending.push_back(i);
+        }
+    }
+    // the places of removed and resized sprites are free now
+    for (auto it = _previous->_placements.cbegin(); it != _previous->_placements.cend(); ++it) {
+        if (!kept.contains(it.key())) {
+            candidates.push_back(it.value().rect.topLeft());
+        }
+    }
+
+    // the rest goes into the free space, larger sprites first like the full pack,
+    // each one at the free top left closest to the top of the page
+    std::stable_sort(pending.begin(), pending.end(), [&content](int a, int b) {
+        return content[a].rect().width() * content[a].rect().height() > content[b].rect().width() * content[b].rect().height();
+    });
+    for (int i: pending) {
+        if (_aborted) return false;
+
+        const QSize size(content[i].rect().width() + _spriteBorder, content[i].rect().height() + _spriteBorder);
+        bool found = false;
+        RectPlacement best = {QRect(), false};
+        for (bool rotated: {false, true}) {
+            if (rotated && !_rotateSprites) break;
+            const QSize placedSize = rotated? size.transposed() : size;
+            for (const QPoint& candidate: candidates) {
+                QRect rect(candidate, placedSize);
+                if (!canvas.contains(rect) || grid.intersects(rect)) continue;
+                if (!found || (rect.y() < best.rect.y()) || ((rect.y() == best.rect.y()) && (rect.x() < best.rect.x()))) {
+                    best = {rect, rotated};
+                    found = true;
+                }
+            }
+        }
+        if (!found) {
+            qDebug() << "Incremental update: no room for" << content[i].name() << ", full repack";
+            return false;
+        }
+        placements[i] = best;
+        grid.insert(best.rect);
+        candidates.push_back(best.rect.topRight() + QPoint(1, 0));
+        candidates.push_back(best.rect.bottomLeft() + QPoint(0, 1));
+    }
+
+    qint64 area = 0;
+    for (const RectPlacement& placement: placements) {
+        area += (qint64)placement.rect.width() * placement.rect.height();
+    }
+    const float occupancy = (float)area / qMax<qint64>(1, (qint64)canvas.width() * canvas.height());
+    if (occupancy < _previous->_packedOccupancy * kIncrementalOccupancy) {
+        qDebug() << "Incremental update: occupancy" << occupancy << "of" << _previous->_packedOccupancy << ", full repack";
+        return false;
+    }
+
+    qDebug() << "Incremental update:" << kept.size() << "sprites kept," << pending.size() << "placed";
+    _packedOccupancy = _previous->_packedOccupancy;
+    return renderRectPage(pageSize, content, placements);
+}
+
+bool SpriteAtlas::renderRectPage(const QSize& size, const QVector<PackContent>& content, const QVector<RectPlacement>& placements) {
+    TRACE_SCOPE_DETAIL("composite", QString("%1x%2").arg(size.width()).arg(size.height()));
     OutputData outputData;
 
     // parse output.
-    outputData._atlasImage = QImage(w, h, QImage::Format_RGBA8888);
+    outputData._atlasImage = QImage(size.width(), size.height(), QImage::Format_RGBA8888);
     outputData._atlasImage.fill(QColor(0, 0, 0, 0));
     QPainter painter(&outputData._atlasImage);
-    for(auto itor = outputContent.Get().begin(); itor != outputContent.Get().end(); itor++ ) {
+    for (int i = 0; i < content.size(); ++i) {
         if (_aborted) return false;
 
-        const BinPack2D::Content<PackContent> &content = *itor;
+        const RectPlacement& placement = placements[i];
 
         // retreive your data.
-        const PackContent &packContent = content.content;
+        const PackContent &packContent = content[i];
         //qDebug() << packContent.mName << packContent.mRect;
 
         // image
         QImage image;
-        if (content.rotated) {
+        if (placement.rotated) {
             image = packContent.image().copy(packContent.rect());
             image = rotate90(image);
         }
 
         SpriteFrameInfo spriteFrame;
         spriteFrame.triangles = packContent.triangles();
-        spriteFrame.frame = QRect(content.coord.x + _textureBorder, content.coord.y + _textureBorder, content.size.w - _spriteBorder, content.size.h - _spriteBorder);
+        spriteFrame.frame = QRect(placement.rect.x() + _textureBorder, placement.rect.y() + _textureBorder, placement.rect.width() - _spriteBorder, placement.rect.height() - _spriteBorder);
         if (spriteFrame.triangles.indices.size()) {
             spriteFrame.offset = QPoint(
                         packContent.rect().left(),
@@ -459,24 +751,25 @@ bool SpriteAtlas::packWithRect(const QVector<PackContent>& content) {
                         );
         } else {
             spriteFrame.offset = QPoint(
-                        (packContent.rect().left() + (-packContent.image().width() + content.size.w - _spriteBorder) * 0.5f),
-                        (-packContent.rect().top() + ( packContent.image().height() - content.size.h + _spriteBorder) * 0.5f)
+                        (packContent.rect().left() + (-packContent.image().width() + placement.rect.width() - _spriteBorder) * 0.5f),
+                        (-packContent.rect().top() + ( packContent.image().height() - placement.rect.height() + _spriteBorder) * 0.5f)
                         );
         }
-        spriteFrame.rotated = content.rotated;
+        spriteFrame.rotated = placement.rotated;
         spriteFrame.sourceColorRect = packContent.rect();
         spriteFrame.sourceSize = packContent.image().size();
-        if (content.rotated) {
-            spriteFrame.frame = QRect(content.coord.x, content.coord.y, content.size.h-_spriteBorder, content.size.w-_spriteBorder);
+        if (placement.rotated) {
+            spriteFrame.frame = QRect(placement.rect.x(), placement.rect.y(), placement.rect.height()-_spriteBorder, placement.rect.width()-_spriteBorder);
 
         }
-        if (content.rotated) {
-            painter.drawImage(QPoint(content.coord.x + _textureBorder, content.coord.y + _textureBorder), image);
+        if (placement.rotated) {
+            painter.drawImage(QPoint(placement.rect.x() + _textureBorder, placement.rect.y() + _textureBorder), image);
         } else {
-            painter.drawImage(QPoint(content.coord.x + _textureBorder, content.coord.y + _textureBorder), packContent.image(), packContent.rect());
+            painter.drawImage(QPoint(placement.rect.x() + _textureBorder, placement.rect.y() + _textureBorder), packContent.image(), packContent.rect());
         }
 
         outputData._spriteFrames[packContent.name()] = spriteFrame;
+        _placements[packContent.name()] = placement;
 
         // add ident to sprite frames
         auto identicalIt = _identicalFrames.find(packContent.name());
@@ -492,6 +785,7 @@ bool SpriteAtlas::packWithRect(const QVector<PackContent>& content) {
 
     painter.end();
     _outputData.push_front(outputData);
+    _pageSize = size;
 
     return true;
 }
@@ -521,10 +815,14 @@ bool SpriteAtlas::packWithPolygon(const QVector<PackContent>& content) {
 
     PolyPack2D::Container<PackContent> container;
     // TODO: abort this place if _aborted
-    container.place(inputContent, _maxTextureSize, 5, std::bind(&SpriteAtlas::onPlaceCallback, this, std::placeholders::_1, std::placeholders::_2));
+    {
+        TRACE_SCOPE_DETAIL("polygon pack", QString("%1 sprites").arg(content.size()));
+        container.place(inputContent, _maxTextureSize, 5, std::bind(&SpriteAtlas::onPlaceCallback, this, std::placeholders::_1, std::placeholders::_2));
+    }
 
     auto outputContent = container.contentList();
 
+    TRACE_SCOPE_DETAIL("composite", QString("%1x%2").arg(container.bounds().width()).arg(container.bounds().height()));
     OutputData outputData;
 
     outputData._atlasImage = QImage(container.bounds().width() + _textureBorder * 2, container.bounds().height() + _textureBorder * 2, QImage::Format_RGBA8888);
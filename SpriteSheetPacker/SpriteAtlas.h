@@ -24,8 +24,11 @@ public:
 
     bool isIdentical(const PackContent& other);
     void trim(int alpha);
+    // of the pixels isIdentical() compares, call after trim()
+    void computeHash();
     void setTriangles(const Triangles& triangles) { _triangles = triangles; }
     void setPolygons(const Polygons& polygons) { _polygons = polygons; }
+    void setName(const QString& name) { _name = name; }
 
     const QString& name() const { return _name; }
     const QImage& image() const { return _image; }
@@ -37,10 +40,35 @@ private:
     QString _name;
     QImage  _image;
     QRect   _rect;
+    quint64 _hash;
     Triangles _triangles;
     Polygons  _polygons;
 };
 
+// Sprites prepared by the atlases of a long running process, for every atlas
+// that is given the cache: projects that pack the same files with the same
+// scale, trim and polygon settings load and trim them once. The least
+// recently used sprites are dropped above maxKBytes of pixels. Thread safe.
+class SpriteContentCache
+{
+public:
+    explicit SpriteContentCache(int maxKBytes) : _cache(maxKBytes) { }
+
+    // false when key is unknown or the file changed since it was inserted
+    bool find(const QString& key, const QFileInfo& fileInfo, PackContent* content);
+    void insert(const QString& key, const QFileInfo& fileInfo, const PackContent& content);
+
+private:
+    struct Entry {
+        QDateTime   lastModified;
+        qint64      fileSize;
+        PackContent content;
+    };
+
+    QMutex                 _mutex;
+    QCache<QString, Entry> _cache;
+};
+
 class SpriteAtlasGenerateProgress: public QObject
 {
     Q_OBJECT
@@ -80,6 +108,20 @@ public:
 
     void setRotateSprites(bool value) { _rotateSprites = value; }
 
+    // Reuses the last generation of previous, the atlas of the same variant
+    // before an edit: source files that did not change are not read and
+    // trimmed again, and with the same packing settings every sprite that
+    // kept its size keeps its place. Added and resized sprites go into the
+    // free space of that layout; the atlas is packed from scratch only when
+    // they don't fit or the page gets too sparse.
+    void setPreviousGeneration(const SpriteAtlas& previous);
+    // sprites not in the previous generation are looked up in cache before
+    // they are loaded, and added to it after; cache must outlive the atlas
+    void setSharedContentCache(SpriteContentCache* cache) { _sharedContentCache = cache; }
+
+    // the files of source folders that are packed
+    static QStringList imageNameFilters() { return QStringList() << "*.png" << "*.jpg" << "*.jpeg" << "*.gif" << "*.bmp"; }
+
     bool generate(SpriteAtlasGenerateProgress* progress = nullptr);
     void abortGeneration() { _aborted = true; }
 
@@ -88,9 +130,31 @@ public:
 
     const QVector<OutputData>& outputData() const { return _outputData; }
     const QMap<QString, QVector<QString>>& identicalFrames() const { return _identicalFrames; }
+    // the image files the last generate() packed, sorted
+    QStringList sourceFiles() const { QStringList files = _contentCache.keys(); files.sort(); return files; }
 
 protected:
+    // where the rect packer put a sprite: the rect includes the sprite
+    // border and is already swapped for rotated sprites
+    struct RectPlacement {
+        QRect rect;
+        bool  rotated;
+    };
+
+    struct CachedContent {
+        QDateTime   lastModified;
+        qint64      fileSize;
+        PackContent content;
+    };
+
+    bool sameContentSettings(const SpriteAtlas& other) const;
+    // filePath with the settings sameContentSettings() compares
+    QString sharedContentKey(const QString& filePath) const;
+    bool samePackSettings(const SpriteAtlas& other) const;
+
     bool packWithRect(const QVector<PackContent>& content);
+    bool packIncremental(const QVector<PackContent>& content);
+    bool renderRectPage(const QSize& size, const QVector<PackContent>& content, const QVector<RectPlacement>& placements);
     bool packWithPolygon(const QVector<PackContent>& content);
 
     void onPlaceCallback(int current, int count);
@@ -119,6 +183,16 @@ private:
     QVector<OutputData> _outputData;
     QMap<QString, QVector<QString>> _identicalFrames;
 
+    // kept for the next generation: the prepared sprites by file path, and
+    // the layout when the rect packer produced a single page
+    QHash<QString, CachedContent> _contentCache;
+    QHash<QString, RectPlacement> _placements;
+    QSize _pageSize;
+    // of the last full pack, incremental updates must not fall far below it
+    float _packedOccupancy;
+    QSharedPointer<SpriteAtlas> _previous;
+    SpriteContentCache* _sharedContentCache;
+
     bool _aborted;
 };
 
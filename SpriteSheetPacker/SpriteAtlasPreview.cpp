@@ -30,7 +30,7 @@ SpriteAtlasPreview::~SpriteAtlasPreview()
     delete ui;
 }
 
-void SpriteAtlasPreview::setAtlas(const SpriteAtlas& atlas, PixelFormat pixelFormat, bool premultiplied) {
+void SpriteAtlasPreview::setAtlas(const SpriteAtlas& atlas, PixelFormat pixelFormat, bool premultiplied, DitherMode dithering) {
 
     if (_scene) {
         if (_outlinesGroup)
@@ -50,7 +50,7 @@ void SpriteAtlasPreview::setAtlas(const SpriteAtlas& atlas, PixelFormat pixelFor
         if (!spriteFrames.size()) continue;
 
 
-        QGraphicsPixmapItem* atlasPixmapItem = _scene->addPixmap(QPixmap::fromImage(convertImage(atlasImage, pixelFormat, premultiplied)));
+        QGraphicsPixmapItem* atlasPixmapItem = _scene->addPixmap(QPixmap::fromImage(convertImage(atlasImage, pixelFormat, premultiplied, dithering)));
         atlasPixmapItem->setPos(atlasPositionX, 0);
         atlasPositionX += atlasPixmapItem->boundingRect().width() + 100;
 
@@ -4,6 +4,7 @@
 #include <QtWidgets>
 #include "SpriteAtlas.h"
 #include "ImageFormat.h"
+#include "ImageConverter.h"
 
 namespace Ui {
 class SpriteAtlasPreview;
@@ -17,7 +18,7 @@ public:
     explicit SpriteAtlasPreview(QWidget *parent = 0);
     ~SpriteAtlasPreview();
 
-    void setAtlas(const SpriteAtlas& atlas, PixelFormat pixelFormat, bool premultiplied);
+    void setAtlas(const SpriteAtlas& atlas, PixelFormat pixelFormat, bool premultiplied, DitherMode dithering = kDitherNone);
 
 public slots:
     void on_toolButtonZoomOut_clicked();
@@ -7,6 +7,12 @@
 
 GenericObjectFactory<std::string, SpritePackerProjectFile> SpritePackerProjectFile::_factory;
 
+void SpritePackerProjectFile::registerFileTypes() {
+    _factory.set<SpritePackerProjectFile>("json");
+    _factory.set<SpritePackerProjectFile>("ssp");
+    _factory.set<SpritePackerProjectFileTPS>("tps");
+}
+
 SpritePackerProjectFile::SpritePackerProjectFile() {
     _algorithm = "Rect";
     _trimMode = "Rect";
@@ -19,6 +25,10 @@ SpritePackerProjectFile::SpritePackerProjectFile() {
     _imageFormat = kPNG,
     _pixelFormat = kARGB8888;
     _premultiplied = true;
+    _dithering = kDitherNone;
+    _textureQuality = kTextureNormal;
+    _supercompression = kSupercompressionZlib;
+    _mipmaps = false;
     _pngOptMode = "None";
     _pngOptLevel = 7;
     _jpgQuality = 80;
@@ -55,6 +65,10 @@ bool SpritePackerProjectFile::read(const QString &fileName) {
     if (json.contains("imageFormat")) _imageFormat = imageFormatFromString(json["imageFormat"].toString());
     if (json.contains("pixelFormat")) _pixelFormat = pixelFormatFromString(json["pixelFormat"].toString());
     if (json.contains("premultiplied")) _premultiplied = json["premultiplied"].toBool();
+    if (json.contains("dithering")) _dithering = ditherModeFromString(json["dithering"].toString());
+    if (json.contains("textureQuality")) _textureQuality = textureQualityFromString(json["textureQuality"].toString());
+    if (json.contains("supercompression")) _supercompression = supercompressionFromString(json["supercompression"].toString());
+    if (json.contains("mipmaps")) _mipmaps = json["mipmaps"].toBool();
     if (json.contains("pngOptMode")) _pngOptMode = json["pngOptMode"].toString();
     if (json.contains("pngOptLevel")) _pngOptLevel = json["pngOptLevel"].toInt();
     if (json.contains("webpQuality")) _webpQuality = json["webpQuality"].toInt();
@@ -107,6 +121,10 @@ bool SpritePackerProjectFile::write(const QString &fileName) {
     json["imageFormat"] = imageFormatToString(_imageFormat);
     json["pixelFormat"] = pixelFormatToString(_pixelFormat);
     json["premultiplied"] = _premultiplied;
+    json["dithering"] = ditherModeToString(_dithering);
+    json["textureQuality"] = textureQualityToString(_textureQuality);
+    json["supercompression"] = supercompressionToString(_supercompression);
+    json["mipmaps"] = _mipmaps;
     json["pngOptMode"] = _pngOptMode;
     json["pngOptLevel"] = _pngOptLevel;
     json["webpQuality"] = _webpQuality;
@@ -52,6 +52,18 @@ public:
     void setPremultiplied(bool premultiplied) { _premultiplied = premultiplied; }
     bool premultiplied() const { return _premultiplied; }
 
+    void setDithering(DitherMode dithering) { _dithering = dithering; }
+    DitherMode dithering() const { return _dithering; }
+
+    void setTextureQuality(TextureQuality textureQuality) { _textureQuality = textureQuality; }
+    TextureQuality textureQuality() const { return _textureQuality; }
+
+    void setSupercompression(Supercompression supercompression) { _supercompression = supercompression; }
+    Supercompression supercompression() const { return _supercompression; }
+
+    void setMipmaps(bool mipmaps) { _mipmaps = mipmaps; }
+    bool mipmaps() const { return _mipmaps; }
+
     void setPngOptMode(const QString& optMode) { _pngOptMode = optMode; }
     const QString& pngOptMode() const { return _pngOptMode; }
 
@@ -91,6 +103,8 @@ public:
     virtual bool write(const QString& fileName);
     virtual bool read(const QString& fileName);
 
+    // the readers of *.json, *.ssp and *.tps project files, by suffix
+    static void registerFileTypes();
     static GenericObjectFactory<std::string, SpritePackerProjectFile>& factory() {
         return _factory;
     }
@@ -107,6 +121,10 @@ protected:
     ImageFormat _imageFormat;
     PixelFormat _pixelFormat;
     bool        _premultiplied;
+    DitherMode  _dithering;
+    TextureQuality _textureQuality;
+    Supercompression _supercompression;
+    bool        _mipmaps;
 
     QString     _pngOptMode;
     int         _pngOptLevel;
@@ -22,21 +22,17 @@ CONFIG(release,debug|release) {
     linux: DESTDIR = $$OUT_PWD
 }
 
-INCLUDEPATH += 3rdparty
+# packing, publishing and project files
+include(sspcore/sspcore.pri)
 
 SOURCES += main.cpp\
     MainWindow.cpp \
-    SpriteAtlas.cpp \
     ScalingVariantWidget.cpp \
-    SpritePackerProjectFile.cpp \
-    PngOptimizer.cpp \
-    PublishSpriteSheet.cpp \
     PreferencesDialog.cpp \
     PublishStatusDialog.cpp \
     AboutDialog.cpp \
     SpritesTreeWidget.cpp \
     command-line.cpp \
-    PolygonImage.cpp \
     SpriteAtlasPreview.cpp \
     StatusBarWidget.cpp \
     UpdaterDialog.cpp \
@@ -46,19 +42,12 @@ SOURCES += main.cpp\
     ElapsedTimer.cpp
 
 HEADERS += MainWindow.h \
-    ImageRotate.h \
-    SpriteAtlas.h \
     ScalingVariantWidget.h \
-    SpritePackerProjectFile.h \
-    PngOptimizer.h \
-    PublishSpriteSheet.h \
     PreferencesDialog.h \
     PublishStatusDialog.h \
     AboutDialog.h \
     SpritesTreeWidget.h \
-    PolygonImage.h \
     SpriteAtlasPreview.h \
-    ImageFormat.h \
     StatusBarWidget.h \
     UpdaterDialog.h \
     ContentProtectionDialog.h \
@@ -66,16 +55,6 @@ HEADERS += MainWindow.h \
     AnimationDialog.h \
     ElapsedTimer.h
 
-#algorithm
-INCLUDEPATH += algorithm
-
-HEADERS += algorithm/binpack2d.hpp \
-    algorithm/triangle_triangle_intersection.h \
-    algorithm/polypack2d.h
-
-SOURCES += algorithm/polypack2d.cpp
-
-
 #other...
 
 FORMS += MainWindow.ui \
@@ -91,15 +70,6 @@ FORMS += MainWindow.ui \
 
 RESOURCES += resources.qrc
 
-include(TPSParser/TPSParser.pri)
-include(3rdparty/optipng/optipng.pri)
-include(3rdparty/qtplist-master/qtplist-master.pri)
-include(3rdparty/clipper/clipper.pri)
-include(3rdparty/poly2tri/poly2tri.pri)
-include(3rdparty/pngquant/pngquant.pri)
-include(3rdparty/lodepng/lodepng.pri)
-include(3rdparty/PVRTexTool/PVRTexTool.pri)
-
 OTHER_FILES += \
     defaultFormats/cocos2d.js \
     defaultFormats/cocos2d-old.js \
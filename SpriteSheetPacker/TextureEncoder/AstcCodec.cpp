@@ -0,0 +1,947 @@
+#include "AstcCodec.h"
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Perceptual channel weights (0.299, 0.587, 0.114) scaled by 128, alpha
+// weighs as much as a gray difference.
+const int kWeights[4] = { 38, 75, 15, 128 };
+
+// Square roots of the channel weights divided by 128, the endpoint fits
+// run in this scaled space.
+const float kMetric[4] = { 0.5449f, 0.7655f, 0.3423f, 1.f };
+
+const int kMaxTexels = 64;
+const int kMaxGridWeights = 64;
+
+inline int bit(int value, int index) {
+    return (value >> index) & 1;
+}
+
+inline void setBits(uint8_t* data, int offset, int count, uint32_t value) {
+    for (int i = 0; i < count; ++i, ++offset) {
+        if ((value >> i) & 1) {
+            data[offset >> 3] |= 1 << (offset & 7);
+        }
+    }
+}
+
+inline uint32_t getBits(const uint8_t* data, int offset, int count) {
+    uint32_t value = 0;
+    for (int i = 0; i < count; ++i, ++offset) {
+        value |= (uint32_t)((data[offset >> 3] >> (offset & 7)) & 1) << i;
+    }
+    return value;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Integer sequence encoding
+
+// Quantization ranges of the integer sequence encoding. The weights use the
+// first twelve, the color endpoints all of them.
+struct IseRange {
+    int levels;
+    int trits;
+    int quints;
+    int bits;
+};
+
+const IseRange kIseRanges[] = {
+    {   2, 0, 0, 1 }, {   3, 1, 0, 0 }, {   4, 0, 0, 2 }, {   5, 0, 1, 0 },
+    {   6, 1, 0, 1 }, {   8, 0, 0, 3 }, {  10, 0, 1, 1 }, {  12, 1, 0, 2 },
+    {  16, 0, 0, 4 }, {  20, 0, 1, 2 }, {  24, 1, 0, 3 }, {  32, 0, 0, 5 },
+    {  40, 0, 1, 3 }, {  48, 1, 0, 4 }, {  64, 0, 0, 6 }, {  80, 0, 1, 4 },
+    {  96, 1, 0, 5 }, { 128, 0, 0, 7 }, { 160, 0, 1, 5 }, { 192, 1, 0, 6 },
+    { 256, 0, 0, 8 }
+};
+
+const int kWeightRanges = 12;
+const int kColorRanges = 21;
+// smallest endpoint range a valid block may end up with
+const int kMinColorRange = 4;
+
+int iseBitCount(int range, int count) {
+    const IseRange& r = kIseRanges[range];
+    return r.bits * count + (r.trits ? (8 * count + 4) / 5 : 0) + (r.quints ? (7 * count + 2) / 3 : 0);
+}
+
+void decodeTrits(int T, int t[5]) {
+    int C;
+    if (((T >> 2) & 7) == 7) {
+        C = (((T >> 5) & 7) << 2) | (T & 3);
+        t[4] = 2;
+        t[3] = 2;
+    } else {
+        C = T & 0x1f;
+        if (((T >> 5) & 3) == 3) {
+            t[4] = 2;
+            t[3] = bit(T, 7);
+        } else {
+            t[4] = bit(T, 7);
+            t[3] = (T >> 5) & 3;
+        }
+    }
+
+    if ((C & 3) == 3) {
+        t[2] = 2;
+        t[1] = bit(C, 4);
+        t[0] = (bit(C, 3) << 1) | (bit(C, 2) & ~bit(C, 3) & 1);
+    } else if (((C >> 2) & 3) == 3) {
+        t[2] = 2;
+        t[1] = 2;
+        t[0] = C & 3;
+    } else {
+        t[2] = bit(C, 4);
+        t[1] = (C >> 2) & 3;
+        t[0] = (bit(C, 1) << 1) | (bit(C, 0) & ~bit(C, 1) & 1);
+    }
+}
+
+void decodeQuints(int Q, int q[3]) {
+    if ((((Q >> 1) & 3) == 3) && (((Q >> 5) & 3) == 0)) {
+        q[2] = (bit(Q, 0) << 2) | ((bit(Q, 4) & ~bit(Q, 0) & 1) << 1) | (bit(Q, 3) & ~bit(Q, 0) & 1);
+        q[1] = 4;
+        q[0] = 4;
+    } else {
+        int C;
+        if (((Q >> 1) & 3) == 3) {
+            q[2] = 4;
+            C = (((Q >> 3) & 3) << 3) | ((~(Q >> 5) & 3) << 1) | bit(Q, 0);
+        } else {
+            q[2] = (Q >> 5) & 3;
+            C = Q & 0x1f;
+        }
+        if ((C & 7) == 5) {
+            q[1] = 4;
+            q[0] = (C >> 3) & 3;
+        } else {
+            q[1] = (C >> 3) & 3;
+            q[0] = C & 7;
+        }
+    }
+}
+
+// Bit replication of an n bit value to 8 bits.
+int replicate(int value, int bits, int targetBits) {
+    int result = 0;
+    for (int shift = targetBits - bits; shift > -bits; shift -= bits) {
+        result |= (shift >= 0) ? (value << shift) : (value >> -shift);
+    }
+    return result & ((1 << targetBits) - 1);
+}
+
+int unquantizeColor(int range, int code) {
+    const IseRange& r = kIseRanges[range];
+    if (!r.trits && !r.quints) {
+        return replicate(code, r.bits, 8);
+    }
+
+    const int d = code >> r.bits;
+    const int m = code & ((1 << r.bits) - 1);
+    const int a = (m & 1) ? 0x1ff : 0;
+    const int b = bit(m, 1), c = bit(m, 2), dd = bit(m, 3), e = bit(m, 4), f = bit(m, 5);
+    int B = 0, C = 0;
+    switch (r.levels) {
+        case 6:   C = 204; break;
+        case 10:  C = 113; break;
+        case 12:  C = 93;  B = (b << 8) | (b << 4) | (b << 2) | (b << 1); break;
+        case 20:  C = 54;  B = (b << 8) | (b << 3) | (b << 2); break;
+        case 24:  C = 44;  B = (c << 8) | (b << 7) | (c << 3) | (b << 2) | (c << 1) | b; break;
+        case 40:  C = 26;  B = (c << 8) | (b << 7) | (c << 2) | (b << 1) | c; break;
+        case 48:  C = 22;  B = (dd << 8) | (c << 7) | (b << 6) | (dd << 2) | (c << 1) | b; break;
+        case 80:  C = 13;  B = (dd << 8) | (c << 7) | (b << 6) | (dd << 1) | c; break;
+        case 96:  C = 11;  B = (e << 8) | (dd << 7) | (c << 6) | (b << 5) | (e << 1) | dd; break;
+        case 160: C = 6;   B = (e << 8) | (dd << 7) | (c << 6) | (b << 5) | e; break;
+        case 192: C = 5;   B = (f << 8) | (e << 7) | (dd << 6) | (c << 5) | (b << 4) | f; break;
+        default: break;
+    }
+    int t = (d * C + B) ^ a;
+    return (a & 0x80) | (t >> 2);
+}
+
+int unquantizeWeight(int range, int code) {
+    const IseRange& r = kIseRanges[range];
+    int value;
+    if (!r.trits && !r.quints) {
+        value = replicate(code, r.bits, 6);
+    } else if (r.bits == 0) {
+        // 3 and 5 levels are spread evenly over 0..64
+        return code * 64 / (r.levels - 1);
+    } else {
+        const int d = code >> r.bits;
+        const int m = code & ((1 << r.bits) - 1);
+        const int a = (m & 1) ? 0x7f : 0;
+        const int b = bit(m, 1), c = bit(m, 2);
+        int B = 0, C = 0;
+        switch (r.levels) {
+            case 6:  C = 50; break;
+            case 10: C = 28; break;
+            case 12: C = 23; B = (b << 6) | (b << 2) | b; break;
+            case 20: C = 13; B = (b << 6) | (b << 1); break;
+            case 24: C = 11; B = (c << 6) | (b << 5) | (c << 1) | b; break;
+            default: break;
+        }
+        int t = (d * C + B) ^ a;
+        value = (a & 0x20) | (t >> 2);
+    }
+    return (value > 32) ? value + 1 : value;
+}
+
+struct IseTables {
+    uint8_t tritEncode[3][3][3][3][3];
+    uint8_t quintEncode[5][5][5];
+    uint8_t colorUnquantized[kColorRanges][256];
+    uint8_t colorQuantized[kColorRanges][256];    // nearest code of every 8 bit value
+    uint8_t weightUnquantized[kWeightRanges][32];
+    uint8_t weightQuantized[kWeightRanges][65];   // nearest code of every weight
+
+    IseTables() {
+        // walk down so the smallest encoding of every tuple wins, it keeps
+        // the bits a shortened last group drops at zero
+        for (int T = 255; T >= 0; --T) {
+            int t[5];
+            decodeTrits(T, t);
+            tritEncode[t[0]][t[1]][t[2]][t[3]][t[4]] = T;
+        }
+        for (int Q = 127; Q >= 0; --Q) {
+            int q[3];
+            decodeQuints(Q, q);
+            quintEncode[q[0]][q[1]][q[2]] = Q;
+        }
+
+        for (int range = 0; range < kColorRanges; ++range) {
+            const int levels = kIseRanges[range].levels;
+            for (int code = 0; code < levels; ++code) {
+                colorUnquantized[range][code] = unquantizeColor(range, code);
+            }
+            for (int value = 0; value < 256; ++value) {
+                colorQuantized[range][value] = nearest(colorUnquantized[range], levels, value);
+            }
+        }
+        for (int range = 0; range < kWeightRanges; ++range) {
+            const int levels = kIseRanges[range].levels;
+            for (int code = 0; code < levels; ++code) {
+                weightUnquantized[range][code] = unquantizeWeight(range, code);
+            }
+            for (int value = 0; value <= 64; ++value) {
+                weightQuantized[range][value] = nearest(weightUnquantized[range], levels, value);
+            }
+        }
+    }
+
+    static int nearest(const uint8_t* values, int count, int value) {
+        int best = 0;
+        for (int code = 1; code < count; ++code) {
+            if (std::abs(values[code] - value) < std::abs(values[best] - value)) {
+                best = code;
+            }
+        }
+        return best;
+    }
+};
+
+const IseTables& iseTables() {
+    static IseTables tables;
+    return tables;
+}
+
+// Bit positions of the trit (quint) block inside a group of 5 (3) values.
+const int kTritBits[5][2] = { { 0, 2 }, { 2, 2 }, { 4, 1 }, { 5, 2 }, { 7, 1 } };
+const int kQuintBits[3][2] = { { 0, 3 }, { 3, 2 }, { 5, 2 } };
+
+// Writes the values as an integer sequence into a zeroed bit buffer.
+void encodeIse(int range, const uint8_t* values, int count, uint8_t* data, int offset) {
+    const IseRange& r = kIseRanges[range];
+    const IseTables& tables = iseTables();
+    const int mask = (1 << r.bits) - 1;
+    const int group = r.trits ? 5 : (r.quints ? 3 : 1);
+
+    for (int first = 0; first < count; first += group) {
+        int high[5] = { 0, 0, 0, 0, 0 };
+        int n = std::min(group, count - first);
+        for (int j = 0; j < n; ++j) {
+            high[j] = values[first + j] >> r.bits;
+        }
+
+        int packed = 0;
+        if (r.trits) {
+            packed = tables.tritEncode[high[0]][high[1]][high[2]][high[3]][high[4]];
+        } else if (r.quints) {
+            packed = tables.quintEncode[high[0]][high[1]][high[2]];
+        }
+
+        for (int j = 0; j < n; ++j) {
+            setBits(data, offset, r.bits, values[first + j] & mask);
+            offset += r.bits;
+            if (r.trits || r.quints) {
+                const int* position = r.trits ? kTritBits[j] : kQuintBits[j];
+                setBits(data, offset, position[1], (packed >> position[0]) & ((1 << position[1]) - 1));
+                offset += position[1];
+            }
+        }
+    }
+}
+
+void decodeIse(int range, const uint8_t* data, int offset, int count, uint8_t* values) {
+    const IseRange& r = kIseRanges[range];
+    const int group = r.trits ? 5 : (r.quints ? 3 : 1);
+
+    for (int first = 0; first < count; first += group) {
+        int n = std::min(group, count - first);
+        int low[5];
+        int packed = 0;
+        for (int j = 0; j < n; ++j) {
+            low[j] = getBits(data, offset, r.bits);
+            offset += r.bits;
+            if (r.trits || r.quints) {
+                const int* position = r.trits ? kTritBits[j] : kQuintBits[j];
+                packed |= getBits(data, offset, position[1]) << position[0];
+                offset += position[1];
+            }
+        }
+
+        int high[5] = { 0, 0, 0, 0, 0 };
+        if (r.trits) {
+            decodeTrits(packed, high);
+        } else if (r.quints) {
+            decodeQuints(packed, high);
+        }
+        for (int j = 0; j < n; ++j) {
+            values[first + j] = (high[j] << r.bits) | low[j];
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Block modes and weight grids
+
+// Weight grid of an 11 bit block mode. Returns false for reserved modes and
+// for the layouts no valid block can use.
+bool decodeBlockMode(int mode, int& gridWidth, int& gridHeight, bool& dualPlane, int& weightRange) {
+    int range = (mode >> 4) & 1;
+    int high = (mode >> 9) & 1;
+    int dual = (mode >> 10) & 1;
+    const int a = (mode >> 5) & 3;
+
+    if (mode & 3) {
+        range |= (mode & 3) << 1;
+        int b = (mode >> 7) & 3;
+        switch ((mode >> 2) & 3) {
+            case 0: gridWidth = b + 4; gridHeight = a + 2; break;
+            case 1: gridWidth = b + 8; gridHeight = a + 2; break;
+            case 2: gridWidth = a + 2; gridHeight = b + 8; break;
+            default:
+                b &= 1;
+                if (mode & 0x100) {
+                    gridWidth = b + 2;
+                    gridHeight = a + 2;
+                } else {
+                    gridWidth = a + 2;
+                    gridHeight = b + 6;
+                }
+                break;
+        }
+    } else {
+        range |= ((mode >> 2) & 3) << 1;
+        if (((mode >> 2) & 3) == 0) {
+            return false;
+        }
+        const int b = (mode >> 9) & 3;
+        switch ((mode >> 7) & 3) {
+            case 0: gridWidth = 12; gridHeight = a + 2; break;
+            case 1: gridWidth = a + 2; gridHeight = 12; break;
+            case 2:
+                gridWidth = a + 6;
+                gridHeight = b + 6;
+                dual = 0;
+                high = 0;
+                break;
+            default:
+                if (a == 0) {
+                    gridWidth = 6;
+                    gridHeight = 10;
+                } else if (a == 1) {
+                    gridWidth = 10;
+                    gridHeight = 6;
+                } else {
+                    return false;
+                }
+                break;
+        }
+    }
+
+    dualPlane = dual != 0;
+    weightRange = range - 2 + 6 * high;
+    int weights = gridWidth * gridHeight * (dualPlane ? 2 : 1);
+    int bits = iseBitCount(weightRange, weights);
+    return (weights <= kMaxGridWeights) && (bits >= 24) && (bits <= 96);
+}
+
+// Endpoint range that fills the bits the weights leave, -1 if too small.
+int colorRangeFor(int weightBits, int colorValues) {
+    // block mode, partition count and endpoint mode take the first 17 bits
+    const int available = 128 - 17 - weightBits;
+    for (int range = kColorRanges - 1; range >= kMinColorRange; --range) {
+        if (iseBitCount(range, colorValues) <= available) {
+            return range;
+        }
+    }
+    return -1;
+}
+
+// One weight grid / quantization layout of a footprint.
+struct AstcLayout {
+    int gridWidth;
+    int gridHeight;
+    int weightRange;
+    int weightBits;
+    int colorRange[2];  // RGB (CEM 8), RGBA (CEM 12), -1 when it does not fit
+    int blockMode;
+
+    // bilinear infill of the texel weights from the grid, as the decoder does it
+    uint8_t infillIndex[kMaxTexels][4];
+    uint8_t infillWeight[kMaxTexels][4];
+};
+
+void computeInfill(int blockWidth, int blockHeight, AstcLayout& layout) {
+    const int ds = (1024 + blockWidth / 2) / (blockWidth - 1);
+    const int dt = (1024 + blockHeight / 2) / (blockHeight - 1);
+    const int gridWidth = layout.gridWidth;
+    const int last = layout.gridWidth * layout.gridHeight - 1;
+
+    for (int t = 0; t < blockHeight; ++t) {
+        for (int s = 0; s < blockWidth; ++s) {
+            int gs = (ds * s * (layout.gridWidth - 1) + 32) >> 6;
+            int gt = (dt * t * (layout.gridHeight - 1) + 32) >> 6;
+            int js = gs >> 4, fs = gs & 15;
+            int jt = gt >> 4, ft = gt & 15;
+            int v0 = js + jt * gridWidth;
+
+            int w11 = (fs * ft + 8) >> 4;
+            int texel = t * blockWidth + s;
+            // the right / bottom neighbours get a zero weight on the last column / row
+            layout.infillIndex[texel][0] = v0;
+            layout.infillIndex[texel][1] = std::min(v0 + 1, last);
+            layout.infillIndex[texel][2] = std::min(v0 + gridWidth, last);
+            layout.infillIndex[texel][3] = std::min(v0 + gridWidth + 1, last);
+            layout.infillWeight[texel][0] = 16 - fs - ft + w11;
+            layout.infillWeight[texel][1] = fs - w11;
+            layout.infillWeight[texel][2] = ft - w11;
+            layout.infillWeight[texel][3] = w11;
+        }
+    }
+}
+
+inline int infillWeight(const AstcLayout& layout, int texel, const int* gridWeights) {
+    const uint8_t* index = layout.infillIndex[texel];
+    const uint8_t* weight = layout.infillWeight[texel];
+    return (gridWeights[index[0]] * weight[0] + gridWeights[index[1]] * weight[1] +
+            gridWeights[index[2]] * weight[2] + gridWeights[index[3]] * weight[3] + 8) >> 4;
+}
+
+// Layouts that won most often on sprite sheets, per footprint, in the order
+// a greedy search added them: grid width, grid height, weight levels.
+struct PreferredLayout {
+    int blockSize;
+    int gridWidth;
+    int gridHeight;
+    int weightLevels;
+};
+
+const PreferredLayout kPreferredLayouts[] = {
+    { 4, 4, 4, 16 }, { 4, 4, 4, 20 }, { 4, 3, 4, 24 }, { 4, 4, 4, 32 },
+    { 6, 6, 6, 4 },  { 6, 6, 6, 5 },  { 6, 3, 6, 12 }, { 6, 6, 3, 16 },
+    { 8, 8, 8, 2 },  { 8, 5, 8, 4 },  { 8, 8, 4, 6 },  { 8, 2, 8, 20 },
+};
+
+// Layouts of one footprint, the most useful first. The quality presets
+// search the first 1, kNormalLayouts or all of them.
+struct AstcFootprint {
+    int width;
+    int height;
+    std::vector<AstcLayout> layouts;
+
+    AstcFootprint(int blockWidth, int blockHeight)
+        : width(blockWidth)
+        , height(blockHeight)
+    {
+        // block mode of every single plane grid / weight range combination
+        static const int kNoMode = -1;
+        int modes[13][13][kWeightRanges];
+        std::fill(&modes[0][0][0], &modes[0][0][0] + 13 * 13 * kWeightRanges, kNoMode);
+        for (int mode = 2047; mode >= 0; --mode) {
+            int gridWidth, gridHeight, weightRange;
+            bool dualPlane;
+            if (((mode & 0x1ff) != 0x1fc) && decodeBlockMode(mode, gridWidth, gridHeight, dualPlane, weightRange) && !dualPlane) {
+                modes[gridWidth][gridHeight][weightRange] = mode;
+            }
+        }
+
+        for (int gridHeight = 2; gridHeight <= blockHeight; ++gridHeight) {
+            for (int gridWidth = 2; gridWidth <= blockWidth; ++gridWidth) {
+                for (int weightRange = 0; weightRange < kWeightRanges; ++weightRange) {
+                    if (modes[gridWidth][gridHeight][weightRange] == kNoMode) continue;
+
+                    AstcLayout layout;
+                    layout.gridWidth = gridWidth;
+                    layout.gridHeight = gridHeight;
+                    layout.weightRange = weightRange;
+                    layout.weightBits = iseBitCount(weightRange, gridWidth * gridHeight);
+                    layout.colorRange[0] = colorRangeFor(layout.weightBits, 6);
+                    layout.colorRange[1] = colorRangeFor(layout.weightBits, 8);
+                    layout.blockMode = modes[gridWidth][gridHeight][weightRange];
+                    if (layout.colorRange[0] < 0) continue;
+                    computeInfill(blockWidth, blockHeight, layout);
+                    layouts.push_back(layout);
+                }
+            }
+        }
+
+        std::stable_sort(layouts.begin(), layouts.end(), [this](const AstcLayout& a, const AstcLayout& b) {
+            int rankA = preferredRank(a), rankB = preferredRank(b);
+            if (rankA != rankB) return rankA < rankB;
+            return score(a) > score(b);
+        });
+    }
+
+    int preferredRank(const AstcLayout& layout) const {
+        int rank = 0;
+        for (const PreferredLayout& preferred : kPreferredLayouts) {
+            if ((preferred.blockSize != width) || (width != height)) continue;
+            if ((preferred.gridWidth == layout.gridWidth) && (preferred.gridHeight == layout.gridHeight) &&
+                (preferred.weightLevels == kIseRanges[layout.weightRange].levels)) {
+                return rank;
+            }
+            ++rank;
+        }
+        return INT_MAX;
+    }
+
+    // Rough precision of the remaining layouts: bits spent per texel on the
+    // weights plus the endpoint precision, both saturating.
+    float score(const AstcLayout& layout) const {
+        float gridCoverage = (float)(layout.gridWidth * layout.gridHeight) / (width * height);
+        float weightPrecision = std::log2((float)kIseRanges[layout.weightRange].levels);
+        float colorPrecision = std::log2((float)kIseRanges[layout.colorRange[1] >= 0 ? layout.colorRange[1] : layout.colorRange[0]].levels);
+        return gridCoverage * 4.f + std::min(weightPrecision, 4.f) + std::min(colorPrecision, 7.f) * 0.5f;
+    }
+};
+
+const AstcFootprint& footprint(int blockWidth, int blockHeight) {
+    static const AstcFootprint footprint4x4(4, 4);
+    static const AstcFootprint footprint6x6(6, 6);
+    static const AstcFootprint footprint8x8(8, 8);
+    if ((blockWidth == 4) && (blockHeight == 4)) return footprint4x4;
+    if ((blockWidth == 6) && (blockHeight == 6)) return footprint6x6;
+    return footprint8x8;
+}
+
+const int kNormalLayouts = 4;
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Encoder
+
+struct Texels {
+    int     count;
+    int     channels;           // 3 for opaque blocks (CEM 8), else 4 (CEM 12)
+    uint8_t rgba[kMaxTexels][4];
+    bool    visible[kMaxTexels]; // alpha > 0, the color counts
+};
+
+struct AstcFit {
+    uint8_t  colorCodes[8];
+    uint8_t  weightCodes[kMaxGridWeights];
+    uint32_t error;
+};
+
+// Endpoint colors of CEM 8 / 12 as the decoder produces them.
+void decodeEndpoints(const int* v, int channels, int e0[4], int e1[4]) {
+    const int a0 = (channels == 4) ? v[6] : 255;
+    const int a1 = (channels == 4) ? v[7] : 255;
+    if (v[1] + v[3] + v[5] >= v[0] + v[2] + v[4]) {
+        e0[0] = v[0]; e0[1] = v[2]; e0[2] = v[4]; e0[3] = a0;
+        e1[0] = v[1]; e1[1] = v[3]; e1[2] = v[5]; e1[3] = a1;
+    } else {
+        // blue contraction
+        e0[0] = (v[1] + v[5]) >> 1; e0[1] = (v[3] + v[5]) >> 1; e0[2] = v[5]; e0[3] = a1;
+        e1[0] = (v[0] + v[4]) >> 1; e1[1] = (v[2] + v[4]) >> 1; e1[2] = v[4]; e1[3] = a0;
+    }
+}
+
+inline int interpolate(int e0, int e1, int weight) {
+    // LDR endpoints are expanded to 16 bit, the result is rounded back to 8 bit
+    int c = ((e0 * 257) * (64 - weight) + (e1 * 257) * weight + 32) >> 6;
+    return (c * 255 + 32767) / 65535;
+}
+
+uint32_t texelError(const Texels& texels, int i, const int e0[4], const int e1[4], int weight) {
+    uint32_t error = 0;
+    for (int c = 0; c < 4; ++c) {
+        if ((c < 3) && !texels.visible[i]) continue;
+        int d = interpolate(e0[c], e1[c], weight) - texels.rgba[i][c];
+        error += kWeights[c] * d * d;
+    }
+    return error;
+}
+
+// Principal axis fit in the weighted space: the endpoints span the
+// projections of all texels on the axis.
+void rangeFit(const Texels& texels, float e0[4], float e1[4]) {
+    float mean[4] = { 0.f, 0.f, 0.f, 0.f };
+    int visible = 0;
+    for (int i = 0; i < texels.count; ++i) {
+        if (texels.visible[i]) {
+            ++visible;
+            for (int c = 0; c < 3; ++c) mean[c] += texels.rgba[i][c] * kMetric[c];
+        }
+        mean[3] += texels.rgba[i][3] * kMetric[3];
+    }
+    for (int c = 0; c < 3; ++c) mean[c] = visible ? mean[c] / visible : 0.f;
+    mean[3] /= texels.count;
+
+    // invisible texels sit on the mean color
+    float deviation[kMaxTexels][4];
+    float covariance[4][4] = { { 0.f } };
+    for (int i = 0; i < texels.count; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            bool counts = (c == 3) ? (texels.channels == 4) : texels.visible[i];
+            deviation[i][c] = counts ? texels.rgba[i][c] * kMetric[c] - mean[c] : 0.f;
+        }
+        for (int row = 0; row < 4; ++row) {
+            for (int column = 0; column < 4; ++column) {
+                covariance[row][column] += deviation[i][row] * deviation[i][column];
+            }
+        }
+    }
+
+    float axis[4] = { 1.f, 1.f, 1.f, 1.f };
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[4];
+        float scale = 0.f;
+        for (int row = 0; row < 4; ++row) {
+            next[row] = 0.f;
+            for (int column = 0; column < 4; ++column) next[row] += covariance[row][column] * axis[column];
+            scale = std::max(scale, std::fabs(next[row]));
+        }
+        if (scale < FLT_EPSILON) break;
+        for (int c = 0; c < 4; ++c) axis[c] = next[c] / scale;
+    }
+    float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] + axis[3] * axis[3]);
+    for (int c = 0; c < 4; ++c) axis[c] /= length;
+
+    float minT = 0.f, maxT = 0.f;
+    for (int i = 0; i < texels.count; ++i) {
+        float t = deviation[i][0] * axis[0] + deviation[i][1] * axis[1] + deviation[i][2] * axis[2] + deviation[i][3] * axis[3];
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+
+    for (int c = 0; c < 4; ++c) {
+        e0[c] = std::min(255.f, std::max(0.f, (mean[c] + axis[c] * minT) / kMetric[c]));
+        e1[c] = std::min(255.f, std::max(0.f, (mean[c] + axis[c] * maxT) / kMetric[c]));
+    }
+    if (texels.channels == 3) {
+        e0[3] = e1[3] = 255.f;
+    }
+}
+
+// Least squares endpoints for the decoded texel weights.
+bool refineEndpoints(const Texels& texels, const int* texelWeights, float e0[4], float e1[4]) {
+    // separate sums for the color (visible texels) and the alpha channel
+    float sums[2][3] = { { 0.f } };
+    float x0[4] = { 0.f, 0.f, 0.f, 0.f };
+    float x1[4] = { 0.f, 0.f, 0.f, 0.f };
+    for (int i = 0; i < texels.count; ++i) {
+        float w = texelWeights[i] / 64.f;
+        float v = 1.f - w;
+        for (int set = 0; set < 2; ++set) {
+            if ((set == 0) && !texels.visible[i]) continue;
+            sums[set][0] += v * v;
+            sums[set][1] += w * w;
+            sums[set][2] += v * w;
+        }
+        for (int c = 0; c < 4; ++c) {
+            if ((c < 3) && !texels.visible[i]) continue;
+            x0[c] += v * texels.rgba[i][c];
+            x1[c] += w * texels.rgba[i][c];
+        }
+    }
+
+    for (int set = 0; set < 2; ++set) {
+        float det = sums[set][0] * sums[set][1] - sums[set][2] * sums[set][2];
+        if (std::fabs(det) < 1e-3f) {
+            return false;
+        }
+    }
+
+    for (int c = 0; c < texels.channels; ++c) {
+        const float* s = sums[(c < 3) ? 0 : 1];
+        float det = s[0] * s[1] - s[2] * s[2];
+        e0[c] = std::min(255.f, std::max(0.f, (x0[c] * s[1] - x1[c] * s[2]) / det));
+        e1[c] = std::min(255.f, std::max(0.f, (x1[c] * s[0] - x0[c] * s[2]) / det));
+    }
+    return true;
+}
+
+// Quantizes the endpoints, fits the grid weights and measures the result.
+void fitLayout(const Texels& texels, const AstcLayout& layout, const float e0[4], const float e1[4],
+               int* texelWeights, AstcFit& fit) {
+    const IseTables& tables = iseTables();
+    const int colorRange = layout.colorRange[texels.channels == 4 ? 1 : 0];
+    const uint8_t* quantized = tables.colorQuantized[colorRange];
+    const uint8_t* unquantized = tables.colorUnquantized[colorRange];
+
+    // keep the sum of the second endpoint larger, no blue contraction
+    int q0[4], q1[4];
+    for (int c = 0; c < 4; ++c) {
+        q0[c] = quantized[(int)(e0[c] + 0.5f)];
+        q1[c] = quantized[(int)(e1[c] + 0.5f)];
+    }
+    if (unquantized[q1[0]] + unquantized[q1[1]] + unquantized[q1[2]] <
+        unquantized[q0[0]] + unquantized[q0[1]] + unquantized[q0[2]]) {
+        for (int c = 0; c < 4; ++c) std::swap(q0[c], q1[c]);
+    }
+
+    int values[8];
+    for (int c = 0; c < texels.channels; ++c) {
+        fit.colorCodes[c * 2] = q0[c];
+        fit.colorCodes[c * 2 + 1] = q1[c];
+        values[c * 2] = unquantized[q0[c]];
+        values[c * 2 + 1] = unquantized[q1[c]];
+    }
+    int d0[4], d1[4];
+    decodeEndpoints(values, texels.channels, d0, d1);
+
+    // ideal weight of every texel: its projection on the endpoint segment
+    float direction[4];
+    float length2[2] = { 0.f, 0.f };
+    for (int c = 0; c < 4; ++c) {
+        direction[c] = (d1[c] - d0[c]) * kMetric[c] * kMetric[c];
+        if (c < 3) length2[0] += (d1[c] - d0[c]) * direction[c];
+    }
+    length2[1] = length2[0] + (d1[3] - d0[3]) * direction[3];
+
+    float ideal[kMaxTexels];
+    for (int i = 0; i < texels.count; ++i) {
+        float dot = (texels.rgba[i][3] - d0[3]) * direction[3];
+        float length = (d1[3] - d0[3]) * direction[3];
+        if (texels.visible[i]) {
+            for (int c = 0; c < 3; ++c) dot += (texels.rgba[i][c] - d0[c]) * direction[c];
+            length = length2[1];
+        }
+        float t = (length > FLT_EPSILON) ? dot / length : 0.f;
+        ideal[i] = std::min(64.f, std::max(0.f, t * 64.f));
+    }
+
+    // grid weights: average of the texels each grid point contributes to
+    const int gridCount = layout.gridWidth * layout.gridHeight;
+    float sum[kMaxGridWeights] = { 0.f };
+    float norm[kMaxGridWeights] = { 0.f };
+    for (int i = 0; i < texels.count; ++i) {
+        for (int k = 0; k < 4; ++k) {
+            int weight = layout.infillWeight[i][k];
+            sum[layout.infillIndex[i][k]] += weight * ideal[i];
+            norm[layout.infillIndex[i][k]] += weight;
+        }
+    }
+
+    int gridWeights[kMaxGridWeights];
+    const uint8_t* weightQuantized = tables.weightQuantized[layout.weightRange];
+    const uint8_t* weightUnquantized = tables.weightUnquantized[layout.weightRange];
+    for (int g = 0; g < gridCount; ++g) {
+        int value = (norm[g] > 0.f) ? (int)(sum[g] / norm[g] + 0.5f) : 32;
+        fit.weightCodes[g] = weightQuantized[value];
+        gridWeights[g] = weightUnquantized[fit.weightCodes[g]];
+    }
+
+    fit.error = 0;
+    for (int i = 0; i < texels.count; ++i) {
+        texelWeights[i] = infillWeight(layout, i, gridWeights);
+        fit.error += texelError(texels, i, d0, d1, texelWeights[i]);
+    }
+}
+
+void packBlock(const Texels& texels, const AstcLayout& layout, const AstcFit& fit, uint8_t* block) {
+    memset(block, 0, 16);
+    setBits(block, 0, 11, layout.blockMode);
+    // bits 11-12: one partition
+    setBits(block, 13, 4, (texels.channels == 4) ? 12 : 8);
+    encodeIse(layout.colorRange[texels.channels == 4 ? 1 : 0], fit.colorCodes, texels.channels * 2, block, 17);
+
+    // the weights are stored bit reversed from the top of the block
+    uint8_t weights[16];
+    memset(weights, 0, sizeof(weights));
+    encodeIse(layout.weightRange, fit.weightCodes, layout.gridWidth * layout.gridHeight, weights, 0);
+    for (int i = 0; i < layout.weightBits; ++i) {
+        if (getBits(weights, i, 1)) setBits(block, 127 - i, 1, 1);
+    }
+}
+
+void packVoidExtent(const uint8_t* color, uint8_t* block) {
+    memset(block, 0, 16);
+    // LDR void extent without extent coordinates
+    setBits(block, 0, 12, 0xdfc);
+    for (int i = 12; i < 64; ++i) setBits(block, i, 1, 1);
+    for (int c = 0; c < 4; ++c) {
+        setBits(block, 64 + c * 16, 16, color[c] * 257);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Decoder
+
+void fillErrorColor(int texels, uint8_t* rgba) {
+    for (int i = 0; i < texels; ++i) {
+        rgba[i * 4 + 0] = 255;
+        rgba[i * 4 + 1] = 0;
+        rgba[i * 4 + 2] = 255;
+        rgba[i * 4 + 3] = 255;
+    }
+}
+
+}
+
+void astcEncodeBlock(const uint8_t* rgba, int blockWidth, int blockHeight, uint8_t* block, int quality) {
+    Texels texels;
+    texels.count = blockWidth * blockHeight;
+    texels.channels = 3;
+    bool constant = true;
+    bool anyVisible = false;
+    for (int i = 0; i < texels.count; ++i) {
+        memcpy(texels.rgba[i], rgba + i * 4, 4);
+        texels.visible[i] = texels.rgba[i][3] > 0;
+        if (texels.rgba[i][3] != 255) texels.channels = 4;
+        if (texels.visible[i]) anyVisible = true;
+        if (memcmp(texels.rgba[i], texels.rgba[0], 4) != 0) constant = false;
+    }
+
+    if (constant || !anyVisible) {
+        const uint8_t transparent[4] = { 0, 0, 0, 0 };
+        packVoidExtent(anyVisible ? texels.rgba[0] : transparent, block);
+        return;
+    }
+
+    const AstcFootprint& layouts = footprint(blockWidth, blockHeight);
+    const int layoutCount = (quality == 0) ? 1 : ((quality == 1) ? kNormalLayouts : (int)layouts.layouts.size());
+    const int refinements = quality + 1;
+
+    float start[4], end[4];
+    rangeFit(texels, start, end);
+
+    AstcFit best;
+    best.error = UINT_MAX;
+    const AstcLayout* bestLayout = nullptr;
+    int searched = 0;
+    for (const AstcLayout& layout : layouts.layouts) {
+        if (searched == layoutCount) break;
+        if (layout.colorRange[texels.channels == 4 ? 1 : 0] < 0) continue;
+        ++searched;
+
+        float e0[4], e1[4];
+        memcpy(e0, start, sizeof(e0));
+        memcpy(e1, end, sizeof(e1));
+        int texelWeights[kMaxTexels];
+        for (int iteration = 0; (iteration < refinements) && best.error; ++iteration) {
+            AstcFit fit;
+            fitLayout(texels, layout, e0, e1, texelWeights, fit);
+            if (fit.error < best.error) {
+                best = fit;
+                bestLayout = &layout;
+            }
+            if (!refineEndpoints(texels, texelWeights, e0, e1)) break;
+        }
+    }
+
+    packBlock(texels, *bestLayout, best, block);
+}
+
+void astcDecodeBlock(const uint8_t* block, int blockWidth, int blockHeight, uint8_t* rgba) {
+    const int texels = blockWidth * blockHeight;
+    const int mode = getBits(block, 0, 11);
+
+    if ((mode & 0x1ff) == 0x1fc) {
+        if (mode & 0x200) {
+            // HDR void extent
+            fillErrorColor(texels, rgba);
+            return;
+        }
+        for (int i = 0; i < texels; ++i) {
+            for (int c = 0; c < 4; ++c) {
+                rgba[i * 4 + c] = (getBits(block, 64 + c * 16, 16) * 255 + 32767) / 65535;
+            }
+        }
+        return;
+    }
+
+    AstcLayout layout;
+    bool dualPlane;
+    if (!decodeBlockMode(mode, layout.gridWidth, layout.gridHeight, dualPlane, layout.weightRange) ||
+        dualPlane || (getBits(block, 11, 2) != 0) ||
+        (layout.gridWidth > blockWidth) || (layout.gridHeight > blockHeight)) {
+        fillErrorColor(texels, rgba);
+        return;
+    }
+
+    const int endpointMode = getBits(block, 13, 4);
+    int colorValues, channels;
+    switch (endpointMode) {
+        case 0: colorValues = 2; channels = 1; break;   // luminance
+        case 4: colorValues = 4; channels = 2; break;   // luminance, alpha
+        case 8: colorValues = 6; channels = 3; break;   // RGB
+        case 12: colorValues = 8; channels = 4; break;  // RGBA
+        default:
+            fillErrorColor(texels, rgba);
+            return;
+    }
+
+    const int gridCount = layout.gridWidth * layout.gridHeight;
+    layout.weightBits = iseBitCount(layout.weightRange, gridCount);
+    const int colorRange = colorRangeFor(layout.weightBits, colorValues);
+    if (colorRange < 0) {
+        fillErrorColor(texels, rgba);
+        return;
+    }
+
+    const IseTables& tables = iseTables();
+    uint8_t codes[8];
+    int values[8];
+    decodeIse(colorRange, block, 17, colorValues, codes);
+    for (int i = 0; i < colorValues; ++i) {
+        values[i] = tables.colorUnquantized[colorRange][codes[i]];
+    }
+
+    int e0[4], e1[4];
+    if (channels >= 3) {
+        decodeEndpoints(values, channels, e0, e1);
+    } else {
+        e0[0] = e0[1] = e0[2] = values[0];
+        e1[0] = e1[1] = e1[2] = values[1];
+        e0[3] = (channels == 2) ? values[2] : 255;
+        e1[3] = (channels == 2) ? values[3] : 255;
+    }
+
+    uint8_t reversed[16];
+    memset(reversed, 0, sizeof(reversed));
+    for (int i = 0; i < layout.weightBits; ++i) {
+        if (getBits(block, 127 - i, 1)) setBits(reversed, i, 1, 1);
+    }
+    uint8_t weightCodes[kMaxGridWeights];
+    decodeIse(layout.weightRange, reversed, 0, gridCount, weightCodes);
+    int gridWeights[kMaxGridWeights];
+    for (int g = 0; g < gridCount; ++g) {
+        gridWeights[g] = tables.weightUnquantized[layout.weightRange][weightCodes[g]];
+    }
+
+    computeInfill(blockWidth, blockHeight, layout);
+    for (int i = 0; i < texels; ++i) {
+        int weight = infillWeight(layout, i, gridWeights);
+        for (int c = 0; c < 4; ++c) {
+            rgba[i * 4 + c] = interpolate(e0[c], e1[c], weight);
+        }
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef ASTCCODEC_H
+#define ASTCCODEC_H
+
+#include <cstdint>
+
+// ASTC LDR block codec for 2D footprints of up to 64 texels (4x4 .. 8x8).
+// The pixels are blockWidth * blockHeight RGBA8888 values in row-major
+// order, every block is 16 bytes.
+//
+// The encoder is restricted to one partition and one weight plane with
+// the RGB (CEM 8) or RGBA (CEM 12) direct endpoint modes. Constant blocks
+// are written as void extent blocks. quality is a TextureQuality value and
+// controls how many weight grid / quantization layouts are searched and
+// how often the endpoints are refined.
+void astcEncodeBlock(const uint8_t* rgba, int blockWidth, int blockHeight, uint8_t* block, int quality);
+
+// Reference decoder for the blocks above, plus the luminance endpoint
+// modes. Anything else (several partitions, dual plane, HDR) decodes to
+// the magenta error color, as the specification requires for blocks a
+// decoder does not support.
+void astcDecodeBlock(const uint8_t* block, int blockWidth, int blockHeight, uint8_t* rgba);
+
+#endif // ASTCCODEC_H
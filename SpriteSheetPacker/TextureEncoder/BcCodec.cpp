@@ -0,0 +1,734 @@
+#include "BcCodec.h"
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BCCODEC_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Perceptual channel weights (0.299, 0.587, 0.114) scaled by 128.
+const int kWeightR = 38;
+const int kWeightG = 75;
+const int kWeightB = 15;
+
+// Square roots of the channel weights. The endpoint fits run in this scaled
+// color space, so a plain euclidean distance there is the weighted error.
+const float kMetric[3] = { 0.5449f, 0.7655f, 0.3423f };
+
+const int kClusterIterations = 3;
+
+inline int extend5(int value) { return (value << 3) | (value >> 2); }
+inline int extend6(int value) { return (value << 2) | (value >> 4); }
+
+inline int quantize(float value, int maxValue) {
+    int q = (int)(value * maxValue / 255.f + 0.5f);
+    return q < 0 ? 0 : (q > maxValue ? maxValue : q);
+}
+
+inline uint32_t colorError(int dr, int dg, int db) {
+    return kWeightR * dr * dr + kWeightG * dg * dg + kWeightB * db * db;
+}
+
+inline uint16_t pack565(int r, int g, int b) {
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline uint16_t quantize565(const float color[3]) {
+    return pack565(quantize(color[0], 31), quantize(color[1], 63), quantize(color[2], 31));
+}
+
+inline void unpack565(uint16_t color, int rgb[3]) {
+    rgb[0] = extend5((color >> 11) & 31);
+    rgb[1] = extend6((color >> 5) & 63);
+    rgb[2] = extend5(color & 31);
+}
+
+inline uint16_t read16(const uint8_t* data) {
+    return (uint16_t)(data[0] | (data[1] << 8));
+}
+
+inline void write16(uint16_t value, uint8_t* data) {
+    data[0] = value & 0xff;
+    data[1] = value >> 8;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// BC1 color block
+
+// The pixels the color block has to represent.
+struct ColorBlock {
+    int16_t r[16];
+    int16_t g[16];
+    int16_t b[16];
+    bool    used[16];         // visible, counts for the endpoint fit
+    bool    transparent[16];  // punch-through, index 3 of the three color mode
+    int     count;            // number of used pixels
+    bool    hasTransparent;
+};
+
+void loadColorBlock(const uint8_t* rgba, bool punchThrough, ColorBlock& block) {
+    block.count = 0;
+    block.hasTransparent = false;
+    for (int i = 0; i < 16; ++i) {
+        const uint8_t* p = rgba + i * 4;
+        block.r[i] = p[0];
+        block.g[i] = p[1];
+        block.b[i] = p[2];
+        block.transparent[i] = punchThrough && (p[3] < 128);
+        // the color of fully transparent pixels is never seen
+        block.used[i] = !block.transparent[i] && (p[3] > 0);
+        if (block.transparent[i]) block.hasTransparent = true;
+        if (block.used[i]) ++block.count;
+    }
+}
+
+struct ColorFit {
+    uint16_t color0;
+    uint16_t color1;
+    uint32_t error;
+    uint8_t  indices[16];
+};
+
+// Palette of the decoder: four colors when color0 > color1, else three
+// colors and transparent black. BC2 / BC3 always decode four colors.
+void buildPalette(uint16_t color0, uint16_t color1, bool fourColorOnly, int palette[4][3]) {
+    unpack565(color0, palette[0]);
+    unpack565(color1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        if (fourColorOnly || (color0 > color1)) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        } else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+}
+
+// Assigns every pixel the nearest of the first paletteSize colors and
+// returns the error of the used pixels. Transparent pixels get index 3.
+uint32_t fitIndices(const ColorBlock& block, const int palette[4][3], int paletteSize, uint8_t* indices) {
+    int32_t errors[16];
+    int32_t bestIndices[16];
+
+#if defined(BCCODEC_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (int half = 0; half < 16; half += 8) {
+        const __m128i r = _mm_loadu_si128((const __m128i*)(block.r + half));
+        const __m128i g = _mm_loadu_si128((const __m128i*)(block.g + half));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(block.b + half));
+        __m128i bestLo = _mm_set1_epi32(INT_MAX);
+        __m128i bestHi = bestLo;
+        __m128i indexLo = zero;
+        __m128i indexHi = zero;
+
+        for (int k = 0; k < paletteSize; ++k) {
+            __m128i dr = _mm_sub_epi16(r, _mm_set1_epi16(palette[k][0]));
+            __m128i dg = _mm_sub_epi16(g, _mm_set1_epi16(palette[k][1]));
+            __m128i db = _mm_sub_epi16(b, _mm_set1_epi16(palette[k][2]));
+            __m128i wdr = _mm_mullo_epi16(dr, _mm_set1_epi16(kWeightR));
+            __m128i wdg = _mm_mullo_epi16(dg, _mm_set1_epi16(kWeightG));
+            __m128i wdb = _mm_mullo_epi16(db, _mm_set1_epi16(kWeightB));
+
+            // widen to 32 bit: madd of (d, 0) pairs with (w * d, 0) pairs gives w * d * d
+            __m128i errorLo = _mm_madd_epi16(_mm_unpacklo_epi16(dr, zero), _mm_unpacklo_epi16(wdr, zero));
+            errorLo = _mm_add_epi32(errorLo, _mm_madd_epi16(_mm_unpacklo_epi16(dg, zero), _mm_unpacklo_epi16(wdg, zero)));
+            errorLo = _mm_add_epi32(errorLo, _mm_madd_epi16(_mm_unpacklo_epi16(db, zero), _mm_unpacklo_epi16(wdb, zero)));
+            __m128i errorHi = _mm_madd_epi16(_mm_unpackhi_epi16(dr, zero), _mm_unpackhi_epi16(wdr, zero));
+            errorHi = _mm_add_epi32(errorHi, _mm_madd_epi16(_mm_unpackhi_epi16(dg, zero), _mm_unpackhi_epi16(wdg, zero)));
+            errorHi = _mm_add_epi32(errorHi, _mm_madd_epi16(_mm_unpackhi_epi16(db, zero), _mm_unpackhi_epi16(wdb, zero)));
+
+            __m128i index = _mm_set1_epi32(k);
+            __m128i lessLo = _mm_cmplt_epi32(errorLo, bestLo);
+            __m128i lessHi = _mm_cmplt_epi32(errorHi, bestHi);
+            bestLo = _mm_or_si128(_mm_and_si128(lessLo, errorLo), _mm_andnot_si128(lessLo, bestLo));
+            bestHi = _mm_or_si128(_mm_and_si128(lessHi, errorHi), _mm_andnot_si128(lessHi, bestHi));
+            indexLo = _mm_or_si128(_mm_and_si128(lessLo, index), _mm_andnot_si128(lessLo, indexLo));
+            indexHi = _mm_or_si128(_mm_and_si128(lessHi, index), _mm_andnot_si128(lessHi, indexHi));
+        }
+
+        _mm_storeu_si128((__m128i*)(errors + half), bestLo);
+        _mm_storeu_si128((__m128i*)(errors + half + 4), bestHi);
+        _mm_storeu_si128((__m128i*)(bestIndices + half), indexLo);
+        _mm_storeu_si128((__m128i*)(bestIndices + half + 4), indexHi);
+    }
+#else
+    for (int i = 0; i < 16; ++i) {
+        errors[i] = INT_MAX;
+        for (int k = 0; k < paletteSize; ++k) {
+            int32_t error = colorError(block.r[i] - palette[k][0],
+                                       block.g[i] - palette[k][1],
+                                       block.b[i] - palette[k][2]);
+            if (error < errors[i]) {
+                errors[i] = error;
+                bestIndices[i] = k;
+            }
+        }
+    }
+#endif
+
+    uint32_t total = 0;
+    for (int i = 0; i < 16; ++i) {
+        if (block.transparent[i]) {
+            indices[i] = 3;
+            continue;
+        }
+        indices[i] = (uint8_t)bestIndices[i];
+        if (block.used[i]) total += errors[i];
+    }
+    return total;
+}
+
+// Orders the endpoints for the requested mode and fits the indices. Equal
+// endpoints decode as three color mode in BC1, so index 3 is left out.
+void fitEndpoints(const ColorBlock& block, uint16_t color0, uint16_t color1, bool fourColor, ColorFit& fit) {
+    if (fourColor ? (color0 < color1) : (color0 > color1)) {
+        uint16_t swap = color0;
+        color0 = color1;
+        color1 = swap;
+    }
+
+    int palette[4][3];
+    buildPalette(color0, color1, false, palette);
+    fit.color0 = color0;
+    fit.color1 = color1;
+    fit.error = fitIndices(block, palette, (color0 > color1) ? 4 : 3, fit.indices);
+}
+
+inline void keepBetter(ColorFit& best, const ColorFit& candidate) {
+    if (candidate.error < best.error) {
+        best = candidate;
+    }
+}
+
+inline void weightedPoint(const ColorBlock& block, int i, float point[3]) {
+    point[0] = block.r[i] * kMetric[0];
+    point[1] = block.g[i] * kMetric[1];
+    point[2] = block.b[i] * kMetric[2];
+}
+
+// Principal axis of the used pixels in the weighted color space, found by
+// power iteration on the covariance matrix.
+void principalAxis(const ColorBlock& block, float axis[3]) {
+    float mean[3] = { 0.f, 0.f, 0.f };
+    for (int i = 0; i < 16; ++i) {
+        if (!block.used[i]) continue;
+        float point[3];
+        weightedPoint(block, i, point);
+        for (int c = 0; c < 3; ++c) mean[c] += point[c];
+    }
+    for (int c = 0; c < 3; ++c) mean[c] /= block.count;
+
+    float covariance[3][3] = { { 0.f } };
+    for (int i = 0; i < 16; ++i) {
+        if (!block.used[i]) continue;
+        float point[3];
+        weightedPoint(block, i, point);
+        for (int c = 0; c < 3; ++c) point[c] -= mean[c];
+        for (int row = 0; row < 3; ++row) {
+            for (int column = 0; column < 3; ++column) {
+                covariance[row][column] += point[row] * point[column];
+            }
+        }
+    }
+
+    float v[3] = { 1.f, 1.f, 1.f };
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float w[3];
+        for (int row = 0; row < 3; ++row) {
+            w[row] = covariance[row][0] * v[0] + covariance[row][1] * v[1] + covariance[row][2] * v[2];
+        }
+        float scale = std::max(std::fabs(w[0]), std::max(std::fabs(w[1]), std::fabs(w[2])));
+        if (scale < FLT_EPSILON) break;
+        for (int c = 0; c < 3; ++c) v[c] = w[c] / scale;
+    }
+
+    float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    for (int c = 0; c < 3; ++c) axis[c] = v[c] / length;
+}
+
+// Fast mode: the pixels at both ends of the principal axis become the
+// endpoints.
+void rangeFit(const ColorBlock& block, bool fourColor, ColorFit& fit) {
+    float axis[3];
+    principalAxis(block, axis);
+
+    float minDot = FLT_MAX, maxDot = -FLT_MAX;
+    int minIndex = 0, maxIndex = 0;
+    for (int i = 0; i < 16; ++i) {
+        if (!block.used[i]) continue;
+        float point[3];
+        weightedPoint(block, i, point);
+        float dot = point[0] * axis[0] + point[1] * axis[1] + point[2] * axis[2];
+        if (dot < minDot) {
+            minDot = dot;
+            minIndex = i;
+        }
+        if (dot > maxDot) {
+            maxDot = dot;
+            maxIndex = i;
+        }
+    }
+
+    float start[3] = { (float)block.r[maxIndex], (float)block.g[maxIndex], (float)block.b[maxIndex] };
+    float end[3] = { (float)block.r[minIndex], (float)block.g[minIndex], (float)block.b[minIndex] };
+    fitEndpoints(block, quantize565(start), quantize565(end), fourColor, fit);
+}
+
+// Least squares endpoints for the indices of the fit. Channels are solved
+// independently, so the channel weights do not change the solution.
+bool refineEndpoints(const ColorBlock& block, const ColorFit& fit, bool fourColor, ColorFit& refined) {
+    const float fourColorWeights[4] = { 1.f, 0.f, 2.f / 3.f, 1.f / 3.f };
+    const float threeColorWeights[4] = { 1.f, 0.f, 0.5f, 0.f };
+    const float* weights = (fit.color0 > fit.color1) ? fourColorWeights : threeColorWeights;
+
+    float alpha2 = 0.f, beta2 = 0.f, alphaBeta = 0.f;
+    float alphaX[3] = { 0.f, 0.f, 0.f };
+    float betaX[3] = { 0.f, 0.f, 0.f };
+    for (int i = 0; i < 16; ++i) {
+        if (!block.used[i]) continue;
+        float alpha = weights[fit.indices[i]];
+        float beta = 1.f - alpha;
+        const float x[3] = { (float)block.r[i], (float)block.g[i], (float)block.b[i] };
+        alpha2 += alpha * alpha;
+        beta2 += beta * beta;
+        alphaBeta += alpha * beta;
+        for (int c = 0; c < 3; ++c) {
+            alphaX[c] += alpha * x[c];
+            betaX[c] += beta * x[c];
+        }
+    }
+
+    float det = alpha2 * beta2 - alphaBeta * alphaBeta;
+    if (std::fabs(det) < FLT_EPSILON) {
+        return false;
+    }
+
+    float start[3], end[3];
+    for (int c = 0; c < 3; ++c) {
+        start[c] = (alphaX[c] * beta2 - betaX[c] * alphaBeta) / det;
+        end[c] = (betaX[c] * alpha2 - alphaX[c] * alphaBeta) / det;
+    }
+    fitEndpoints(block, quantize565(start), quantize565(end), fourColor, refined);
+    return true;
+}
+
+// Snaps a weighted color to the RGB565 grid, returns the packed value and
+// the snapped weighted color.
+uint16_t snap565(const float weighted[3], float snapped[3]) {
+    int r = quantize(weighted[0] / kMetric[0], 31);
+    int g = quantize(weighted[1] / kMetric[1], 63);
+    int b = quantize(weighted[2] / kMetric[2], 31);
+    snapped[0] = extend5(r) * kMetric[0];
+    snapped[1] = extend6(g) * kMetric[1];
+    snapped[2] = extend5(b) * kMetric[2];
+    return pack565(r, g, b);
+}
+
+// High quality mode: the used pixels are sorted along the axis and every
+// ordered split into the palette entries is solved by least squares (the
+// cluster fit of squish). The endpoints give the axis of the next pass.
+void clusterFit(const ColorBlock& block, bool fourColor, ColorFit& best) {
+    float axis[3];
+    principalAxis(block, axis);
+
+    for (int iteration = 0; iteration < kClusterIterations; ++iteration) {
+        // sort the used pixels along the axis
+        int order[16];
+        float dots[16];
+        int n = 0;
+        for (int i = 0; i < 16; ++i) {
+            if (!block.used[i]) continue;
+            float point[3];
+            weightedPoint(block, i, point);
+            float dot = point[0] * axis[0] + point[1] * axis[1] + point[2] * axis[2];
+            int j = n++;
+            for (; (j > 0) && (dots[j - 1] > dot); --j) {
+                dots[j] = dots[j - 1];
+                order[j] = order[j - 1];
+            }
+            dots[j] = dot;
+            order[j] = i;
+        }
+
+        // prefix sums of the sorted points
+        float prefix[17][3];
+        prefix[0][0] = prefix[0][1] = prefix[0][2] = 0.f;
+        for (int i = 0; i < n; ++i) {
+            float point[3];
+            weightedPoint(block, order[i], point);
+            for (int c = 0; c < 3; ++c) prefix[i + 1][c] = prefix[i][c] + point[c];
+        }
+
+        float bestError = FLT_MAX;
+        uint16_t bestStart = 0, bestEnd = 0;
+        float bestA[3] = { 0.f, 0.f, 0.f };
+        float bestB[3] = { 0.f, 0.f, 0.f };
+
+        // clusters [0, i) [i, j) [j, k) [k, n) with weights of the start
+        // endpoint 1, 2/3, 1/3, 0 (1, 1/2, -, 0 in three color mode)
+        const float third = 1.f / 3.f;
+        for (int i = 0; i <= n; ++i) {
+            for (int j = i; j <= n; ++j) {
+                for (int k = j; k <= (fourColor ? n : j); ++k) {
+                    float count0 = (float)i;
+                    float count1 = (float)(n - k);
+                    float count2 = (float)(j - i);
+                    float count3 = (float)(k - j);
+                    float w2 = fourColor ? 2.f * third : 0.5f;
+                    float w3 = third;
+
+                    float alpha2 = count0 + count2 * w2 * w2 + count3 * w3 * w3;
+                    float beta2 = count1 + count2 * (1.f - w2) * (1.f - w2) + count3 * (1.f - w3) * (1.f - w3);
+                    float alphaBeta = count2 * w2 * (1.f - w2) + count3 * w3 * (1.f - w3);
+                    float det = alpha2 * beta2 - alphaBeta * alphaBeta;
+                    if (det < FLT_EPSILON) continue;
+
+                    float a[3], b[3], alphaX[3], betaX[3];
+                    for (int c = 0; c < 3; ++c) {
+                        float sum0 = prefix[i][c];
+                        float sum2 = prefix[j][c] - prefix[i][c];
+                        float sum3 = prefix[k][c] - prefix[j][c];
+                        float sum1 = prefix[n][c] - prefix[k][c];
+                        alphaX[c] = sum0 + sum2 * w2 + sum3 * w3;
+                        betaX[c] = sum1 + sum2 * (1.f - w2) + sum3 * (1.f - w3);
+                        a[c] = (alphaX[c] * beta2 - betaX[c] * alphaBeta) / det;
+                        b[c] = (betaX[c] * alpha2 - alphaX[c] * alphaBeta) / det;
+                    }
+
+                    float snappedA[3], snappedB[3];
+                    uint16_t start = snap565(a, snappedA);
+                    uint16_t end = snap565(b, snappedB);
+
+                    // squared error up to the constant sum of the squared points
+                    float error = 0.f;
+                    for (int c = 0; c < 3; ++c) {
+                        error += snappedA[c] * snappedA[c] * alpha2 + snappedB[c] * snappedB[c] * beta2
+                               + 2.f * (snappedA[c] * snappedB[c] * alphaBeta - snappedA[c] * alphaX[c] - snappedB[c] * betaX[c]);
+                    }
+                    if (error < bestError) {
+                        bestError = error;
+                        bestStart = start;
+                        bestEnd = end;
+                        for (int c = 0; c < 3; ++c) {
+                            bestA[c] = snappedA[c];
+                            bestB[c] = snappedB[c];
+                        }
+                    }
+                }
+            }
+        }
+
+        if (bestError == FLT_MAX) {
+            return;
+        }
+
+        ColorFit candidate;
+        fitEndpoints(block, bestStart, bestEnd, fourColor, candidate);
+        if (candidate.error >= best.error) {
+            return;
+        }
+        best = candidate;
+
+        float length = 0.f;
+        for (int c = 0; c < 3; ++c) {
+            axis[c] = bestA[c] - bestB[c];
+            length += axis[c] * axis[c];
+        }
+        if (length < FLT_EPSILON) {
+            return;
+        }
+        length = std::sqrt(length);
+        for (int c = 0; c < 3; ++c) axis[c] /= length;
+    }
+}
+
+// Endpoint pairs whose interpolated color (index 2) hits each 8 bit value
+// as close as possible, for blocks of a single color.
+struct SingleColorTables {
+    uint8_t fourColor5[256][2];
+    uint8_t fourColor6[256][2];
+    uint8_t threeColor5[256][2];
+    uint8_t threeColor6[256][2];
+
+    SingleColorTables() {
+        build(fourColor5, 5, true);
+        build(fourColor6, 6, true);
+        build(threeColor5, 5, false);
+        build(threeColor6, 6, false);
+    }
+
+    static void build(uint8_t table[256][2], int bits, bool fourColor) {
+        const int maxValue = (1 << bits) - 1;
+        for (int value = 0; value < 256; ++value) {
+            int bestError = INT_MAX;
+            for (int a = 0; a <= maxValue; ++a) {
+                for (int b = 0; b <= maxValue; ++b) {
+                    int ea = (bits == 5) ? extend5(a) : extend6(a);
+                    int eb = (bits == 5) ? extend5(b) : extend6(b);
+                    int interpolated = fourColor ? (2 * ea + eb) / 3 : (ea + eb) / 2;
+                    int error = std::abs(interpolated - value);
+                    if (error < bestError) {
+                        bestError = error;
+                        table[value][0] = a;
+                        table[value][1] = b;
+                    }
+                }
+            }
+        }
+    }
+};
+
+const SingleColorTables& singleColorTables() {
+    static SingleColorTables tables;
+    return tables;
+}
+
+bool isSingleColor(const ColorBlock& block, int& first) {
+    first = -1;
+    for (int i = 0; i < 16; ++i) {
+        if (!block.used[i]) continue;
+        if (first < 0) {
+            first = i;
+        } else if ((block.r[i] != block.r[first]) || (block.g[i] != block.g[first]) || (block.b[i] != block.b[first])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void singleColorFit(const ColorBlock& block, int pixel, bool fourColor, ColorFit& fit) {
+    const SingleColorTables& tables = singleColorTables();
+    const uint8_t (*table5)[2] = fourColor ? tables.fourColor5 : tables.threeColor5;
+    const uint8_t (*table6)[2] = fourColor ? tables.fourColor6 : tables.threeColor6;
+    uint16_t start = pack565(table5[block.r[pixel]][0], table6[block.g[pixel]][0], table5[block.b[pixel]][0]);
+    uint16_t end = pack565(table5[block.r[pixel]][1], table6[block.g[pixel]][1], table5[block.b[pixel]][1]);
+    fitEndpoints(block, start, end, fourColor, fit);
+}
+
+void encodeColorBlock(const uint8_t* rgba, uint8_t* output, int quality, bool punchThrough) {
+    ColorBlock block;
+    loadColorBlock(rgba, punchThrough, block);
+
+    ColorFit best;
+    if (block.count == 0) {
+        // nothing visible, equal endpoints select the three color mode
+        best.color0 = best.color1 = 0;
+        for (int i = 0; i < 16; ++i) best.indices[i] = block.transparent[i] ? 3 : 0;
+    } else {
+        // punch-through pixels need the three color mode
+        const bool fourColor = !block.hasTransparent;
+        int first;
+        if (isSingleColor(block, first)) {
+            singleColorFit(block, first, fourColor, best);
+        } else {
+            rangeFit(block, fourColor, best);
+            for (int iteration = 0; (iteration < quality) && best.error; ++iteration) {
+                ColorFit refined;
+                if (!refineEndpoints(block, best, fourColor, refined) || (refined.error >= best.error)) break;
+                best = refined;
+            }
+            if ((quality >= 2) && best.error) {
+                clusterFit(block, fourColor, best);
+                // opaque BC1 blocks may still do better with three colors
+                if (punchThrough && fourColor && best.error) {
+                    ColorFit threeColor = best;
+                    clusterFit(block, false, threeColor);
+                    keepBetter(best, threeColor);
+                }
+            }
+        }
+    }
+
+    write16(best.color0, output);
+    write16(best.color1, output + 2);
+    for (int row = 0; row < 4; ++row) {
+        output[4 + row] = best.indices[row * 4] | (best.indices[row * 4 + 1] << 2) |
+                         (best.indices[row * 4 + 2] << 4) | (best.indices[row * 4 + 3] << 6);
+    }
+}
+
+void decodeColorBlock(const uint8_t* block, bool fourColorOnly, uint8_t* rgba) {
+    uint16_t color0 = read16(block);
+    uint16_t color1 = read16(block + 2);
+    int palette[4][3];
+    buildPalette(color0, color1, fourColorOnly, palette);
+    const bool punchThrough = !fourColorOnly && (color0 <= color1);
+
+    for (int i = 0; i < 16; ++i) {
+        int index = (block[4 + i / 4] >> ((i % 4) * 2)) & 3;
+        uint8_t* p = rgba + i * 4;
+        p[0] = palette[index][0];
+        p[1] = palette[index][1];
+        p[2] = palette[index][2];
+        p[3] = (punchThrough && (index == 3)) ? 0 : 255;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// BC3 alpha block
+
+// Eight interpolated values when alpha0 > alpha1, else six and 0, 255.
+void buildAlphaPalette(int alpha0, int alpha1, int palette[8]) {
+    palette[0] = alpha0;
+    palette[1] = alpha1;
+    if (alpha0 > alpha1) {
+        for (int i = 1; i < 7; ++i) {
+            palette[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+        }
+    } else {
+        for (int i = 1; i < 5; ++i) {
+            palette[i + 1] = ((5 - i) * alpha0 + i * alpha1) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+// Stops as soon as the error reaches bound.
+uint32_t fitAlphaIndices(const int* alpha, const int palette[8], uint32_t bound, uint8_t* indices) {
+    uint32_t total = 0;
+    for (int i = 0; (i < 16) && (total < bound); ++i) {
+        uint32_t best = UINT_MAX;
+        for (int k = 0; k < 8; ++k) {
+            int d = alpha[i] - palette[k];
+            uint32_t error = d * d;
+            if (error < best) {
+                best = error;
+                indices[i] = k;
+            }
+        }
+        total += best;
+    }
+    return total;
+}
+
+struct AlphaFit {
+    int      alpha0;
+    int      alpha1;
+    uint32_t error;
+    uint8_t  indices[16];
+};
+
+void tryAlphaEndpoints(const int* alpha, int alpha0, int alpha1, AlphaFit& best) {
+    int palette[8];
+    uint8_t indices[16];
+    buildAlphaPalette(alpha0, alpha1, palette);
+    uint32_t error = fitAlphaIndices(alpha, palette, best.error, indices);
+    if (error < best.error) {
+        best.alpha0 = alpha0;
+        best.alpha1 = alpha1;
+        best.error = error;
+        for (int i = 0; i < 16; ++i) best.indices[i] = indices[i];
+    }
+}
+
+void encodeBc3Alpha(const uint8_t* rgba, uint8_t* output, int quality) {
+    int alpha[16];
+    int minAlpha = 255, maxAlpha = 0;
+    // range of the values the six value mode has to interpolate
+    int minInner = 255, maxInner = 0;
+    for (int i = 0; i < 16; ++i) {
+        int value = rgba[i * 4 + 3];
+        alpha[i] = value;
+        if (value < minAlpha) minAlpha = value;
+        if (value > maxAlpha) maxAlpha = value;
+        if ((value > 0) && (value < 255)) {
+            if (value < minInner) minInner = value;
+            if (value > maxInner) maxInner = value;
+        }
+    }
+    if (minInner > maxInner) {
+        minInner = maxInner = 0;
+    }
+
+    AlphaFit best;
+    best.alpha0 = best.alpha1 = minAlpha;
+    best.error = 0;
+    for (int i = 0; i < 16; ++i) best.indices[i] = 0;
+
+    if (minAlpha != maxAlpha) {
+        best.error = UINT_MAX;
+        tryAlphaEndpoints(alpha, maxAlpha, minAlpha, best);
+        if (quality >= 1) {
+            tryAlphaEndpoints(alpha, minInner, maxInner, best);
+        }
+        if (quality >= 2) {
+            const int radius = 4;
+            for (int d0 = -radius; (d0 <= radius) && best.error; ++d0) {
+                for (int d1 = -radius; (d1 <= radius) && best.error; ++d1) {
+                    int high = maxAlpha + d0, low = minAlpha + d1;
+                    if ((low >= 0) && (high <= 255) && (high > low)) {
+                        tryAlphaEndpoints(alpha, high, low, best);
+                    }
+                    low = minInner + d0;
+                    high = maxInner + d1;
+                    if ((low >= 0) && (high <= 255) && (low <= high)) {
+                        tryAlphaEndpoints(alpha, low, high, best);
+                    }
+                }
+            }
+        }
+    }
+
+    output[0] = best.alpha0;
+    output[1] = best.alpha1;
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; ++i) {
+        bits |= (uint64_t)best.indices[i] << (3 * i);
+    }
+    for (int i = 0; i < 6; ++i) {
+        output[2 + i] = (bits >> (8 * i)) & 0xff;
+    }
+}
+
+}
+
+void bc1EncodeBlock(const uint8_t* rgba, uint8_t* block, int quality) {
+    encodeColorBlock(rgba, block, quality, true);
+}
+
+void bc2EncodeBlock(const uint8_t* rgba, uint8_t* block, int quality) {
+    for (int i = 0; i < 8; ++i) {
+        int low = (rgba[(i * 2) * 4 + 3] + 8) / 17;
+        int high = (rgba[(i * 2 + 1) * 4 + 3] + 8) / 17;
+        block[i] = low | (high << 4);
+    }
+    encodeColorBlock(rgba, block + 8, quality, false);
+}
+
+void bc3EncodeBlock(const uint8_t* rgba, uint8_t* block, int quality) {
+    encodeBc3Alpha(rgba, block, quality);
+    encodeColorBlock(rgba, block + 8, quality, false);
+}
+
+void bc1DecodeBlock(const uint8_t* block, uint8_t* rgba) {
+    decodeColorBlock(block, false, rgba);
+}
+
+void bc2DecodeBlock(const uint8_t* block, uint8_t* rgba) {
+    decodeColorBlock(block + 8, true, rgba);
+    for (int i = 0; i < 16; ++i) {
+        rgba[i * 4 + 3] = ((block[i / 2] >> ((i % 2) * 4)) & 15) * 17;
+    }
+}
+
+void bc3DecodeBlock(const uint8_t* block, uint8_t* rgba) {
+    decodeColorBlock(block + 8, true, rgba);
+
+    int palette[8];
+    buildAlphaPalette(block[0], block[1], palette);
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; ++i) {
+        bits |= (uint64_t)block[2 + i] << (8 * i);
+    }
+    for (int i = 0; i < 16; ++i) {
+        rgba[i * 4 + 3] = palette[(bits >> (3 * i)) & 7];
+    }
+}
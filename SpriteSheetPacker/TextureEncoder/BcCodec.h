@@ -0,0 +1,26 @@
+#ifndef BCCODEC_H
+#define BCCODEC_H
+
+#include <cstdint>
+
+// BC1 / BC2 / BC3 (DXT1 / DXT3 / DXT5) block codec. Every function works on
+// one 4x4 block: the pixels are 16 RGBA8888 values in row-major order and
+// the compressed block is stored little-endian, the way it is laid out in
+// PVR, KTX and DDS files.
+//
+// quality is a TextureQuality value: 0 fast (range fit), 1 normal (range
+// fit refined by least squares), 2 high (cluster fit).
+
+// Pixels with alpha below 128 are encoded as punch-through transparent.
+void bc1EncodeBlock(const uint8_t* rgba, uint8_t* block, int quality);
+// Explicit 4 bit alpha followed by a four color BC1 block.
+void bc2EncodeBlock(const uint8_t* rgba, uint8_t* block, int quality);
+// Interpolated alpha followed by a four color BC1 block.
+void bc3EncodeBlock(const uint8_t* rgba, uint8_t* block, int quality);
+
+// Reference decoders, they write all four channels.
+void bc1DecodeBlock(const uint8_t* block, uint8_t* rgba);
+void bc2DecodeBlock(const uint8_t* block, uint8_t* rgba);
+void bc3DecodeBlock(const uint8_t* block, uint8_t* rgba);
+
+#endif // BCCODEC_H
@@ -0,0 +1,704 @@
+#include "EtcCodec.h"
+#include <climits>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ETCCODEC_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const int kEtcModifiers[8][2] = {
+    {  2,   8 }, {  5,  17 }, {  9,  29 }, { 13,  42 },
+    { 18,  60 }, { 24,  80 }, { 33, 106 }, { 47, 183 }
+};
+
+const int kEacModifiers[16][8] = {
+    { -3, -6,  -9, -15, 2, 5, 8, 14 },
+    { -3, -7, -10, -13, 2, 6, 9, 12 },
+    { -2, -5,  -8, -13, 1, 4, 7, 12 },
+    { -2, -4,  -6, -13, 1, 3, 5, 12 },
+    { -3, -6,  -8, -12, 2, 5, 7, 11 },
+    { -3, -7,  -9, -11, 2, 6, 8, 10 },
+    { -4, -7,  -8, -11, 3, 6, 7, 10 },
+    { -3, -5,  -8, -11, 2, 4, 7, 10 },
+    { -2, -6,  -8, -10, 1, 5, 7,  9 },
+    { -2, -5,  -8, -10, 1, 4, 7,  9 },
+    { -2, -4,  -8, -10, 1, 3, 7,  9 },
+    { -2, -5,  -7, -10, 1, 4, 6,  9 },
+    { -3, -4,  -7, -10, 2, 3, 6,  9 },
+    { -1, -2,  -3, -10, 0, 1, 2,  9 },
+    { -4, -6,  -8,  -9, 3, 5, 7,  8 },
+    { -3, -5,  -7,  -9, 2, 4, 6,  8 }
+};
+
+const int kEtc2Distances[8] = { 3, 6, 11, 16, 23, 32, 41, 64 };
+
+// Perceptual channel weights (0.299, 0.587, 0.114) scaled by 128.
+const int kWeightR = 38;
+const int kWeightG = 75;
+const int kWeightB = 15;
+
+inline int clamp255(int value) {
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+inline int extend4(int value) { return (value << 4) | value; }
+inline int extend5(int value) { return (value << 3) | (value >> 2); }
+inline int extend6(int value) { return (value << 2) | (value >> 4); }
+inline int extend7(int value) { return (value << 1) | (value >> 6); }
+
+inline int signExtend3(int value) {
+    return (value & 4) ? value - 8 : value;
+}
+
+inline uint32_t colorError(int dr, int dg, int db) {
+    return kWeightR * dr * dr + kWeightG * dg * dg + kWeightB * db * db;
+}
+
+inline uint64_t readBlock(const uint8_t* block) {
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; ++i) {
+        bits = (bits << 8) | block[i];
+    }
+    return bits;
+}
+
+inline void writeBlock(uint64_t bits, uint8_t* block) {
+    for (int i = 7; i >= 0; --i) {
+        block[i] = bits & 0xff;
+        bits >>= 8;
+    }
+}
+
+inline int quantize(float value, int maxValue) {
+    int q = (int)(value * maxValue / 255.f + 0.5f);
+    return q < 0 ? 0 : (q > maxValue ? maxValue : q);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// ETC1 individual / differential modes
+
+// Eight pixels of one half of the block. position is the pixel bit index
+// used by the index planes (x * 4 + y).
+struct Subblock {
+    int16_t r[8];
+    int16_t g[8];
+    int16_t b[8];
+    int     position[8];
+};
+
+void splitSubblocks(const uint8_t* rgba, int flip, Subblock subblocks[2]) {
+    int count[2] = { 0, 0 };
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            int s = flip ? (y >> 1) : (x >> 1);
+            Subblock& subblock = subblocks[s];
+            const uint8_t* p = rgba + (y * 4 + x) * 4;
+            int i = count[s]++;
+            subblock.r[i] = p[0];
+            subblock.g[i] = p[1];
+            subblock.b[i] = p[2];
+            subblock.position[i] = x * 4 + y;
+        }
+    }
+}
+
+// Error of the subblock for one base color and modifier table, with the
+// best modifier index of every pixel.
+uint32_t subblockError(const Subblock& subblock, const int base[3], int table, uint8_t* indices) {
+    const int a = kEtcModifiers[table][0];
+    const int b = kEtcModifiers[table][1];
+    const int modifiers[4] = { a, b, -a, -b };
+
+    int candidates[4][3];
+    for (int k = 0; k < 4; ++k) {
+        for (int c = 0; c < 3; ++c) {
+            candidates[k][c] = clamp255(base[c] + modifiers[k]);
+        }
+    }
+
+#if defined(ETCCODEC_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i r = _mm_loadu_si128((const __m128i*)subblock.r);
+    const __m128i g = _mm_loadu_si128((const __m128i*)subblock.g);
+    const __m128i b16 = _mm_loadu_si128((const __m128i*)subblock.b);
+    __m128i bestLo = _mm_set1_epi32(INT_MAX);
+    __m128i bestHi = bestLo;
+    __m128i indexLo = zero;
+    __m128i indexHi = zero;
+
+    for (int k = 0; k < 4; ++k) {
+        __m128i dr = _mm_sub_epi16(r, _mm_set1_epi16(candidates[k][0]));
+        __m128i dg = _mm_sub_epi16(g, _mm_set1_epi16(candidates[k][1]));
+        __m128i db = _mm_sub_epi16(b16, _mm_set1_epi16(candidates[k][2]));
+        __m128i wdr = _mm_mullo_epi16(dr, _mm_set1_epi16(kWeightR));
+        __m128i wdg = _mm_mullo_epi16(dg, _mm_set1_epi16(kWeightG));
+        __m128i wdb = _mm_mullo_epi16(db, _mm_set1_epi16(kWeightB));
+
+        // widen to 32 bit: madd of (d, 0) pairs with (w * d, 0) pairs gives w * d * d
+        __m128i errorLo = _mm_madd_epi16(_mm_unpacklo_epi16(dr, zero), _mm_unpacklo_epi16(wdr, zero));
+        errorLo = _mm_add_epi32(errorLo, _mm_madd_epi16(_mm_unpacklo_epi16(dg, zero), _mm_unpacklo_epi16(wdg, zero)));
+        errorLo = _mm_add_epi32(errorLo, _mm_madd_epi16(_mm_unpacklo_epi16(db, zero), _mm_unpacklo_epi16(wdb, zero)));
+        __m128i errorHi = _mm_madd_epi16(_mm_unpackhi_epi16(dr, zero), _mm_unpackhi_epi16(wdr, zero));
+        errorHi = _mm_add_epi32(errorHi, _mm_madd_epi16(_mm_unpackhi_epi16(dg, zero), _mm_unpackhi_epi16(wdg, zero)));
+        errorHi = _mm_add_epi32(errorHi, _mm_madd_epi16(_mm_unpackhi_epi16(db, zero), _mm_unpackhi_epi16(wdb, zero)));
+
+        __m128i index = _mm_set1_epi32(k);
+        __m128i lessLo = _mm_cmplt_epi32(errorLo, bestLo);
+        __m128i lessHi = _mm_cmplt_epi32(errorHi, bestHi);
+        bestLo = _mm_or_si128(_mm_and_si128(lessLo, errorLo), _mm_andnot_si128(lessLo, bestLo));
+        bestHi = _mm_or_si128(_mm_and_si128(lessHi, errorHi), _mm_andnot_si128(lessHi, bestHi));
+        indexLo = _mm_or_si128(_mm_and_si128(lessLo, index), _mm_andnot_si128(lessLo, indexLo));
+        indexHi = _mm_or_si128(_mm_and_si128(lessHi, index), _mm_andnot_si128(lessHi, indexHi));
+    }
+
+    int32_t errors[8];
+    int32_t bestIndices[8];
+    _mm_storeu_si128((__m128i*)errors, bestLo);
+    _mm_storeu_si128((__m128i*)(errors + 4), bestHi);
+    _mm_storeu_si128((__m128i*)bestIndices, indexLo);
+    _mm_storeu_si128((__m128i*)(bestIndices + 4), indexHi);
+
+    uint32_t total = 0;
+    for (int i = 0; i < 8; ++i) {
+        total += errors[i];
+        indices[i] = (uint8_t)bestIndices[i];
+    }
+    return total;
+#else
+    uint32_t total = 0;
+    for (int i = 0; i < 8; ++i) {
+        uint32_t best = UINT_MAX;
+        for (int k = 0; k < 4; ++k) {
+            uint32_t error = colorError(subblock.r[i] - candidates[k][0],
+                                        subblock.g[i] - candidates[k][1],
+                                        subblock.b[i] - candidates[k][2]);
+            if (error < best) {
+                best = error;
+                indices[i] = k;
+            }
+        }
+        total += best;
+    }
+    return total;
+#endif
+}
+
+struct SubblockFit {
+    int      color[3];  // quantized to 4 or 5 bits
+    int      table;
+    uint32_t error;
+    uint8_t  indices[8];
+};
+
+void fitSubblock(const Subblock& subblock, const int color[3], int colorBits, SubblockFit& fit) {
+    int base[3];
+    for (int c = 0; c < 3; ++c) {
+        fit.color[c] = color[c];
+        base[c] = (colorBits == 4) ? extend4(color[c]) : extend5(color[c]);
+    }
+
+    fit.error = UINT_MAX;
+    uint8_t indices[8];
+    for (int table = 0; (table < 8) && fit.error; ++table) {
+        uint32_t error = subblockError(subblock, base, table, indices);
+        if (error < fit.error) {
+            fit.error = error;
+            fit.table = table;
+            for (int i = 0; i < 8; ++i) fit.indices[i] = indices[i];
+        }
+    }
+}
+
+// Quantizes the subblock average and fits the neighbouring base colors
+// too, more of them for higher quality levels.
+int fitSubblockCandidates(const Subblock& subblock, int colorBits, int quality, SubblockFit* fits) {
+    float sum[3] = { 0.f, 0.f, 0.f };
+    for (int i = 0; i < 8; ++i) {
+        sum[0] += subblock.r[i];
+        sum[1] += subblock.g[i];
+        sum[2] += subblock.b[i];
+    }
+
+    const int maxValue = (1 << colorBits) - 1;
+    int average[3];
+    for (int c = 0; c < 3; ++c) {
+        average[c] = quantize(sum[c] / 8.f, maxValue);
+    }
+
+    int count = 0;
+    for (int dr = -1; dr <= 1; ++dr) {
+        for (int dg = -1; dg <= 1; ++dg) {
+            for (int db = -1; db <= 1; ++db) {
+                bool luminanceStep = (dr == dg) && (dg == db);
+                if ((quality == 0) && (dr || dg || db)) continue;
+                if ((quality == 1) && !luminanceStep) continue;
+
+                int color[3] = { average[0] + dr, average[1] + dg, average[2] + db };
+                if ((color[0] < 0) || (color[0] > maxValue) ||
+                    (color[1] < 0) || (color[1] > maxValue) ||
+                    (color[2] < 0) || (color[2] > maxValue)) {
+                    continue;
+                }
+                fitSubblock(subblock, color, colorBits, fits[count++]);
+            }
+        }
+    }
+    return count;
+}
+
+void packIndices(uint64_t& bits, const Subblock& subblock, const SubblockFit& fit) {
+    for (int i = 0; i < 8; ++i) {
+        int position = subblock.position[i];
+        bits |= (uint64_t)((fit.indices[i] >> 1) & 1) << (16 + position);
+        bits |= (uint64_t)(fit.indices[i] & 1) << position;
+    }
+}
+
+struct EtcBlock {
+    uint64_t bits;
+    uint32_t error;
+};
+
+EtcBlock encodeEtc1Modes(const uint8_t* rgba, int quality) {
+    EtcBlock best = { 0, UINT_MAX };
+    SubblockFit fits[2][27];
+
+    for (int flip = 0; (flip < 2) && best.error; ++flip) {
+        Subblock subblocks[2];
+        splitSubblocks(rgba, flip, subblocks);
+
+        // individual mode: two independent RGB444 colors
+        for (int s = 0; s < 2; ++s) {
+            int count = fitSubblockCandidates(subblocks[s], 4, quality, fits[s]);
+            int bestFit = 0;
+            for (int i = 1; i < count; ++i) {
+                if (fits[s][i].error < fits[s][bestFit].error) bestFit = i;
+            }
+            fits[s][0] = fits[s][bestFit];
+        }
+        uint32_t error = fits[0][0].error + fits[1][0].error;
+        if (error < best.error) {
+            const SubblockFit& f0 = fits[0][0];
+            const SubblockFit& f1 = fits[1][0];
+            uint64_t bits = ((uint64_t)f0.color[0] << 60) | ((uint64_t)f1.color[0] << 56) |
+                            ((uint64_t)f0.color[1] << 52) | ((uint64_t)f1.color[1] << 48) |
+                            ((uint64_t)f0.color[2] << 44) | ((uint64_t)f1.color[2] << 40) |
+                            ((uint64_t)f0.table << 37) | ((uint64_t)f1.table << 34) |
+                            ((uint64_t)flip << 32);
+            packIndices(bits, subblocks[0], f0);
+            packIndices(bits, subblocks[1], f1);
+            best.bits = bits;
+            best.error = error;
+        }
+
+        // differential mode: RGB555 and a signed RGB333 delta
+        int count0 = fitSubblockCandidates(subblocks[0], 5, quality, fits[0]);
+        int count1 = fitSubblockCandidates(subblocks[1], 5, quality, fits[1]);
+        for (int i = 0; i < count0; ++i) {
+            for (int j = 0; j < count1; ++j) {
+                const SubblockFit& f0 = fits[0][i];
+                const SubblockFit& f1 = fits[1][j];
+                uint32_t error = f0.error + f1.error;
+                if (error >= best.error) continue;
+
+                int dr = f1.color[0] - f0.color[0];
+                int dg = f1.color[1] - f0.color[1];
+                int db = f1.color[2] - f0.color[2];
+                if ((dr < -4) || (dr > 3) || (dg < -4) || (dg > 3) || (db < -4) || (db > 3)) continue;
+
+                uint64_t bits = ((uint64_t)f0.color[0] << 59) | ((uint64_t)(dr & 7) << 56) |
+                                ((uint64_t)f0.color[1] << 51) | ((uint64_t)(dg & 7) << 48) |
+                                ((uint64_t)f0.color[2] << 43) | ((uint64_t)(db & 7) << 40) |
+                                ((uint64_t)f0.table << 37) | ((uint64_t)f1.table << 34) |
+                                ((uint64_t)1 << 33) | ((uint64_t)flip << 32);
+                packIndices(bits, subblocks[0], f0);
+                packIndices(bits, subblocks[1], f1);
+                best.bits = bits;
+                best.error = error;
+            }
+        }
+    }
+
+    return best;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// ETC2 planar mode
+
+enum Etc2Mode {
+    kEtcIndividual,
+    kEtcDifferential,
+    kEtc2T,
+    kEtc2H,
+    kEtc2Planar
+};
+
+Etc2Mode etc2Mode(uint64_t bits) {
+    if (!((bits >> 33) & 1)) {
+        return kEtcIndividual;
+    }
+    int r = (int)((bits >> 59) & 31) + signExtend3((bits >> 56) & 7);
+    if ((r < 0) || (r > 31)) return kEtc2T;
+    int g = (int)((bits >> 51) & 31) + signExtend3((bits >> 48) & 7);
+    if ((g < 0) || (g > 31)) return kEtc2H;
+    int b = (int)((bits >> 43) & 31) + signExtend3((bits >> 40) & 7);
+    if ((b < 0) || (b > 31)) return kEtc2Planar;
+    return kEtcDifferential;
+}
+
+// Least squares solution of color(x, y) = O + x * (H - O) / 4 + y * (V - O) / 4,
+// the inverse of the normal equations is the same for every block.
+struct PlanarSolver {
+    double inverse[3][3];
+
+    PlanarSolver() {
+        double ata[3][3] = { { 0 } };
+        for (int y = 0; y < 4; ++y) {
+            for (int x = 0; x < 4; ++x) {
+                double a[3] = { (4 - x - y) / 4.0, x / 4.0, y / 4.0 };
+                for (int i = 0; i < 3; ++i) {
+                    for (int j = 0; j < 3; ++j) {
+                        ata[i][j] += a[i] * a[j];
+                    }
+                }
+            }
+        }
+        double det = ata[0][0] * (ata[1][1] * ata[2][2] - ata[1][2] * ata[2][1]) -
+                     ata[0][1] * (ata[1][0] * ata[2][2] - ata[1][2] * ata[2][0]) +
+                     ata[0][2] * (ata[1][0] * ata[2][1] - ata[1][1] * ata[2][0]);
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                int i1 = (j + 1) % 3, i2 = (j + 2) % 3;
+                int j1 = (i + 1) % 3, j2 = (i + 2) % 3;
+                inverse[i][j] = (ata[i1][j1] * ata[i2][j2] - ata[i1][j2] * ata[i2][j1]) / det;
+            }
+        }
+    }
+};
+
+const PlanarSolver& planarSolver() {
+    static const PlanarSolver solver;
+    return solver;
+}
+
+inline int planarValue(int o, int h, int v, int x, int y) {
+    return clamp255((x * (h - o) + y * (v - o) + 4 * o + 2) >> 2);
+}
+
+uint32_t planarChannelError(const int* values, int o, int h, int v) {
+    uint32_t error = 0;
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            int d = planarValue(o, h, v, x, y) - values[y * 4 + x];
+            error += d * d;
+        }
+    }
+    return error;
+}
+
+EtcBlock encodePlanar(const uint8_t* rgba, int quality) {
+    const PlanarSolver& solver = planarSolver();
+    const int bits[3] = { 6, 7, 6 };
+    const int weights[3] = { kWeightR, kWeightG, kWeightB };
+
+    int quantized[3][3];  // channel, (O, H, V)
+    uint32_t totalError = 0;
+    for (int c = 0; c < 3; ++c) {
+        int values[16];
+        double rhs[3] = { 0, 0, 0 };
+        for (int y = 0; y < 4; ++y) {
+            for (int x = 0; x < 4; ++x) {
+                int value = rgba[(y * 4 + x) * 4 + c];
+                values[y * 4 + x] = value;
+                rhs[0] += value * (4 - x - y) / 4.0;
+                rhs[1] += value * x / 4.0;
+                rhs[2] += value * y / 4.0;
+            }
+        }
+
+        const int maxValue = (1 << bits[c]) - 1;
+        int q[3];
+        for (int i = 0; i < 3; ++i) {
+            double solution = solver.inverse[i][0] * rhs[0] + solver.inverse[i][1] * rhs[1] + solver.inverse[i][2] * rhs[2];
+            q[i] = quantize((float)solution, maxValue);
+        }
+
+        auto expand = [&](int value) { return (bits[c] == 7) ? extend7(value) : extend6(value); };
+        uint32_t bestError = planarChannelError(values, expand(q[0]), expand(q[1]), expand(q[2]));
+        int best[3] = { q[0], q[1], q[2] };
+
+        // channels are independent, refine each one on its own
+        if (quality > 0) {
+            for (int d = 0; d < 27; ++d) {
+                int candidate[3] = { q[0] + d % 3 - 1, q[1] + (d / 3) % 3 - 1, q[2] + d / 9 - 1 };
+                if ((candidate[0] < 0) || (candidate[0] > maxValue) ||
+                    (candidate[1] < 0) || (candidate[1] > maxValue) ||
+                    (candidate[2] < 0) || (candidate[2] > maxValue)) {
+                    continue;
+                }
+                uint32_t error = planarChannelError(values, expand(candidate[0]), expand(candidate[1]), expand(candidate[2]));
+                if (error < bestError) {
+                    bestError = error;
+                    best[0] = candidate[0];
+                    best[1] = candidate[1];
+                    best[2] = candidate[2];
+                }
+            }
+        }
+
+        for (int i = 0; i < 3; ++i) quantized[c][i] = best[i];
+        totalError += weights[c] * bestError;
+    }
+
+    const int ro = quantized[0][0], rh = quantized[0][1], rv = quantized[0][2];
+    const int go = quantized[1][0], gh = quantized[1][1], gv = quantized[1][2];
+    const int bo = quantized[2][0], bh = quantized[2][1], bv = quantized[2][2];
+
+    uint64_t packed = ((uint64_t)ro << 57) |
+                      ((uint64_t)(go >> 6) << 56) | ((uint64_t)(go & 63) << 49) |
+                      ((uint64_t)(bo >> 5) << 48) | ((uint64_t)((bo >> 3) & 3) << 43) | ((uint64_t)(bo & 7) << 39) |
+                      ((uint64_t)(rh >> 1) << 34) | ((uint64_t)1 << 33) | ((uint64_t)(rh & 1) << 32) |
+                      ((uint64_t)gh << 25) | ((uint64_t)bh << 19) |
+                      ((uint64_t)rv << 13) | ((uint64_t)gv << 6) | (uint64_t)bv;
+
+    // the unused bits must make red and green fit and blue overflow,
+    // that is how a decoder tells the planar mode apart
+    const int freeBits[6] = { 63, 55, 47, 46, 45, 42 };
+    for (int combination = 0; combination < 64; ++combination) {
+        uint64_t candidate = packed;
+        for (int i = 0; i < 6; ++i) {
+            if (combination & (1 << i)) candidate |= (uint64_t)1 << freeBits[i];
+        }
+        if (etc2Mode(candidate) == kEtc2Planar) {
+            EtcBlock block = { candidate, totalError };
+            return block;
+        }
+    }
+
+    EtcBlock invalid = { 0, UINT_MAX };
+    return invalid;
+}
+
+void decodePlanar(uint64_t bits, uint8_t* rgba) {
+    int ro = (bits >> 57) & 63;
+    int go = (((bits >> 56) & 1) << 6) | ((bits >> 49) & 63);
+    int bo = (((bits >> 48) & 1) << 5) | (((bits >> 43) & 3) << 3) | ((bits >> 39) & 7);
+    int rh = (((bits >> 34) & 31) << 1) | ((bits >> 32) & 1);
+    int gh = (bits >> 25) & 127;
+    int bh = (bits >> 19) & 63;
+    int rv = (bits >> 13) & 63;
+    int gv = (bits >> 6) & 127;
+    int bv = bits & 63;
+
+    ro = extend6(ro); rh = extend6(rh); rv = extend6(rv);
+    go = extend7(go); gh = extend7(gh); gv = extend7(gv);
+    bo = extend6(bo); bh = extend6(bh); bv = extend6(bv);
+
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            uint8_t* p = rgba + (y * 4 + x) * 4;
+            p[0] = planarValue(ro, rh, rv, x, y);
+            p[1] = planarValue(go, gh, gv, x, y);
+            p[2] = planarValue(bo, bh, bv, x, y);
+        }
+    }
+}
+
+inline int pixelIndex(uint64_t bits, int x, int y) {
+    int position = x * 4 + y;
+    return (int)((((bits >> (16 + position)) & 1) << 1) | ((bits >> position) & 1));
+}
+
+void decodePaintColors(uint64_t bits, const int paint[4][3], uint8_t* rgba) {
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            const int* color = paint[pixelIndex(bits, x, y)];
+            uint8_t* p = rgba + (y * 4 + x) * 4;
+            p[0] = color[0];
+            p[1] = color[1];
+            p[2] = color[2];
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// EAC alpha
+
+// Stops early and returns a value >= bound once the error can't beat it.
+uint32_t eacError(const int* alpha, int base, int multiplier, int table, uint32_t bound, uint8_t* indices) {
+    uint32_t total = 0;
+    int values[8];
+    for (int k = 0; k < 8; ++k) {
+        values[k] = clamp255(base + kEacModifiers[table][k] * multiplier);
+    }
+    for (int i = 0; i < 16; ++i) {
+        uint32_t best = UINT_MAX;
+        for (int k = 0; k < 8; ++k) {
+            int d = alpha[i] - values[k];
+            uint32_t error = d * d;
+            if (error < best) {
+                best = error;
+                indices[i] = k;
+            }
+        }
+        total += best;
+        if (total >= bound) break;
+    }
+    return total;
+}
+
+}
+
+void etc1EncodeBlock(const uint8_t* rgba, uint8_t* block, int quality) {
+    writeBlock(encodeEtc1Modes(rgba, quality).bits, block);
+}
+
+void etc2EncodeRgbBlock(const uint8_t* rgba, uint8_t* block, int quality) {
+    EtcBlock best = encodeEtc1Modes(rgba, quality);
+    if (best.error > 0) {
+        EtcBlock planar = encodePlanar(rgba, quality);
+        if (planar.error < best.error) {
+            best = planar;
+        }
+    }
+    writeBlock(best.bits, block);
+}
+
+void eacEncodeAlphaBlock(const uint8_t* rgba, uint8_t* block, int quality) {
+    // alpha values in the index order of the block (x * 4 + y)
+    int alpha[16];
+    int minAlpha = 255, maxAlpha = 0;
+    for (int x = 0; x < 4; ++x) {
+        for (int y = 0; y < 4; ++y) {
+            int value = rgba[(y * 4 + x) * 4 + 3];
+            alpha[x * 4 + y] = value;
+            if (value < minAlpha) minAlpha = value;
+            if (value > maxAlpha) maxAlpha = value;
+        }
+    }
+
+    int bestBase = minAlpha, bestMultiplier = 1, bestTable = 13;
+    uint8_t bestIndices[16];
+    // table 13 has a zero modifier, a solid block is encoded exactly
+    for (int i = 0; i < 16; ++i) bestIndices[i] = 4;
+
+    if (minAlpha != maxAlpha) {
+        const int radius = quality;
+        uint32_t bestError = UINT_MAX;
+        uint8_t indices[16];
+        for (int table = 0; (table < 16) && bestError; ++table) {
+            int low = kEacModifiers[table][3];
+            int high = kEacModifiers[table][7];
+            int multiplier0 = (int)((maxAlpha - minAlpha) / (float)(high - low) + 0.5f);
+            for (int multiplier = multiplier0 - radius; multiplier <= multiplier0 + radius; ++multiplier) {
+                if ((multiplier < 1) || (multiplier > 15)) continue;
+                int base0 = (int)((minAlpha + maxAlpha) / 2.f - multiplier * (high + low) / 2.f + 0.5f);
+                for (int base = base0 - radius; (base <= base0 + radius) && bestError; ++base) {
+                    if ((base < 0) || (base > 255)) continue;
+                    uint32_t error = eacError(alpha, base, multiplier, table, bestError, indices);
+                    if (error < bestError) {
+                        bestError = error;
+                        bestBase = base;
+                        bestMultiplier = multiplier;
+                        bestTable = table;
+                        for (int i = 0; i < 16; ++i) bestIndices[i] = indices[i];
+                    }
+                }
+            }
+        }
+    }
+
+    uint64_t bits = ((uint64_t)bestBase << 56) | ((uint64_t)bestMultiplier << 52) | ((uint64_t)bestTable << 48);
+    for (int i = 0; i < 16; ++i) {
+        bits |= (uint64_t)bestIndices[i] << (45 - 3 * i);
+    }
+    writeBlock(bits, block);
+}
+
+void etc2DecodeRgbBlock(const uint8_t* block, uint8_t* rgba) {
+    uint64_t bits = readBlock(block);
+    Etc2Mode mode = etc2Mode(bits);
+
+    if ((mode == kEtcIndividual) || (mode == kEtcDifferential)) {
+        int base[2][3];
+        if (mode == kEtcIndividual) {
+            for (int c = 0; c < 3; ++c) {
+                base[0][c] = extend4((bits >> (60 - c * 8)) & 15);
+                base[1][c] = extend4((bits >> (56 - c * 8)) & 15);
+            }
+        } else {
+            for (int c = 0; c < 3; ++c) {
+                int color = (bits >> (59 - c * 8)) & 31;
+                int delta = signExtend3((bits >> (56 - c * 8)) & 7);
+                base[0][c] = extend5(color);
+                base[1][c] = extend5(color + delta);
+            }
+        }
+        int tables[2] = { (int)((bits >> 37) & 7), (int)((bits >> 34) & 7) };
+        int flip = (bits >> 32) & 1;
+
+        for (int y = 0; y < 4; ++y) {
+            for (int x = 0; x < 4; ++x) {
+                int s = flip ? (y >> 1) : (x >> 1);
+                int a = kEtcModifiers[tables[s]][0];
+                int b = kEtcModifiers[tables[s]][1];
+                const int modifiers[4] = { a, b, -a, -b };
+                int modifier = modifiers[pixelIndex(bits, x, y)];
+                uint8_t* p = rgba + (y * 4 + x) * 4;
+                p[0] = clamp255(base[s][0] + modifier);
+                p[1] = clamp255(base[s][1] + modifier);
+                p[2] = clamp255(base[s][2] + modifier);
+            }
+        }
+    } else if (mode == kEtc2T) {
+        int c1[3] = { extend4((int)((((bits >> 59) & 3) << 2) | ((bits >> 56) & 3))),
+                      extend4((bits >> 52) & 15),
+                      extend4((bits >> 48) & 15) };
+        int c2[3] = { extend4((bits >> 44) & 15), extend4((bits >> 40) & 15), extend4((bits >> 36) & 15) };
+        int d = kEtc2Distances[(((bits >> 34) & 3) << 1) | ((bits >> 32) & 1)];
+        int paint[4][3];
+        for (int c = 0; c < 3; ++c) {
+            paint[0][c] = c1[c];
+            paint[1][c] = clamp255(c2[c] + d);
+            paint[2][c] = c2[c];
+            paint[3][c] = clamp255(c2[c] - d);
+        }
+        decodePaintColors(bits, paint, rgba);
+    } else if (mode == kEtc2H) {
+        int r1 = (bits >> 59) & 15;
+        int g1 = (int)((((bits >> 56) & 7) << 1) | ((bits >> 52) & 1));
+        int b1 = (int)((((bits >> 51) & 1) << 3) | ((bits >> 47) & 7));
+        int r2 = (bits >> 43) & 15;
+        int g2 = (bits >> 39) & 15;
+        int b2 = (bits >> 35) & 15;
+        int ordering = (((r1 << 8) | (g1 << 4) | b1) >= ((r2 << 8) | (g2 << 4) | b2)) ? 1 : 0;
+        int d = kEtc2Distances[(((bits >> 34) & 1) << 2) | (((bits >> 32) & 1) << 1) | ordering];
+        int c1[3] = { extend4(r1), extend4(g1), extend4(b1) };
+        int c2[3] = { extend4(r2), extend4(g2), extend4(b2) };
+        int paint[4][3];
+        for (int c = 0; c < 3; ++c) {
+            paint[0][c] = clamp255(c1[c] + d);
+            paint[1][c] = clamp255(c1[c] - d);
+            paint[2][c] = clamp255(c2[c] + d);
+            paint[3][c] = clamp255(c2[c] - d);
+        }
+        decodePaintColors(bits, paint, rgba);
+    } else {
+        decodePlanar(bits, rgba);
+    }
+}
+
+void eacDecodeAlphaBlock(const uint8_t* block, uint8_t* rgba) {
+    uint64_t bits = readBlock(block);
+    int base = (bits >> 56) & 255;
+    int multiplier = (bits >> 52) & 15;
+    int table = (bits >> 48) & 15;
+    for (int i = 0; i < 16; ++i) {
+        int index = (bits >> (45 - 3 * i)) & 7;
+        int x = i / 4, y = i % 4;
+        rgba[(y * 4 + x) * 4 + 3] = clamp255(base + kEacModifiers[table][index] * multiplier);
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef ETCCODEC_H
+#define ETCCODEC_H
+
+#include <cstdint>
+
+// ETC1 / ETC2 / EAC block codec. Every function works on one 4x4 block:
+// the pixels are 16 RGBA8888 values in row-major order (pixel x, y at
+// index y * 4 + x) and the compressed block is stored big-endian, the way
+// it is laid out in PVR, KTX and PKM files.
+//
+// quality is a TextureQuality value: 0 fast, 1 normal, 2 high.
+
+// Individual and differential modes only, decodable by any ETC1 decoder.
+void etc1EncodeBlock(const uint8_t* rgba, uint8_t* block, int quality);
+// ETC1 modes plus the ETC2 planar mode for smooth gradients.
+void etc2EncodeRgbBlock(const uint8_t* rgba, uint8_t* block, int quality);
+// EAC alpha block used in front of the color block by ETC2 RGBA8.
+void eacEncodeAlphaBlock(const uint8_t* rgba, uint8_t* block, int quality);
+
+// Reference decoders (all ETC2 RGB modes, ETC1 blocks included). They
+// write R, G, B (or A) and leave the other channels untouched.
+void etc2DecodeRgbBlock(const uint8_t* block, uint8_t* rgba);
+void eacDecodeAlphaBlock(const uint8_t* block, uint8_t* rgba);
+
+#endif // ETCCODEC_H
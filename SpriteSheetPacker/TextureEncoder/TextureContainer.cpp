@@ -0,0 +1,320 @@
+#include "TextureContainer.h"
+#include <QtConcurrent>
+#include <QtEndian>
+
+namespace {
+
+const quint32 kPvrVersion = 0x03525650;
+
+// PVR v3 compressed pixel format identifiers
+quint64 pvrPixelFormat(PixelFormat pixelFormat) {
+    switch (pixelFormat) {
+        case kETC1: return 6;
+        case kETC2: return 22;
+        case kETC2A: return 23;
+        case kDXT1: return 7;
+        case kDXT3: return 9;
+        case kDXT5: return 11;
+        case kASTC4x4: return 27;
+        case kASTC6x6: return 31;
+        case kASTC8x8: return 34;
+        default: return 0;
+    }
+}
+
+// OpenGL ES internal formats of the compressed textures
+quint32 glInternalFormat(PixelFormat pixelFormat) {
+    switch (pixelFormat) {
+        case kETC1: return 0x8D64;      // GL_ETC1_RGB8_OES
+        case kETC2: return 0x9274;      // GL_COMPRESSED_RGB8_ETC2
+        case kETC2A: return 0x9278;     // GL_COMPRESSED_RGBA8_ETC2_EAC
+        case kDXT1: return 0x83F1;      // GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+        case kDXT3: return 0x83F2;      // GL_COMPRESSED_RGBA_S3TC_DXT3_EXT
+        case kDXT5: return 0x83F3;      // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+        case kASTC4x4: return 0x93B0;   // GL_COMPRESSED_RGBA_ASTC_4x4_KHR
+        case kASTC6x6: return 0x93B4;   // GL_COMPRESSED_RGBA_ASTC_6x6_KHR
+        case kASTC8x8: return 0x93B7;   // GL_COMPRESSED_RGBA_ASTC_8x8_KHR
+        default: return 0;
+    }
+}
+
+quint32 glBaseInternalFormat(PixelFormat pixelFormat) {
+    return ((pixelFormat == kETC1) || (pixelFormat == kETC2)) ? 0x1907   // GL_RGB
+                                                              : 0x1908;  // GL_RGBA
+}
+
+// Vulkan formats of the compressed textures, ETC1 is stored as ETC2 RGB
+quint32 vkFormat(PixelFormat pixelFormat) {
+    switch (pixelFormat) {
+        case kETC1: return 147;         // VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK
+        case kETC2: return 147;
+        case kETC2A: return 151;        // VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK
+        case kDXT1: return 133;         // VK_FORMAT_BC1_RGBA_UNORM_BLOCK
+        case kDXT3: return 135;         // VK_FORMAT_BC2_UNORM_BLOCK
+        case kDXT5: return 137;         // VK_FORMAT_BC3_UNORM_BLOCK
+        case kASTC4x4: return 157;      // VK_FORMAT_ASTC_4x4_UNORM_BLOCK
+        case kASTC6x6: return 165;      // VK_FORMAT_ASTC_6x6_UNORM_BLOCK
+        case kASTC8x8: return 171;      // VK_FORMAT_ASTC_8x8_UNORM_BLOCK
+        default: return 0;
+    }
+}
+
+// KTX2 supercompression scheme identifiers
+quint32 ktx2Scheme(Supercompression supercompression) {
+    return (supercompression == kSupercompressionZlib) ? 3 : 0;
+}
+
+// ASTC block footprint, 0 for the other formats
+int astcBlockSize(PixelFormat pixelFormat) {
+    switch (pixelFormat) {
+        case kASTC4x4: return 4;
+        case kASTC6x6: return 6;
+        case kASTC8x8: return 8;
+        default: return 0;
+    }
+}
+
+// PKM texture types
+int pkmType(PixelFormat pixelFormat) {
+    switch (pixelFormat) {
+        case kETC1: return 0;   // ETC1_RGB_NO_MIPMAPS
+        case kETC2: return 1;   // ETC2PACKAGE_RGB_NO_MIPMAPS
+        case kETC2A: return 3;  // ETC2PACKAGE_RGBA_NO_MIPMAPS
+        default: return -1;
+    }
+}
+
+template <typename T>
+void appendLittleEndian(QByteArray& data, T value) {
+    T le = qToLittleEndian<T>(value);
+    data.append(reinterpret_cast<const char*>(&le), sizeof(T));
+}
+
+template <typename T>
+void appendBigEndian(QByteArray& data, T value) {
+    T be = qToBigEndian<T>(value);
+    data.append(reinterpret_cast<const char*>(&be), sizeof(T));
+}
+
+}
+
+bool TextureContainer::supportsPvr(PixelFormat pixelFormat) {
+    return pvrPixelFormat(pixelFormat) != 0;
+}
+
+bool TextureContainer::supportsPkm(PixelFormat pixelFormat) {
+    return pkmType(pixelFormat) != -1;
+}
+
+bool TextureContainer::supportsAstc(PixelFormat pixelFormat) {
+    return astcBlockSize(pixelFormat) != 0;
+}
+
+bool TextureContainer::supportsKtx(PixelFormat pixelFormat) {
+    return glInternalFormat(pixelFormat) != 0;
+}
+
+bool TextureContainer::supportsKtx2(PixelFormat pixelFormat) {
+    return vkFormat(pixelFormat) != 0;
+}
+
+bool TextureContainer::supports(ImageFormat imageFormat, PixelFormat pixelFormat) {
+    switch (imageFormat) {
+        case kPKM: return supportsPkm(pixelFormat);
+        case kPVR:
+        case kPVR_CCZ: return supportsPvr(pixelFormat);
+        case kASTC: return supportsAstc(pixelFormat);
+        case kKTX: return supportsKtx(pixelFormat);
+        case kKTX2: return supportsKtx2(pixelFormat);
+        default: return false;
+    }
+}
+
+QByteArray TextureContainer::pvr(PixelFormat pixelFormat, const QSize& size, const QByteArray& payload) {
+    QByteArray data = pvrHeader(pixelFormat, size);
+    data.append(payload);
+    return data;
+}
+
+QByteArray TextureContainer::pvrHeader(PixelFormat pixelFormat, const QSize& size) {
+    QByteArray data;
+    data.reserve(52);
+    appendLittleEndian<quint32>(data, kPvrVersion);
+    appendLittleEndian<quint32>(data, 0);                            // flags
+    appendLittleEndian<quint64>(data, pvrPixelFormat(pixelFormat));
+    appendLittleEndian<quint32>(data, 0);                            // color space: linear RGB
+    appendLittleEndian<quint32>(data, 0);                            // channel type: unsigned byte normalised
+    appendLittleEndian<quint32>(data, size.height());
+    appendLittleEndian<quint32>(data, size.width());
+    appendLittleEndian<quint32>(data, 1);                            // depth
+    appendLittleEndian<quint32>(data, 1);                            // surfaces
+    appendLittleEndian<quint32>(data, 1);                            // faces
+    appendLittleEndian<quint32>(data, 1);                            // mip map count
+    appendLittleEndian<quint32>(data, 0);                            // meta data size
+    return data;
+}
+
+QByteArray TextureContainer::pkm(PixelFormat pixelFormat, const QSize& size, const QByteArray& payload) {
+    QByteArray data;
+    data.reserve(16 + payload.size());
+    data.append("PKM ");
+    data.append((pixelFormat == kETC1) ? "10" : "20");
+    appendBigEndian<quint16>(data, pkmType(pixelFormat));
+    appendBigEndian<quint16>(data, (size.width() + 3) & ~3);        // padded size
+    appendBigEndian<quint16>(data, (size.height() + 3) & ~3);
+    appendBigEndian<quint16>(data, size.width());                   // original size
+    appendBigEndian<quint16>(data, size.height());
+    data.append(payload);
+    return data;
+}
+
+QByteArray TextureContainer::astc(PixelFormat pixelFormat, const QSize& size, const QByteArray& payload) {
+    const int blockSize = astcBlockSize(pixelFormat);
+    QByteArray data;
+    data.reserve(16 + payload.size());
+    appendLittleEndian<quint32>(data, 0x5CA1AB13);                   // magic
+    data.append((char)blockSize);                                   // block x, y, z
+    data.append((char)blockSize);
+    data.append((char)1);
+    // 24 bit little-endian x, y, z size
+    for (int dimension : { size.width(), size.height(), 1 }) {
+        data.append((char)(dimension & 0xff));
+        data.append((char)((dimension >> 8) & 0xff));
+        data.append((char)((dimension >> 16) & 0xff));
+    }
+    data.append(payload);
+    return data;
+}
+
+QByteArray TextureContainer::ktx(PixelFormat pixelFormat, const QSize& size, const QByteArray& payload) {
+    static const char kIdentifier[12] = { '\xAB', 'K', 'T', 'X', ' ', '1', '1', '\xBB', '\r', '\n', '\x1A', '\n' };
+
+    QByteArray data;
+    data.reserve(68 + payload.size());
+    data.append(kIdentifier, sizeof(kIdentifier));
+    appendLittleEndian<quint32>(data, 0x04030201);                   // endianness
+    appendLittleEndian<quint32>(data, 0);                            // glType: compressed
+    appendLittleEndian<quint32>(data, 1);                            // glTypeSize
+    appendLittleEndian<quint32>(data, 0);                            // glFormat: compressed
+    appendLittleEndian<quint32>(data, glInternalFormat(pixelFormat));
+    appendLittleEndian<quint32>(data, glBaseInternalFormat(pixelFormat));
+    appendLittleEndian<quint32>(data, size.width());
+    appendLittleEndian<quint32>(data, size.height());
+    appendLittleEndian<quint32>(data, 0);                            // depth
+    appendLittleEndian<quint32>(data, 0);                            // array elements
+    appendLittleEndian<quint32>(data, 1);                            // faces
+    appendLittleEndian<quint32>(data, 1);                            // mip map levels
+    appendLittleEndian<quint32>(data, 0);                            // key/value data size
+    appendLittleEndian<quint32>(data, payload.size());               // image size
+    data.append(payload);
+    return data;
+}
+
+QByteArray TextureContainer::ktx2(PixelFormat pixelFormat, const QSize& size, const QVector<QByteArray>& levels, Supercompression supercompression) {
+    static const char kIdentifier[12] = { '\xAB', 'K', 'T', 'X', ' ', '2', '0', '\xBB', '\r', '\n', '\x1A', '\n' };
+
+    QVector<QByteArray> levelData = levels;
+    if (supercompression == kSupercompressionZlib) {
+        QtConcurrent::blockingMap(levelData, [](QByteArray& level) {
+            // strip the 4 byte length qCompress puts in front of the zlib stream
+            level = qCompress(level, 9).mid(4);
+        });
+    }
+
+    // data format descriptor: one basic block with a single sample, or an
+    // alpha and a color sample for ETC2A, DXT3 and DXT5
+    const int blockSize = astcBlockSize(pixelFormat) ? astcBlockSize(pixelFormat) : 4;
+    const int blockBytes = ((pixelFormat == kETC1) || (pixelFormat == kETC2) || (pixelFormat == kDXT1)) ? 8 : 16;
+    const bool twoPlanes = (pixelFormat == kETC2A) || (pixelFormat == kDXT3) || (pixelFormat == kDXT5);
+    quint32 colorModel;
+    switch (pixelFormat) {
+        case kDXT1: colorModel = 128; break;        // KHR_DF_MODEL_BC1A
+        case kDXT3: colorModel = 129; break;        // KHR_DF_MODEL_BC2
+        case kDXT5: colorModel = 130; break;        // KHR_DF_MODEL_BC3
+        case kASTC4x4:
+        case kASTC6x6:
+        case kASTC8x8: colorModel = 162; break;     // KHR_DF_MODEL_ASTC
+        default: colorModel = 161; break;           // KHR_DF_MODEL_ETC2
+    }
+
+    QByteArray dfd;
+    const int samples = twoPlanes ? 2 : 1;
+    const quint32 blockLength = 24 + 16 * samples;
+    appendLittleEndian<quint32>(dfd, 4 + blockLength);               // total size
+    appendLittleEndian<quint32>(dfd, 0);                             // vendor: Khronos, type: basic
+    appendLittleEndian<quint32>(dfd, 2 | (blockLength << 16));       // version 1.3
+    appendLittleEndian<quint32>(dfd, colorModel | (1 << 8) | (1 << 16)); // BT.709 primaries, linear, straight alpha
+    appendLittleEndian<quint32>(dfd, (blockSize - 1) | ((blockSize - 1) << 8));
+    appendLittleEndian<quint32>(dfd, blockBytes);                    // bytes per plane
+    appendLittleEndian<quint32>(dfd, 0);
+    if (twoPlanes) {
+        // alpha channel id 15 of the ETC2 / BC2 / BC3 models, then color
+        appendLittleEndian<quint32>(dfd, 0 | (63 << 16) | (15u << 24));
+        appendLittleEndian<quint32>(dfd, 0);
+        appendLittleEndian<quint32>(dfd, 0);
+        appendLittleEndian<quint32>(dfd, 0xFFFFFFFF);
+        appendLittleEndian<quint32>(dfd, 64 | (63 << 16) | ((colorModel == 161 ? 2u : 0u) << 24));
+    } else {
+        // ETC2 color, BC1 color with alpha, ASTC data
+        const quint32 channel = (colorModel == 161) ? 2 : ((colorModel == 128) ? 1 : 0);
+        appendLittleEndian<quint32>(dfd, 0 | ((blockBytes * 8 - 1) << 16) | (channel << 24));
+    }
+    appendLittleEndian<quint32>(dfd, 0);                             // sample position
+    appendLittleEndian<quint32>(dfd, 0);                             // lower
+    appendLittleEndian<quint32>(dfd, 0xFFFFFFFF);                    // upper
+
+    // header, index and level index
+    const int levelCount = levelData.size();
+    const quint32 dfdOffset = 80 + 24 * levelCount;
+    // uncompressed levels start on a multiple of the block size
+    const int alignment = (supercompression == kSupercompressionNone) ? blockBytes : 1;
+
+    QVector<quint64> levelOffsets(levelCount);
+    quint64 offset = dfdOffset + dfd.size();
+    for (int level = levelCount - 1; level >= 0; --level) {
+        // the smallest level is stored first
+        offset = (offset + alignment - 1) / alignment * alignment;
+        levelOffsets[level] = offset;
+        offset += levelData[level].size();
+    }
+
+    QByteArray data;
+    data.reserve(offset);
+    data.append(kIdentifier, sizeof(kIdentifier));
+    appendLittleEndian<quint32>(data, vkFormat(pixelFormat));
+    appendLittleEndian<quint32>(data, 1);                            // type size
+    appendLittleEndian<quint32>(data, size.width());
+    appendLittleEndian<quint32>(data, size.height());
+    appendLittleEndian<quint32>(data, 0);                            // depth
+    appendLittleEndian<quint32>(data, 0);                            // layers
+    appendLittleEndian<quint32>(data, 1);                            // faces
+    appendLittleEndian<quint32>(data, levelCount);
+    appendLittleEndian<quint32>(data, ktx2Scheme(supercompression));
+    appendLittleEndian<quint32>(data, dfdOffset);
+    appendLittleEndian<quint32>(data, dfd.size());
+    appendLittleEndian<quint32>(data, 0);                            // key/value data
+    appendLittleEndian<quint32>(data, 0);
+    appendLittleEndian<quint64>(data, 0);                            // supercompression global data
+    appendLittleEndian<quint64>(data, 0);
+    for (int level = 0; level < levelCount; ++level) {
+        appendLittleEndian<quint64>(data, levelOffsets[level]);
+        appendLittleEndian<quint64>(data, levelData[level].size());
+        appendLittleEndian<quint64>(data, levels[level].size());    // uncompressed size
+    }
+    data.append(dfd);
+    for (int level = levelCount - 1; level >= 0; --level) {
+        data.append(QByteArray(levelOffsets[level] - data.size(), 0));
+        data.append(levelData[level]);
+    }
+    return data;
+}
+
+QByteArray TextureContainer::serialize(ImageFormat imageFormat, PixelFormat pixelFormat, const QSize& size, const QByteArray& payload) {
+    switch (imageFormat) {
+        case kPKM: return pkm(pixelFormat, size, payload);
+        case kASTC: return astc(pixelFormat, size, payload);
+        case kKTX: return ktx(pixelFormat, size, payload);
+        case kKTX2: return ktx2(pixelFormat, size, QVector<QByteArray>() << payload, kSupercompressionNone);
+        default: return pvr(pixelFormat, size, payload);
+    }
+}
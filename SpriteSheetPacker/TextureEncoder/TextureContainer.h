@@ -0,0 +1,40 @@
+#ifndef TEXTURECONTAINER_H
+#define TEXTURECONTAINER_H
+
+#include <QByteArray>
+#include <QSize>
+#include <QVector>
+#include "ImageFormat.h"
+
+// File containers for the payload produced by TextureEncoder.
+class TextureContainer
+{
+public:
+    static bool supportsPvr(PixelFormat pixelFormat);
+    static bool supportsPkm(PixelFormat pixelFormat);
+    static bool supportsAstc(PixelFormat pixelFormat);
+    static bool supportsKtx(PixelFormat pixelFormat);
+    static bool supportsKtx2(PixelFormat pixelFormat);
+    // Whether the image format is one of the containers above and can hold
+    // the pixel format (PVR.CCZ holds a PVR file).
+    static bool supports(ImageFormat imageFormat, PixelFormat pixelFormat);
+
+    // PVR v3: 52 byte header, no meta data, one surface and mip level.
+    // Holds the ETC, DXT and ASTC payloads.
+    static QByteArray pvr(PixelFormat pixelFormat, const QSize& size, const QByteArray& payload);
+    static QByteArray pvrHeader(PixelFormat pixelFormat, const QSize& size);
+    // PKM: 16 byte big-endian header used for ETC1 / ETC2 textures.
+    static QByteArray pkm(PixelFormat pixelFormat, const QSize& size, const QByteArray& payload);
+    // .astc: 16 byte header of the ARM reference encoder, ASTC only.
+    static QByteArray astc(PixelFormat pixelFormat, const QSize& size, const QByteArray& payload);
+    // KTX 1.1: 64 byte header with the OpenGL ES internal format, no key/value
+    // data and one mip level. Holds the ETC, DXT and ASTC payloads.
+    static QByteArray ktx(PixelFormat pixelFormat, const QSize& size, const QByteArray& payload);
+    // KTX 2.0: Vulkan format, data format descriptor and the mip levels,
+    // largest first. The levels are supercompressed in parallel.
+    static QByteArray ktx2(PixelFormat pixelFormat, const QSize& size, const QVector<QByteArray>& levels, Supercompression supercompression);
+    // The container of the image format, uncompressed for PVR.CCZ.
+    static QByteArray serialize(ImageFormat imageFormat, PixelFormat pixelFormat, const QSize& size, const QByteArray& payload);
+};
+
+#endif // TEXTURECONTAINER_H
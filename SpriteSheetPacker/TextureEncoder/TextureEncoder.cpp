@@ -0,0 +1,248 @@
+#include "TextureEncoder.h"
+#include "EtcCodec.h"
+#include "BcCodec.h"
+#include "AstcCodec.h"
+#include <QtConcurrent>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// largest block footprint, ASTC 8x8
+const int kMaxBlockTexels = 64;
+
+inline int blocksAcross(int pixels, int blockSize) {
+    return (pixels + blockSize - 1) / blockSize;
+}
+
+}
+
+TextureEncoder::TextureEncoder(PixelFormat pixelFormat, TextureQuality quality)
+    : _pixelFormat(pixelFormat)
+    , _quality(quality)
+{
+
+}
+
+bool TextureEncoder::supports(PixelFormat pixelFormat) {
+    switch (pixelFormat) {
+        case kETC1:
+        case kETC2:
+        case kETC2A:
+        case kDXT1:
+        case kDXT3:
+        case kDXT5:
+        case kASTC4x4:
+        case kASTC6x6:
+        case kASTC8x8:
+            return true;
+        default:
+            return false;
+    }
+}
+
+int TextureEncoder::blockWidth() const {
+    switch (_pixelFormat) {
+        case kASTC6x6: return 6;
+        case kASTC8x8: return 8;
+        default: return 4;
+    }
+}
+
+int TextureEncoder::blockHeight() const {
+    // all supported footprints are square
+    return blockWidth();
+}
+
+int TextureEncoder::blockBytes() const {
+    switch (_pixelFormat) {
+        case kETC2A:
+        case kDXT3:
+        case kDXT5:
+        case kASTC4x4:
+        case kASTC6x6:
+        case kASTC8x8:
+            return 16;
+        default:
+            return 8;
+    }
+}
+
+bool TextureEncoder::hasAlpha() const {
+    return (_pixelFormat == kETC2A) || (_pixelFormat == kDXT1) || (_pixelFormat == kDXT3) || (_pixelFormat == kDXT5) ||
+           (_pixelFormat == kASTC4x4) || (_pixelFormat == kASTC6x6) || (_pixelFormat == kASTC8x8);
+}
+
+QByteArray TextureEncoder::encode(const QImage& image) const {
+    QImage rgba = image.convertToFormat(QImage::Format_RGBA8888);
+    if (rgba.isNull()) {
+        return QByteArray();
+    }
+
+    const int blocksX = blocksAcross(rgba.width(), blockWidth());
+    const int blocksY = blocksAcross(rgba.height(), blockHeight());
+    const int rowBytes = blocksX * blockBytes();
+
+    QByteArray data(blocksY * rowBytes, 0);
+    uchar* output = reinterpret_cast<uchar*>(data.data());
+
+    QVector<int> blockRows(blocksY);
+    for (int i = 0; i < blocksY; ++i) blockRows[i] = i;
+
+    QtConcurrent::blockingMap(blockRows, [&](int& blockRow) {
+        encodeBlockRow(rgba, blockRow, output + blockRow * rowBytes);
+    });
+
+    return data;
+}
+
+void TextureEncoder::encodeBlockRow(const QImage& image, int blockRow, uchar* output) const {
+    const int width = blockWidth();
+    const int height = blockHeight();
+    const int blocksX = blocksAcross(image.width(), width);
+    const int quality = _quality;
+    uint8_t pixels[kMaxBlockTexels * 4];
+
+    for (int blockX = 0; blockX < blocksX; ++blockX) {
+        // partial blocks at the right and bottom edge repeat the last column / row
+        for (int y = 0; y < height; ++y) {
+            const uchar* line = image.constScanLine(qMin(blockRow * height + y, image.height() - 1));
+            for (int x = 0; x < width; ++x) {
+                int sourceX = qMin(blockX * width + x, image.width() - 1);
+                memcpy(pixels + (y * width + x) * 4, line + sourceX * 4, 4);
+            }
+        }
+
+        uchar* block = output + blockX * blockBytes();
+        switch (_pixelFormat) {
+            case kETC1:
+                etc1EncodeBlock(pixels, block, quality);
+                break;
+            case kETC2:
+                etc2EncodeRgbBlock(pixels, block, quality);
+                break;
+            case kETC2A:
+                eacEncodeAlphaBlock(pixels, block, quality);
+                etc2EncodeRgbBlock(pixels, block + 8, quality);
+                break;
+            case kDXT1:
+                bc1EncodeBlock(pixels, block, quality);
+                break;
+            case kDXT3:
+                bc2EncodeBlock(pixels, block, quality);
+                break;
+            case kDXT5:
+                bc3EncodeBlock(pixels, block, quality);
+                break;
+            case kASTC4x4:
+            case kASTC6x6:
+            case kASTC8x8:
+                astcEncodeBlock(pixels, width, height, block, quality);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+QImage TextureEncoder::decode(const QByteArray& data, const QSize& size) const {
+    const int blocksX = blocksAcross(size.width(), blockWidth());
+    const int blocksY = blocksAcross(size.height(), blockHeight());
+    const int rowBytes = blocksX * blockBytes();
+    if (data.size() < blocksY * rowBytes) {
+        return QImage();
+    }
+
+    QImage image(size, QImage::Format_RGBA8888);
+    // detach once, the block rows are written from worker threads
+    image.bits();
+
+    const uchar* input = reinterpret_cast<const uchar*>(data.constData());
+    QVector<int> blockRows(blocksY);
+    for (int i = 0; i < blocksY; ++i) blockRows[i] = i;
+
+    QtConcurrent::blockingMap(blockRows, [&](int& blockRow) {
+        decodeBlockRow(input + blockRow * rowBytes, blockRow, image);
+    });
+
+    return image;
+}
+
+void TextureEncoder::decodeBlockRow(const uchar* input, int blockRow, QImage& image) const {
+    const int width = blockWidth();
+    const int height = blockHeight();
+    const int blocksX = blocksAcross(image.width(), width);
+    uint8_t pixels[kMaxBlockTexels * 4];
+
+    for (int blockX = 0; blockX < blocksX; ++blockX) {
+        memset(pixels, 255, sizeof(pixels));
+
+        const uchar* block = input + blockX * blockBytes();
+        switch (_pixelFormat) {
+            case kETC1:
+            case kETC2:
+                etc2DecodeRgbBlock(block, pixels);
+                break;
+            case kETC2A:
+                eacDecodeAlphaBlock(block, pixels);
+                etc2DecodeRgbBlock(block + 8, pixels);
+                break;
+            case kDXT1:
+                bc1DecodeBlock(block, pixels);
+                break;
+            case kDXT3:
+                bc2DecodeBlock(block, pixels);
+                break;
+            case kDXT5:
+                bc3DecodeBlock(block, pixels);
+                break;
+            case kASTC4x4:
+            case kASTC6x6:
+            case kASTC8x8:
+                astcDecodeBlock(block, width, height, pixels);
+                break;
+            default:
+                break;
+        }
+
+        for (int y = 0; y < height; ++y) {
+            int targetY = blockRow * height + y;
+            if (targetY >= image.height()) break;
+            uchar* line = const_cast<uchar*>(image.constScanLine(targetY));
+            for (int x = 0; x < width; ++x) {
+                int targetX = blockX * width + x;
+                if (targetX >= image.width()) break;
+                memcpy(line + targetX * 4, pixels + (y * width + x) * 4, 4);
+            }
+        }
+    }
+}
+
+double TextureEncoder::psnr(const QImage& original, const QImage& decoded, bool withAlpha) {
+    QImage a = original.convertToFormat(QImage::Format_RGBA8888);
+    QImage b = decoded.convertToFormat(QImage::Format_RGBA8888);
+    if (a.size() != b.size() || a.isNull()) {
+        return 0.0;
+    }
+
+    const int channels = withAlpha ? 4 : 3;
+    double sum = 0.0;
+    for (int y = 0; y < a.height(); ++y) {
+        const uchar* lineA = a.constScanLine(y);
+        const uchar* lineB = b.constScanLine(y);
+        qint64 lineSum = 0;
+        for (int x = 0; x < a.width(); ++x) {
+            for (int c = 0; c < channels; ++c) {
+                int d = lineA[x * 4 + c] - lineB[x * 4 + c];
+                lineSum += d * d;
+            }
+        }
+        sum += lineSum;
+    }
+
+    double mse = sum / ((double)a.width() * a.height() * channels);
+    if (mse == 0.0) {
+        return qInf();
+    }
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
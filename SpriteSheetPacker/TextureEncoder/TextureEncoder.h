@@ -0,0 +1,36 @@
+#ifndef TEXTUREENCODER_H
+#define TEXTUREENCODER_H
+
+#include <QImage>
+#include "ImageFormat.h"
+
+// Built-in block compressor for the GPU pixel formats. The image is cut
+// into 4x4 blocks (ASTC: 4x4, 6x6 or 8x8), block rows are encoded in parallel on the global thread
+// pool and the payload is returned in the order PVR/KTX/PKM files store it.
+class TextureEncoder
+{
+public:
+    TextureEncoder(PixelFormat pixelFormat, TextureQuality quality = kTextureNormal);
+
+    static bool supports(PixelFormat pixelFormat);
+
+    int blockWidth() const;
+    int blockHeight() const;
+    int blockBytes() const;
+    bool hasAlpha() const;
+    QByteArray encode(const QImage& image) const;
+
+    // Reference decoder, used to check the encoder output.
+    QImage decode(const QByteArray& data, const QSize& size) const;
+    static double psnr(const QImage& original, const QImage& decoded, bool withAlpha);
+
+protected:
+    void encodeBlockRow(const QImage& image, int blockRow, uchar* output) const;
+    void decodeBlockRow(const uchar* input, int blockRow, QImage& image) const;
+
+private:
+    PixelFormat    _pixelFormat;
+    TextureQuality _quality;
+};
+
+#endif // TEXTUREENCODER_H
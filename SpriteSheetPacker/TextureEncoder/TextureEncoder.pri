@@ -0,0 +1,16 @@
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/AstcCodec.cpp \
+    $$PWD/BcCodec.cpp \
+    $$PWD/EtcCodec.cpp \
+    $$PWD/TextureContainer.cpp \
+    $$PWD/TextureEncoder.cpp
+
+HEADERS += \
+    $$PWD/AstcCodec.h \
+    $$PWD/BcCodec.h \
+    $$PWD/EtcCodec.h \
+    $$PWD/TextureContainer.h \
+    $$PWD/TextureEncoder.h
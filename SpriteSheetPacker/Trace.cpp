@@ -0,0 +1,102 @@
+#include "Trace.h"
+#include "JsonWriter.h"
+
+QAtomicInt Trace::_enabled(0);
+QElapsedTimer Trace::_clock;
+QMutex Trace::_mutex;
+QVector<Trace::Event> Trace::_events;
+QStringList Trace::_threadNames;
+
+void Trace::start() {
+    QMutexLocker locker(&_mutex);
+    if (_enabled.load()) return;
+    _clock.start();
+    _enabled.store(1);
+}
+
+void Trace::addEvent(const char* name, qint64 begin, qint64 end, const QString& detail) {
+    const int thread = threadIndex();
+    QMutexLocker locker(&_mutex);
+    _events.push_back({name, begin, end - begin, thread, detail});
+}
+
+QMap<QString, qint64> Trace::durations() {
+    QMutexLocker locker(&_mutex);
+    QMap<QString, qint64> durations;
+    for (const Event& event: _events) {
+        durations[QString::fromLatin1(event.name)] += event.duration;
+    }
+    return durations;
+}
+
+void Trace::clear() {
+    QMutexLocker locker(&_mutex);
+    _events.clear();
+}
+
+// small numbers instead of thread handles, in the order threads first trace
+int Trace::threadIndex() {
+    static thread_local int index = -1;
+    if (index < 0) {
+        QMutexLocker locker(&_mutex);
+        index = _threadNames.size();
+        QThread* thread = QThread::currentThread();
+        bool main = QCoreApplication::instance() && (thread == QCoreApplication::instance()->thread());
+        _threadNames.push_back(main? QString("main") : QString("worker %1").arg(index));
+    }
+    return index;
+}
+
+bool Trace::save(const QString& fileName, QString* errorString) {
+    QMutexLocker locker(&_mutex);
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        *errorString = QString("Can't write %1: %2").arg(fileName).arg(file.errorString());
+        return false;
+    }
+
+    QTextStream stream(&file);
+    stream.setCodec("UTF-8");
+    JsonWriter json(stream, false);
+    json.beginObject();
+    json.beginArray("traceEvents");
+    for (int i = 0; i < _threadNames.size(); ++i) {
+        json.beginObject();
+        json.value("name", QString("thread_name"));
+        json.value("ph", QString("M"));
+        json.value("pid", 1);
+        json.value("tid", i);
+        json.beginObject("args");
+        json.value("name", _threadNames.at(i));
+        json.end();
+        json.end();
+    }
+    for (const Event& event: _events) {
+        json.beginObject();
+        json.value("name", QString::fromLatin1(event.name));
+        json.value("cat", QString("ssp"));
+        json.value("ph", QString("X"));
+        json.value("ts", event.begin);
+        json.value("dur", event.duration);
+        json.value("pid", 1);
+        json.value("tid", event.thread);
+        if (!event.detail.isEmpty()) {
+            json.beginObject("args");
+            json.value("detail", event.detail);
+            json.end();
+        }
+        json.end();
+    }
+    json.end();
+    json.value("displayTimeUnit", QString("ms"));
+    json.end();
+    stream << '\n';
+    stream.flush();
+
+    if (file.error() != QFile::NoError) {
+        *errorString = QString("Can't write %1: %2").arg(fileName).arg(file.errorString());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,83 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QtCore>
+
+// Timed events of the packing and publishing stages, written in the Chrome
+// trace event format (chrome://tracing, ui.perfetto.dev). Events are only
+// collected between start() and the end of the process; until then a
+// TRACE_SCOPE is a single atomic load, and building with
+// DEFINES+=SSP_NO_TRACE removes the scopes altogether.
+//
+//   void decode(const QString& fileName) {
+//       TRACE_SCOPE_DETAIL("decode", fileName);
+//       ...
+//   }
+class Trace
+{
+public:
+    static void start();
+    static bool enabled() { return _enabled.load() != 0; }
+
+    // every event since start(), complete events of scopes still open are missing
+    static bool save(const QString& fileName, QString* errorString);
+    // microseconds spent in the events of each name, summed over all threads
+    static QMap<QString, qint64> durations();
+    // drops the events so far, the clock keeps running
+    static void clear();
+
+    // microseconds since start()
+    static qint64 now() { return _clock.nsecsElapsed() / 1000; }
+    static void addEvent(const char* name, qint64 begin, qint64 end, const QString& detail);
+
+private:
+    struct Event {
+        const char* name;
+        qint64      begin;
+        qint64      duration;
+        int         thread;
+        QString     detail;
+    };
+
+    static int threadIndex();
+
+    static QAtomicInt      _enabled;
+    static QElapsedTimer   _clock;
+    static QMutex          _mutex;
+    static QVector<Event>  _events;
+    static QStringList     _threadNames;
+};
+
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name) : _name(Trace::enabled()? name : nullptr), _begin(_name? Trace::now() : 0) { }
+    ~TraceScope() { if (_name) Trace::addEvent(_name, _begin, Trace::now(), _detail); }
+
+    bool active() const { return _name != nullptr; }
+    void setDetail(const QString& detail) { _detail = detail; }
+
+private:
+    Q_DISABLE_COPY(TraceScope)
+
+    const char* _name;
+    qint64      _begin;
+    QString     _detail;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifndef SSP_NO_TRACE
+// times the rest of the enclosing block
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+// detail, shown with the event, is only evaluated while tracing
+#define TRACE_SCOPE_DETAIL(name, detail) \
+    TraceScope TRACE_CONCAT(traceScope, __LINE__)(name); \
+    if (TRACE_CONCAT(traceScope, __LINE__).active()) TRACE_CONCAT(traceScope, __LINE__).setDetail(detail)
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_SCOPE_DETAIL(name, detail)
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,51 @@
+#-------------------------------------------------
+#
+# cli: the command line of SpriteSheetPacker as a console tool of its own.
+# It links sspcore and QtCore/QtGui only, so build servers need neither
+# QtWidgets nor a display server. The editor still runs the same command
+# line when it is started with arguments.
+#
+#-------------------------------------------------
+
+QT += core gui network
+QT -= widgets
+
+TARGET = SpriteSheetPackerCli
+TEMPLATE = app
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+# next to the editor, the command line finds defaultFormats where it does
+CONFIG(release,debug|release) {
+    win32: DESTDIR = $$PWD/../../install/win/bin
+    macx: DESTDIR = $$PWD/../../install/macos/bin
+    linux: DESTDIR = $$PWD/../../install/linux/bin
+} else {
+    macx: DESTDIR = $$OUT_PWD
+    win32: DESTDIR = $$OUT_PWD/debug
+    linux: DESTDIR = $$OUT_PWD
+}
+
+include(../sspcore/sspcore.pri)
+
+SOURCES += \
+    main.cpp \
+    ../command-line.cpp
+
+# the editor bundles them on macOS, the console tool has no bundle
+unix {
+    QMAKE_POST_LINK += mkdir -p $$shell_quote($$DESTDIR/defaultFormats) $$escape_expand(\\n\\t)
+    QMAKE_POST_LINK += $${QMAKE_COPY} $$shell_quote($$PWD/../defaultFormats)/*.* $$shell_quote($$DESTDIR/defaultFormats) $$escape_expand(\\n\\t)
+}
+
+win32 {
+    QMAKE_PRE_LINK += if not exist $$shell_quote($$shell_path($$DESTDIR/defaultFormats)) mkdir $$shell_quote($$shell_path($$DESTDIR/defaultFormats)) $$escape_expand(\\n\\t)
+    FILES = $$files(../defaultFormats/*.*)
+    for(FILE, FILES) {
+        QMAKE_PRE_LINK += $${QMAKE_COPY} $$shell_quote($$shell_path($$PWD/$$FILE)) $$shell_quote($$shell_path($$DESTDIR/defaultFormats)) $$escape_expand(\\n\\t)
+    }
+
+    CONFIG(release,debug|release) {
+        QMAKE_POST_LINK = windeployqt $$shell_quote($$shell_path($${DESTDIR}/$${TARGET}.exe))
+    }
+}
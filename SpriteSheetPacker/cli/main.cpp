@@ -0,0 +1,20 @@
+#include <QCoreApplication>
+#include "SpritePackerProjectFile.h"
+
+int commandLine(QCoreApplication& app);
+
+// The command line without the editor: the same options as
+// "SpriteSheetPacker <arguments>", see command-line.cpp.
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCoreApplication::setOrganizationName("amakaseev");
+    QCoreApplication::setOrganizationDomain("spicyminds-lab.com");
+    QCoreApplication::setApplicationName("SpriteSheetPacker");
+    QCoreApplication::setApplicationVersion("1.0.9");
+
+    SpritePackerProjectFile::registerFileTypes();
+
+    return commandLine(app);
+}
@@ -1,16 +1,130 @@
 #include <QtCore>
+#include <QtConcurrent>
+#include <QLocalServer>
+#include <QLocalSocket>
 #include "SpriteAtlas.h"
 #include "PublishSpriteSheet.h"
 #include "SpritePackerProjectFile.h"
+#include "PngOptimizer.h"
+#include "Trace.h"
 
-int commandLine(QCoreApplication& app) {
-    QCommandLineParser parser;
-    parser.setApplicationDescription("");
-    parser.addHelpOption();
-    parser.addVersionOption();
-    parser.addPositionalArgument("source", "Sprites for packing or project file (You can override project file options with [options]).");
-    parser.addPositionalArgument("destination", "Destination folder where you're saving the sprite sheet. Optional when using project file");
+#if defined(Q_OS_UNIX)
+#include <sys/stat.h>
+#endif
+
+// Encodes every atlas page with all PNG optimization modes and levels and
+// prints size and time, so a level can be chosen from real atlases.
+void benchmarkPng(const QList<SpriteAtlas>& atlases, PixelFormat pixelFormat, bool premultiplied, DitherMode dithering) {
+    for (const SpriteAtlas& atlas: atlases) {
+        for (const SpriteAtlas::OutputData& outputData: atlas.outputData()) {
+            QImage image = convertImage(outputData._atlasImage, pixelFormat, premultiplied, dithering);
+            qInfo() << QString("Page %1x%2:").arg(image.width()).arg(image.height());
+
+            for (const QString& optMode: QStringList() << "Lossless" << "Lossy") {
+                for (int optLevel = 1; optLevel <= 7; ++optLevel) {
+                    QScopedPointer<PngOptimizer> optimizer;
+                    if (optMode == "Lossless") {
+                        optimizer.reset(new LosslessPngOptimizer(optLevel - 1));
+                    } else {
+                        optimizer.reset(new PngQuantOptimizer(optLevel - 1));
+                    }
+
+                    QElapsedTimer timer;
+                    timer.start();
+                    QByteArray pngData;
+                    bool success = optimizer->optimizeImage(image, pngData);
+                    qint64 time = timer.elapsed();
+
+                    if (success) {
+                        qInfo() << QString("  %1 level %2: %3 bytes, %4 ms").arg(optMode, -8).arg(optLevel).arg(pngData.size()).arg(time);
+                    } else {
+                        qInfo() << QString("  %1 level %2: failed").arg(optMode, -8).arg(optLevel);
+                    }
+                }
+            }
+        }
+    }
+}
+
+namespace {
+
+// ms without further changes before watch mode republishes, editors and
+// version control touch many files in a row
+const int kSettleInterval = 200;
+// ms between scans of the watched folders for images saved in place, which
+// change no folder and so send no notification
+const int kWatchPollInterval = 2000;
+
+// pixels of prepared sprites the pack server keeps for all projects
+const int kServeCacheKBytes = 512 * 1024;
+// projects whose last atlases the pack server keeps
+const int kServeProjects = 16;
+// ms a running pack server has to accept a connection before its socket counts as stale
+const int kServeProbeTimeout = 1000;
 
+// one sprite sheet of a pack: a scaling variant of the project file, or the
+// only sheet of a sprites folder
+struct SheetVariant {
+    QString name;
+    float   scale;
+    int     maxTextureSize;
+    bool    pow2;
+    // destination without extension
+    QString filePath;
+};
+
+bool operator==(const SheetVariant& a, const SheetVariant& b) {
+    return (a.name == b.name) && (a.scale == b.scale) && (a.maxTextureSize == b.maxTextureSize) &&
+           (a.pow2 == b.pow2) && (a.filePath == b.filePath);
+}
+
+// the settings of the project file, or the defaults for a sprites folder,
+// with [options] applied
+struct PackJob {
+    // as given on the command line, destinationPath is empty when it comes from the project file
+    QString     sourcePath;
+    QString     destinationPath;
+    QString     projectFilePath;
+    QStringList srcList;
+    QString     trimMode;
+    QString     algorithm;
+    int         trim;
+    float       epsilon;
+    int         textureBorder;
+    int         spriteBorder;
+    bool        heuristicMask;
+    bool        forceSquared;
+    QString     format;
+    QString     pngOptMode;
+    int         pngOptLevel;
+    ImageFormat imageFormat;
+    PixelFormat pixelFormat;
+    bool        premultiplied;
+    DitherMode  dithering;
+    TextureQuality textureQuality;
+    Supercompression supercompression;
+    bool        mipmaps;
+    bool        trimSpriteNames;
+    bool        prependSmartFolderName;
+
+    QVector<SheetVariant> variants;
+};
+
+// true when the sheets of both jobs are made the same way, variants aside
+bool sameSettings(const PackJob& a, const PackJob& b) {
+    return (a.srcList == b.srcList) && (a.trimMode == b.trimMode) && (a.algorithm == b.algorithm) &&
+           (a.trim == b.trim) && (a.epsilon == b.epsilon) && (a.textureBorder == b.textureBorder) &&
+           (a.spriteBorder == b.spriteBorder) && (a.heuristicMask == b.heuristicMask) &&
+           (a.forceSquared == b.forceSquared) && (a.format == b.format) && (a.pngOptMode == b.pngOptMode) &&
+           (a.pngOptLevel == b.pngOptLevel) && (a.imageFormat == b.imageFormat) && (a.pixelFormat == b.pixelFormat) &&
+           (a.premultiplied == b.premultiplied) && (a.dithering == b.dithering) &&
+           (a.textureQuality == b.textureQuality) && (a.supercompression == b.supercompression) &&
+           (a.mipmaps == b.mipmaps) && (a.trimSpriteNames == b.trimSpriteNames) &&
+           (a.prependSmartFolderName == b.prependSmartFolderName);
+}
+
+// the [options] of the command line, also parsed from pack server requests
+void addOptions(QCommandLineParser& parser) {
     parser.addOptions({
         {{"f", "format"}, "Format for export sprite sheet data. Default is cocos2d.", "format"},
         {"trimMode", "Rect - Removes the transparency around a sprite. The sprites appear to have their original size when using them.\n\
@@ -25,90 +139,123 @@ Default is Rect", "mode", "Rect"},
         {"max-size", "Sets the maximum size for the texture, default is 8192.", "size", "8192"},
         {"png-opt-mode", "Optimizes the png's file size.\n\
 None - No optimization at all(fastest).\n\
-Lossless - Uses optipng to optimize the filesize. The reduction is mostly small but doesn't harm image quality.\n\
+Lossless - Reduces color type, bit depth and palette where no pixel changes and searches PNG filter and deflate strategies. The reduction is mostly small but doesn't harm image quality.\n\
 Lossy - Uses pngquant to optimize the filesize. The reduction is mostly about 70%, but the image quality gets a bit worse.", "int", "0"},
-        {"png-opt-level", "Optimizes the image's file size. Only useful in combination with opt-mode Lossless. Allowed values: 1 to 7 (Using a high value might take some time to optimize.", "int", "0"},
+        {"png-opt-level", "Optimizes the image's file size. Allowed values: 1 to 7 (Using a high value might take some time to optimize.\n\
+Lossless - higher levels try more filter and compression strategies.\n\
+Lossy - higher levels quantize slower with a higher quality limit (1: speed 10, quality 0-70 ... 7: speed 1, quality 0-100).", "int", "0"},
+        {"png-benchmark", "Packs the sprites and prints the size and time of every png-opt-mode and png-opt-level for each page instead of publishing."},
+        {"dithering", "Dithering used when reducing colors to ARGB4444, ARGB8565 or RGB565.\n\
+None - No dithering (fastest).\n\
+Ordered - 4x4 ordered (Bayer) dithering.\n\
+FloydSteinberg - Error diffusion dithering.", "mode", "None"},
+        {"texture-quality", "Search effort of the built-in ETC1/ETC2, DXT and ASTC encoders.\n\
+Fast - Single candidate per mode (DXT: range fit, ASTC: one weight grid).\n\
+Normal - Also tries neighbouring base colors (DXT: least squares refinement, ASTC: four weight grids, default).\n\
+High - Exhaustive search around every base color (DXT: cluster fit, ASTC: every weight grid, slowest).", "mode", "Normal"},
+        {"supercompression", "Supercompression of the *.ktx2 mip levels.\n\
+None - Levels are stored as they are uploaded to the GPU.\n\
+Zlib - Every level is deflated on its own (default).", "mode", "Zlib"},
+        {"mipmaps", "Writes the full mip chain into *.ktx2 files. Default is disable."},
+        {"batch", "Text file listing project files to publish as a batch, one per line and relative to the list. Lines starting with # are skipped.", "file"},
+        {"max-concurrent-pages", "Pages converted and encoded at the same time, for all projects of a batch together. Lower it to bound memory use, default is the number of CPU cores.", "int"},
+        {"serve", "Runs as a pack server: answers pack requests on the local socket (or named pipe) with the given name until the process is stopped. Only the user running it can connect, and an existing file of that name is never replaced unless it is the socket of a server that is gone.", "name"},
+        {"depfile", "Writes the inputs of the sprite sheets as a Makefile dependency rule to the given file: every packed image, the source folders, the project file and the format script.", "file"},
+        {"stamp", "Touches the given file whenever an image or data file was written, and only then. It is the target of the --depfile rule.", "file"},
+        {"trace", "Writes how long every stage of packing and publishing took, on which thread, to the given file in the Chrome trace event format (open it in chrome://tracing or ui.perfetto.dev). With --watch and --serve the file is rewritten after every round and holds only that round.", "file"},
+        {"watch", "Keeps running after publishing and publishes again whenever the source folders or the project file change."},
+        {"force", "Writes every image and data file, also the ones the publish manifest of the destination folder has as unchanged."},
         {"scale", "Scales all images before creating the sheet. E.g. use 0.5 for half size, default is 1 (Scale has no effect when source is a project file).", "float", "1"},
         {"trimSpriteNames", "Remove image file extensions from the sprite names - e.g. .png, .jpg, ...", "bool", "false"},
         {"prependSmartFolderName", "Prepends the smart folder's name as part of the sprite name.", "bool", "false"},
     });
+}
 
-    parser.process(app);
+void loadFormats() {
+    QSettings settings;
+    QStringList formatsFolder;
+    formatsFolder.push_back(PublishSpriteSheet::defaultFormatsFolder());
+    formatsFolder.push_back(settings.value("Preferences/customFormatFolder").toString());
 
-    bool destinationSet = true;
-    SpritePackerProjectFile* projectFile = nullptr;
+    PublishSpriteSheet::loadFormats(formatsFolder);
+    qDebug() << "Support Formats:" << PublishSpriteSheet::formats().keys();
+}
 
-    if (parser.positionalArguments().size() > 2) {
-        qDebug() << "Too many arguments, see help for information.";
-        parser.showHelp();
-        return -1;
-    } else if ((parser.positionalArguments().size() == 1) || (parser.positionalArguments().size() == 2)) {
-        QFileInfo src(parser.positionalArguments().at(0));
-        if (!src.isDir()) {
-            std::string suffix = src.suffix().toStdString();
-            projectFile = SpritePackerProjectFile::factory().get(suffix)();
-        }
+// Reads sourcePath (and the project file it is) into job, destinationPath
+// empty for the destination of the project file. Watch mode calls it again
+// whenever the project file changes.
+bool loadJob(const QCommandLineParser& parser, const QString& sourcePath, const QString& destinationPath, PackJob& job) {
+    bool destinationSet = !destinationPath.isEmpty();
+    QScopedPointer<SpritePackerProjectFile> projectFile;
 
-        if (parser.positionalArguments().size() == 1) {
-            if (!projectFile) {
-                qDebug() << "Arguments must have source and destination, see help for information.";
-                parser.showHelp();
-                return -1;
-            } else {
-                destinationSet = false; // we should already have our destination saved in our project file
-            }
-        } else if (parser.positionalArguments().size() == 2) {
-            destinationSet = true;
+    QFileInfo source(sourcePath);
+    QFileInfo destination;
+    if (!source.isDir()) {
+        auto instantiator = SpritePackerProjectFile::factory().get(source.suffix().toStdString());
+        if (instantiator) {
+            projectFile.reset(instantiator());
         }
-
-    } else {
-        qDebug() << "Arguments must have source and destination, see help for information.";
-        parser.showHelp();
-        return -1;
     }
 
-    qDebug() << "arguments:" << parser.positionalArguments();
-    qDebug() << "options:" << parser.optionNames();
-
-    QFileInfo source(parser.positionalArguments().at(0));
-    QFileInfo destination;
-
     if (destinationSet) {
-        destination.setFile(parser.positionalArguments().at(1));
+        destination.setFile(destinationPath);
     }
 
     // initialize [options]
-    QString trimMode = "Rect";
-    QString algorithm = "Rect";
-    int trim = 1;
-    float epsilon = 5.f;
-    int textureBorder = 0;
-    int spriteBorder = 2;
+    job.sourcePath = sourcePath;
+    job.destinationPath = destinationPath;
+    job.projectFilePath = projectFile? source.absoluteFilePath() : QString();
+    job.srcList = QStringList() << source.filePath();
+    job.trimMode = "Rect";
+    job.algorithm = "Rect";
+    job.trim = 1;
+    job.epsilon = 5.f;
+    job.textureBorder = 0;
+    job.spriteBorder = 2;
     bool pow2 = false;
-    bool forceSquared = false;
-    bool heuristicMask = false;
+    job.forceSquared = false;
+    job.heuristicMask = false;
     int maxSize = 8192;
     float imageScale = 1;
-    QString format = "cocos2d";
-    QString pngOptMode = "None";
-    int pngOptLevel = 0;
-    bool trimSpriteNames = false;
-    bool prependSmartFolderName = false;
+    job.format = "cocos2d";
+    job.pngOptMode = "None";
+    job.pngOptLevel = 0;
+    job.imageFormat = kPNG;
+    job.pixelFormat = kARGB8888;
+    job.premultiplied = true;
+    job.dithering = kDitherNone;
+    job.textureQuality = kTextureNormal;
+    job.supercompression = kSupercompressionZlib;
+    job.mipmaps = false;
+    job.trimSpriteNames = false;
+    job.prependSmartFolderName = false;
 
     if (projectFile) {
         if (!projectFile->read(source.filePath())) {
             qCritical() << "File format error.";
+            return false;
         } else {
-            trimMode = projectFile->trimMode();
-            algorithm = projectFile->algorithm();
-            trim = projectFile->trimThreshold();
-            epsilon = projectFile->epsilon();
-            textureBorder = projectFile->textureBorder();
-            spriteBorder = projectFile->spriteBorder();
-            pngOptMode = projectFile->pngOptMode();
-            pngOptLevel = projectFile->pngOptLevel();
-            trimSpriteNames = projectFile->trimSpriteNames();
-            prependSmartFolderName = projectFile->prependSmartFolderName();
+            job.srcList = projectFile->srcList();
+            job.trimMode = projectFile->trimMode();
+            job.algorithm = projectFile->algorithm();
+            job.trim = projectFile->trimThreshold();
+            job.epsilon = projectFile->epsilon();
+            job.textureBorder = projectFile->textureBorder();
+            job.spriteBorder = projectFile->spriteBorder();
+            job.pngOptMode = projectFile->pngOptMode();
+            job.pngOptLevel = projectFile->pngOptLevel();
+            job.imageFormat = projectFile->imageFormat();
+            job.pixelFormat = projectFile->pixelFormat();
+            job.premultiplied = projectFile->premultiplied();
+            job.dithering = projectFile->dithering();
+            job.textureQuality = projectFile->textureQuality();
+            job.supercompression = projectFile->supercompression();
+            job.mipmaps = projectFile->mipmaps();
+            job.trimSpriteNames = projectFile->trimSpriteNames();
+            job.prependSmartFolderName = projectFile->prependSmartFolderName();
+            if (!parser.isSet("format")) {
+                job.format = projectFile->dataFormat();
+            }
 
             if (!destinationSet) {
                 destination.setFile(projectFile->destPath());
@@ -122,27 +269,27 @@ Lossy - Uses pngquant to optimize the filesize. The reduction is mostly about 70
 
     if (!destination.isDir()) {
         qDebug() << "Incorrect destination folder";
-        return -1;
+        return false;
     }
 
     // you can override project file options
     if (parser.isSet("trimMode")) {
-        trimMode = parser.value("trimMode");
+        job.trimMode = parser.value("trimMode");
     }
     if (parser.isSet("algorithm")) {
-     algorithm = parser.value("algorithm");
+        job.algorithm = parser.value("algorithm");
     }
     if (parser.isSet("trim")) {
-        trim = parser.value("trim").toInt();
+        job.trim = parser.value("trim").toInt();
     }
     if (parser.isSet("epsilon")) {
-        epsilon = parser.value("epsilon").toFloat();
+        job.epsilon = parser.value("epsilon").toFloat();
     }
     if (parser.isSet("texture-border")) {
-        textureBorder = parser.value("texture-border").toInt();
+        job.textureBorder = parser.value("texture-border").toInt();
     }
     if (parser.isSet("sprite-border")) {
-        spriteBorder = parser.value("sprite-border").toInt();
+        job.spriteBorder = parser.value("sprite-border").toInt();
     }
     if (parser.isSet("powerOf2")) {
         pow2 = true;
@@ -154,64 +301,60 @@ Lossy - Uses pngquant to optimize the filesize. The reduction is mostly about 70
         imageScale = parser.value("scale").toFloat();
     }
     if (parser.isSet("format")) {
-        format = parser.value("format");
+        job.format = parser.value("format");
     }
 
-     if (parser.isSet("png-opt-mode")) {
-         pngOptMode = parser.value("png-opt-mode");
-     }
+    if (parser.isSet("png-opt-mode")) {
+        job.pngOptMode = parser.value("png-opt-mode");
+    }
 
-    if (parser.isSet("png-opt-level")) {
-        pngOptLevel = parser.value("png-opt-level").toInt();
-        pngOptLevel = qBound(1, pngOptLevel, 7);
+    if (parser.isSet("dithering")) {
+        job.dithering = ditherModeFromString(parser.value("dithering"));
     }
 
-    qDebug() << "trimMode:" << trimMode;
-    qDebug() << "algorithm:" << algorithm;
-    qDebug() << "trim:" << trim;
-    qDebug() << "epsilon:" << epsilon;
-    qDebug() << "textureBorder:" << textureBorder;
-    qDebug() << "spriteBorder:" << spriteBorder;
-    qDebug() << "pow2:" << pow2;
-    qDebug() << "maxSize:" << maxSize;
-    qDebug() << "scale:" << imageScale;
-    qDebug() << "png-opt-mode:" << pngOptMode;
-    qDebug() << "png-opt-level:" << pngOptLevel;
+    if (parser.isSet("texture-quality")) {
+        job.textureQuality = textureQualityFromString(parser.value("texture-quality"));
+    }
 
-    // load formats
-    QSettings settings;
-    QStringList formatsFolder;
-    formatsFolder.push_back(QCoreApplication::applicationDirPath() + "/defaultFormats");
-    formatsFolder.push_back(settings.value("Preferences/customFormatFolder").toString());
+    if (parser.isSet("supercompression")) {
+        job.supercompression = supercompressionFromString(parser.value("supercompression"));
+    }
 
-    PublishSpriteSheet publisher;
+    if (parser.isSet("mipmaps")) {
+        job.mipmaps = true;
+    }
 
-    // load formats
-    PublishSpriteSheet::formats().clear();
-    for (auto folder: formatsFolder) {
-        if (QDir(folder).exists()) {
-            QDirIterator fileNames(folder, QStringList() << "*.js", QDir::Files | QDir::NoSymLinks | QDir::NoDotAndDotDot);
-            while(fileNames.hasNext()) {
-                fileNames.next();
-                PublishSpriteSheet::addFormat(fileNames.fileInfo().baseName(), fileNames.filePath());
-            }
-        }
+    if (parser.isSet("png-opt-level")) {
+        job.pngOptLevel = parser.value("png-opt-level").toInt();
+        job.pngOptLevel = qBound(1, job.pngOptLevel, 7);
     }
-    qDebug() << "Support Formats:" << PublishSpriteSheet::formats().keys();
 
+    qDebug() << "trimMode:" << job.trimMode;
+    qDebug() << "algorithm:" << job.algorithm;
+    qDebug() << "trim:" << job.trim;
+    qDebug() << "epsilon:" << job.epsilon;
+    qDebug() << "textureBorder:" << job.textureBorder;
+    qDebug() << "spriteBorder:" << job.spriteBorder;
+    qDebug() << "pow2:" << pow2;
+    qDebug() << "maxSize:" << maxSize;
+    qDebug() << "scale:" << imageScale;
+    qDebug() << "png-opt-mode:" << job.pngOptMode;
+    qDebug() << "png-opt-level:" << job.pngOptLevel;
+    qDebug() << "dithering:" << ditherModeToString(job.dithering);
+    qDebug() << "texture-quality:" << textureQualityToString(job.textureQuality);
+    qDebug() << "supercompression:" << supercompressionToString(job.supercompression);
+    qDebug() << "mipmaps:" << job.mipmaps;
+
+    job.variants.clear();
     if (projectFile) {
         for (int i=0; i<projectFile->scalingVariants().size(); ++i) {
             ScalingVariant variant = projectFile->scalingVariants().at(i);
 
-            QString variantName = variant.name;
-            float scale = variant.scale;
-            maxSize = variant.maxTextureSize;
-            pow2 = variant.pow2;
             QString spriteSheetName = projectFile->spriteSheetName();
             if (spriteSheetName.contains("{v}")) {
-                spriteSheetName.replace("{v}", variantName);
+                spriteSheetName.replace("{v}", variant.name);
             } else {
-                spriteSheetName = variantName + spriteSheetName;
+                spriteSheetName = variant.name + spriteSheetName;
             }
             while (spriteSheetName.at(0) == '/') {
                 spriteSheetName.remove(0,1);
@@ -226,60 +369,728 @@ Lossy - Uses pngquant to optimize the filesize. The reduction is mostly about 70
                 }
             }
 
-            // Generate sprite atlas
-            SpriteAtlas atlas(QStringList() << projectFile->srcList(), textureBorder, spriteBorder, trim, heuristicMask, pow2, forceSquared, maxSize, scale);
-            if (trimMode == "Polygon") {
-                atlas.enablePolygonMode(true, epsilon);
+            job.variants.push_back({variant.name, variant.scale, variant.maxTextureSize, variant.pow2, destFileInfo.filePath()});
+        }
+    } else {
+        job.variants.push_back({QString(), imageScale, maxSize, pow2, destination.filePath() + source.fileName()});
+    }
+
+    return true;
+}
+
+// Packs the given variants of job into atlases, keyed by variant name, all
+// of them at once on the shared thread pool. Atlases already there are the
+// previous generation of their variant.
+bool generateAtlases(const PackJob& job, const QVector<int>& variantIndexes, QMap<QString, SpriteAtlas>& atlases, SpriteContentCache* contentCache = nullptr) {
+    QVector<SpriteAtlas> generated(variantIndexes.size());
+    QVector<int> indexes;
+    for (int i = 0; i < variantIndexes.size(); ++i) {
+        generated[i] = atlases.value(job.variants.at(variantIndexes.at(i)).name);
+        indexes.push_back(i);
+    }
+
+    SpriteAtlas* generatedAtlases = generated.data();
+    QAtomicInt failed(0);
+    QtConcurrent::blockingMap(indexes, [&](int& index) {
+        const SheetVariant& variant = job.variants.at(variantIndexes.at(index));
+        TRACE_SCOPE_DETAIL("generate", variant.name);
+
+        // Generate sprite atlas
+        SpriteAtlas atlas(job.srcList, job.textureBorder, job.spriteBorder, job.trim, job.heuristicMask, variant.pow2, job.forceSquared, variant.maxTextureSize, variant.scale);
+        if (job.trimMode == "Polygon") {
+            atlas.enablePolygonMode(true, job.epsilon);
+        }
+        if (job.algorithm == "Polygon") {
+            atlas.setAlgorithm(job.algorithm);
+        }
+        if (atlases.contains(variant.name)) {
+            atlas.setPreviousGeneration(generatedAtlases[index]);
+        }
+        atlas.setSharedContentCache(contentCache);
+        if (!atlas.generate()) {
+            qCritical() << "ERROR: Generate atlas!";
+            failed.store(1);
+            return;
+        }
+        generatedAtlases[index] = atlas;
+    });
+    if (failed.load()) {
+        return false;
+    }
+
+    for (int i = 0; i < variantIndexes.size(); ++i) {
+        atlases[job.variants.at(variantIndexes.at(i)).name] = generated.at(i);
+    }
+    return true;
+}
+
+// pageSemaphore is shared by the projects of a batch, nullptr for a single project
+bool publishAtlases(const QCommandLineParser& parser, const PackJob& job, const QVector<int>& variantIndexes, const QMap<QString, SpriteAtlas>& atlases,
+                    QSemaphore* pageSemaphore = nullptr, QVector<PublishTaskResult>* results = nullptr) {
+    TRACE_SCOPE("publish");
+    PublishSpriteSheet publisher;
+    for (int index: variantIndexes) {
+        const SheetVariant& variant = job.variants.at(index);
+        publisher.addSpriteSheet(atlases[variant.name], variant.filePath);
+    }
+
+    publisher.setTrimSpriteNames(job.trimSpriteNames);
+    publisher.setPrependSmartFolderName(job.prependSmartFolderName);
+    publisher.setPngQuality(job.pngOptMode, job.pngOptLevel);
+    publisher.setImageFormat(job.imageFormat);
+    publisher.setPixelFormat(job.pixelFormat);
+    publisher.setPremultiplied(job.premultiplied);
+    publisher.setDithering(job.dithering);
+    publisher.setTextureQuality(job.textureQuality);
+    publisher.setSupercompression(job.supercompression);
+    publisher.setMipmaps(job.mipmaps);
+    publisher.setSkipUnchanged(!parser.isSet("force"));
+    if (parser.isSet("max-concurrent-pages")) {
+        publisher.setMaxConcurrentPages(parser.value("max-concurrent-pages").toInt());
+    }
+    publisher.setPageSemaphore(pageSemaphore);
+
+    bool success = publisher.publish(job.format);
+    if (results) {
+        *results = publisher.publishResults();
+    }
+    if (!success) {
+        qCritical() << "ERROR: publish atlas!";
+        return false;
+    }
+    return true;
+}
+
+QVector<int> allVariants(const PackJob& job) {
+    QVector<int> variantIndexes;
+    for (int i = 0; i < job.variants.size(); ++i) {
+        variantIndexes.push_back(i);
+    }
+    return variantIndexes;
+}
+
+// the project file, the image files given as sources and the source
+// folders with all their subfolders; the images in the folders are not
+// watched one by one, a large tree would run out of inotify watches
+QStringList watchedPaths(const PackJob& job) {
+    QStringList paths;
+    if (!job.projectFilePath.isEmpty()) {
+        paths.push_back(job.projectFilePath);
+    }
+    for (const QString& src: job.srcList) {
+        QFileInfo fileInfo(src);
+        if (fileInfo.isDir()) {
+            paths.push_back(fileInfo.absoluteFilePath());
+            QDirIterator it(src, QDir::AllDirs | QDir::NoSymLinks | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                paths.push_back(QFileInfo(it.next()).absoluteFilePath());
             }
-            if (algorithm == "Polygon") {
-             atlas.setAlgorithm(algorithm);
+        } else if (fileInfo.exists()) {
+            paths.push_back(fileInfo.absoluteFilePath());
+        }
+    }
+    return paths;
+}
+
+// the images and subfolders directly in a watched folder, with the time and
+// size of the images, to tell which folder events changed sprites
+typedef QHash<QString, QPair<QDateTime, qint64>> FolderSnapshot;
+
+FolderSnapshot scanFolder(const QString& folder) {
+    FolderSnapshot snapshot;
+    QDirIterator it(folder, SpriteAtlas::imageNameFilters(), QDir::AllDirs | QDir::Files | QDir::NoSymLinks | QDir::NoDotAndDotDot);
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo& fileInfo = it.fileInfo();
+        snapshot.insert(fileInfo.fileName(), fileInfo.isDir()? qMakePair(QDateTime(), (qint64)-1) : qMakePair(fileInfo.lastModified(), fileInfo.size()));
+    }
+    return snapshot;
+}
+
+// a path in a Makefile rule
+QString makeEscaped(const QString& path) {
+    QString escaped = path;
+    escaped.replace('$', "$$").replace('#', "\\#").replace(' ', "\\ ");
+    return escaped;
+}
+
+// The --depfile rule and the --stamp file after a publish of job, results
+// of the pages published this time. The rule has the stamp as target, or
+// the images of all pages of every variant in atlases without one, also of
+// those watch() did not publish again; the source folders are inputs too
+// so that added and removed sprites rebuild the sheets.
+bool writeBuildFiles(const QCommandLineParser& parser, const PackJob& job, const QMap<QString, SpriteAtlas>& atlases, const QVector<PublishTaskResult>& results) {
+    if (parser.isSet("stamp")) {
+        bool written = false;
+        for (const PublishTaskResult& result: results) {
+            written = written || (result.success && (!result.imageSkipped || !result.dataFile.isEmpty()));
+        }
+        QFile stamp(parser.value("stamp"));
+        if (written || !stamp.exists()) {
+            QStringList files;
+            for (const PublishTaskResult& result: results) {
+                files += result.imageFiles;
+                if (!result.dataFile.isEmpty()) files.push_back(result.dataFile);
             }
-            if (!atlas.generate()) {
-                qCritical() << "ERROR: Generate atlas!";
-                return -1;
+            if (!stamp.open(QIODevice::WriteOnly | QIODevice::Text) || (stamp.write(files.join('\n').toUtf8() + '\n') < 0)) {
+                qCritical() << QString("Can't write %1: %2").arg(stamp.fileName()).arg(stamp.errorString());
+                return false;
             }
+        }
+    }
 
-            publisher.addSpriteSheet(atlas, destFileInfo.filePath());
+    if (parser.isSet("depfile")) {
+        QStringList targets;
+        if (parser.isSet("stamp")) {
+            targets.push_back(QFileInfo(parser.value("stamp")).absoluteFilePath());
+        } else {
+            PublishSpriteSheet publisher;
+            for (const SheetVariant& variant: job.variants) {
+                if (atlases.contains(variant.name)) {
+                    publisher.addSpriteSheet(atlases[variant.name], variant.filePath);
+                }
+            }
+            publisher.setImageFormat(job.imageFormat);
+            for (const QString& imageFile: publisher.imageFiles()) {
+                targets.push_back(QFileInfo(imageFile).absoluteFilePath());
+            }
+        }
 
-            if (!parser.isSet("format")) {
-                format = projectFile->dataFormat();
+        QStringList inputs;
+        if (!job.projectFilePath.isEmpty()) {
+            inputs.push_back(job.projectFilePath);
+        }
+        const QString scriptFileName = PublishSpriteSheet::formats().value(job.format);
+        if (!scriptFileName.isEmpty()) {
+            inputs.push_back(QFileInfo(scriptFileName).absoluteFilePath());
+        }
+        for (const QString& src: job.srcList) {
+            if (QFileInfo(src).isDir()) {
+                inputs.push_back(QFileInfo(src).absoluteFilePath());
+                QDirIterator it(src, QDir::AllDirs | QDir::NoSymLinks | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+                while (it.hasNext()) {
+                    inputs.push_back(QFileInfo(it.next()).absoluteFilePath());
+                }
+            }
+        }
+        QSet<QString> sourceFiles;
+        for (const SpriteAtlas& atlas: atlases) {
+            for (const QString& sourceFile: atlas.sourceFiles()) {
+                sourceFiles.insert(QFileInfo(sourceFile).absoluteFilePath());
             }
         }
+        QStringList sortedSourceFiles = sourceFiles.values();
+        sortedSourceFiles.sort();
+        inputs += sortedSourceFiles;
 
-        delete projectFile;
-        projectFile = nullptr;
-    } else {
-        // Generate sprite atlas
-        SpriteAtlas atlas(QStringList() << source.filePath(), textureBorder, spriteBorder, trim, heuristicMask, pow2, forceSquared, maxSize, imageScale);
-        if (trimMode == "Polygon") {
-            atlas.enablePolygonMode(true, epsilon);
+        QFile depfile(parser.value("depfile"));
+        if (!depfile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            qCritical() << QString("Can't write %1: %2").arg(depfile.fileName()).arg(depfile.errorString());
+            return false;
         }
-        if (algorithm == "Polygon") {
-         atlas.setAlgorithm(algorithm);
+        QTextStream stream(&depfile);
+        stream.setCodec("UTF-8");
+        for (int i = 0; i < targets.size(); ++i) {
+            stream << (i? " " : "") << makeEscaped(targets.at(i));
         }
-        if (!atlas.generate()) {
-            qCritical() << "ERROR: Generate atlas!";
+        stream << ":";
+        for (const QString& input: inputs) {
+            stream << " \\\n  " << makeEscaped(input);
+        }
+        stream << "\n";
+        stream.flush();
+        if (depfile.error() != QFile::NoError) {
+            qCritical() << QString("Can't write %1: %2").arg(depfile.fileName()).arg(depfile.errorString());
+            return false;
+        }
+    }
+    return true;
+}
+
+// the events of --trace so far, nothing without a fileName
+void saveTrace(const QString& fileName) {
+    if (fileName.isEmpty()) return;
+    QString errorString;
+    if (!Trace::save(fileName, &errorString)) {
+        qWarning() << errorString;
+    }
+}
+
+// the events of one round of watch() or serve(), which are dropped after
+// saving: a process that runs for days would keep them all otherwise
+void saveRoundTrace(const QString& fileName) {
+    saveTrace(fileName);
+    Trace::clear();
+}
+
+// Keeps publishing job until the process is stopped: changes are collected
+// until the files settle, then only the variants they affect are packed
+// again, starting from their previous atlases.
+int watch(QCoreApplication& app, const QCommandLineParser& parser, PackJob job, QMap<QString, SpriteAtlas> atlases) {
+    QFileSystemWatcher watcher;
+    QTimer settleTimer;
+    settleTimer.setSingleShot(true);
+    settleTimer.setInterval(kSettleInterval);
+    QElapsedTimer sinceFirstChange;
+    bool projectChanged = false;
+    bool sourcesChanged = false;
+    // of every watched folder, only a folder that sent an event is scanned again
+    QHash<QString, FolderSnapshot> snapshots;
+
+    // editors that save by replacing a file drop its watch, so the set is synced after every round
+    auto syncWatchedPaths = [&watcher, &job, &snapshots]() {
+        QSet<QString> paths;
+        for (const QString& path: watchedPaths(job)) {
+            paths.insert(path);
+        }
+        QSet<QString> watched;
+        for (const QString& path: watcher.files() + watcher.directories()) {
+            watched.insert(path);
+        }
+        QStringList removed;
+        for (const QString& path: watched) {
+            if (!paths.contains(path)) removed.push_back(path);
+        }
+        QStringList added;
+        for (const QString& path: paths) {
+            if (!watched.contains(path)) added.push_back(path);
+        }
+        if (!removed.isEmpty()) watcher.removePaths(removed);
+        if (!added.isEmpty()) watcher.addPaths(added);
+
+        QHash<QString, FolderSnapshot> folders;
+        for (const QString& folder: watcher.directories()) {
+            auto it = snapshots.find(folder);
+            folders.insert(folder, (it != snapshots.end())? it.value() : scanFolder(folder));
+        }
+        snapshots = folders;
+    };
+
+    auto onChanged = [&](const QString& path) {
+        if (path == job.projectFilePath) {
+            projectChanged = true;
+        } else {
+            sourcesChanged = true;
+        }
+        if (!settleTimer.isActive()) {
+            sinceFirstChange.start();
+        }
+        settleTimer.start();
+    };
+    // files other than images, editor backups for one, come and go without a round
+    auto onFolderChanged = [&](const QString& folder) {
+        FolderSnapshot snapshot = scanFolder(folder);
+        FolderSnapshot& previous = snapshots[folder];
+        if (snapshot != previous) {
+            previous = snapshot;
+            onChanged(folder);
+        }
+    };
+    QObject::connect(&watcher, &QFileSystemWatcher::fileChanged, onChanged);
+    QObject::connect(&watcher, &QFileSystemWatcher::directoryChanged, onFolderChanged);
+
+    QTimer pollTimer;
+    pollTimer.setInterval(kWatchPollInterval);
+    QObject::connect(&pollTimer, &QTimer::timeout, [&]() {
+        for (const QString& folder: snapshots.keys()) {
+            onFolderChanged(folder);
+        }
+    });
+
+    QObject::connect(&settleTimer, &QTimer::timeout, [&]() {
+        QElapsedTimer rebuildTimer;
+        rebuildTimer.start();
+
+        QVector<int> variantIndexes;
+        if (projectChanged) {
+            PackJob changedJob;
+            if (!loadJob(parser, job.sourcePath, job.destinationPath, changedJob)) {
+                qWarning() << "Project file not published, waiting for the next change.";
+                projectChanged = sourcesChanged = false;
+                syncWatchedPaths();
+                return;
+            }
+            if (sourcesChanged || !sameSettings(job, changedJob)) {
+                variantIndexes = allVariants(changedJob);
+            } else {
+                for (int i = 0; i < changedJob.variants.size(); ++i) {
+                    if (!job.variants.contains(changedJob.variants.at(i))) {
+                        variantIndexes.push_back(i);
+                    }
+                }
+            }
+            job = changedJob;
+
+            // atlases of removed variants are not starting points anymore
+            QSet<QString> names;
+            for (const SheetVariant& variant: job.variants) {
+                names.insert(variant.name);
+            }
+            for (const QString& name: atlases.keys()) {
+                if (!names.contains(name)) atlases.remove(name);
+            }
+        } else {
+            // every variant has every sprite
+            variantIndexes = allVariants(job);
+        }
+        projectChanged = sourcesChanged = false;
+        syncWatchedPaths();
+
+        if (variantIndexes.isEmpty()) {
+            qInfo() << "No variant affected.";
+            return;
+        }
+        QVector<PublishTaskResult> results;
+        if (!generateAtlases(job, variantIndexes, atlases) ||
+            !publishAtlases(parser, job, variantIndexes, atlases, nullptr, &results) ||
+            !writeBuildFiles(parser, job, atlases, results)) {
+            qWarning() << "Republish failed, waiting for the next change.";
+            saveRoundTrace(parser.value("trace"));
+            return;
+        }
+        qInfo() << QString("Republished %1 of %2 variants in %3 ms, %4 ms after the first change.")
+                   .arg(variantIndexes.size()).arg(job.variants.size())
+                   .arg(rebuildTimer.elapsed()).arg(sinceFirstChange.elapsed());
+        saveRoundTrace(parser.value("trace"));
+    });
+
+    syncWatchedPaths();
+    pollTimer.start();
+    qInfo() << QString("Watching %1 paths for changes, stop with Ctrl+C.").arg(watcher.files().size() + watcher.directories().size());
+    return app.exec();
+}
+
+QJsonObject replyError(const QJsonObject& reply, const QString& errorString) {
+    QJsonObject result = reply;
+    result["success"] = false;
+    result["error"] = errorString;
+    return result;
+}
+
+// one pack server request, see serve()
+QJsonObject serveRequest(const QByteArray& line, SpriteContentCache& contentCache, QMap<QString, QMap<QString, SpriteAtlas>>& projectAtlases, QStringList& recentProjects) {
+    QElapsedTimer timer;
+    timer.start();
+
+    QJsonParseError parseError;
+    QJsonObject request = QJsonDocument::fromJson(line, &parseError).object();
+    QJsonObject reply;
+    reply["id"] = request["id"];
+    if (parseError.error != QJsonParseError::NoError) {
+        return replyError(reply, parseError.errorString());
+    }
+
+    QCommandLineParser parser;
+    addOptions(parser);
+    QStringList arguments;
+    arguments.push_back(QCoreApplication::applicationFilePath());
+    for (const QJsonValue& argument: request["arguments"].toArray()) {
+        arguments.push_back(argument.toString());
+    }
+    if (!parser.parse(arguments)) {
+        return replyError(reply, parser.errorText());
+    }
+    if (parser.isSet("serve") || parser.isSet("watch") || parser.isSet("batch") || parser.isSet("png-benchmark") || parser.isSet("trace")) {
+        return replyError(reply, "--serve, --watch, --batch, --png-benchmark and --trace can't be requested.");
+    }
+    if ((parser.positionalArguments().size() < 1) || (parser.positionalArguments().size() > 2)) {
+        return replyError(reply, "Arguments must have source and optional destination.");
+    }
+
+    PackJob job;
+    if (!loadJob(parser, parser.positionalArguments().at(0), parser.positionalArguments().value(1), job)) {
+        return replyError(reply, QString("Can't load %1").arg(parser.positionalArguments().at(0)));
+    }
+
+    // the last atlases of the project are the previous generation of this one
+    const QString projectKey = QFileInfo(job.sourcePath).absoluteFilePath() + '\n' + job.destinationPath;
+    recentProjects.removeAll(projectKey);
+    recentProjects.push_back(projectKey);
+    while (recentProjects.size() > kServeProjects) {
+        projectAtlases.remove(recentProjects.takeFirst());
+    }
+    QMap<QString, SpriteAtlas>& atlases = projectAtlases[projectKey];
+
+    if (!generateAtlases(job, allVariants(job), atlases, &contentCache)) {
+        projectAtlases.remove(projectKey);
+        return replyError(reply, "Generate atlas failed.");
+    }
+    const qint64 generateTime = timer.elapsed();
+
+    QVector<PublishTaskResult> results;
+    bool success = publishAtlases(parser, job, allVariants(job), atlases, nullptr, &results);
+    reply["generateTime"] = (double)generateTime;
+    reply["publishTime"] = (double)(timer.elapsed() - generateTime);
+
+    QJsonArray outputs;
+    for (const PublishTaskResult& result: results) {
+        QJsonObject output;
+        output["file"] = result.outputFilePath;
+        output["success"] = result.success;
+        if (!result.success) {
+            output["error"] = result.errorString;
+        }
+        output["imageFiles"] = QJsonArray::fromStringList(result.imageFiles);
+        output["dataFile"] = result.dataFile;
+        output["imageSkipped"] = result.imageSkipped;
+        output["dataSkipped"] = result.dataSkipped;
+        output["imageSize"] = (double)result.imageSize;
+        output["time"] = (double)result.totalTime;
+        outputs.push_back(output);
+    }
+    reply["outputs"] = outputs;
+    reply["success"] = success;
+    reply["time"] = (double)timer.elapsed();
+    return reply;
+}
+
+// Removes the socket a killed pack server left at serverName. Anything else
+// there stays: a file that is not a socket, or the socket of a server that
+// still accepts connections.
+bool removeStaleServer(const QString& serverName, QString* errorString) {
+#if defined(Q_OS_UNIX)
+    // the socket file, as QLocalServer names it
+    const QString path = QDir::isAbsolutePath(serverName)? serverName : QDir::tempPath() + "/" + serverName;
+    struct stat status;
+    if (lstat(QFile::encodeName(path).constData(), &status) != 0) {
+        return true;
+    }
+    if (!S_ISSOCK(status.st_mode)) {
+        *errorString = QString("%1 exists and is not a socket").arg(path);
+        return false;
+    }
+#endif
+    QLocalSocket probe;
+    probe.connectToServer(serverName);
+    if (probe.waitForConnected(kServeProbeTimeout)) {
+        *errorString = QString("Another server is listening on %1").arg(serverName);
+        return false;
+    }
+    QLocalServer::removeServer(serverName);
+    return true;
+}
+
+// Answers pack requests on the local socket serverName until the process is
+// stopped. Every request and every reply is one line of JSON:
+//   {"id": 1, "arguments": ["/path/project.ssp", "--format", "json"]}
+//   {"id": 1, "success": true, "outputs": [...], "generateTime": 12, "publishTime": 30, "time": 42}
+// where arguments are those of a command line run, with absolute paths, and
+// outputs has the files written or left unchanged for every page. Requests
+// are answered one at a time in the order they come, each one uses the whole
+// thread pool. The last atlases of recent projects stay in memory as the
+// previous generation of their next request, and all projects share one
+// cache of prepared sprites. The trace, if any, is saved after each request
+// and has only the events of that request.
+int serve(QCoreApplication& app, const QString& serverName, const QString& traceFileName) {
+    loadFormats();
+
+    SpriteContentCache contentCache(kServeCacheKBytes);
+    QMap<QString, QMap<QString, SpriteAtlas>> projectAtlases;
+    QStringList recentProjects;
+
+    QLocalServer server;
+    QString errorString;
+    if (!removeStaleServer(serverName, &errorString)) {
+        qCritical() << QString("Can't listen on %1: %2").arg(serverName).arg(errorString);
+        return -1;
+    }
+    // requests write files wherever they ask to, other users must not send any
+    server.setSocketOptions(QLocalServer::UserAccessOption);
+    if (!server.listen(serverName)) {
+        qCritical() << QString("Can't listen on %1: %2").arg(serverName).arg(server.errorString());
+        return -1;
+    }
+
+    QObject::connect(&server, &QLocalServer::newConnection, [&]() {
+        while (QLocalSocket* socket = server.nextPendingConnection()) {
+            QObject::connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+            QObject::connect(socket, &QLocalSocket::readyRead, socket, [&, socket]() {
+                while (socket->canReadLine()) {
+                    QJsonObject reply = serveRequest(socket->readLine(), contentCache, projectAtlases, recentProjects);
+                    socket->write(QJsonDocument(reply).toJson(QJsonDocument::Compact) + '\n');
+                    saveRoundTrace(traceFileName);
+                }
+            });
+        }
+    });
+
+    qInfo() << "Serving pack requests on" << server.fullServerName();
+    return app.exec();
+}
+
+// the project files of a batch list: one per line, relative to the list,
+// empty lines and lines starting with # are skipped
+bool readBatchList(const QString& fileName, QStringList& projectPaths) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qCritical() << QString("Can't read %1: %2").arg(fileName).arg(file.errorString());
+        return false;
+    }
+    QDir dir = QFileInfo(fileName).absoluteDir();
+    QTextStream stream(&file);
+    while (!stream.atEnd()) {
+        QString line = stream.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#')) continue;
+        projectPaths.push_back(dir.absoluteFilePath(line));
+    }
+    return true;
+}
+
+bool isProjectFile(const QString& path) {
+    QFileInfo fileInfo(path);
+    return fileInfo.isFile() && SpritePackerProjectFile::factory().get(fileInfo.suffix().toStdString());
+}
+
+// Publishes every project to the destination of its project file. The
+// projects, and below them their variants and pages, all run on the shared
+// thread pool, so cores that finish one project move on to the others;
+// a project is packed, published and released by the thread that took it.
+// Returns -1 when any project failed, the others are published anyway.
+int publishBatch(const QCommandLineParser& parser, const QStringList& projectPaths) {
+    struct BatchResult {
+        bool   success;
+        qint64 time;
+    };
+
+    QElapsedTimer batchTimer;
+    batchTimer.start();
+
+    // the memory of a batch goes to the pages being converted and encoded,
+    // so their limit holds for all projects together
+    int maxConcurrentPages = parser.isSet("max-concurrent-pages")? qMax(1, parser.value("max-concurrent-pages").toInt()) : QThread::idealThreadCount();
+    QSemaphore pageSemaphore(maxConcurrentPages);
+
+    std::function<BatchResult(const QString&)> publishProject = [&parser, &pageSemaphore](const QString& projectPath) {
+        QElapsedTimer timer;
+        timer.start();
+        PackJob job;
+        QMap<QString, SpriteAtlas> atlases;
+        bool success = loadJob(parser, projectPath, QString(), job) &&
+                       generateAtlases(job, allVariants(job), atlases) &&
+                       publishAtlases(parser, job, allVariants(job), atlases, &pageSemaphore);
+        return BatchResult{success, timer.elapsed()};
+    };
+    QVector<BatchResult> results = QtConcurrent::blockingMapped<QVector<BatchResult>>(projectPaths, publishProject);
+
+    int failedCount = 0;
+    for (int i = 0; i < projectPaths.size(); ++i) {
+        if (results.at(i).success) {
+            qInfo() << QString("Published %1 in %2 ms").arg(projectPaths.at(i)).arg(results.at(i).time);
+        } else {
+            qWarning() << QString("Publish %1 failed").arg(projectPaths.at(i));
+            failedCount++;
+        }
+    }
+    qInfo() << QString("Batch of %1 projects published in %2 ms, %3 failed.").arg(projectPaths.size()).arg(batchTimer.elapsed()).arg(failedCount);
+
+    return failedCount? -1 : 1;
+}
+
+// everything after parsing, see commandLine()
+int runCommandLine(QCoreApplication& app, const QCommandLineParser& parser) {
+    if (parser.isSet("serve")) {
+        return serve(app, parser.value("serve"), parser.value("trace"));
+    }
+
+    // several project files, or a list of them, are one batch
+    QStringList projectPaths;
+    if (parser.isSet("batch") && !readBatchList(parser.value("batch"), projectPaths)) {
+        return -1;
+    }
+    bool allProjectFiles = true;
+    for (const QString& argument: parser.positionalArguments()) {
+        allProjectFiles = allProjectFiles && isProjectFile(argument);
+        projectPaths.push_back(argument);
+    }
+    if (parser.isSet("batch") || ((parser.positionalArguments().size() > 1) && allProjectFiles)) {
+        if (parser.isSet("watch") || parser.isSet("png-benchmark") || parser.isSet("depfile") || parser.isSet("stamp")) {
+            qDebug() << "--watch, --png-benchmark, --depfile and --stamp take a single source, see help for information.";
+            return -1;
+        }
+        loadFormats();
+        return publishBatch(parser, projectPaths);
+    }
+
+    if (parser.positionalArguments().size() > 2) {
+        qDebug() << "Too many arguments, see help for information.";
+        parser.showHelp();
+        return -1;
+    } else if (parser.positionalArguments().size() == 1) {
+        QFileInfo src(parser.positionalArguments().at(0));
+        if (src.isDir() || !SpritePackerProjectFile::factory().get(src.suffix().toStdString())) {
+            qDebug() << "Arguments must have source and destination, see help for information.";
+            parser.showHelp();
             return -1;
         }
+        // we should already have our destination saved in our project file
+    } else if (parser.positionalArguments().isEmpty()) {
+        qDebug() << "Arguments must have source and destination, see help for information.";
+        parser.showHelp();
+        return -1;
+    }
+
+    qDebug() << "arguments:" << parser.positionalArguments();
+    qDebug() << "options:" << parser.optionNames();
 
-        publisher.addSpriteSheet(atlas, destination.filePath() + source.fileName());
+    PackJob job;
+    if (!loadJob(parser, parser.positionalArguments().at(0), parser.positionalArguments().value(1), job)) {
+        return -1;
     }
 
-    publisher.setTrimSpriteNames(trimSpriteNames);
-    publisher.setPrependSmartFolderName(prependSmartFolderName);
-    publisher.setPngQuality(pngOptMode, pngOptLevel);
+    loadFormats();
 
-    if (!publisher.publish(format, false)) {
-        qCritical() << "ERROR: publish atlas!";
+    QMap<QString, SpriteAtlas> atlases;
+    if (!generateAtlases(job, allVariants(job), atlases)) {
         return -1;
     }
 
-    qDebug() << "Publishing is finished.";
+    if (parser.isSet("png-benchmark")) {
+        QList<SpriteAtlas> variantAtlases;
+        for (const SheetVariant& variant: job.variants) {
+            variantAtlases.push_back(atlases[variant.name]);
+        }
+        benchmarkPng(variantAtlases, job.pixelFormat, job.premultiplied, job.dithering);
+        return 1;
+    }
 
+    QVector<PublishTaskResult> results;
+    if (!publishAtlases(parser, job, allVariants(job), atlases, nullptr, &results) ||
+        !writeBuildFiles(parser, job, atlases, results)) {
+        return -1;
+    }
 
-//    qDebug() << source.fileName() << source.isDir();
-//    qDebug() << destination.filePath() << destination.isDir();
+    qDebug() << "Publishing is finished.";
+
+    if (parser.isSet("watch")) {
+        saveRoundTrace(parser.value("trace"));
+        return watch(app, parser, job, atlases);
+    }
 
     return 1;
 }
 
+}
+
+int commandLine(QCoreApplication& app) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("source", "Sprites for packing or project file (You can override project file options with [options]). Several project files are published as a batch.");
+    parser.addPositionalArgument("destination", "Destination folder where you're saving the sprite sheet. Optional when using project file");
+
+    addOptions(parser);
+
+    parser.process(app);
+
+    if (parser.isSet("trace")) {
+        Trace::start();
+    }
+    int result = runCommandLine(app, parser);
+    // watch and serve saved their last round already, unless they failed before it
+    const bool roundsSaved = (parser.isSet("watch") || parser.isSet("serve")) && Trace::durations().isEmpty();
+    if (!roundsSaved) {
+        saveTrace(parser.value("trace"));
+    }
+    return result;
+}
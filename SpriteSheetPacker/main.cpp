@@ -6,22 +6,22 @@ int commandLine(QCoreApplication& app);
 
 int main(int argc, char *argv[])
 {
-    QApplication app(argc, argv);
+    // the command line runs on QCoreApplication: no platform plugin, no
+    // display and none of the widgets initialization
+    QScopedPointer<QCoreApplication> app((argc > 1)? new QCoreApplication(argc, argv) : new QApplication(argc, argv));
 
     QCoreApplication::setOrganizationName("amakaseev");
     QCoreApplication::setOrganizationDomain("spicyminds-lab.com");
     QCoreApplication::setApplicationName("SpriteSheetPacker");
     QCoreApplication::setApplicationVersion("1.0.9");
 
-    SpritePackerProjectFile::factory().set<SpritePackerProjectFile>("json");
-    SpritePackerProjectFile::factory().set<SpritePackerProjectFile>("ssp");
-    SpritePackerProjectFile::factory().set<SpritePackerProjectFileTPS>("tps");
+    SpritePackerProjectFile::registerFileTypes();
 
     if (argc > 1) {
-        return commandLine(app);
+        return commandLine(*app);
     } else {
         MainWindow* wnd = new MainWindow();
         wnd->show();
-        return app.exec();
+        return app->exec();
     }
 }
@@ -0,0 +1,26 @@
+#ifndef SSPCORE_H
+#define SSPCORE_H
+
+// The API of sspcore, the packer without its editor:
+//
+//   SpritePackerProjectFile::registerFileTypes();
+//   PublishSpriteSheet::loadFormats(QStringList() << PublishSpriteSheet::defaultFormatsFolder());
+//
+//   SpriteAtlas atlas(QStringList() << "sprites/", 0, 2);
+//   if (atlas.generate()) {
+//       PublishSpriteSheet publisher;
+//       publisher.addSpriteSheet(atlas, "out/sheet");
+//       publisher.publish("json");
+//   }
+//
+// Needs a QCoreApplication for the thread pool and plugins, QtWidgets is
+// not used.
+
+#define SSPCORE_VERSION 1
+
+#include "SpriteAtlas.h"
+#include "SpritePackerProjectFile.h"
+#include "PublishSpriteSheet.h"
+#include "Trace.h"
+
+#endif // SSPCORE_H
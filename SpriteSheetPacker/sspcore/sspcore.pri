@@ -0,0 +1,39 @@
+# Links sspcore into a project: include it from the .pro of the tool and
+# build sspcore.pro first (see sprite-sheet-packer.pro). The headers of the
+# packer folder, the 3rdparty headers they use and the libraries sspcore
+# needs at link time come with it.
+
+QT += core gui xml qml concurrent
+CONFIG += c++11
+# must match the CONFIG sspcore was built with
+no_trace: DEFINES += SSP_NO_TRACE
+
+SSPCORE_PATH = $$PWD/..
+SSPCORE_OUT = $$shadowed($$PWD)
+
+INCLUDEPATH += \
+    $$PWD \
+    $$SSPCORE_PATH \
+    $$SSPCORE_PATH/3rdparty \
+    $$SSPCORE_PATH/../runtime \
+    $$SSPCORE_PATH/algorithm \
+    $$SSPCORE_PATH/TPSParser \
+    $$SSPCORE_PATH/TextureEncoder \
+    $$SSPCORE_PATH/3rdparty/qtplist-master \
+    $$SSPCORE_PATH/3rdparty/pngquant \
+    $$SSPCORE_PATH/3rdparty/optipng/zlib
+
+LIBS += -L$$SSPCORE_OUT -lsspcore
+win32-msvc*: PRE_TARGETDEPS += $$SSPCORE_OUT/sspcore.lib
+else: PRE_TARGETDEPS += $$SSPCORE_OUT/libsspcore.a
+
+# libimagequant in sspcore is built with OpenMP unless CONFIG+=no_openmp, in
+# the scopes of pngquant.pri
+!no_openmp {
+    *-g++*|linux-clang* {
+        QMAKE_LFLAGS += -fopenmp
+    }
+}
+
+# PVRTexLib is a shared library, linked and deployed with the tool
+include($$SSPCORE_PATH/3rdparty/PVRTexTool/PVRTexTool.pri)
@@ -0,0 +1,86 @@
+#-------------------------------------------------
+#
+# sspcore: sprite packing, publishing and project files, without QtWidgets.
+# The editor and the command line link it, so can other tools; see
+# sspcore.pri for what a project that links it needs.
+#
+#-------------------------------------------------
+
+QT += core gui xml qml concurrent
+QT -= widgets
+
+TARGET = sspcore
+TEMPLATE = lib
+CONFIG += staticlib c++11
+
+# CONFIG+=no_trace compiles the trace scopes out, --trace then writes no stage events
+no_trace: DEFINES += SSP_NO_TRACE
+
+# the same folder in debug and release, sspcore.pri links it from there
+DESTDIR = $$OUT_PWD
+
+CORE = $$PWD/..
+
+INCLUDEPATH += $$CORE $$CORE/3rdparty
+# readers for the published data formats, shared with game runtimes
+INCLUDEPATH += $$CORE/../runtime
+
+SOURCES += \
+    $$CORE/SpriteAtlas.cpp \
+    $$CORE/SpritePackerProjectFile.cpp \
+    $$CORE/PngOptimizer.cpp \
+    $$CORE/PublishSpriteSheet.cpp \
+    $$CORE/PolygonImage.cpp \
+    $$CORE/ImageConverter.cpp \
+    $$CORE/CczWriter.cpp \
+    $$CORE/ParallelDeflate.cpp \
+    $$CORE/PngWriter.cpp \
+    $$CORE/DataFileExporter.cpp \
+    $$CORE/ScriptExporter.cpp \
+    $$CORE/PListWriter.cpp \
+    $$CORE/PublishManifest.cpp \
+    $$CORE/Trace.cpp
+
+HEADERS += \
+    $$PWD/sspcore.h \
+    $$CORE/ImageRotate.h \
+    $$CORE/SpriteAtlas.h \
+    $$CORE/SpritePackerProjectFile.h \
+    $$CORE/GenericObjectFactory.h \
+    $$CORE/PngOptimizer.h \
+    $$CORE/PublishSpriteSheet.h \
+    $$CORE/PolygonImage.h \
+    $$CORE/ImageFormat.h \
+    $$CORE/ImageConverter.h \
+    $$CORE/CczWriter.h \
+    $$CORE/ParallelDeflate.h \
+    $$CORE/PngWriter.h \
+    $$CORE/DataFileExporter.h \
+    $$CORE/JsonWriter.h \
+    $$CORE/../runtime/SpriteSheetBinary.h \
+    $$CORE/ScriptExporter.h \
+    $$CORE/PListWriter.h \
+    $$CORE/PublishManifest.h \
+    $$CORE/Trace.h
+
+#algorithm
+INCLUDEPATH += $$CORE/algorithm
+
+HEADERS += $$CORE/algorithm/binpack2d.hpp \
+    $$CORE/algorithm/triangle_triangle_intersection.h \
+    $$CORE/algorithm/polypack2d.h
+
+SOURCES += $$CORE/algorithm/polypack2d.cpp
+
+include($$CORE/TPSParser/TPSParser.pri)
+include($$CORE/TextureEncoder/TextureEncoder.pri)
+include($$CORE/3rdparty/optipng/optipng.pri)
+include($$CORE/3rdparty/qtplist-master/qtplist-master.pri)
+include($$CORE/3rdparty/clipper/clipper.pri)
+include($$CORE/3rdparty/poly2tri/poly2tri.pri)
+include($$CORE/3rdparty/pngquant/pngquant.pri)
+include($$CORE/3rdparty/lodepng/lodepng.pri)
+
+# only the headers: PVRTexLib is linked and deployed by the tools, see sspcore.pri
+INCLUDEPATH += $$CORE/3rdparty/PVRTexTool/Include
+win32: DEFINES += _WINDLL_IMPORT
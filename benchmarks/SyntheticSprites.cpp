@@ -0,0 +1,236 @@
+#include "SyntheticSprites.h"
+
+#include <cmath>
+#include <random>
+#include <QPainter>
+
+namespace {
+
+// the raw mt19937 sequence is the same on every standard library, the std
+// distributions are not; draws are never two arguments of one call, whose
+// order of evaluation the compiler picks
+class Random
+{
+public:
+    explicit Random(quint32 seed) : _engine(seed) { }
+
+    int range(int min, int max) { return min + (int)(_engine() % (quint32)(max - min + 1)); }
+    double unit() { return _engine() / 4294967296.0; }
+    QColor color(int alpha = 255) {
+        const int red = range(0, 255);
+        const int green = range(0, 255);
+        const int blue = range(0, 255);
+        return QColor(red, green, blue, alpha);
+    }
+    QPointF point(const QRectF& rect) {
+        const double x = rect.left() + unit() * rect.width();
+        const double y = rect.top() + unit() * rect.height();
+        return QPointF(x, y);
+    }
+
+private:
+    std::mt19937 _engine;
+};
+
+QImage emptyImage(int width, int height) {
+    QImage image(width, height, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    return image;
+}
+
+// a shape inside a transparent margin, with random strokes so no two are identical
+QImage shapeSprite(Random& random, int width, int height) {
+    QImage image = emptyImage(width, height);
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    const int margin = qMin(random.range(0, 8), qMin(width, height) / 4);
+    QRectF rect = QRectF(image.rect()).adjusted(margin, margin, -margin, -margin);
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(random.color());
+    if (random.range(0, 1)) {
+        painter.drawRoundedRect(rect, rect.width() / 6, rect.height() / 6);
+    } else {
+        painter.drawEllipse(rect);
+    }
+    const QColor stroke = random.color();
+    painter.setPen(QPen(stroke, 1 + random.range(0, 2)));
+    for (int i = 0; i < 3; ++i) {
+        const QPointF from = random.point(rect);
+        const QPointF to = random.point(rect);
+        painter.drawLine(from, to);
+    }
+    return image;
+}
+
+QVector<QImage> uniform(Random& random) {
+    QVector<QImage> images;
+    for (int i = 0; i < 256; ++i) {
+        const int width = random.range(16, 128);
+        const int height = random.range(16, 128);
+        images.push_back(shapeSprite(random, width, height));
+    }
+    return images;
+}
+
+// Pareto distributed sides: half below 19 pixels, a few close to 512
+QVector<QImage> powerLaw(Random& random) {
+    QVector<QImage> images;
+    for (int i = 0; i < 256; ++i) {
+        const double side = qMin(512.0, 12.0 * pow(1.0 - random.unit(), -1.0 / 1.5));
+        const double aspect = 0.5 + random.unit() * 1.5;
+        images.push_back(shapeSprite(random, qMax(4, (int)(side * aspect)), qMax(4, (int)side)));
+    }
+    return images;
+}
+
+QVector<QImage> tallThin(Random& random) {
+    QVector<QImage> images;
+    for (int i = 0; i < 128; ++i) {
+        const int thickness = random.range(4, 24);
+        const int length = random.range(96, 480);
+        images.push_back((i % 2)? shapeSprite(random, length, thickness) : shapeSprite(random, thickness, length));
+    }
+    return images;
+}
+
+QVector<QImage> nineSlice(Random& random) {
+    static const int widths[] = {48, 64, 96, 128, 192, 256};
+    static const int heights[] = {24, 32, 48, 64};
+
+    QVector<QImage> images;
+    for (int i = 0; i < 72; ++i) {
+        const int width = widths[random.range(0, 5)];
+        const int height = heights[random.range(0, 3)];
+        QImage image = emptyImage(width, height);
+        QPainter painter(&image);
+        painter.setRenderHint(QPainter::Antialiasing);
+        QLinearGradient gradient(0, 0, 0, image.height());
+        gradient.setColorAt(0, random.color());
+        gradient.setColorAt(1, random.color());
+        painter.setBrush(gradient);
+        const QColor border = random.color();
+        painter.setPen(QPen(border, random.range(1, 3)));
+        const int radius = random.range(2, 10);
+        painter.drawRoundedRect(QRectF(image.rect()).adjusted(1, 1, -1, -1), radius, radius);
+        painter.end();
+        images.push_back(image);
+    }
+    for (int i = 0; i < 24; ++i) {
+        const int side = random.range(16, 32);
+        images.push_back(shapeSprite(random, side, side));
+    }
+    return images;
+}
+
+// 8 characters with 24 frames each, made of 6 poses that are held for 2 to 6 frames
+QVector<QImage> animation(Random& random) {
+    QVector<QImage> images;
+    for (int character = 0; character < 8; ++character) {
+        QVector<QImage> poses;
+        const QColor body = random.color();
+        const QColor limbs = random.color();
+        for (int pose = 0; pose < 6; ++pose) {
+            QImage image = emptyImage(96, 128);
+            QPainter painter(&image);
+            painter.setRenderHint(QPainter::Antialiasing);
+            const double phase = pose * M_PI / 3;
+            const QPointF hip(48 + 6 * sin(phase), 76);
+            painter.setPen(QPen(limbs, 8, Qt::SolidLine, Qt::RoundCap));
+            painter.drawLine(hip, hip + QPointF(18 * sin(phase), 44));
+            painter.drawLine(hip, hip - QPointF(18 * sin(phase), -44));
+            painter.drawLine(hip - QPointF(0, 36), hip + QPointF(26 * cos(phase), -10));
+            painter.setPen(Qt::NoPen);
+            painter.setBrush(body);
+            painter.drawEllipse(QRectF(hip.x() - 14, 28, 28, 50));
+            painter.drawEllipse(QRectF(hip.x() - 12, 4, 24, 24));
+            painter.end();
+            poses.push_back(image);
+        }
+        int frame = 0;
+        while (frame < 24) {
+            const QImage& pose = poses.at(random.range(0, 5));
+            for (int hold = random.range(2, 6); (hold > 0) && (frame < 24); --hold, ++frame) {
+                images.push_back(pose);
+            }
+        }
+    }
+    return images;
+}
+
+// star shaped islands with holes cut out of them, alpha fading to the edge
+QVector<QImage> irregularAlpha(Random& random) {
+    QVector<QImage> images;
+    for (int i = 0; i < 128; ++i) {
+        const int side = random.range(32, 256);
+        QImage image = emptyImage(side, side);
+        QPainter painter(&image);
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.setPen(Qt::NoPen);
+        for (int island = random.range(1, 3); island > 0; --island) {
+            const QPointF center = random.point(QRectF(side * 0.25, side * 0.25, side * 0.5, side * 0.5));
+            const double radius = side * (0.15 + random.unit() * 0.3);
+            QPolygonF star;
+            const int points = random.range(5, 14);
+            for (int p = 0; p < points * 2; ++p) {
+                const double r = radius * ((p % 2)? 0.4 + random.unit() * 0.3 : 0.8 + random.unit() * 0.2);
+                const double angle = p * M_PI / points;
+                star << center + QPointF(r * cos(angle), r * sin(angle));
+            }
+            QRadialGradient gradient(center, radius);
+            QColor color = random.color();
+            gradient.setColorAt(0, color);
+            color.setAlpha(random.range(0, 96));
+            gradient.setColorAt(1, color);
+            painter.setBrush(gradient);
+            painter.drawPolygon(star);
+        }
+        painter.setCompositionMode(QPainter::CompositionMode_Clear);
+        for (int hole = random.range(0, 2); hole > 0; --hole) {
+            const double radius = side * (0.04 + random.unit() * 0.06);
+            const QPointF center = random.point(QRectF(side * 0.3, side * 0.3, side * 0.4, side * 0.4));
+            painter.drawEllipse(center, radius, radius);
+        }
+        painter.end();
+        images.push_back(image);
+    }
+    return images;
+}
+
+}
+
+QStringList SyntheticSprites::distributions() {
+    return QStringList() << "uniform" << "power-law" << "tall-thin" << "nine-slice" << "animation" << "irregular-alpha";
+}
+
+QVector<QImage> SyntheticSprites::generate(const QString& distribution, quint32 seed) {
+    // every distribution has a sequence of its own, adding one does not change the others
+    Random random(seed * 31 + distributions().indexOf(distribution));
+    if (distribution == "uniform") return uniform(random);
+    if (distribution == "power-law") return powerLaw(random);
+    if (distribution == "tall-thin") return tallThin(random);
+    if (distribution == "nine-slice") return nineSlice(random);
+    if (distribution == "animation") return animation(random);
+    if (distribution == "irregular-alpha") return irregularAlpha(random);
+    return QVector<QImage>();
+}
+
+bool SyntheticSprites::write(const QString& distribution, quint32 seed, const QString& folder, QString* errorString) {
+    if (!distributions().contains(distribution)) {
+        *errorString = QString("Unknown distribution %1").arg(distribution);
+        return false;
+    }
+    if (!QDir().mkpath(folder)) {
+        *errorString = QString("Can't create %1").arg(folder);
+        return false;
+    }
+
+    const QVector<QImage> images = generate(distribution, seed);
+    for (int i = 0; i < images.size(); ++i) {
+        const QString fileName = QString("%1/%2_%3.png").arg(folder).arg(distribution).arg(i, 4, 10, QChar('0'));
+        if (!images.at(i).save(fileName, "PNG")) {
+            *errorString = QString("Can't write %1").arg(fileName);
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,27 @@
+#ifndef SYNTHETICSPRITES_H
+#define SYNTHETICSPRITES_H
+
+#include <QtCore>
+#include <QImage>
+
+// Reproducible sprite sets for the benchmarks: a distribution and a seed
+// always give the same images, on every platform, so results of different
+// builds can be compared.
+//
+//   uniform          sides evenly spread between 16 and 128 pixels
+//   power-law        mostly small sprites and a few large ones
+//   tall-thin        bars, half of them upright and half lying
+//   nine-slice       UI buttons, panels and icons in few sizes, mostly opaque
+//   animation        character frames where most poses are held and repeat
+//   irregular-alpha  blobs, islands and holes with soft edges, for polygon mode
+class SyntheticSprites
+{
+public:
+    static QStringList distributions();
+
+    // writes the sprites of distribution to folder as PNG files
+    static bool write(const QString& distribution, quint32 seed, const QString& folder, QString* errorString);
+    static QVector<QImage> generate(const QString& distribution, quint32 seed);
+};
+
+#endif // SYNTHETICSPRITES_H
@@ -0,0 +1,33 @@
+#-------------------------------------------------
+#
+# benchmarks: packs and publishes synthetic sprite sets with every
+# algorithm and writes the time of each stage, peak memory, occupancy,
+# pages and mesh vertices as JSON; see main.cpp. "make benchmark" in its
+# build folder runs it into benchmark-results.json.
+#
+#-------------------------------------------------
+
+QT += core gui
+QT -= widgets
+
+TARGET = benchmarks
+TEMPLATE = app
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+include(../SpriteSheetPacker/sspcore/sspcore.pri)
+
+SOURCES += \
+    main.cpp \
+    SyntheticSprites.cpp
+
+HEADERS += \
+    SyntheticSprites.h
+
+win32: LIBS += -lpsapi
+
+unix {
+    benchmark.commands = ./$$TARGET --repeat 3 --output benchmark-results.json
+    benchmark.depends = $(TARGET)
+    QMAKE_EXTRA_TARGETS += benchmark
+}
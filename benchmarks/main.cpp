@@ -0,0 +1,346 @@
+#include <QtCore>
+#include "sspcore.h"
+#include "SyntheticSprites.h"
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+// Packs and publishes the synthetic sprite sets (and optionally folders of
+// real sprites) with every packing algorithm and writes, as JSON, how long
+// each stage took, the peak memory of each case where the system can tell
+// (Linux) and of the whole run, the atlas occupancy, the pages and the mesh
+// vertices. Sets and settings are fixed by the seed and
+// the options, so results of different builds can be compared:
+//
+//   benchmarks --output results.json --repeat 3
+//   benchmarks --corpus ~/game/sprites --distribution nine-slice
+
+namespace {
+
+// raised when a field of the results changes its meaning
+const int kResultsVersion = 2;
+
+struct Algorithm {
+    const char* name;
+    const char* trimMode;
+};
+
+// every packing algorithm with the trim mode it packs, a new one only needs a line here
+const Algorithm kAlgorithms[] = {
+    {"Rect", "Rect"},
+    {"Polygon", "Polygon"},
+};
+
+struct CaseResult {
+    QString distribution;
+    QString algorithm;
+    bool    success;
+    QString errorString;
+
+    int     sprites;
+    int     uniqueSprites;
+    QVector<QSize> pages;
+    // share of the page pixels that are not fully transparent
+    double  occupancy;
+    // of the sprite meshes, 4 for a sprite drawn as a quad
+    int     vertices;
+
+    // microseconds, stages are summed over the threads they ran on
+    qint64  generateTime;
+    qint64  publishTime;
+    QMap<QString, qint64> stages;
+    // of the case alone, -1 where the peak can't be reset between cases
+    qint64  peakRssKBytes;
+};
+
+// Starts a new peak of resident memory at what the process has now, false
+// where the system keeps one peak for the whole process.
+bool resetPeakRss() {
+#if defined(Q_OS_LINUX)
+    QFile file("/proc/self/clear_refs");
+    return file.open(QIODevice::WriteOnly) && (file.write("5") == 1);
+#else
+    return false;
+#endif
+}
+
+// the most memory the process had resident since resetPeakRss() or its
+// start, 0 where unknown
+qint64 peakRssKBytes() {
+#if defined(Q_OS_LINUX)
+    // unlike ru_maxrss, VmHWM follows resetPeakRss()
+    QFile file("/proc/self/status");
+    if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        for (QByteArray line = file.readLine(); !line.isEmpty(); line = file.readLine()) {
+            if (line.startsWith("VmHWM:")) {
+                return line.mid(6).trimmed().split(' ').value(0).toLongLong();
+            }
+        }
+    }
+#endif
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize / 1024;
+    }
+    return 0;
+#elif defined(Q_OS_UNIX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#if defined(Q_OS_MACOS)
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return 0;
+#endif
+}
+
+void measureAtlas(const SpriteAtlas& atlas, CaseResult& result) {
+    QSet<QString> identical;
+    for (const QVector<QString>& names: atlas.identicalFrames()) {
+        for (const QString& name: names) identical.insert(name);
+    }
+
+    result.sprites = 0;
+    result.uniqueSprites = 0;
+    result.vertices = 0;
+    result.pages.clear();
+    qint64 area = 0;
+    qint64 opaque = 0;
+    for (const SpriteAtlas::OutputData& page: atlas.outputData()) {
+        result.pages.push_back(page._atlasImage.size());
+        QImage image = page._atlasImage.convertToFormat(QImage::Format_RGBA8888);
+        area += (qint64)image.width() * image.height();
+        for (int y = 0; y < image.height(); ++y) {
+            const uchar* line = image.constScanLine(y);
+            for (int x = 0; x < image.width(); ++x) {
+                if (line[x * 4 + 3]) opaque++;
+            }
+        }
+
+        for (auto it = page._spriteFrames.cbegin(); it != page._spriteFrames.cend(); ++it) {
+            result.sprites++;
+            if (identical.contains(it.key())) continue;
+            result.uniqueSprites++;
+            result.vertices += it.value().triangles.verts.empty()? 4 : (int)it.value().triangles.verts.size();
+        }
+    }
+    result.occupancy = area? 100.0 * opaque / area : 0.0;
+}
+
+// one generate and publish of the sprites in sourceFolder
+bool runCase(const QCommandLineParser& parser, const QString& sourceFolder, const Algorithm& algorithm, const QString& outputFolder, CaseResult& result) {
+    Trace::clear();
+    QElapsedTimer timer;
+    timer.start();
+
+    // the defaults of the command line
+    SpriteAtlas atlas(QStringList() << sourceFolder, 0, 2, 1);
+    atlas.setAlgorithm(algorithm.name);
+    if (QString(algorithm.trimMode) == "Polygon") {
+        atlas.enablePolygonMode(true, 5.f);
+    }
+    if (!atlas.generate()) {
+        result.errorString = "Generate atlas failed.";
+        return false;
+    }
+    result.generateTime = timer.nsecsElapsed() / 1000;
+
+    timer.restart();
+    PublishSpriteSheet publisher;
+    publisher.addSpriteSheet(atlas, outputFolder + "/" + result.distribution + "-" + algorithm.name);
+    publisher.setPngQuality(parser.value("png-opt-mode"), parser.value("png-opt-level").toInt());
+    publisher.setSkipUnchanged(false);
+    if (!publisher.publish("binary")) {
+        for (const PublishTaskResult& page: publisher.publishResults()) {
+            if (!page.success) result.errorString = page.errorString;
+        }
+        return false;
+    }
+    result.publishTime = timer.nsecsElapsed() / 1000;
+
+    result.stages = Trace::durations();
+    measureAtlas(atlas, result);
+    return true;
+}
+
+double milliseconds(qint64 microseconds) {
+    return microseconds / 1000.0;
+}
+
+void writeResults(QTextStream& stream, const QCommandLineParser& parser, const QVector<CaseResult>& results, qint64 peakRss) {
+    JsonWriter json(stream);
+    json.beginObject();
+    json.value("version", kResultsVersion);
+    json.value("date", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    json.value("qt", QString(qVersion()));
+    json.value("threads", QThread::idealThreadCount());
+    json.value("seed", parser.value("seed").toInt());
+    json.value("repeat", parser.value("repeat").toInt());
+    json.value("pngOptMode", parser.value("png-opt-mode"));
+    json.value("pngOptLevel", parser.value("png-opt-level").toInt());
+    json.value("peakRssKBytes", peakRss);
+    json.beginArray("cases");
+    for (const CaseResult& result: results) {
+        json.beginObject();
+        json.value("distribution", result.distribution);
+        json.value("algorithm", result.algorithm);
+        json.value("success", result.success);
+        if (!result.success) {
+            json.value("error", result.errorString);
+            json.end();
+            continue;
+        }
+        json.value("sprites", result.sprites);
+        json.value("uniqueSprites", result.uniqueSprites);
+        json.beginArray("pages");
+        for (const QSize& size: result.pages) {
+            json.beginObject();
+            json.value("width", size.width());
+            json.value("height", size.height());
+            json.end();
+        }
+        json.end();
+        json.value("occupancy", result.occupancy);
+        json.value("vertices", result.vertices);
+        json.value("generateTime", milliseconds(result.generateTime));
+        json.value("publishTime", milliseconds(result.publishTime));
+        json.value("totalTime", milliseconds(result.generateTime + result.publishTime));
+        json.beginObject("stages");
+        for (auto it = result.stages.cbegin(); it != result.stages.cend(); ++it) {
+            json.value(it.key(), milliseconds(it.value()));
+        }
+        json.end();
+        if (result.peakRssKBytes >= 0) {
+            json.value("peakRssKBytes", result.peakRssKBytes);
+        }
+        json.end();
+    }
+    json.end();
+    json.end();
+    stream << '\n';
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("benchmarks");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Packs and publishes synthetic sprite sets with every algorithm and writes the time, memory and packing quality as JSON.");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"output", "Writes the results to the given file instead of the standard output.", "file"},
+        {"distribution", QString("Runs only the given distribution, can be repeated: %1.").arg(SyntheticSprites::distributions().join(", ")), "name"},
+        {"algorithm", "Runs only the given algorithm, can be repeated.", "name"},
+        {"corpus", "Also packs the images of the given folder, can be repeated.", "folder"},
+        {"seed", "Seed of the synthetic sprites, default is 1.", "int", "1"},
+        {"repeat", "Runs every case the given times and keeps the fastest, default is 1.", "int", "1"},
+        {"png-opt-mode", "None, Lossless or Lossy. Default is None.", "mode", "None"},
+        {"png-opt-level", "1 to 7, default is 1.", "int", "1"},
+        {"work-dir", "Folder for the sprites and the published sheets, default is a temporary folder that is removed.", "folder"},
+    });
+    parser.process(app);
+
+    QTemporaryDir temporaryDir;
+    const QString workDir = parser.isSet("work-dir")? parser.value("work-dir") : temporaryDir.path();
+    if (workDir.isEmpty() || !QDir().mkpath(workDir + "/out")) {
+        qCritical() << "Can't create the work folder" << workDir;
+        return 1;
+    }
+
+    // the sets to pack, by name
+    const QStringList distributions = parser.isSet("distribution")? parser.values("distribution") : SyntheticSprites::distributions();
+    QList<QPair<QString, QString>> sets;
+    const quint32 seed = parser.value("seed").toUInt();
+    for (const QString& distribution: distributions) {
+        const QString folder = workDir + "/" + distribution;
+        QString errorString;
+        if (!SyntheticSprites::write(distribution, seed, folder, &errorString)) {
+            qCritical() << errorString;
+            return 1;
+        }
+        sets.push_back(qMakePair(distribution, folder));
+    }
+    for (const QString& folder: parser.values("corpus")) {
+        if (!QFileInfo(folder).isDir()) {
+            qCritical() << "Not a folder:" << folder;
+            return 1;
+        }
+        sets.push_back(qMakePair("corpus:" + QDir(folder).dirName(), QDir(folder).absolutePath()));
+    }
+
+    // formats without a script, the sheets are published as binary
+    PublishSpriteSheet::loadFormats(QStringList());
+    Trace::start();
+
+    // writing the sprites, before the cases reset the peak
+    const qint64 setupPeakRss = peakRssKBytes();
+    const int repeat = qMax(1, parser.value("repeat").toInt());
+    QVector<CaseResult> results;
+    bool failed = false;
+    for (const auto& set: sets) {
+        for (const Algorithm& algorithm: kAlgorithms) {
+            if (parser.isSet("algorithm") && !parser.values("algorithm").contains(algorithm.name)) continue;
+
+            // value initialized, the numbers start at 0
+            CaseResult best = CaseResult();
+            best.distribution = set.first;
+            best.algorithm = algorithm.name;
+            best.success = false;
+            const bool peakReset = resetPeakRss();
+            for (int run = 0; run < repeat; ++run) {
+                CaseResult result = best;
+                result.success = runCase(parser, set.second, algorithm, workDir + "/out", result);
+                if (!result.success) {
+                    best = result;
+                    break;
+                }
+                if (!best.success || (result.generateTime + result.publishTime < best.generateTime + best.publishTime)) {
+                    best = result;
+                }
+            }
+            best.peakRssKBytes = peakReset? peakRssKBytes() : -1;
+            failed = failed || !best.success;
+
+            if (best.success) {
+                qInfo().noquote() << QString("%1 %2: %3 pages, %4% occupancy, %5 vertices, generate %6 ms, publish %7 ms")
+                                     .arg(best.distribution).arg(best.algorithm).arg(best.pages.size())
+                                     .arg(best.occupancy, 0, 'f', 1).arg(best.vertices)
+                                     .arg(milliseconds(best.generateTime), 0, 'f', 1).arg(milliseconds(best.publishTime), 0, 'f', 1);
+            } else {
+                qCritical().noquote() << QString("%1 %2 failed: %3").arg(best.distribution).arg(best.algorithm).arg(best.errorString);
+            }
+            results.push_back(best);
+        }
+    }
+
+    // where the cases reset the peak it is the largest of the run's parts
+    qint64 peakRss = qMax(setupPeakRss, peakRssKBytes());
+    for (const CaseResult& result: results) {
+        peakRss = qMax(peakRss, result.peakRssKBytes);
+    }
+
+    QFile file;
+    if (parser.isSet("output")) {
+        file.setFileName(parser.value("output"));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            qCritical() << QString("Can't write %1: %2").arg(file.fileName()).arg(file.errorString());
+            return 1;
+        }
+    } else {
+        file.open(stdout, QIODevice::WriteOnly | QIODevice::Text);
+    }
+    QTextStream stream(&file);
+    stream.setCodec("UTF-8");
+    writeResults(stream, parser, results, peakRss);
+
+    return failed? 1 : 0;
+}
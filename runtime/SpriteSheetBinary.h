@@ -0,0 +1,167 @@
+// Reader for the "binary" data format of SpriteSheet Packer (*.ssb).
+//
+// The file is meant to be mapped or loaded into memory and used in place:
+// every table is an array of little-endian, 4 byte aligned records that
+// the structs below describe, so opening a sheet is a handful of bounds
+// checks and lookups are a binary search over the frame table. The header
+// has no dependencies besides the C++ standard library and expects a
+// little-endian CPU, as every current desktop and mobile target is.
+//
+//   SpriteSheetBinary sheet;
+//   if (sheet.open(data, size)) {
+//       const SpriteSheetBinary::Frame* frame = sheet.find("hero/walk_01");
+//       ...
+//   }
+//
+// Layout, all offsets are from the beginning of the file:
+//   Header
+//   Frame[frameCount]          sorted by name (bytewise), see find()
+//   Vertex[vertexCount]        polygon mesh vertices of all frames
+//   uint16_t[indexCount]       triangle indices, relative to the first vertex of their frame
+//   char[stringTableSize]      UTF-8 names, each one followed by a 0 byte
+
+#ifndef SPRITESHEETBINARY_H
+#define SPRITESHEETBINARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+class SpriteSheetBinary
+{
+public:
+    static const uint32_t kMagic = 0x42505353;  // "SSPB"
+    static const uint16_t kVersion = 1;
+    static const uint32_t kNoString = 0xffffffff;
+
+    struct Header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t headerSize;
+        uint32_t fileSize;
+        uint32_t flags;                 // reserved, 0
+        uint32_t textureWidth;
+        uint32_t textureHeight;
+        uint32_t imageName;             // string table offset of the image file name
+        uint32_t maskName;              // alpha mask of JPG+PNG atlases, kNoString otherwise
+        uint32_t frameCount;
+        uint32_t frameOffset;
+        uint32_t vertexCount;
+        uint32_t vertexOffset;
+        uint32_t indexCount;
+        uint32_t indexOffset;
+        uint32_t stringTableSize;
+        uint32_t stringTableOffset;
+    };
+
+    enum FrameFlags {
+        kRotated = 1 << 0,              // stored rotated by 90 degrees clockwise
+        kTrimmed = 1 << 1               // sourceColorRect is smaller than sourceSize
+    };
+
+    struct Rect {
+        int32_t x;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+    };
+
+    struct Frame {
+        uint32_t name;                  // string table offset
+        uint32_t nameLength;            // in bytes, without the 0 byte
+        uint32_t flags;
+        Rect     frame;                 // position and size in the texture
+        int32_t  offsetX;
+        int32_t  offsetY;
+        Rect     sourceColorRect;
+        int32_t  sourceWidth;
+        int32_t  sourceHeight;
+        uint32_t firstVertex;
+        uint32_t vertexCount;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+    };
+
+    struct Vertex {
+        int32_t x;
+        int32_t y;
+    };
+
+    SpriteSheetBinary() : _data(nullptr), _header(nullptr) { }
+
+    // data must stay valid and 4 byte aligned while the sheet is used;
+    // returns false for anything that is not a complete version 1 file
+    bool open(const void* data, size_t size) {
+        _data = static_cast<const uint8_t*>(data);
+        _header = nullptr;
+        if (!_data || (reinterpret_cast<uintptr_t>(_data) % 4 != 0) || (size < sizeof(Header))) return false;
+
+        const Header* header = reinterpret_cast<const Header*>(_data);
+        if ((header->magic != kMagic) || (header->version != kVersion) || (header->headerSize != sizeof(Header))) return false;
+        if (header->fileSize > size) return false;
+        if (!fits(header, header->frameOffset, header->frameCount, sizeof(Frame)) ||
+            !fits(header, header->vertexOffset, header->vertexCount, sizeof(Vertex)) ||
+            !fits(header, header->indexOffset, header->indexCount, sizeof(uint16_t)) ||
+            !fits(header, header->stringTableOffset, header->stringTableSize, 1)) {
+            return false;
+        }
+        _header = header;
+        return true;
+    }
+
+    bool isOpen() const { return _header != nullptr; }
+    const Header& header() const { return *_header; }
+
+    uint32_t frameCount() const { return _header->frameCount; }
+    const Frame* frames() const { return reinterpret_cast<const Frame*>(_data + _header->frameOffset); }
+    const Frame& frame(uint32_t index) const { return frames()[index]; }
+
+    const Vertex* vertices(const Frame& frame) const { return reinterpret_cast<const Vertex*>(_data + _header->vertexOffset) + frame.firstVertex; }
+    const uint16_t* indices(const Frame& frame) const { return reinterpret_cast<const uint16_t*>(_data + _header->indexOffset) + frame.firstIndex; }
+
+    // 0 terminated UTF-8, nullptr for kNoString
+    const char* string(uint32_t offset) const {
+        return (offset < _header->stringTableSize)? reinterpret_cast<const char*>(_data + _header->stringTableOffset + offset) : nullptr;
+    }
+    const char* name(const Frame& frame) const { return string(frame.name); }
+    const char* imageName() const { return string(_header->imageName); }
+    const char* maskName() const { return string(_header->maskName); }
+
+    // binary search for the frame called name, nullptr if there is none
+    const Frame* find(const char* name) const { return find(name, strlen(name)); }
+    const Frame* find(const char* name, size_t length) const {
+        const Frame* first = frames();
+        size_t count = _header->frameCount;
+        while (count > 0) {
+            size_t half = count / 2;
+            const Frame* middle = first + half;
+            int order = compare(*middle, name, length);
+            if (order == 0) return middle;
+            if (order < 0) {
+                first = middle + 1;
+                count -= half + 1;
+            } else {
+                count = half;
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    static bool fits(const Header* header, uint32_t offset, uint32_t count, size_t elementSize) {
+        return (offset % 4 == 0) && (offset <= header->fileSize) &&
+               (static_cast<uint64_t>(count) * elementSize <= header->fileSize - offset);
+    }
+
+    int compare(const Frame& frame, const char* name, size_t length) const {
+        size_t common = (frame.nameLength < length)? frame.nameLength : length;
+        int order = memcmp(string(frame.name), name, common);
+        if (order != 0) return order;
+        return (frame.nameLength < length)? -1 : ((frame.nameLength > length)? 1 : 0);
+    }
+
+    const uint8_t* _data;
+    const Header*  _header;
+};
+
+#endif // SPRITESHEETBINARY_H
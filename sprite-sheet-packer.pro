@@ -1,2 +1,11 @@
 TEMPLATE = subdirs
-SUBDIRS = SpriteSheetPacker
\ No newline at end of file
+SUBDIRS = sspcore SpriteSheetPacker cli benchmarks
+
+# the packing core, linked by the editor and the command line
+sspcore.subdir = SpriteSheetPacker/sspcore
+SpriteSheetPacker.depends = sspcore
+# the command line alone, without QtWidgets
+cli.subdir = SpriteSheetPacker/cli
+cli.depends = sspcore
+# synthetic packing and publishing benchmarks, see benchmarks/main.cpp
+benchmarks.depends = sspcore